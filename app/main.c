@@ -3,98 +3,227 @@
 #include <string.h>
 #include <stdlib.h>
 #include <readline/readline.h>
-#include <readline/history.h>
 #include <signal.h>
 #include <pwd.h>
 #include <sys/stat.h>
 #include <sys/wait.h>
 #include <fcntl.h>
+#include <errno.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
 #include "../src/lab.h"
+#include "../src/parse.h"
+#include "../src/exec.h"
+#include "../src/jobs.h"
+#include "../src/isearch.h"
+#include "../src/recall.h"
+#include "../src/complete.h"
+#include "../src/script.h"
 
-static void explain_waitpid(int status)
+static struct shell sh;
+static bool at_eof;
+
+/* epoll tags for the fds the loop owns, pidfds are tagged by their job */
+static char tag_input, tag_child, tag_timer, tag_prompt;
+
+/*
+ * Run one line of input, blank lines are not saved in the history.
+ */
+static void run_line(char *line)
 {
-    if (!WIFEXITED(status))
+    if (!line)
     {
-        fprintf(stderr, "Child exited with status %d\n", WEXITSTATUS(status));
+        at_eof = true;
+        return;
     }
-
-    if (WIFSIGNALED(status))
+    // do nothing on blank lines don't save history or attempt to exec
+    line = trim_white(line);
+    if (!*line)
     {
-        fprintf(stderr, "Child exited via signal %d\n", WTERMSIG(status));
+        free(line);
+        return;
     }
-
-    if (WIFSTOPPED(status))
+    histring_add(&sh.recall, line);
+    // logged once it is done so the entry has its status and duration
+    histlog_begin(&sh.hist, line);
+    // the whole tree for this line comes out of the shell arena
+    arena_reset(&sh.arena);
+    const char *err;
+    struct ast_pipeline *list = parse_line(&sh.arena, line, &err);
+    free(line);
+    if (err)
+    {
+        fprintf(stderr, "%s\n", err);
+        sh.status = 2;
+    }
+    else
     {
-        fprintf(stderr, "Child stopped by %d\n", WSTOPSIG(status));
+        exec_list(&sh, list);
     }
+    histlog_end(&sh.hist, sh.status);
+    histindex_update(&sh.histindex, &sh.hist);
+    // readline draws the next prompt once this returns
+    if (sh.share_history)
+        sh_history_sync(&sh);
+    rl_set_prompt(sh_prompt(&sh));
+}
 
-    if (WIFCONTINUED(status))
+static void watch_fd(int ep, int fd, void *tag)
+{
+    struct epoll_event ev;
+    ev.events = EPOLLIN;
+    ev.data.ptr = tag;
+    if (epoll_ctl(ep, EPOLL_CTL_ADD, fd, &ev) < 0)
     {
-        fprintf(stderr, "Child was resumed by delivery of SIGCONT\n");
+        perror("epoll_ctl");
+        exit(EXIT_FAILURE);
     }
 }
 
-int main(int argc, char *argv[])
+/*
+ * Log out after TMOUT seconds without input at the prompt, like other
+ * shells. An unset or non positive TMOUT disarms the timer.
+ */
+static void arm_timeout(int tfd)
 {
-    parse_args(argc, argv);
-    struct shell sh;
-    sh_init(&sh);
-    char *line = (char *)NULL;
-    while ((line = readline(sh.prompt)))
+    struct itimerspec its;
+    memset(&its, 0, sizeof(its));
+    const char *env = getenv("TMOUT");
+    if (env)
+        its.it_value.tv_sec = atol(env) > 0 ? atol(env) : 0;
+    timerfd_settime(tfd, 0, &its, NULL);
+}
+
+/*
+ * The interactive shell waits in one place for terminal input, children
+ * exiting and timers. Readline is driven through its callback interface so
+ * a job that finishes while a line is being typed is reported right away
+ * and the line is redrawn under the notice.
+ */
+static void event_loop(void)
+{
+    int ep = epoll_create1(EPOLL_CLOEXEC);
+    int tfd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK);
+    if (ep < 0 || tfd < 0)
+    {
+        perror("epoll");
+        exit(EXIT_FAILURE);
+    }
+    watch_fd(ep, STDIN_FILENO, &tag_input);
+    watch_fd(ep, sh.jobs.wake[0], &tag_child);
+    watch_fd(ep, tfd, &tag_timer);
+    if (sh.prompt_fmt.event_fd >= 0)
+        watch_fd(ep, sh.prompt_fmt.event_fd, &tag_prompt);
+    jobs_watch(&sh, ep);
+
+    rl_callback_handler_install(sh_prompt(&sh), run_line);
+    arm_timeout(tfd);
+    while (!at_eof)
     {
-        // do nothing on blank lines don't save history or attempt to exec
-        line = trim_white(line);
-        if (!*line)
+        struct epoll_event ev[64];
+        int n = epoll_wait(ep, ev, 64, -1);
+        if (n < 0)
         {
-            free(line);
-            continue;
+            if (errno == EINTR)
+                continue;
+            perror("epoll_wait");
+            break;
         }
-        add_history(line);
-        // check to see if we are launching a built in command
-        char **cmd = cmd_parse(line);
-        if (!do_builtin(&sh, cmd))
+
+        bool input = false;
+        bool timeout = false;
+        bool redraw = false;
+        // Job events all come before anything that can free a job
+        for (int i = 0; i < n; i++)
         {
-            pid_t pid = fork();
-            if (pid == 0)
+            void *tag = ev[i].data.ptr;
+            if (tag == &tag_input)
             {
-                /*This is the child process*/
-                pid_t child = getpid();
-                setpgid(child, child);
-                tcsetpgrp(sh.shell_terminal, child);
-                signal(SIGINT, SIG_DFL);
-                signal(SIGQUIT, SIG_DFL);
-                signal(SIGTSTP, SIG_DFL);
-                signal(SIGTTIN, SIG_DFL);
-                signal(SIGTTOU, SIG_DFL);
-                execvp(cmd[0], cmd);
-                exit(EXIT_FAILURE);
+                input = true;
             }
-            else if (pid < 0)
+            else if (tag == &tag_timer)
             {
-                // If fork failed we are in trouble!
-                perror("fork return < 0 Process creation failed!");
-                abort();
+                timeout = true;
             }
-
-            /*
-            This is in the parent put the child process into its own
-            process group and give it control of the terminal
-            to avoid a race condition
-            */
-            // printf("shell:%d , child%d\n",sh.shell_pgid, pid);
-            setpgid(pid, pid);
-            tcsetpgrp(sh.shell_terminal, pid);
-            int status;
-            int rval = waitpid(pid, &status, 0);
-            if (rval == -1)
+            else if (tag == &tag_prompt)
+            {
+                redraw = prompt_refresh(&sh.prompt_fmt);
+            }
+            else if (tag == &tag_child)
+            {
+                if (jobs_pending(&sh))
+                    jobs_reap(&sh);
+            }
+            else
             {
-                fprintf(stderr, "Wait pid failed with -1\n");
-		explain_waitpid(status);
+                jobs_event(&sh, tag);
             }
-            cmd_free(cmd);
-            // get control of the shell
-            tcsetpgrp(sh.shell_terminal, sh.shell_pgid);
+        }
+
+        if (jobs_unreported(&sh))
+        {
+            rl_clear_visible_line();
+            fflush(rl_outstream);
+            jobs_notify(&sh);
+            rl_on_new_line();
+            rl_redisplay();
+        }
+        // The worker found something new for the prompt on the screen
+        if (redraw && !isearch_active())
+        {
+            rl_clear_visible_line();
+            fflush(rl_outstream);
+            rl_set_prompt(sh_prompt(&sh));
+            rl_on_new_line();
+            rl_redisplay();
+        }
+        if (timeout)
+        {
+            rl_callback_handler_remove();
+            fprintf(stderr, "\ntimed out waiting for input: auto-logout\n");
+            break;
+        }
+        if (input)
+        {
+            rl_callback_read_char();
+            arm_timeout(tfd);
+        }
+    }
+    if (at_eof)
+        rl_callback_handler_remove();
+    close(tfd);
+    close(ep);
+}
+
+int main(int argc, char *argv[])
+{
+    parse_args(&sh, argc, argv);
+    sh_init(&sh);
+    if (sh.shell_is_interactive)
+    {
+        isearch_install(&sh);
+        recall_install(&sh);
+        complete_install(&sh);
+        event_loop();
+        // Saves the directories visited since the last save
+        sh_destroy(&sh);
+    }
+    // Nobody types here, the lines go straight to the parser
+    struct script script;
+    if (sh.command)
+    {
+        script_init_string(&script, sh.command);
+    }
+    else
+    {
+        int fd = sh.script ? open(sh.script, O_RDONLY | O_CLOEXEC) : STDIN_FILENO;
+        if (fd < 0 || script_open(&script, fd, !sh.script) < 0)
+        {
+            fprintf(stderr, "%s: %s\n", sh.script ? sh.script : "stdin", strerror(errno));
+            exit(127);
         }
     }
-    exit(EXIT_SUCCESS);
+    script_run(&sh, &script);
+    script_close(&script);
+    exit(sh.status);
 }
@@ -0,0 +1,71 @@
+#include <stdio.h>
+#include <string.h>
+#include "bench.h"
+#include "../src/lab.h"
+
+#define EXTRA_BUILTINS 256
+
+static const char *const hits[] = {"cd", "exit", "history", "hash"};
+static const char *const misses[] = {"ls", "grep", "git", "make", "cat", "awk"};
+
+static int nop(struct shell *sh, char **argv)
+{
+    UNUSED(sh);
+    UNUSED(argv);
+    return 0;
+}
+
+/* What do_builtin used to do, one strcmp per registered name */
+static bool chain(const char *const *names, size_t n, const char *name)
+{
+    for (size_t i = 0; i < n; i++) {
+        if (strcmp(names[i], name) == 0)
+            return true;
+    }
+    return false;
+}
+
+static void run(const char *label, const char *const *names, size_t count,
+                const char *const *registered, size_t nregistered)
+{
+    size_t iters;
+    size_t found = 0;
+    double start = bench_now();
+    for (iters = 0; bench_now() - start < BENCH_MIN_SECONDS; iters++) {
+        for (size_t i = 0; i < count; i++)
+            found += builtin_lookup(names[i]) != NULL;
+    }
+    double table = iters * count / (bench_now() - start);
+
+    start = bench_now();
+    for (iters = 0; bench_now() - start < BENCH_MIN_SECONDS; iters++) {
+        for (size_t i = 0; i < count; i++)
+            found += chain(registered, nregistered, names[i]);
+    }
+    double linear = iters * count / (bench_now() - start);
+    bench_sink(&found);
+    printf("  %-28s table %8.1f M lookups/s   strcmp chain %8.1f M lookups/s\n",
+           label, table / 1e6, linear / 1e6);
+}
+
+int main(void)
+{
+    static char extra[EXTRA_BUILTINS][24];
+    static const char *registered[EXTRA_BUILTINS + 4];
+    size_t n = 0;
+    for (size_t i = 0; i < 4; i++)
+        registered[n++] = hits[i];
+
+    printf("builtin: dispatch lookups\n");
+    run("4 builtins, builtin names", hits, 4, registered, n);
+    run("4 builtins, other names", misses, 6, registered, n);
+
+    for (size_t i = 0; i < EXTRA_BUILTINS; i++) {
+        snprintf(extra[i], sizeof(extra[i]), "extra-builtin-%zu", i);
+        builtin_register(extra[i], nop);
+        registered[n++] = extra[i];
+    }
+    run("260 builtins, builtin names", hits, 4, registered, n);
+    run("260 builtins, other names", misses, 6, registered, n);
+    return 0;
+}
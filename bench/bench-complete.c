@@ -0,0 +1,141 @@
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "bench.h"
+#include "../src/complete.h"
+
+#define DIRS 10
+#define PER_DIR 2000
+#define ROOT "/tmp/bench-complete"
+
+static void count_name(const char *name, void *ctx)
+{
+    bench_sink(name);
+    (*(size_t *)ctx)++;
+}
+
+static void make_tree(char *path, size_t n)
+{
+    char file[256];
+    mkdir(ROOT, 0700);
+    path[0] = '\0';
+    for (int d = 0; d < DIRS; d++) {
+        snprintf(file, sizeof(file), ROOT "/bin%d", d);
+        mkdir(file, 0700);
+        snprintf(path + strlen(path), n - strlen(path), "%s%s", d ? ":" : "", file);
+        for (int i = 0; i < PER_DIR; i++) {
+            snprintf(file, sizeof(file), ROOT "/bin%d/tool-%d-%05d", d, d, i);
+            int fd = open(file, O_WRONLY | O_CREAT, 0700);
+            if (fd >= 0)
+                close(fd);
+        }
+    }
+}
+
+static void remove_tree(void)
+{
+    char file[256];
+    for (int d = 0; d < DIRS; d++) {
+        for (int i = 0; i < PER_DIR; i++) {
+            snprintf(file, sizeof(file), ROOT "/bin%d/tool-%d-%05d", d, d, i);
+            unlink(file);
+        }
+        snprintf(file, sizeof(file), ROOT "/bin%d", d);
+        rmdir(file);
+    }
+    rmdir(ROOT);
+}
+
+/* How long each completion took, sorted for percentiles once done */
+#define MAX_TABS (1 << 20)
+
+struct tab
+{
+    double *lat;
+    size_t count;
+};
+
+static void tab_press(struct complete *c, const char *prefix, struct tab *t)
+{
+    size_t found = 0;
+    double start = bench_now();
+    complete_commands(c, prefix, count_name, &found);
+    if (t->count < MAX_TABS)
+        t->lat[t->count++] = bench_now() - start;
+}
+
+static int cmp_double(const void *a, const void *b)
+{
+    double x = *(const double *)a;
+    double y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+static void tab_report(const char *label, struct tab *t)
+{
+    qsort(t->lat, t->count, sizeof(double), cmp_double);
+    printf("  %-28s %8.1f us p50 %8.1f us p99 %8.1f us max\n", label,
+           t->lat[t->count / 2] * 1e6, t->lat[t->count * 99 / 100] * 1e6,
+           t->lat[t->count - 1] * 1e6);
+    t->count = 0;
+}
+
+/*
+ * A PATH of 20k programs: TAB pressed over and over while the worker does
+ * the first read, then once it is done, then after one directory changed.
+ */
+int main(void)
+{
+    static char path[DIRS * 64];
+    make_tree(path, sizeof(path));
+    printf("complete: %d programs in %d directories\n", DIRS * PER_DIR, DIRS);
+
+    struct complete c;
+    struct tab tab = {(double *)malloc(sizeof(double) * MAX_TABS), 0};
+    double start = bench_now();
+    complete_init(&c, path);
+    // complete_wait would block, keep pressing until the last directory is in
+    size_t last = 0;
+    while (last < PER_DIR) {
+        tab_press(&c, "tool-3", &tab);
+        last = 0;
+        complete_commands(&c, "tool-9-", count_name, &last);
+    }
+    complete_wait(&c);
+    printf("  %-28s %8.1f ms\n", "first read of PATH", (bench_now() - start) * 1e3);
+    tab_report("TAB during the first read", &tab);
+
+    const char *prefixes[] = {"tool-3-0042", "tool-3", ""};
+    for (size_t p = 0; p < sizeof(prefixes) / sizeof(prefixes[0]); p++) {
+        double t0 = bench_now();
+        while (bench_now() - t0 < BENCH_MIN_SECONDS)
+            tab_press(&c, prefixes[p], &tab);
+        char label[64];
+        snprintf(label, sizeof(label), "TAB \"%s\"", prefixes[p]);
+        tab_report(label, &tab);
+    }
+    free(tab.lat);
+
+    // One new program, only its directory is read again
+    int fd = open(ROOT "/bin4/tool-new", O_WRONLY | O_CREAT, 0700);
+    if (fd >= 0)
+        close(fd);
+    struct timespec times[2] = {{0, UTIME_OMIT}, {1, 0}};
+    utimensat(AT_FDCWD, ROOT "/bin4", times, 0);
+    start = bench_now();
+    complete_refresh(&c, path);
+    complete_wait(&c);
+    printf("  %-28s %8.1f ms\n", "refresh, one directory changed", (bench_now() - start) * 1e3);
+    start = bench_now();
+    complete_refresh(&c, path);
+    complete_wait(&c);
+    printf("  %-28s %8.1f us\n", "refresh, nothing changed", (bench_now() - start) * 1e6);
+
+    complete_destroy(&c);
+    unlink(ROOT "/bin4/tool-new");
+    remove_tree();
+    return 0;
+}
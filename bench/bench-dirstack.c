@@ -0,0 +1,74 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "bench.h"
+#include "../src/dirstack.h"
+
+#define DEPTH 32
+#define ROOT "/tmp/bench-dirstack"
+
+static void make_deep(const char *top, char *path, size_t n)
+{
+    snprintf(path, n, "%s", top);
+    mkdir(path, 0700);
+    for (int i = 0; i < DEPTH; i++) {
+        snprintf(path + strlen(path), n - strlen(path), "/level-%02d", i);
+        mkdir(path, 0700);
+    }
+}
+
+static void remove_deep(char *path)
+{
+    for (int i = 0; i <= DEPTH; i++) {
+        rmdir(path);
+        *strrchr(path, '/') = '\0';
+    }
+}
+
+/*
+ * Going back and forth between two directories 32 levels down, with cd to
+ * each path and with pushd, which swaps the directory held on the stack
+ * with the current one.
+ */
+int main(void)
+{
+    static char a[4096], b[4096];
+    char *cwd = getcwd(NULL, 0);
+    mkdir(ROOT, 0700);
+    make_deep(ROOT "/a", a, sizeof(a));
+    make_deep(ROOT "/b", b, sizeof(b));
+    printf("dirstack: two directories %d levels deep\n", DEPTH);
+
+    size_t n = 0;
+    double start = bench_now();
+    while (bench_now() - start < BENCH_MIN_SECONDS) {
+        if (chdir(n & 1 ? a : b) < 0)
+            return 1;
+        n++;
+    }
+    printf("  %-24s %8.2f us/switch\n", "cd path", (bench_now() - start) / n * 1e6);
+
+    struct dirstack d;
+    dirstack_init(&d);
+    if (chdir(a) < 0 || dirstack_push(&d, b) < 0)
+        return 1;
+    n = 0;
+    start = bench_now();
+    while (bench_now() - start < BENCH_MIN_SECONDS) {
+        if (dirstack_swap(&d) < 0)
+            return 1;
+        n++;
+    }
+    printf("  %-24s %8.2f us/switch\n", "pushd (swap)", (bench_now() - start) / n * 1e6);
+    dirstack_destroy(&d);
+
+    if (chdir(cwd) < 0)
+        return 1;
+    free(cwd);
+    remove_deep(a);
+    remove_deep(b);
+    rmdir(ROOT);
+    return 0;
+}
@@ -0,0 +1,107 @@
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <readline/readline.h>
+#include "bench.h"
+#include "../src/complete.h"
+
+#define FILES 200000
+#define ROOT "/tmp/bench-filecomplete"
+
+/* Ten files start with it, like a name typed up to its last digit */
+#define WORD ROOT "/file-01234"
+
+static void count_match(const char *match, void *ctx)
+{
+    bench_sink(match);
+    (*(size_t *)ctx)++;
+}
+
+static void make_dir(void)
+{
+    char file[256];
+    mkdir(ROOT, 0700);
+    for (int i = 0; i < FILES; i++) {
+        snprintf(file, sizeof(file), ROOT "/file-%06d", i);
+        int fd = open(file, O_WRONLY | O_CREAT, 0600);
+        if (fd >= 0)
+            close(fd);
+    }
+    // A directory nobody touched for a while, as most are when TAB is pressed
+    struct timespec times[2] = {{0, UTIME_OMIT}, {1, 0}};
+    utimensat(AT_FDCWD, ROOT, times, 0);
+}
+
+static void remove_dir(void)
+{
+    char file[256];
+    for (int i = 0; i < FILES; i++) {
+        snprintf(file, sizeof(file), ROOT "/file-%06d", i);
+        unlink(file);
+    }
+    rmdir(ROOT);
+}
+
+/* What readline does on each TAB without a completion function */
+static size_t readline_tab(void)
+{
+    size_t found = 0;
+    char *match;
+    for (int state = 0; (match = rl_filename_completion_function(WORD, state)); state++) {
+        bench_sink(match);
+        free(match);
+        found++;
+    }
+    return found;
+}
+
+static size_t snapshot_tab(struct complete *c)
+{
+    size_t found = 0;
+    complete_files(c, WORD, count_match, &found);
+    return found;
+}
+
+static void report(const char *label, double secs, size_t tabs, size_t found)
+{
+    printf("  %-30s %10.1f us/TAB (%zu matches)\n", label, secs / tabs * 1e6, found);
+}
+
+/*
+ * TAB after a name in a directory of 200k files: readline reads the whole
+ * directory again each time, the snapshot is read once and searched.
+ */
+int main(void)
+{
+    make_dir();
+    printf("filecomplete: %d files in one directory\n", FILES);
+
+    size_t tabs = 0, found = 0;
+    double start = bench_now();
+    while (bench_now() - start < BENCH_MIN_SECONDS || tabs < 3) {
+        found = readline_tab();
+        tabs++;
+    }
+    report("readline", bench_now() - start, tabs, found);
+
+    struct complete c;
+    complete_init(&c, "");
+    start = bench_now();
+    found = snapshot_tab(&c);
+    report("snapshot, first TAB", bench_now() - start, 1, found);
+
+    tabs = 0;
+    start = bench_now();
+    while (bench_now() - start < BENCH_MIN_SECONDS) {
+        found = snapshot_tab(&c);
+        tabs++;
+    }
+    report("snapshot, next TABs", bench_now() - start, tabs, found);
+    complete_destroy(&c);
+
+    remove_dir();
+    return 0;
+}
@@ -0,0 +1,62 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <readline/history.h>
+#include "bench.h"
+#include "../src/histlog.h"
+
+#define ENTRIES 1000000
+#define LOG_PATH "/tmp/bench-histlog.log"
+#define TEXT_PATH "/tmp/bench-histlog.txt"
+
+/*
+ * Load a history of a million commands two ways: mapping the log and
+ * indexing its records, and read_history on the same commands as a plain
+ * text file, which is add_history once per line.
+ */
+int main(void)
+{
+    char line[128];
+    struct histlog h;
+    unlink(LOG_PATH);
+    FILE *text = fopen(TEXT_PATH, "w");
+    histlog_init(&h);
+    if (!text || histlog_open(&h, LOG_PATH) < 0) {
+        perror("bench-histlog");
+        return 1;
+    }
+    double start = bench_now();
+    for (int i = 0; i < ENTRIES; i++) {
+        snprintf(line, sizeof(line), "git commit -m 'change %d' && make -j8 check", i);
+        histlog_append(&h, line, 1700000000 + i, (uint32_t)(i % 1000), i % 3);
+        fprintf(text, "%s\n", line);
+    }
+    double append = bench_now() - start;
+    fclose(text);
+    histlog_close(&h, 0);
+    printf("histlog: %d entries\n", ENTRIES);
+    printf("  %-28s %10.0f appends/s\n", "append, one write each", ENTRIES / append);
+
+    size_t iters;
+    size_t found = 0;
+    start = bench_now();
+    for (iters = 0; bench_now() - start < BENCH_MIN_SECONDS; iters++) {
+        histlog_init(&h);
+        histlog_open(&h, LOG_PATH);
+        found += h.count;
+        histlog_close(&h, 0);
+    }
+    printf("  %-28s %10.2f ms\n", "mmap and index", (bench_now() - start) / iters * 1e3);
+
+    start = bench_now();
+    for (iters = 0; iters < 1 || bench_now() - start < BENCH_MIN_SECONDS; iters++) {
+        read_history(TEXT_PATH);
+        found += history_length;
+        clear_history();
+    }
+    printf("  %-28s %10.2f ms\n", "read_history", (bench_now() - start) / iters * 1e3);
+    bench_sink(&found);
+    unlink(LOG_PATH);
+    unlink(TEXT_PATH);
+    return 0;
+}
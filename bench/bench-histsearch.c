@@ -0,0 +1,74 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "bench.h"
+#include "../src/histindex.h"
+
+#define ENTRIES 1000000
+
+static const char *const cmds[] = {"git commit -m", "git checkout", "make -j8", "vim", "ls -la",
+                                   "grep -rn", "ssh deploy@", "docker run --rm", "cd", "python3"};
+static const char *const words[] = {"src", "tests", "README.md", "build", "parser", "jobs",
+                                    "history", "release", "kernel", "config", "main.c", "lab"};
+
+static const char *const patterns[] = {
+    "checkout release-42",  /* rare */
+    "make -j8",             /* in a tenth of the entries */
+    "docker run --rm lab",  /* common trigrams, rarer together */
+    "no such command",      /* no match */
+    "vi",                   /* too short for a trigram, scans */
+};
+
+static int cmp_double(const void *a, const void *b)
+{
+    double x = *(const double *)a;
+    double y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+int main(void)
+{
+    char line[160];
+    struct histlog h;
+    struct histindex ix;
+    histlog_init(&h);
+    histindex_init(&ix);
+    srand(1);
+    for (int i = 0; i < ENTRIES; i++) {
+        snprintf(line, sizeof(line), "%s %s/%s-%d", cmds[rand() % 10], words[rand() % 12],
+                 words[rand() % 12], rand() % 1000);
+        histlog_append(&h, line, 0, 0, 0);
+    }
+
+    printf("histsearch: %d entries\n", ENTRIES);
+    double start = bench_now();
+    histindex_search(&ix, &h, "build the index", h.count);
+    printf("  %-24s %10.1f ms, %zu trigrams\n", "index build", (bench_now() - start) * 1e3,
+           ix.count);
+
+    for (size_t p = 0; p < sizeof(patterns) / sizeof(patterns[0]); p++) {
+        double lat[1024];
+        size_t iters;
+        long found = 0;
+        for (iters = 0; iters < 1024; iters++) {
+            double t0 = bench_now();
+            found += histindex_search(&ix, &h, patterns[p], h.count);
+            lat[iters] = bench_now() - t0;
+        }
+        qsort(lat, iters, sizeof(double), cmp_double);
+        bench_sink(&found);
+        printf("  %-24s %10.1f us p50 %8.1f us p99\n", patterns[p], lat[iters / 2] * 1e6,
+               lat[iters * 99 / 100] * 1e6);
+    }
+
+    // history -s lists every match, newest first
+    start = bench_now();
+    size_t matches = 0;
+    for (long i = (long)h.count; (i = histindex_search(&ix, &h, "checkout release", (size_t)i)) >= 0;)
+        matches++;
+    printf("  %-24s %10.1f ms for %zu matches\n", "all of checkout release", (bench_now() - start) * 1e3,
+           matches);
+    histindex_destroy(&ix);
+    histlog_close(&h, 0);
+    return 0;
+}
@@ -0,0 +1,94 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "bench.h"
+#include "../src/jump.h"
+
+#define ENTRIES 100000
+#define FILE_PATH "/tmp/bench-jump"
+
+/* What the last components are made of, each word is in 2000 names */
+static const char *words[] = {
+    "api", "auth", "billing", "cache", "catalog", "checkout", "config", "deploy", "docs",
+    "events", "gateway", "geo", "identity", "images", "indexer", "inventory", "ledger",
+    "logs", "mail", "media", "metrics", "notify", "orders", "payments", "pricing",
+    "profile", "queue", "ranking", "refunds", "reports", "risk", "router", "search",
+    "session", "shipping", "social", "storage", "stream", "sync", "tax", "tenant",
+    "tokens", "tracing", "upload", "users", "vault", "video", "web", "worker", "zones",
+};
+#define NWORDS (sizeof(words) / sizeof(words[0]))
+
+static int cmp_double(const void *a, const void *b)
+{
+    double x = *(const double *)a;
+    double y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+/* Look the words up over and over, print the p50 and p99 of a lookup */
+static void lookup(struct jump *j, const char *label, char **query, time_t now)
+{
+    static double lat[1 << 20];
+    size_t n = 0, found = 0;
+    double start = bench_now();
+    while (bench_now() - start < BENCH_MIN_SECONDS && n < sizeof(lat) / sizeof(lat[0])) {
+        const struct jump_match *m;
+        double t0 = bench_now();
+        found = jump_find(j, query, now, &m);
+        lat[n++] = bench_now() - t0;
+        bench_sink(m);
+    }
+    qsort(lat, n, sizeof(double), cmp_double);
+    printf("  %-28s %8.1f us p50 %8.1f us p99 (%zu found)\n", label, lat[n / 2] * 1e6,
+           lat[n * 99 / 100] * 1e6, found);
+}
+
+/*
+ * A jump file of 100k deep directories, cd by the exact name of one, by a
+ * word 2000 names start with, with a word for the path too, and by a part
+ * of a name no name starts with, which looks through every name.
+ */
+int main(void)
+{
+    char path[256];
+    struct jump j;
+    time_t now = 1700000000;
+    unlink(FILE_PATH);
+    jump_init(&j);
+    if (jump_open(&j, FILE_PATH) < 0)
+        return 1;
+    srand(42);
+    for (int i = 0; i < ENTRIES; i++) {
+        snprintf(path, sizeof(path), "/home/dev/src/org-%02d/team-%03d/%s-%04d/deploy/k8s",
+                 i % 20, i % 500, words[i % NWORDS], i / (int)NWORDS);
+        // the last component is what cd looks for, keep it the service name
+        *strrchr(path, '/') = '\0';
+        *strrchr(path, '/') = '\0';
+        jump_visit(&j, path, now - rand() % (30 * 86400));
+    }
+    double start = bench_now();
+    if (jump_save(&j) < 0)
+        return 1;
+    printf("jump: %d directories\n", ENTRIES);
+    printf("  %-28s %8.1f ms\n", "save", (bench_now() - start) * 1e3);
+    jump_close(&j);
+
+    start = bench_now();
+    jump_init(&j);
+    if (jump_open(&j, FILE_PATH) < 0)
+        return 1;
+    printf("  %-28s %8.1f us\n", "open (mmap)", (bench_now() - start) * 1e6);
+
+    char *exact[] = {"payments-0042", NULL};
+    char *word[] = {"payments", NULL};
+    char *two[] = {"team-023", "payments", NULL};
+    char *inside[] = {"ments-0042", NULL};
+    lookup(&j, "cd payments-0042", exact, now);
+    lookup(&j, "cd payments", word, now);
+    lookup(&j, "cd team-023 payments", two, now);
+    lookup(&j, "cd ments-0042 (every name)", inside, now);
+    jump_close(&j);
+    unlink(FILE_PATH);
+    return 0;
+}
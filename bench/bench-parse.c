@@ -0,0 +1,64 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "bench.h"
+#include "../src/parse.h"
+
+/* Build a line of n bytes by repeating unit and then appending tail */
+static char *make_line(const char *unit, const char *tail, size_t n)
+{
+    size_t ulen = strlen(unit);
+    size_t tlen = strlen(tail);
+    char *line = (char *)malloc(n + tlen + 1);
+    size_t i = 0;
+    while (i + ulen <= n) {
+        memcpy(line + i, unit, ulen);
+        i += ulen;
+    }
+    memcpy(line + i, tail, tlen + 1);
+    return line;
+}
+
+int main(void)
+{
+    static const struct
+    {
+        const char *name;
+        const char *unit;
+        const char *tail;
+    } shapes[] = {
+        {"typical", "ls -la /usr | grep \"foo bar\" >out; true && echo 'x' ", ""},
+        {"quotes", "\"a\"'b'\\c", ""},
+        {"long pipeline", "a|", "a"},
+        {"redirections", "x >a <b 2>>c ", ""},
+        {"unterminated", "x", " \"never closed"},
+        {"operators", "a&&b||", "c"},
+        {"substitutions", "x$(a \"$(b `c` $(d))\")y ", ""},
+        {"too deep", "$(echo ", ""},
+    };
+    size_t sizes[] = {1024, 64 * 1024, 1024 * 1024};
+    struct arena a;
+    arena_init(&a, 0);
+
+    printf("parse: throughput and cost per byte, flat ns/B means linear time\n");
+    for (size_t s = 0; s < sizeof(shapes) / sizeof(shapes[0]); s++) {
+        for (size_t z = 0; z < sizeof(sizes) / sizeof(sizes[0]); z++) {
+            char *line = make_line(shapes[s].unit, shapes[s].tail, sizes[z]);
+            size_t n = strlen(line);
+            size_t iters;
+            double start = bench_now();
+            for (iters = 0; bench_now() - start < BENCH_MIN_SECONDS; iters++) {
+                const char *err;
+                arena_reset(&a);
+                bench_sink(parse_line(&a, line, &err));
+            }
+            double secs = bench_now() - start;
+            printf("  %-14s %8zu bytes %12.0f lines/s %8.1f MB/s %6.2f ns/B\n",
+                   shapes[s].name, n, iters / secs, (double)n * iters / secs / 1e6,
+                   secs * 1e9 / ((double)n * iters));
+            free(line);
+        }
+    }
+    arena_destroy(&a);
+    return 0;
+}
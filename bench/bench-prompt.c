@@ -0,0 +1,44 @@
+#include <malloc.h>
+#include <stdio.h>
+#include "bench.h"
+#include "../src/prompt.h"
+
+static const char *const templates[] = {
+    "shell>",
+    "\\u@\\h:\\w\\$ ",
+    "[\\t] \\u@\\h \\W $? \\$ ",
+};
+
+/*
+ * Render each template into the reused buffer, then parse and render it
+ * every time, which is what a prompt read from the variable for every
+ * line would cost.
+ */
+int main(void)
+{
+    printf("prompt:\n");
+    for (size_t t = 0; t < sizeof(templates) / sizeof(templates[0]); t++) {
+        struct prompt p;
+        prompt_init(&p, templates[t]);
+        prompt_render(&p, 0, NULL);
+        size_t heap = mallinfo2().uordblks;
+        size_t iters;
+        double start = bench_now();
+        for (iters = 0; bench_now() - start < BENCH_MIN_SECONDS; iters++)
+            bench_sink(prompt_render(&p, (int)(iters & 255), NULL));
+        double render = (bench_now() - start) / iters;
+        size_t grown = mallinfo2().uordblks - heap;
+        prompt_destroy(&p);
+
+        start = bench_now();
+        for (iters = 0; bench_now() - start < BENCH_MIN_SECONDS; iters++) {
+            prompt_init(&p, templates[t]);
+            bench_sink(prompt_render(&p, 0, NULL));
+            prompt_destroy(&p);
+        }
+        double parse = (bench_now() - start) / iters;
+        printf("  %-26s render %7.0f ns, heap +%zu B   parse and render %8.0f ns\n", templates[t],
+               render * 1e9, grown, parse * 1e9);
+    }
+    return 0;
+}
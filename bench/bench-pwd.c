@@ -0,0 +1,74 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "bench.h"
+#include "../src/prompt.h"
+#include "../src/pwd.h"
+
+#define DEPTH 32
+#define ROOT "/tmp/bench-pwd"
+
+/*
+ * What it costs to know the working directory 32 levels down: the path
+ * from getcwd, the logical path checked with a stat of "." as pwd reads
+ * it, and a \w prompt rendered with each of getcwd and the logical path.
+ */
+int main(void)
+{
+    static char path[4096];
+    char *cwd = getcwd(NULL, 0);
+    snprintf(path, sizeof(path), "%s", ROOT);
+    mkdir(path, 0700);
+    for (int i = 0; i < DEPTH; i++) {
+        snprintf(path + strlen(path), sizeof(path) - strlen(path), "/level-%02d", i);
+        mkdir(path, 0700);
+    }
+    if (chdir(path) < 0)
+        return 1;
+    printf("pwd: %d levels deep\n", DEPTH);
+
+    char buf[4096];
+    size_t n = 0;
+    double start = bench_now();
+    while (bench_now() - start < BENCH_MIN_SECONDS) {
+        bench_sink(getcwd(buf, sizeof(buf)));
+        n++;
+    }
+    printf("  %-24s %8.0f ns\n", "getcwd", (bench_now() - start) / n * 1e9);
+
+    struct pwd p;
+    pwd_init(&p);
+    n = 0;
+    start = bench_now();
+    while (bench_now() - start < BENCH_MIN_SECONDS) {
+        bench_sink(pwd_get(&p));
+        n++;
+    }
+    printf("  %-24s %8.0f ns\n", "logical, checked", (bench_now() - start) / n * 1e9);
+
+    struct prompt pr;
+    prompt_init(&pr, "\\w \\$ ");
+    for (int logical = 0; logical < 2; logical++) {
+        n = 0;
+        start = bench_now();
+        while (bench_now() - start < BENCH_MIN_SECONDS) {
+            bench_sink(prompt_render(&pr, 0, logical ? p.path : NULL));
+            n++;
+        }
+        printf("  %-24s %8.0f ns\n", logical ? "prompt, logical" : "prompt, getcwd",
+               (bench_now() - start) / n * 1e9);
+    }
+    prompt_destroy(&pr);
+    pwd_destroy(&p);
+
+    if (chdir(cwd) < 0)
+        return 1;
+    free(cwd);
+    for (int i = 0; i <= DEPTH; i++) {
+        rmdir(path);
+        *strrchr(path, '/') = '\0';
+    }
+    return 0;
+}
@@ -0,0 +1,69 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "bench.h"
+#include "../src/lab.h"
+#include "../src/scan.h"
+
+#define SCAN_BYTES (64u * 1024 * 1024)
+
+static double gbps(size_t bytes, size_t iters, double secs)
+{
+    return (double)bytes * iters / secs / 1e9;
+}
+
+int main(void)
+{
+    size_t count;
+    const struct scan_kernel *k = scan_kernels(&count);
+    char *word = (char *)malloc(SCAN_BYTES);
+    char *blank = (char *)malloc(SCAN_BYTES);
+    memset(word, 'x', SCAN_BYTES);
+    memset(blank, ' ', SCAN_BYTES);
+
+    printf("scan: separator search over %u MiB, selected kernel %s\n",
+           SCAN_BYTES >> 20, scan_kernel()->name);
+    for (size_t i = 0; i < count; i++) {
+        size_t iters;
+        double start;
+        size_t r = 0;
+
+        start = bench_now();
+        for (iters = 0; bench_now() - start < BENCH_MIN_SECONDS; iters++)
+            r += k[i].find_space(word, SCAN_BYTES);
+        double space = gbps(SCAN_BYTES, iters, bench_now() - start);
+
+        start = bench_now();
+        for (iters = 0; bench_now() - start < BENCH_MIN_SECONDS; iters++)
+            r += k[i].find_nonspace(blank, SCAN_BYTES);
+        double nonspace = gbps(SCAN_BYTES, iters, bench_now() - start);
+
+        bench_sink(&r);
+        printf("  %-8s find_space %7.2f GB/s   find_nonspace %7.2f GB/s\n",
+               k[i].name, space, nonspace);
+    }
+
+    // The end to end cost on a pasted multi megabyte argument list
+    char *line = (char *)malloc(SCAN_BYTES + 1);
+    for (size_t i = 0; i < SCAN_BYTES; i++)
+        line[i] = (i % 64 == 63) ? ' ' : 'a';
+    line[SCAN_BYTES] = '\0';
+    struct arena a;
+    arena_init(&a, 0);
+    size_t iters;
+    double start = bench_now();
+    for (iters = 0; bench_now() - start < BENCH_MIN_SECONDS; iters++) {
+        struct cmd_tokens t;
+        arena_reset(&a);
+        cmd_tokenize(&a, line, &t);
+        bench_sink(t.tok);
+    }
+    printf("  cmd_tokenize on 64 byte args %7.2f GB/s\n",
+           gbps(SCAN_BYTES, iters, bench_now() - start));
+
+    arena_destroy(&a);
+    free(line);
+    free(word);
+    free(blank);
+    return 0;
+}
@@ -0,0 +1,141 @@
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <readline/readline.h>
+#include "bench.h"
+#include "../src/lab.h"
+#include "../src/parse.h"
+#include "../src/exec.h"
+#include "../src/script.h"
+
+#define LINES 50000
+#define FILE_PATH "/tmp/bench-script"
+
+static const char *const lines[] = {
+    "true",
+    "test -d /tmp && test abc = abc",
+    "echo hello world >/dev/null",
+    "cd /tmp",
+};
+
+/* What the shell did with a stdin that is not a terminal before scripts */
+static void run_readline(struct shell *sh, int fd)
+{
+    const char *err;
+    rl_instream = fdopen(fd, "r");
+    rl_outstream = fopen("/dev/null", "w");
+    char *line;
+    while ((line = readline("shell>"))) {
+        char *cmd = trim_white(line);
+        if (*cmd) {
+            arena_reset(&sh->arena);
+            struct ast_pipeline *pl = parse_line(&sh->arena, cmd, &err);
+            if (!err)
+                exec_list(sh, pl);
+        }
+        free(line);
+    }
+    fclose(rl_instream);
+    fclose(rl_outstream);
+}
+
+static void report(const char *label, double seconds)
+{
+    printf("  %-24s %10.0f commands/s %8.2f us/command\n", label, LINES / seconds,
+           seconds / LINES * 1e6);
+}
+
+/* The script as a pipe, written by a child */
+static int pipe_of(const char *text, size_t len)
+{
+    int fds[2];
+    if (pipe(fds) < 0)
+        exit(1);
+    if (fork() == 0) {
+        close(fds[0]);
+        for (size_t off = 0; off < len;) {
+            ssize_t n = write(fds[1], text + off, len - off);
+            if (n <= 0)
+                _exit(1);
+            off += (size_t)n;
+        }
+        _exit(0);
+    }
+    close(fds[1]);
+    return fds[0];
+}
+
+/*
+ * 50k builtin lines run from a file and from a pipe, through readline the
+ * way a stdin that was not a terminal used to be read, and through the
+ * script reader that maps the file or reads the pipe 64 KiB at a time.
+ */
+int main(void)
+{
+    struct shell sh;
+    memset(&sh, 0, sizeof(sh));
+    sh.shell_terminal = -1;
+    sh.spawn_mode = spawn_default_mode();
+    arena_init(&sh.arena, 0);
+    cmdhash_init(&sh.cmdhash);
+    writer_init(&sh.out, STDOUT_FILENO);
+    jobs_init(&sh);
+
+    FILE *f = fopen(FILE_PATH, "w");
+    if (!f)
+        return 1;
+    for (int i = 0; i < LINES; i++)
+        fprintf(f, "%s\n", lines[i % (sizeof(lines) / sizeof(lines[0]))]);
+    fclose(f);
+    size_t len = 0;
+    char *text = NULL;
+    f = fopen(FILE_PATH, "r");
+    if (!f || getdelim(&text, &len, '\0', f) < 0)
+        return 1;
+    len = strlen(text);
+    fclose(f);
+    printf("script: %d builtin lines\n", LINES);
+
+    double start = bench_now();
+    run_readline(&sh, open(FILE_PATH, O_RDONLY));
+    report("readline, file", bench_now() - start);
+
+    start = bench_now();
+    run_readline(&sh, pipe_of(text, len));
+    report("readline, pipe", bench_now() - start);
+    wait(NULL);
+
+    struct script s;
+    start = bench_now();
+    if (script_open(&s, open(FILE_PATH, O_RDONLY), false) < 0)
+        return 1;
+    script_run(&sh, &s);
+    script_close(&s);
+    report("script, file (mmap)", bench_now() - start);
+
+    start = bench_now();
+    if (script_open(&s, pipe_of(text, len), false) < 0)
+        return 1;
+    script_run(&sh, &s);
+    script_close(&s);
+    report("script, pipe (64 KiB)", bench_now() - start);
+    wait(NULL);
+
+    start = bench_now();
+    script_init_string(&s, text);
+    script_run(&sh, &s);
+    script_close(&s);
+    report("-c string", bench_now() - start);
+
+    free(text);
+    unlink(FILE_PATH);
+    jobs_destroy(&sh);
+    writer_destroy(&sh.out);
+    cmdhash_destroy(&sh.cmdhash);
+    arena_destroy(&sh.arena);
+    free(sh.pipestatus);
+    return 0;
+}
@@ -0,0 +1,78 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include "bench.h"
+#include "../src/spawn.h"
+
+/* Resident memory to add so fork has a realistic amount of page tables to copy */
+#define BALLAST_BYTES (256u * 1024 * 1024)
+
+static int cmp_double(const void *a, const void *b)
+{
+    double x = *(const double *)a;
+    double y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+/*
+ * Launch /bin/true and wait for it in a loop. The latency of a launch is
+ * the time spawn_cmd takes to return, which is what the shell waits for
+ * before it can start the next stage or print the next prompt.
+ */
+static void run(const char *name, enum spawn_mode mode)
+{
+    char *argv[] = {"/bin/true", NULL};
+    struct spawn_req req = {"/bin/true", argv, NULL, 0, 0, -1, NULL, NULL};
+    size_t cap = 1024;
+    double *lat = (double *)malloc(sizeof(double) * cap);
+    size_t iters;
+    double start = bench_now();
+    for (iters = 0; bench_now() - start < BENCH_MIN_SECONDS * 4; iters++) {
+        int status;
+        double t0 = bench_now();
+        pid_t pid = spawn_cmd(mode, &req);
+        double t1 = bench_now();
+        if (pid < 0 || waitpid(pid, &status, 0) != pid) {
+            perror("spawn");
+            exit(EXIT_FAILURE);
+        }
+        if (iters == cap) {
+            cap *= 2;
+            lat = (double *)realloc(lat, sizeof(double) * cap);
+        }
+        lat[iters] = t1 - t0;
+    }
+    double secs = bench_now() - start;
+    qsort(lat, iters, sizeof(double), cmp_double);
+    printf("  %-12s %10.0f launches/s %10.1f us p50 %10.1f us p99\n", name, iters / secs,
+           lat[iters / 2] * 1e6, lat[iters * 99 / 100] * 1e6);
+    free(lat);
+}
+
+static void run_all(void)
+{
+    run("posix_spawn", SPAWN_POSIX);
+    run("fork", SPAWN_FORK);
+    run("zygote", SPAWN_ZYGOTE);
+}
+
+int main(void)
+{
+    // Like the shell the helper is forked before the process grows
+    if (spawn_zygote_start() < 0) {
+        perror("spawn_zygote_start");
+        return 1;
+    }
+    printf("spawn: launch and reap /bin/true\n");
+    run_all();
+
+    char *ballast = (char *)malloc(BALLAST_BYTES);
+    memset(ballast, 1, BALLAST_BYTES);
+    bench_sink(ballast);
+    printf("spawn: with %u MiB resident in the shell\n", BALLAST_BYTES >> 20);
+    run_all();
+    free(ballast);
+    spawn_zygote_stop();
+    return 0;
+}
@@ -0,0 +1,65 @@
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include "bench.h"
+#include "../src/lab.h"
+#include "../src/parse.h"
+#include "../src/exec.h"
+
+/*
+ * The same substitution three ways: builtins run in the shell, the same
+ * builtins in a forked subshell (the redirection rules out the in-shell
+ * path) and the program of the same name run from the subshell.
+ */
+static const char *const lines[][3] = {
+    {"true $(pwd)", "true $(pwd </dev/null)", "true $(/bin/pwd)"},
+    {"true $(echo a b c)", "true $(echo a b c </dev/null)", "true $(/bin/echo a b c)"},
+    {"true \"$(printf '%s-%d' x 1)\"", "true \"$(printf '%s-%d' x 1 </dev/null)\"",
+     "true \"$(/usr/bin/printf '%s-%d' x 1)\""},
+};
+
+static double run_line(struct shell *sh, const char *line)
+{
+    const char *err;
+    size_t iters;
+    double start = bench_now();
+    for (iters = 0; bench_now() - start < BENCH_MIN_SECONDS; iters++) {
+        arena_reset(&sh->arena);
+        struct ast_pipeline *pl = parse_line(&sh->arena, line, &err);
+        if (err) {
+            fprintf(stderr, "%s: %s\n", line, err);
+            return 0;
+        }
+        exec_list(sh, pl);
+    }
+    bench_sink(&sh->status);
+    return iters / (bench_now() - start);
+}
+
+int main(void)
+{
+    struct shell sh;
+    memset(&sh, 0, sizeof(sh));
+    sh.shell_terminal = -1;
+    sh.spawn_mode = spawn_default_mode();
+    arena_init(&sh.arena, 0);
+    cmdhash_init(&sh.cmdhash);
+    writer_init(&sh.out, STDOUT_FILENO);
+    jobs_init(&sh);
+
+    printf("subst: lines/s for a command substitution\n");
+    for (size_t i = 0; i < sizeof(lines) / sizeof(lines[0]); i++) {
+        double in_shell = run_line(&sh, lines[i][0]);
+        double subshell = run_line(&sh, lines[i][1]);
+        double program = run_line(&sh, lines[i][2]);
+        printf("  %-30s in shell %9.0f   subshell %7.0f   program %7.0f   %5.0fx\n", lines[i][0],
+               in_shell, subshell, program, subshell > 0 ? in_shell / subshell : 0);
+    }
+
+    jobs_destroy(&sh);
+    writer_destroy(&sh.out);
+    cmdhash_destroy(&sh.cmdhash);
+    arena_destroy(&sh.arena);
+    free(sh.pipestatus);
+    return 0;
+}
@@ -0,0 +1,71 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "bench.h"
+#include "../src/lab.h"
+
+static char *make_line(size_t n)
+{
+    static const char *words[] = {"ls", "-la", "--color=auto", "/usr/local/share", "x"};
+    char *line = (char *)malloc(n + 1);
+    size_t i = 0;
+    for (size_t w = 0; i < n; w++) {
+        const char *word = words[w % 5];
+        for (size_t j = 0; word[j] && i < n; j++)
+            line[i++] = word[j];
+        if (i < n)
+            line[i++] = ' ';
+    }
+    line[n] = '\0';
+    return line;
+}
+
+static void report(const char *name, size_t n, size_t iters, double secs)
+{
+    printf("  %-22s %10zu bytes %14.0f lines/s %10.1f MB/s\n", name, n,
+           iters / secs, (double)n * iters / secs / 1e6);
+}
+
+int main(void)
+{
+    size_t sizes[] = {10, 1024, 1024 * 1024};
+    struct arena a;
+    arena_init(&a, 0);
+
+    printf("tokenize: cmd_parse vs zero copy cmd_tokenize\n");
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+        char *line = make_line(sizes[s]);
+        size_t iters;
+        double start;
+
+        start = bench_now();
+        for (iters = 0; bench_now() - start < BENCH_MIN_SECONDS; iters++) {
+            char **argv = cmd_parse(line);
+            bench_sink(argv);
+            cmd_free(argv);
+        }
+        report("cmd_parse", sizes[s], iters, bench_now() - start);
+
+        start = bench_now();
+        for (iters = 0; bench_now() - start < BENCH_MIN_SECONDS; iters++) {
+            struct cmd_tokens t;
+            arena_reset(&a);
+            cmd_tokenize(&a, line, &t);
+            bench_sink(t.tok);
+        }
+        report("cmd_tokenize", sizes[s], iters, bench_now() - start);
+
+        start = bench_now();
+        for (iters = 0; bench_now() - start < BENCH_MIN_SECONDS; iters++) {
+            struct cmd_tokens t;
+            arena_reset(&a);
+            cmd_tokenize(&a, line, &t);
+            char **argv = cmd_materialize(&a, &t);
+            bench_sink(argv);
+        }
+        report("tokenize+materialize", sizes[s], iters, bench_now() - start);
+        free(line);
+    }
+    arena_destroy(&a);
+    return 0;
+}
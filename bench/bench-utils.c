@@ -0,0 +1,61 @@
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include "bench.h"
+#include "../src/lab.h"
+#include "../src/parse.h"
+#include "../src/exec.h"
+
+/* Each builtin line next to the same command run from its program file */
+static const char *const lines[][2] = {
+    {"true", "/bin/true"},
+    {"echo hello world >/dev/null", "/bin/echo hello world >/dev/null"},
+    {"printf '%s=%d\\n' x 42 >/dev/null", "/usr/bin/printf '%s=%d\\n' x 42 >/dev/null"},
+    {"test -d /tmp && test abc = abc", "/usr/bin/test -d /tmp && /usr/bin/test abc = abc"},
+    {"pwd >/dev/null", "/bin/pwd >/dev/null"},
+};
+
+static double run_line(struct shell *sh, const char *line)
+{
+    const char *err;
+    size_t iters;
+    double start = bench_now();
+    for (iters = 0; bench_now() - start < BENCH_MIN_SECONDS; iters++) {
+        arena_reset(&sh->arena);
+        struct ast_pipeline *pl = parse_line(&sh->arena, line, &err);
+        if (err) {
+            fprintf(stderr, "%s: %s\n", line, err);
+            return 0;
+        }
+        exec_list(sh, pl);
+    }
+    bench_sink(&sh->status);
+    return iters / (bench_now() - start);
+}
+
+int main(void)
+{
+    struct shell sh;
+    memset(&sh, 0, sizeof(sh));
+    sh.shell_terminal = -1;
+    sh.spawn_mode = spawn_default_mode();
+    arena_init(&sh.arena, 0);
+    cmdhash_init(&sh.cmdhash);
+    writer_init(&sh.out, STDOUT_FILENO);
+    jobs_init(&sh);
+
+    printf("utils: lines run through exec_list, builtin vs program\n");
+    for (size_t i = 0; i < sizeof(lines) / sizeof(lines[0]); i++) {
+        double builtin = run_line(&sh, lines[i][0]);
+        double program = run_line(&sh, lines[i][1]);
+        printf("  %-34s %10.0f lines/s %8.0f lines/s as programs  %6.0fx\n", lines[i][0],
+               builtin, program, program > 0 ? builtin / program : 0);
+    }
+
+    jobs_destroy(&sh);
+    writer_destroy(&sh.out);
+    cmdhash_destroy(&sh.cmdhash);
+    arena_destroy(&sh.arena);
+    free(sh.pipestatus);
+    return 0;
+}
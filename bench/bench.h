@@ -0,0 +1,22 @@
+#ifndef BENCH_H
+#define BENCH_H
+#include <stdio.h>
+#include <time.h>
+
+/* Minimum wall clock time to spend on each measurement */
+#define BENCH_MIN_SECONDS 0.25
+
+static inline double bench_now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+/* Keep the compiler from throwing away a result we only computed to time */
+static inline void bench_sink(const void *p)
+{
+    __asm__ __volatile__("" : : "r"(p) : "memory");
+}
+
+#endif
@@ -0,0 +1,125 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include "arena.h"
+
+#define ARENA_ALIGN _Alignof(max_align_t)
+#define ARENA_MIN_CHUNK 1024
+
+struct arena_chunk
+{
+    struct arena_chunk *next;
+    size_t cap;
+    size_t used;
+    max_align_t data[];
+};
+
+static void *xmalloc(size_t n)
+{
+    void *rval = malloc(n);
+    if (!rval) {
+        fprintf(stderr, "arena: out of memory\n");
+        abort();
+    }
+    return rval;
+}
+
+static size_t align_up(size_t n, size_t align)
+{
+    return (n + align - 1) & ~(align - 1);
+}
+
+void arena_init(struct arena *a, size_t cap)
+{
+    a->base = cap ? (char *)xmalloc(cap) : NULL;
+    a->cap = cap;
+    a->used = 0;
+    a->chunks = NULL;
+    a->allocated = 0;
+    a->reserved = cap;
+}
+
+static void *arena_alloc_align(struct arena *a, size_t n, size_t align)
+{
+    size_t off;
+    struct arena_chunk *c = a->chunks;
+
+    if (!c) {
+        off = align_up(a->used, align);
+        if (a->base && off + n <= a->cap) {
+            a->allocated += off + n - a->used;
+            a->used = off + n;
+            return a->base + off;
+        }
+    } else {
+        off = align_up(c->used, align);
+        if (off + n <= c->cap) {
+            a->allocated += off + n - c->used;
+            c->used = off + n;
+            return (char *)c->data + off;
+        }
+    }
+
+    // Out of room, chain on a chunk at least twice the size of the last one
+    size_t cap = c ? c->cap * 2 : a->cap * 2;
+    if (cap < ARENA_MIN_CHUNK)
+        cap = ARENA_MIN_CHUNK;
+    if (cap < n)
+        cap = n;
+    c = (struct arena_chunk *)xmalloc(sizeof(struct arena_chunk) + cap);
+    c->next = a->chunks;
+    c->cap = cap;
+    c->used = n;
+    a->chunks = c;
+    a->reserved += cap;
+    a->allocated += n;
+    return c->data;
+}
+
+void *arena_alloc(struct arena *a, size_t n)
+{
+    return arena_alloc_align(a, n, ARENA_ALIGN);
+}
+
+char *arena_strndup(struct arena *a, const char *s, size_t n)
+{
+    char *rval = (char *)arena_alloc_align(a, n + 1, 1);
+    memcpy(rval, s, n);
+    rval[n] = '\0';
+    return rval;
+}
+
+void arena_reset(struct arena *a)
+{
+    if (a->chunks) {
+        size_t cap = a->cap;
+        while (a->chunks) {
+            struct arena_chunk *next = a->chunks->next;
+            cap += a->chunks->cap;
+            free(a->chunks);
+            a->chunks = next;
+        }
+        free(a->base);
+        a->base = (char *)xmalloc(cap);
+        a->cap = cap;
+        a->reserved = cap;
+    }
+    a->used = 0;
+    a->allocated = 0;
+}
+
+void arena_destroy(struct arena *a)
+{
+    while (a->chunks) {
+        struct arena_chunk *next = a->chunks->next;
+        free(a->chunks);
+        a->chunks = next;
+    }
+    free(a->base);
+    a->base = NULL;
+    a->cap = 0;
+    a->used = 0;
+    a->allocated = 0;
+    a->reserved = 0;
+}
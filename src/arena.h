@@ -0,0 +1,78 @@
+#ifndef ARENA_H
+#define ARENA_H
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+  struct arena_chunk;
+
+  /**
+   * A bump allocator for memory that lives exactly as long as one command.
+   * Allocations come out of a primary block; when it fills up overflow
+   * chunks are chained on. arena_reset hands everything back at once and
+   * coalesces the overflow into a single primary block so the next command
+   * of the same size is served by one allocation.
+   */
+  struct arena
+  {
+    char *base;                 /* primary block, may be NULL */
+    size_t cap;                 /* size of the primary block */
+    size_t used;                /* bytes used in the primary block */
+    struct arena_chunk *chunks; /* overflow chunks, newest first */
+    size_t allocated;           /* bytes handed out since the last reset */
+    size_t reserved;            /* bytes currently held from malloc */
+  };
+
+  /**
+   * @brief Initialize an arena with a primary block of cap bytes. A cap of
+   * zero defers all allocation until the first call to arena_alloc.
+   *
+   * @param a The arena
+   * @param cap Size of the primary block
+   */
+  void arena_init(struct arena *a, size_t cap);
+
+  /**
+   * @brief Allocate n bytes aligned for any object type. The memory is not
+   * zeroed. This function aborts if the system is out of memory.
+   *
+   * @param a The arena
+   * @param n Number of bytes
+   * @return void* The memory
+   */
+  void *arena_alloc(struct arena *a, size_t n);
+
+  /**
+   * @brief Copy n bytes of s into the arena and NUL terminate the copy.
+   * Strings are packed with no alignment padding.
+   *
+   * @param a The arena
+   * @param s The bytes to copy
+   * @param n Number of bytes to copy
+   * @return char* The copy
+   */
+  char *arena_strndup(struct arena *a, const char *s, size_t n);
+
+  /**
+   * @brief Release every allocation made from the arena. Any overflow chunks
+   * are freed and the primary block is grown to cover them.
+   *
+   * @param a The arena
+   */
+  void arena_reset(struct arena *a);
+
+  /**
+   * @brief Free all memory held by the arena.
+   *
+   * @param a The arena
+   */
+  void arena_destroy(struct arena *a);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif
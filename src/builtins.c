@@ -0,0 +1,718 @@
+#include <errno.h>
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "builtins.h"
+#include "lab.h"
+
+int builtin_true(struct shell *sh, char **argv)
+{
+    UNUSED(sh);
+    UNUSED(argv);
+    return 0;
+}
+
+int builtin_false(struct shell *sh, char **argv)
+{
+    UNUSED(sh);
+    UNUSED(argv);
+    return 1;
+}
+
+static int hex_digit(char c)
+{
+    if (c >= '0' && c <= '9')
+        return c - '0';
+    if (c >= 'a' && c <= 'f')
+        return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F')
+        return c - 'A' + 10;
+    return -1;
+}
+
+/*
+ * Decode the escape sequence that follows a backslash at s and append the
+ * byte it stands for. Octal escapes are \NNN in a printf format and \0NNN
+ * for echo and %b, which is what octal0 selects. \c sets *stop, nothing
+ * more may be printed. Unknown escapes are kept as written. Returns the
+ * first character after the sequence.
+ */
+static const char *unescape(struct writer *w, const char *s, bool octal0, bool *stop)
+{
+    static const char simple[] = "\\\\a\ab\be\033f\fn\nr\rt\tv\v\"\"''";
+    int c = 0;
+    int digits = 0;
+
+    if (*s == 'c')
+    {
+        *stop = true;
+        return s + 1;
+    }
+    for (const char *p = simple; *p; p += 2)
+    {
+        if (*s == p[0])
+        {
+            writer_putc(w, p[1]);
+            return s + 1;
+        }
+    }
+    if (*s == 'x' && hex_digit(s[1]) >= 0)
+    {
+        for (s++; digits < 2 && hex_digit(*s) >= 0; s++, digits++)
+            c = c * 16 + hex_digit(*s);
+        writer_putc(w, (char)c);
+        return s;
+    }
+    if (octal0 ? *s == '0' : *s >= '0' && *s <= '7')
+    {
+        if (octal0)
+            s++;
+        for (; digits < 3 && *s >= '0' && *s <= '7'; s++, digits++)
+            c = c * 8 + (*s - '0');
+        writer_putc(w, (char)c);
+        return s;
+    }
+    writer_putc(w, '\\');
+    return s;
+}
+
+/*
+ * echo [-neE] [string ...]
+ * Like the echo found in PATH on GNU systems, which is what scripts got
+ * before echo was a builtin. Escapes are only interpreted with -e.
+ */
+int builtin_echo(struct shell *sh, char **argv)
+{
+    struct writer *w = &sh->out;
+    bool newline = true;
+    bool escapes = false;
+    int i = 1;
+
+    for (; argv[i] && argv[i][0] == '-' && argv[i][1]; i++)
+    {
+        const char *opt = argv[i] + 1;
+        if (opt[strspn(opt, "neE")])
+            break;
+        for (; *opt; opt++)
+        {
+            if (*opt == 'n')
+                newline = false;
+            else
+                escapes = *opt == 'e';
+        }
+    }
+    for (int first = i; argv[i]; i++)
+    {
+        if (i > first)
+            writer_putc(w, ' ');
+        if (!escapes)
+        {
+            writer_puts(w, argv[i]);
+            continue;
+        }
+        bool stop = false;
+        for (const char *s = argv[i]; *s && !stop;)
+        {
+            if (*s == '\\' && s[1])
+                s = unescape(w, s + 1, true, &stop);
+            else
+                writer_putc(w, *s++);
+        }
+        if (stop)
+            return 0;
+    }
+    if (newline)
+        writer_putc(w, '\n');
+    return 0;
+}
+
+struct printf_args
+{
+    char **next; /* arguments not used yet */
+    bool used;   /* the format consumed at least one argument */
+    int status;
+};
+
+static const char *next_arg(struct printf_args *a)
+{
+    if (!*a->next)
+        return NULL;
+    a->used = true;
+    return *a->next++;
+}
+
+/*
+ * Report a numeric argument that did not convert completely. The value
+ * converted so far is still printed, like other implementations do.
+ */
+static void check_number(struct printf_args *a, const char *arg, const char *end)
+{
+    if (errno == ERANGE)
+    {
+        fprintf(stderr, "printf: %s: %s\n", arg, strerror(ERANGE));
+        a->status = 1;
+    }
+    else if (end == arg || *end)
+    {
+        fprintf(stderr, "printf: %s: %s\n", arg,
+                end == arg ? "expected a numeric value" : "value not completely converted");
+        a->status = 1;
+    }
+}
+
+/* A leading quote makes the value of a numeric argument its first character */
+static bool quoted_char(const char *arg, intmax_t *v)
+{
+    if (arg[0] != '\'' && arg[0] != '"')
+        return false;
+    *v = (unsigned char)arg[1];
+    return true;
+}
+
+static intmax_t arg_int(struct printf_args *a)
+{
+    const char *arg = next_arg(a);
+    intmax_t v = 0;
+    if (!arg || !*arg || quoted_char(arg, &v))
+        return v;
+    char *end;
+    errno = 0;
+    v = strtoimax(arg, &end, 0);
+    check_number(a, arg, end);
+    return v;
+}
+
+static uintmax_t arg_uint(struct printf_args *a)
+{
+    const char *arg = next_arg(a);
+    intmax_t v = 0;
+    if (!arg || !*arg || quoted_char(arg, &v))
+        return (uintmax_t)v;
+    char *end;
+    errno = 0;
+    uintmax_t u = strtoumax(arg, &end, 0);
+    check_number(a, arg, end);
+    return u;
+}
+
+static long double arg_float(struct printf_args *a)
+{
+    const char *arg = next_arg(a);
+    intmax_t v = 0;
+    if (!arg || !*arg)
+        return 0;
+    if (quoted_char(arg, &v))
+        return (long double)v;
+    char *end;
+    errno = 0;
+    long double d = strtold(arg, &end);
+    check_number(a, arg, end);
+    return d;
+}
+
+/*
+ * Print the argument of a %b conversion with escapes interpreted into w,
+ * padded or cut as the conversion says. Returns false after \c.
+ */
+static bool print_b(struct writer *w, const char *spec, const char *arg)
+{
+    struct writer tmp;
+    bool stop = false;
+    writer_init(&tmp, -1);
+    for (const char *s = arg ? arg : ""; *s && !stop;)
+    {
+        if (*s == '\\' && s[1])
+            s = unescape(&tmp, s + 1, true, &stop);
+        else
+            writer_putc(&tmp, *s++);
+    }
+    // The expansion may hold NUL bytes, those are passed through when not padding
+    if (strcmp(spec, "%s") == 0)
+    {
+        if (tmp.len)
+            writer_put(w, tmp.buf, tmp.len);
+    }
+    else
+    {
+        writer_putc(&tmp, '\0');
+        writer_printf(w, spec, tmp.buf);
+    }
+    writer_destroy(&tmp);
+    return !stop;
+}
+
+/*
+ * Run through the format once. Returns false if output must stop.
+ */
+static bool printf_once(struct writer *w, const char *fmt, struct printf_args *a)
+{
+    while (*fmt)
+    {
+        if (*fmt == '\\')
+        {
+            bool stop = false;
+            if (!fmt[1])
+            {
+                writer_putc(w, *fmt++);
+                continue;
+            }
+            fmt = unescape(w, fmt + 1, false, &stop);
+            if (stop)
+                return false;
+            continue;
+        }
+        if (*fmt != '%')
+        {
+            writer_putc(w, *fmt++);
+            continue;
+        }
+        if (fmt[1] == '%')
+        {
+            writer_putc(w, '%');
+            fmt += 2;
+            continue;
+        }
+
+        // Rebuild the conversion with * replaced and the widest length modifier
+        char spec[64];
+        size_t n = 0;
+        const char *start = fmt++;
+        spec[n++] = '%';
+        while (*fmt && strchr("-+ #0'", *fmt) && n < 8)
+            spec[n++] = *fmt++;
+        for (int part = 0; part < 2; part++)
+        {
+            if (part == 1)
+            {
+                if (*fmt != '.')
+                    break;
+                spec[n++] = *fmt++;
+            }
+            if (*fmt == '*')
+            {
+                n += (size_t)snprintf(spec + n, sizeof(spec) - n, "%d", (int)arg_int(a));
+                fmt++;
+            }
+            else
+            {
+                while (*fmt >= '0' && *fmt <= '9' && n < 40)
+                    spec[n++] = *fmt++;
+            }
+        }
+        char conv = *fmt;
+        if (!conv || !strchr("diouxXeEfFgGaAcsb", conv))
+        {
+            fprintf(stderr, "printf: %.*s: invalid conversion specification\n",
+                    (int)(fmt - start + (conv != 0)), start);
+            a->status = 1;
+            return false;
+        }
+        fmt++;
+        spec[n] = '\0';
+
+        if (strchr("di", conv))
+        {
+            strcpy(spec + n, conv == 'd' ? "jd" : "ji");
+            writer_printf(w, spec, arg_int(a));
+        }
+        else if (strchr("ouxX", conv))
+        {
+            spec[n] = 'j';
+            spec[n + 1] = conv;
+            spec[n + 2] = '\0';
+            writer_printf(w, spec, arg_uint(a));
+        }
+        else if (strchr("eEfFgGaA", conv))
+        {
+            spec[n] = 'L';
+            spec[n + 1] = conv;
+            spec[n + 2] = '\0';
+            writer_printf(w, spec, arg_float(a));
+        }
+        else if (conv == 'c')
+        {
+            const char *arg = next_arg(a);
+            strcpy(spec + n, arg && *arg ? "c" : "s");
+            if (arg && *arg)
+                writer_printf(w, spec, arg[0]);
+            else
+                writer_printf(w, spec, "");
+        }
+        else if (conv == 's')
+        {
+            const char *arg = next_arg(a);
+            strcpy(spec + n, "s");
+            writer_printf(w, spec, arg ? arg : "");
+        }
+        else
+        {
+            strcpy(spec + n, "s");
+            if (!print_b(w, spec, next_arg(a)))
+                return false;
+        }
+    }
+    return true;
+}
+
+/*
+ * printf format [argument ...]
+ * The format is reused until every argument has been consumed. Missing
+ * arguments print as an empty string or zero.
+ */
+int builtin_printf(struct shell *sh, char **argv)
+{
+    int i = 1;
+    if (argv[i] && strcmp(argv[i], "--") == 0)
+        i++;
+    if (!argv[i])
+    {
+        fprintf(stderr, "printf: usage: printf format [arguments]\n");
+        return 2;
+    }
+    struct printf_args a = {argv + i + 1, false, 0};
+    const char *fmt = argv[i];
+    for (;;)
+    {
+        a.used = false;
+        if (!printf_once(&sh->out, fmt, &a) || !*a.next || !a.used)
+            break;
+    }
+    return a.status;
+}
+
+/*
+ * pwd [-L|-P]
+ * -L, the default, prints the logical working directory so the path the
+ * user took through symbolic links is kept. -P prints the physical path.
+ */
+int builtin_pwd(struct shell *sh, char **argv)
+{
+    bool physical = false;
+    for (int i = 1; argv[i] && argv[i][0] == '-'; i++)
+    {
+        if (strcmp(argv[i], "--") == 0)
+            break;
+        if (strcmp(argv[i], "-L") == 0)
+        {
+            physical = false;
+        }
+        else if (strcmp(argv[i], "-P") == 0)
+        {
+            physical = true;
+        }
+        else
+        {
+            fprintf(stderr, "pwd: %s: invalid option\n", argv[i]);
+            return 2;
+        }
+    }
+
+    const char *pwd = physical ? NULL : pwd_get(&sh->pwd);
+    if (pwd)
+    {
+        writer_puts(&sh->out, pwd);
+        writer_putc(&sh->out, '\n');
+        return 0;
+    }
+    char *cwd = getcwd(NULL, 0);
+    if (!cwd)
+    {
+        fprintf(stderr, "pwd: %s\n", strerror(errno));
+        return 1;
+    }
+    writer_puts(&sh->out, cwd);
+    writer_putc(&sh->out, '\n');
+    free(cwd);
+    return 0;
+}
+
+/*
+ * State of the test expression parser. Once err is set the result no
+ * longer matters and the command exits with 2.
+ */
+struct test_expr
+{
+    char **argv;
+    int argc;
+    int pos;
+    bool err;
+};
+
+static void test_error(struct test_expr *t, const char *arg, const char *msg)
+{
+    if (!t->err)
+    {
+        if (arg)
+            fprintf(stderr, "test: %s: %s\n", arg, msg);
+        else
+            fprintf(stderr, "test: %s\n", msg);
+    }
+    t->err = true;
+}
+
+static bool is_unary(const char *op)
+{
+    return op[0] == '-' && op[1] && !op[2] && strchr("bcdefghLnprsStuwxzOGk", op[1]);
+}
+
+static bool is_binary(const char *op)
+{
+    static const char *const ops[] = {"=", "==", "!=", "<", ">", "-eq", "-ne", "-gt", "-ge",
+                                      "-lt", "-le", "-nt", "-ot", "-ef", NULL};
+    for (int i = 0; ops[i]; i++)
+    {
+        if (strcmp(op, ops[i]) == 0)
+            return true;
+    }
+    return false;
+}
+
+static intmax_t test_int(struct test_expr *t, const char *s)
+{
+    char *end;
+    errno = 0;
+    intmax_t v = strtoimax(s, &end, 10);
+    while (*end == ' ' || *end == '\t')
+        end++;
+    if (errno || end == s || *end || !*s)
+        test_error(t, s, "integer expression expected");
+    return v;
+}
+
+static bool test_unary(struct test_expr *t, char op, const char *arg)
+{
+    struct stat st;
+    switch (op)
+    {
+    case 'n':
+        return *arg;
+    case 'z':
+        return !*arg;
+    case 't':
+        return isatty((int)test_int(t, arg));
+    case 'r':
+        return access(arg, R_OK) == 0;
+    case 'w':
+        return access(arg, W_OK) == 0;
+    case 'x':
+        return access(arg, X_OK) == 0;
+    case 'h':
+    case 'L':
+        return lstat(arg, &st) == 0 && S_ISLNK(st.st_mode);
+    }
+    if (stat(arg, &st) < 0)
+        return false;
+    switch (op)
+    {
+    case 'b':
+        return S_ISBLK(st.st_mode);
+    case 'c':
+        return S_ISCHR(st.st_mode);
+    case 'd':
+        return S_ISDIR(st.st_mode);
+    case 'f':
+        return S_ISREG(st.st_mode);
+    case 'p':
+        return S_ISFIFO(st.st_mode);
+    case 'S':
+        return S_ISSOCK(st.st_mode);
+    case 's':
+        return st.st_size > 0;
+    case 'u':
+        return st.st_mode & S_ISUID;
+    case 'g':
+        return st.st_mode & S_ISGID;
+    case 'k':
+        return st.st_mode & S_ISVTX;
+    case 'O':
+        return st.st_uid == geteuid();
+    case 'G':
+        return st.st_gid == getegid();
+    default:
+        return true; /* -e */
+    }
+}
+
+static int cmp_mtime(const struct stat *a, const struct stat *b)
+{
+    if (a->st_mtim.tv_sec != b->st_mtim.tv_sec)
+        return a->st_mtim.tv_sec < b->st_mtim.tv_sec ? -1 : 1;
+    if (a->st_mtim.tv_nsec != b->st_mtim.tv_nsec)
+        return a->st_mtim.tv_nsec < b->st_mtim.tv_nsec ? -1 : 1;
+    return 0;
+}
+
+static bool test_binary(struct test_expr *t, const char *l, const char *op, const char *r)
+{
+    if (op[0] != '-')
+    {
+        int c = strcmp(l, r);
+        if (op[0] == '<')
+            return c < 0;
+        if (op[0] == '>')
+            return c > 0;
+        return op[0] == '!' ? c != 0 : c == 0;
+    }
+    if ((op[1] == 'n' && op[2] == 't') || op[1] == 'o' || (op[1] == 'e' && op[2] == 'f'))
+    {
+        struct stat a, b;
+        bool ha = stat(l, &a) == 0;
+        bool hb = stat(r, &b) == 0;
+        if (op[1] == 'e')
+            return ha && hb && a.st_dev == b.st_dev && a.st_ino == b.st_ino;
+        if (op[1] == 'n')
+            return ha && (!hb || cmp_mtime(&a, &b) > 0);
+        return hb && (!ha || cmp_mtime(&a, &b) < 0);
+    }
+    intmax_t a = test_int(t, l);
+    intmax_t b = test_int(t, r);
+    if (strcmp(op, "-eq") == 0)
+        return a == b;
+    if (strcmp(op, "-ne") == 0)
+        return a != b;
+    if (strcmp(op, "-gt") == 0)
+        return a > b;
+    if (strcmp(op, "-ge") == 0)
+        return a >= b;
+    if (strcmp(op, "-lt") == 0)
+        return a < b;
+    return a <= b;
+}
+
+static bool test_or(struct test_expr *t);
+
+static bool test_primary(struct test_expr *t)
+{
+    if (t->pos >= t->argc)
+    {
+        test_error(t, NULL, "argument expected");
+        return false;
+    }
+    char **a = t->argv + t->pos;
+    int left = t->argc - t->pos;
+    if (strcmp(a[0], "(") == 0)
+    {
+        t->pos++;
+        bool v = test_or(t);
+        if (t->pos >= t->argc || strcmp(t->argv[t->pos], ")") != 0)
+            test_error(t, NULL, "')' expected");
+        t->pos++;
+        return v;
+    }
+    if (left >= 3 && is_binary(a[1]))
+    {
+        t->pos += 3;
+        return test_binary(t, a[0], a[1], a[2]);
+    }
+    if (left >= 2 && is_unary(a[0]))
+    {
+        t->pos += 2;
+        return test_unary(t, a[0][1], a[1]);
+    }
+    t->pos++;
+    return *a[0];
+}
+
+static bool test_not(struct test_expr *t)
+{
+    if (t->pos < t->argc && strcmp(t->argv[t->pos], "!") == 0)
+    {
+        t->pos++;
+        return !test_not(t);
+    }
+    return test_primary(t);
+}
+
+static bool test_and(struct test_expr *t)
+{
+    bool v = test_not(t);
+    while (t->pos < t->argc && strcmp(t->argv[t->pos], "-a") == 0)
+    {
+        t->pos++;
+        v = test_not(t) && v;
+    }
+    return v;
+}
+
+static bool test_or(struct test_expr *t)
+{
+    bool v = test_and(t);
+    while (t->pos < t->argc && strcmp(t->argv[t->pos], "-o") == 0)
+    {
+        t->pos++;
+        v = test_and(t) || v;
+    }
+    return v;
+}
+
+/*
+ * POSIX decides what up to four arguments mean from their number alone,
+ * which settles cases like test ! = x. Longer expressions are parsed with
+ * the usual precedence of ! over -a over -o.
+ */
+static bool test_args(struct test_expr *t, char **a, int n)
+{
+    switch (n)
+    {
+    case 0:
+        return false;
+    case 1:
+        return *a[0];
+    case 2:
+        if (strcmp(a[0], "!") == 0)
+            return !*a[1];
+        if (is_unary(a[0]))
+            return test_unary(t, a[0][1], a[1]);
+        break;
+    case 3:
+        if (is_binary(a[1]))
+            return test_binary(t, a[0], a[1], a[2]);
+        if (strcmp(a[0], "!") == 0)
+            return !test_args(t, a + 1, 2);
+        if (strcmp(a[0], "(") == 0 && strcmp(a[2], ")") == 0)
+            return *a[1];
+        break;
+    case 4:
+        if (strcmp(a[0], "!") == 0)
+            return !test_args(t, a + 1, 3);
+        if (strcmp(a[0], "(") == 0 && strcmp(a[3], ")") == 0)
+            return test_args(t, a + 1, 2);
+        break;
+    }
+    t->argv = a;
+    t->argc = n;
+    t->pos = 0;
+    bool v = test_or(t);
+    if (t->pos < n)
+        test_error(t, a[t->pos], n == 2 ? "unary operator expected" : "unexpected argument");
+    return v;
+}
+
+/*
+ * test expression
+ * [ expression ]
+ * Exits 0 if the expression is true, 1 if it is false and 2 on errors.
+ */
+int builtin_test(struct shell *sh, char **argv)
+{
+    UNUSED(sh);
+    int n = 0;
+    while (argv[n + 1])
+        n++;
+    if (strcmp(argv[0], "[") == 0)
+    {
+        if (!n || strcmp(argv[n], "]") != 0)
+        {
+            fprintf(stderr, "[: missing ']'\n");
+            return 2;
+        }
+        n--;
+    }
+    struct test_expr t = {argv + 1, n, 0, false};
+    bool v = test_args(&t, argv + 1, n);
+    return t.err ? 2 : !v;
+}
@@ -0,0 +1,27 @@
+#ifndef BUILTINS_H
+#define BUILTINS_H
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+  struct shell;
+
+  /*
+   * Utilities that scripts run so often that launching a program for each
+   * call dominates their run time. They behave like the POSIX utilities of
+   * the same name and print through sh->out.
+   */
+  int builtin_true(struct shell *sh, char **argv);
+  int builtin_false(struct shell *sh, char **argv);
+  int builtin_echo(struct shell *sh, char **argv);
+  int builtin_printf(struct shell *sh, char **argv);
+  int builtin_pwd(struct shell *sh, char **argv);
+  int builtin_test(struct shell *sh, char **argv);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif
@@ -0,0 +1,255 @@
+#include <limits.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "cmdhash.h"
+
+/* What execvp searches when PATH is not set */
+#define CMDHASH_DEFAULT_PATH "/bin:/usr/bin"
+#define CMDHASH_MIN_CAP 64
+
+static uint32_t fnv1a(const char *s)
+{
+    uint32_t h = 2166136261u;
+    for (; *s; s++) {
+        h ^= (unsigned char)*s;
+        h *= 16777619u;
+    }
+    return h;
+}
+
+static char *xstrdup(const char *s)
+{
+    char *rval = strdup(s);
+    if (!rval) {
+        fprintf(stderr, "strdup failed\n");
+        abort();
+    }
+    return rval;
+}
+
+static void *xcalloc(size_t n, size_t size)
+{
+    void *rval = calloc(n, size);
+    if (!rval) {
+        fprintf(stderr, "calloc failed\n");
+        abort();
+    }
+    return rval;
+}
+
+void cmdhash_init(struct cmdhash *h)
+{
+    h->slots = NULL;
+    h->cap = 0;
+    h->count = 0;
+    h->path_env = NULL;
+    h->dirs = NULL;
+    h->ndirs = 0;
+    h->epoch = 1;
+    h->hits = 0;
+    h->misses = 0;
+    h->scratch = NULL;
+}
+
+void cmdhash_clear(struct cmdhash *h)
+{
+    for (size_t i = 0; i < h->cap; i++) {
+        free(h->slots[i].name);
+        free(h->slots[i].path);
+        h->slots[i].name = NULL;
+        h->slots[i].path = NULL;
+    }
+    h->count = 0;
+}
+
+static void free_dirs(struct cmdhash *h)
+{
+    for (size_t i = 0; i < h->ndirs; i++)
+        free(h->dirs[i].name);
+    free(h->dirs);
+    free(h->path_env);
+    h->dirs = NULL;
+    h->ndirs = 0;
+    h->path_env = NULL;
+}
+
+void cmdhash_destroy(struct cmdhash *h)
+{
+    cmdhash_clear(h);
+    free(h->slots);
+    free(h->scratch);
+    free_dirs(h);
+    cmdhash_init(h);
+}
+
+void cmdhash_tick(struct cmdhash *h)
+{
+    h->epoch++;
+}
+
+/*
+ * Make sure the directory list matches PATH. If PATH changed everything we
+ * remembered may be wrong so the table is cleared.
+ */
+static void sync_path(struct cmdhash *h)
+{
+    const char *env = getenv("PATH");
+    if (!env)
+        env = CMDHASH_DEFAULT_PATH;
+    if (h->path_env && strcmp(env, h->path_env) == 0)
+        return;
+
+    cmdhash_clear(h);
+    free_dirs(h);
+    h->path_env = xstrdup(env);
+
+    size_t n = 1;
+    for (const char *p = env; *p; p++)
+        n += *p == ':';
+    h->dirs = (struct cmdhash_dir *)xcalloc(n, sizeof(struct cmdhash_dir));
+    const char *start = env;
+    for (;;) {
+        const char *end = strchr(start, ':');
+        size_t len = end ? (size_t)(end - start) : strlen(start);
+        // An empty entry means the current directory
+        char *dir = len ? strndup(start, len) : xstrdup(".");
+        if (!dir) {
+            fprintf(stderr, "strndup failed\n");
+            abort();
+        }
+        h->dirs[h->ndirs].name = dir;
+        h->ndirs++;
+        if (!end)
+            break;
+        start = end + 1;
+    }
+}
+
+static struct timespec dir_mtime(const char *dir)
+{
+    struct stat st;
+    if (stat(dir, &st) < 0) {
+        struct timespec missing = {-1, -1};
+        return missing;
+    }
+    return st.st_mtim;
+}
+
+/*
+ * Check directory i for changes, at most once per epoch. The first check
+ * only records the modification time.
+ */
+static bool dir_changed(struct cmdhash *h, size_t i)
+{
+    struct cmdhash_dir *d = &h->dirs[i];
+    if (d->checked == h->epoch)
+        return false;
+    struct timespec now = dir_mtime(d->name);
+    bool changed = d->checked &&
+                   (now.tv_sec != d->mtime.tv_sec || now.tv_nsec != d->mtime.tv_nsec);
+    d->mtime = now;
+    d->checked = h->epoch;
+    return changed;
+}
+
+static struct cmdhash_entry *find_slot(struct cmdhash_entry *slots, size_t cap,
+                                       const char *name, uint32_t hash)
+{
+    size_t mask = cap - 1;
+    for (size_t i = hash & mask;; i = (i + 1) & mask) {
+        struct cmdhash_entry *e = &slots[i];
+        if (!e->name || (e->hash == hash && strcmp(e->name, name) == 0))
+            return e;
+    }
+}
+
+/*
+ * Move every entry found before PATH directory keep into a fresh table of
+ * cap slots, the rest are freed. Rebuilding avoids tombstones, entries are
+ * only ever dropped when a directory changes which is rare.
+ */
+static void rebuild(struct cmdhash *h, size_t cap, size_t keep)
+{
+    struct cmdhash_entry *slots = (struct cmdhash_entry *)xcalloc(cap, sizeof(struct cmdhash_entry));
+    h->count = 0;
+    for (size_t i = 0; i < h->cap; i++) {
+        struct cmdhash_entry *e = &h->slots[i];
+        if (!e->name)
+            continue;
+        if (e->dir < keep) {
+            *find_slot(slots, cap, e->name, e->hash) = *e;
+            h->count++;
+        } else {
+            free(e->name);
+            free(e->path);
+        }
+    }
+    free(h->slots);
+    h->slots = slots;
+    h->cap = cap;
+}
+
+static bool is_executable(const char *path)
+{
+    struct stat st;
+    return stat(path, &st) == 0 && S_ISREG(st.st_mode) && access(path, X_OK) == 0;
+}
+
+const char *cmdhash_lookup(struct cmdhash *h, const char *name)
+{
+    sync_path(h);
+    uint32_t hash = fnv1a(name);
+
+    if (h->count) {
+        struct cmdhash_entry *e = find_slot(h->slots, h->cap, name, hash);
+        if (e->name) {
+            bool stale = false;
+            size_t dir = e->dir;
+            // A change in an earlier directory may shadow the program
+            for (size_t i = 0; i <= dir && !stale; i++) {
+                if (dir_changed(h, i)) {
+                    rebuild(h, h->cap, i);
+                    stale = true;
+                }
+            }
+            if (!stale) {
+                h->hits++;
+                e->hits++;
+                return e->path;
+            }
+        }
+    }
+
+    h->misses++;
+    char buf[PATH_MAX];
+    for (size_t i = 0; i < h->ndirs; i++) {
+        // Record the directory before we look in it so a change races safe
+        if (dir_changed(h, i) && h->count)
+            rebuild(h, h->cap, i);
+        int n = snprintf(buf, sizeof(buf), "%s/%s", h->dirs[i].name, name);
+        if (n < 0 || (size_t)n >= sizeof(buf) || !is_executable(buf))
+            continue;
+
+        // Relative directories depend on the cwd, those are never remembered
+        if (h->dirs[i].name[0] != '/') {
+            free(h->scratch);
+            h->scratch = xstrdup(buf);
+            return h->scratch;
+        }
+        if ((h->count + 1) * 2 > h->cap)
+            rebuild(h, h->cap ? h->cap * 2 : CMDHASH_MIN_CAP, h->ndirs);
+        struct cmdhash_entry *e = find_slot(h->slots, h->cap, name, hash);
+        e->name = xstrdup(name);
+        e->path = xstrdup(buf);
+        e->dir = i;
+        e->hash = hash;
+        e->hits = 0;
+        h->count++;
+        return e->path;
+    }
+    return NULL;
+}
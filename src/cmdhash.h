@@ -0,0 +1,103 @@
+#ifndef CMDHASH_H
+#define CMDHASH_H
+#include <stdint.h>
+#include <stddef.h>
+#include <time.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+  /**
+   * A command name resolved to the absolute path of the program.
+   */
+  struct cmdhash_entry
+  {
+    char *name;     /* NULL for an empty slot */
+    char *path;
+    size_t dir;     /* index of the PATH directory the program was found in */
+    uint32_t hash;
+    unsigned long hits;
+  };
+
+  /**
+   * A directory from PATH and the modification time it had when we last
+   * looked at it.
+   */
+  struct cmdhash_dir
+  {
+    char *name;
+    struct timespec mtime;
+    unsigned long checked; /* epoch the mtime was last checked in */
+  };
+
+  /**
+   * Remembers where commands were found in PATH so they can be launched
+   * without walking PATH again. The table uses open addressing with linear
+   * probing and is kept at most half full. An entry is forgotten when PATH
+   * changes or when the modification time of the directory it was found in,
+   * or of any directory before it in PATH, changes.
+   */
+  struct cmdhash
+  {
+    struct cmdhash_entry *slots;
+    size_t cap;   /* always a power of two */
+    size_t count;
+    char *path_env; /* the PATH the directories were split from */
+    struct cmdhash_dir *dirs;
+    size_t ndirs;
+    unsigned long epoch;
+    unsigned long hits;   /* lookups answered from the table */
+    unsigned long misses; /* lookups that had to search PATH */
+    char *scratch; /* last program found in a relative PATH directory */
+  };
+
+  /**
+   * @brief Initialize an empty table.
+   *
+   * @param h The table
+   */
+  void cmdhash_init(struct cmdhash *h);
+
+  /**
+   * @brief Free all memory held by the table.
+   *
+   * @param h The table
+   */
+  void cmdhash_destroy(struct cmdhash *h);
+
+  /**
+   * @brief Forget every remembered command, the hit and miss counters are
+   * kept.
+   *
+   * @param h The table
+   */
+  void cmdhash_clear(struct cmdhash *h);
+
+  /**
+   * @brief Start a new epoch. The directories of PATH are checked for
+   * changes at most once per epoch, the shell starts one for every line it
+   * runs.
+   *
+   * @param h The table
+   */
+  void cmdhash_tick(struct cmdhash *h);
+
+  /**
+   * @brief Find the program that runs for name. Names containing a / are
+   * not looked up and should be run as given.
+   *
+   * @param h The table
+   * @param name The command name
+   * @return The absolute path of the program, or NULL if there is no
+   * executable with that name in PATH. The string is owned by the table and
+   * is valid until the next call into the table.
+   */
+  const char *cmdhash_lookup(struct cmdhash *h, const char *name);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif
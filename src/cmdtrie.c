@@ -0,0 +1,162 @@
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "cmdtrie.h"
+
+/* Longest name the tree takes, the longest a directory entry can have */
+#define CMDTRIE_NAME_MAX NAME_MAX
+
+static void *xrealloc(void *p, size_t size)
+{
+    void *rval = realloc(p, size);
+    if (!rval) {
+        fprintf(stderr, "realloc failed\n");
+        abort();
+    }
+    return rval;
+}
+
+static uint32_t new_node(struct cmdtrie *t, unsigned char c)
+{
+    if (t->count == t->cap) {
+        t->cap = t->cap ? t->cap * 2 : 256;
+        t->nodes = (struct cmdtrie_node *)xrealloc(t->nodes, sizeof(struct cmdtrie_node) * t->cap);
+    }
+    struct cmdtrie_node *n = &t->nodes[t->count];
+    memset(n, 0, sizeof(*n));
+    n->c = c;
+    return (uint32_t)t->count++;
+}
+
+void cmdtrie_init(struct cmdtrie *t)
+{
+    t->nodes = NULL;
+    t->count = 0;
+    t->cap = 0;
+    new_node(t, 0);
+}
+
+void cmdtrie_destroy(struct cmdtrie *t)
+{
+    free(t->nodes);
+    t->nodes = NULL;
+    t->count = 0;
+    t->cap = 0;
+}
+
+/* The child of parent for byte c, made in its sorted place if create is set */
+static uint32_t child(struct cmdtrie *t, uint32_t parent, unsigned char c, bool create)
+{
+    uint32_t prev = 0;
+    uint32_t cur = t->nodes[parent].child;
+    while (cur && t->nodes[cur].c < c) {
+        prev = cur;
+        cur = t->nodes[cur].next;
+    }
+    if (cur && t->nodes[cur].c == c)
+        return cur;
+    if (!create)
+        return 0;
+    uint32_t n = new_node(t, c);
+    t->nodes[n].next = cur;
+    if (prev)
+        t->nodes[prev].next = n;
+    else
+        t->nodes[parent].child = n;
+    return n;
+}
+
+/* Fill path with the nodes from the root to the end of name */
+static size_t walk(struct cmdtrie *t, const char *name, uint32_t *path, bool create)
+{
+    size_t depth = 0;
+    path[0] = 0;
+    for (const char *s = name; *s; s++) {
+        uint32_t n = child(t, path[depth], (unsigned char)*s, create);
+        if (!n)
+            return 0;
+        path[++depth] = n;
+    }
+    return depth + 1;
+}
+
+bool cmdtrie_add(struct cmdtrie *t, const char *name)
+{
+    uint32_t path[CMDTRIE_NAME_MAX + 1];
+    if (!*name || strlen(name) > CMDTRIE_NAME_MAX)
+        return false;
+    size_t n = walk(t, name, path, true);
+    struct cmdtrie_node *end = &t->nodes[path[n - 1]];
+    if (end->refs == UINT16_MAX)
+        return false;
+    if (end->refs++)
+        return false;
+    for (size_t i = 0; i < n; i++)
+        t->nodes[path[i]].below++;
+    return true;
+}
+
+bool cmdtrie_remove(struct cmdtrie *t, const char *name)
+{
+    uint32_t path[CMDTRIE_NAME_MAX + 1];
+    if (!*name || strlen(name) > CMDTRIE_NAME_MAX)
+        return false;
+    size_t n = walk(t, name, path, false);
+    if (!n || !t->nodes[path[n - 1]].refs)
+        return false;
+    if (--t->nodes[path[n - 1]].refs)
+        return false;
+    for (size_t i = 0; i < n; i++)
+        t->nodes[path[i]].below--;
+    return true;
+}
+
+size_t cmdtrie_count(const struct cmdtrie *t)
+{
+    return t->count ? t->nodes[0].below : 0;
+}
+
+struct visit
+{
+    const struct cmdtrie *t;
+    char name[CMDTRIE_NAME_MAX + 1];
+    void (*fn)(const char *name, void *ctx);
+    void *ctx;
+};
+
+/* Every name at or under node, whose bytes up to node are in v->name */
+static void visit(struct visit *v, uint32_t node, size_t len)
+{
+    const struct cmdtrie_node *n = &v->t->nodes[node];
+    if (n->refs) {
+        v->name[len] = '\0';
+        v->fn(v->name, v->ctx);
+    }
+    for (uint32_t c = n->child; c; c = v->t->nodes[c].next) {
+        if (!v->t->nodes[c].below)
+            continue;
+        v->name[len] = (char)v->t->nodes[c].c;
+        visit(v, c, len + 1);
+    }
+}
+
+size_t cmdtrie_complete(const struct cmdtrie *t, const char *prefix,
+                        void (*fn)(const char *name, void *ctx), void *ctx)
+{
+    uint32_t path[CMDTRIE_NAME_MAX + 1];
+    size_t len = strlen(prefix);
+    if (!t->count || len > CMDTRIE_NAME_MAX)
+        return 0;
+    // Only a walk that may create nodes changes the tree
+    size_t n = walk((struct cmdtrie *)t, prefix, path, false);
+    if (!n || !t->nodes[path[n - 1]].below)
+        return 0;
+    struct visit v;
+    v.t = t;
+    v.fn = fn;
+    v.ctx = ctx;
+    memcpy(v.name, prefix, len);
+    visit(&v, path[n - 1], len);
+    return t->nodes[path[n - 1]].below;
+}
@@ -0,0 +1,94 @@
+#ifndef CMDTRIE_H
+#define CMDTRIE_H
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+  /**
+   * One byte of a name. The children of a node are a list in byte order
+   * linked through next, so a walk of the tree visits names sorted.
+   */
+  struct cmdtrie_node
+  {
+    uint32_t child; /* first child, 0 for none, the root is node 0 */
+    uint32_t next;  /* next sibling */
+    uint32_t below; /* names ending at this node or under it */
+    uint16_t refs;  /* times the name ending here was added and not removed */
+    unsigned char c;
+  };
+
+  /**
+   * A prefix tree of command names. A name can be added more than once,
+   * once for every PATH directory holding a program with that name, and
+   * is in the tree until it was removed as often. Nodes of removed names
+   * stay and are skipped by the counts in below.
+   */
+  struct cmdtrie
+  {
+    struct cmdtrie_node *nodes;
+    size_t count;
+    size_t cap;
+  };
+
+  /**
+   * @brief Initialize an empty tree.
+   *
+   * @param t The tree
+   */
+  void cmdtrie_init(struct cmdtrie *t);
+
+  /**
+   * @brief Free all memory held by the tree.
+   *
+   * @param t The tree
+   */
+  void cmdtrie_destroy(struct cmdtrie *t);
+
+  /**
+   * @brief Add a name.
+   *
+   * @param t The tree
+   * @param name The name
+   * @return True if the name was not in the tree before
+   */
+  bool cmdtrie_add(struct cmdtrie *t, const char *name);
+
+  /**
+   * @brief Take back one add of a name.
+   *
+   * @param t The tree
+   * @param name The name
+   * @return True if that was its last add and the name left the tree
+   */
+  bool cmdtrie_remove(struct cmdtrie *t, const char *name);
+
+  /**
+   * @brief Count the names in the tree.
+   *
+   * @param t The tree
+   * @return The number of distinct names
+   */
+  size_t cmdtrie_count(const struct cmdtrie *t);
+
+  /**
+   * @brief Call fn for every name that starts with prefix, in byte order.
+   *
+   * @param t The tree
+   * @param prefix The start of the names
+   * @param fn Called with each name, which is only valid during the call
+   * @param ctx Passed to fn
+   * @return The number of names found
+   */
+  size_t cmdtrie_complete(const struct cmdtrie *t, const char *prefix,
+                          void (*fn)(const char *name, void *ctx), void *ctx);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif
@@ -0,0 +1,445 @@
+#define _GNU_SOURCE
+#include <dirent.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <readline/readline.h>
+#include "complete.h"
+#include "lab.h"
+
+/* Changes applied to the tree per hold of the lock */
+#define COMPLETE_BATCH 256
+
+static void *xrealloc(void *p, size_t size)
+{
+    void *rval = realloc(p, size);
+    if (!rval) {
+        fprintf(stderr, "realloc failed\n");
+        abort();
+    }
+    return rval;
+}
+
+static char *xstrdup(const char *s)
+{
+    char *rval = strdup(s);
+    if (!rval) {
+        fprintf(stderr, "strdup failed\n");
+        abort();
+    }
+    return rval;
+}
+
+static int cmp_name(const void *a, const void *b)
+{
+    return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+/* A name to add to the tree or to take out of it */
+struct change
+{
+    const char *name;
+    bool add;
+};
+
+struct changes
+{
+    struct change *items;
+    size_t count;
+    size_t cap;
+};
+
+static void change_push(struct changes *ch, const char *name, bool add)
+{
+    if (ch->count == ch->cap) {
+        ch->cap = ch->cap ? ch->cap * 2 : 64;
+        ch->items = (struct change *)xrealloc(ch->items, sizeof(struct change) * ch->cap);
+    }
+    ch->items[ch->count].name = name;
+    ch->items[ch->count].add = add;
+    ch->count++;
+}
+
+/* Taking the lock once per batch lets completion in between */
+static void changes_apply(struct complete *c, struct changes *ch)
+{
+    for (size_t i = 0; i < ch->count; i += COMPLETE_BATCH) {
+        size_t end = i + COMPLETE_BATCH < ch->count ? i + COMPLETE_BATCH : ch->count;
+        if (c->running)
+            pthread_mutex_lock(&c->lock);
+        for (size_t j = i; j < end; j++) {
+            if (ch->items[j].add)
+                cmdtrie_add(&c->trie, ch->items[j].name);
+            else
+                cmdtrie_remove(&c->trie, ch->items[j].name);
+        }
+        if (c->running)
+            pthread_mutex_unlock(&c->lock);
+    }
+    ch->count = 0;
+}
+
+static void names_free(char **names, size_t count)
+{
+    for (size_t i = 0; i < count; i++)
+        free(names[i]);
+    free(names);
+}
+
+/*
+ * The programs in a directory, sorted. The type in the entry skips
+ * directories without a stat, anything else has to be a regular file
+ * someone may execute.
+ */
+static char **read_programs(const char *dir, size_t *count)
+{
+    char **names = NULL;
+    size_t cap = 0;
+    *count = 0;
+    DIR *d = opendir(dir);
+    if (!d)
+        return NULL;
+    struct dirent *e;
+    while ((e = readdir(d))) {
+        struct stat st;
+        if (e->d_name[0] == '.' && (!e->d_name[1] || (e->d_name[1] == '.' && !e->d_name[2])))
+            continue;
+        if (e->d_type == DT_DIR)
+            continue;
+        if (fstatat(dirfd(d), e->d_name, &st, 0) < 0 || !S_ISREG(st.st_mode) ||
+            !(st.st_mode & 0111))
+            continue;
+        if (*count == cap) {
+            cap = cap ? cap * 2 : 64;
+            names = (char **)xrealloc(names, sizeof(char *) * cap);
+        }
+        names[(*count)++] = xstrdup(e->d_name);
+    }
+    closedir(d);
+    qsort(names, *count, sizeof(char *), cmp_name);
+    return names;
+}
+
+/*
+ * Read a directory again if its modification time changed and move the
+ * tree from what it held to what it holds now. A directory that is gone
+ * holds nothing.
+ */
+static void scan_dir(struct complete *c, struct complete_dir *d, struct changes *ch)
+{
+    struct stat st;
+    bool exists = stat(d->name, &st) == 0 && S_ISDIR(st.st_mode);
+    if (exists && d->scanned && st.st_mtim.tv_sec == d->mtime.tv_sec &&
+        st.st_mtim.tv_nsec == d->mtime.tv_nsec)
+        return;
+    if (!exists && !d->count)
+        return;
+
+    size_t count = 0;
+    char **names = exists ? read_programs(d->name, &count) : NULL;
+    size_t i = 0, j = 0;
+    while (i < d->count || j < count) {
+        int cmp = i == d->count ? 1 : j == count ? -1 : strcmp(d->names[i], names[j]);
+        if (cmp < 0)
+            change_push(ch, d->names[i++], false);
+        else if (cmp > 0)
+            change_push(ch, names[j++], true);
+        else
+            i++, j++;
+    }
+    changes_apply(c, ch);
+    names_free(d->names, d->count);
+    d->names = names;
+    d->count = count;
+    d->scanned = exists;
+    if (exists)
+        d->mtime = st.st_mtim;
+}
+
+static void dir_drop(struct complete *c, struct complete_dir *d, struct changes *ch)
+{
+    for (size_t i = 0; i < d->count; i++)
+        change_push(ch, d->names[i], false);
+    changes_apply(c, ch);
+    names_free(d->names, d->count);
+    free(d->name);
+}
+
+/*
+ * Split a new PATH into directories. Directories it shares with the old
+ * one keep what was read from them. Relative directories depend on where
+ * the shell is and are left out.
+ */
+static void set_path(struct complete *c, const char *path, struct changes *ch)
+{
+    struct complete_dir *dirs = NULL;
+    size_t ndirs = 0;
+    char *copy = xstrdup(path);
+    char *save = NULL;
+    for (char *tok = strtok_r(copy, ":", &save); tok; tok = strtok_r(NULL, ":", &save)) {
+        if (tok[0] != '/')
+            continue;
+        dirs = (struct complete_dir *)xrealloc(dirs, sizeof(struct complete_dir) * (ndirs + 1));
+        struct complete_dir *d = &dirs[ndirs++];
+        memset(d, 0, sizeof(*d));
+        for (size_t i = 0; i < c->ndirs; i++) {
+            if (c->dirs[i].name && strcmp(c->dirs[i].name, tok) == 0) {
+                *d = c->dirs[i];
+                c->dirs[i].name = NULL;
+                break;
+            }
+        }
+        if (!d->name)
+            d->name = xstrdup(tok);
+    }
+    free(copy);
+    for (size_t i = 0; i < c->ndirs; i++) {
+        if (c->dirs[i].name)
+            dir_drop(c, &c->dirs[i], ch);
+    }
+    free(c->dirs);
+    c->dirs = dirs;
+    c->ndirs = ndirs;
+    free(c->path);
+    c->path = xstrdup(path);
+}
+
+static void refresh(struct complete *c, const char *path)
+{
+    struct changes ch = {NULL, 0, 0};
+    if (!c->path || strcmp(c->path, path) != 0)
+        set_path(c, path, &ch);
+    for (size_t i = 0; i < c->ndirs; i++)
+        scan_dir(c, &c->dirs[i], &ch);
+    free(ch.items);
+}
+
+static void *complete_worker(void *arg)
+{
+    struct complete *c = (struct complete *)arg;
+    pthread_mutex_lock(&c->lock);
+    for (;;) {
+        while (!c->want_path && !c->stop)
+            pthread_cond_wait(&c->wake, &c->lock);
+        if (c->stop)
+            break;
+        char *path = c->want_path;
+        c->want_path = NULL;
+        c->busy = true;
+        pthread_mutex_unlock(&c->lock);
+        refresh(c, path);
+        free(path);
+        pthread_mutex_lock(&c->lock);
+        c->busy = false;
+        if (!c->want_path)
+            pthread_cond_broadcast(&c->idle);
+    }
+    pthread_mutex_unlock(&c->lock);
+    return NULL;
+}
+
+void complete_init(struct complete *c, const char *path)
+{
+    sigset_t all, old;
+    memset(c, 0, sizeof(*c));
+    cmdtrie_init(&c->trie);
+    dirsnap_init(&c->files);
+    pthread_mutex_init(&c->lock, NULL);
+    pthread_cond_init(&c->wake, NULL);
+    pthread_cond_init(&c->idle, NULL);
+    // Signals are for the shell, the worker starts with all of them blocked
+    sigfillset(&all);
+    pthread_sigmask(SIG_SETMASK, &all, &old);
+    c->running = pthread_create(&c->worker, NULL, complete_worker, c) == 0;
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+    complete_refresh(c, path);
+}
+
+void complete_destroy(struct complete *c)
+{
+    if (c->running) {
+        pthread_mutex_lock(&c->lock);
+        c->stop = true;
+        pthread_cond_signal(&c->wake);
+        pthread_mutex_unlock(&c->lock);
+        pthread_join(c->worker, NULL);
+        pthread_mutex_destroy(&c->lock);
+        pthread_cond_destroy(&c->wake);
+        pthread_cond_destroy(&c->idle);
+    }
+    for (size_t i = 0; i < c->ndirs; i++) {
+        names_free(c->dirs[i].names, c->dirs[i].count);
+        free(c->dirs[i].name);
+    }
+    free(c->dirs);
+    free(c->path);
+    free(c->want_path);
+    cmdtrie_destroy(&c->trie);
+    dirsnap_destroy(&c->files);
+    memset(c, 0, sizeof(*c));
+}
+
+void complete_forget(struct complete *c)
+{
+    memset(c, 0, sizeof(*c));
+}
+
+void complete_refresh(struct complete *c, const char *path)
+{
+    if (!c->running) {
+        if (c->trie.nodes)
+            refresh(c, path);
+        return;
+    }
+    pthread_mutex_lock(&c->lock);
+    free(c->want_path);
+    c->want_path = xstrdup(path);
+    pthread_cond_signal(&c->wake);
+    pthread_mutex_unlock(&c->lock);
+}
+
+void complete_wait(struct complete *c)
+{
+    if (!c->running)
+        return;
+    pthread_mutex_lock(&c->lock);
+    while (c->want_path || c->busy)
+        pthread_cond_wait(&c->idle, &c->lock);
+    pthread_mutex_unlock(&c->lock);
+}
+
+size_t complete_commands(struct complete *c, const char *prefix,
+                         void (*fn)(const char *name, void *ctx), void *ctx)
+{
+    if (!c->trie.nodes)
+        return 0;
+    if (c->running)
+        pthread_mutex_lock(&c->lock);
+    size_t n = cmdtrie_complete(&c->trie, prefix, fn, ctx);
+    if (c->running)
+        pthread_mutex_unlock(&c->lock);
+    return n;
+}
+
+size_t complete_files(struct complete *c, const char *word,
+                      void (*fn)(const char *match, void *ctx), void *ctx)
+{
+    char match[PATH_MAX];
+    const char *slash = strrchr(word, '/');
+    size_t dirlen = slash ? (size_t)(slash - word) + 1 : 0;
+    if (dirlen >= sizeof(match))
+        return 0;
+    memcpy(match, word, dirlen);
+    match[dirlen] = '\0';
+    if (dirsnap_load(&c->files, dirlen ? match : ".") < 0)
+        return 0;
+
+    const char *base = word + dirlen;
+    size_t n;
+    const uint32_t *entries = dirsnap_find(&c->files, base, &n);
+    size_t found = 0;
+    for (size_t k = 0; k < n; k++) {
+        uint32_t i = entries[k];
+        const char *name = dirsnap_name(&c->files, i);
+        if (name[0] == '.' && base[0] != '.')
+            continue;
+        int len = snprintf(match + dirlen, sizeof(match) - dirlen, "%s%s", name,
+                           dirsnap_is_dir(&c->files, i) ? "/" : "");
+        if (len < 0 || (size_t)len >= sizeof(match) - dirlen)
+            continue;
+        fn(match, ctx);
+        found++;
+    }
+    return found;
+}
+
+/* The matches of the word being completed, handed to readline one by one */
+static struct shell *complete_sh;
+static const char *mark_dirs;
+static char **matches;
+static size_t nmatches;
+static size_t matches_cap;
+static size_t next_match;
+
+static void add_match(const char *name, void *ctx)
+{
+    UNUSED(ctx);
+    if (nmatches == matches_cap) {
+        matches_cap = matches_cap ? matches_cap * 2 : 64;
+        matches = (char **)xrealloc(matches, sizeof(char *) * matches_cap);
+    }
+    matches[nmatches++] = xstrdup(name);
+}
+
+/* readline takes every match it was given, the rest are left over */
+static void matches_reset(void)
+{
+    while (next_match < nmatches)
+        free(matches[next_match++]);
+    nmatches = 0;
+    next_match = 0;
+}
+
+static char *command_match(const char *text, int state)
+{
+    if (!state) {
+        matches_reset();
+        size_t len = strlen(text);
+        for (size_t i = 0; builtin_name(i); i++) {
+            if (strncmp(builtin_name(i), text, len) == 0)
+                add_match(builtin_name(i), NULL);
+        }
+        complete_commands(&complete_sh->complete, text, add_match, NULL);
+    }
+    return next_match < nmatches ? matches[next_match++] : NULL;
+}
+
+static char *file_match(const char *text, int state)
+{
+    if (!state) {
+        matches_reset();
+        complete_files(&complete_sh->complete, text, add_match, NULL);
+    }
+    return next_match < nmatches ? matches[next_match++] : NULL;
+}
+
+/* The word starts a command if only blanks separate it from an operator */
+static bool command_position(int start)
+{
+    int i = start;
+    while (i > 0 && (rl_line_buffer[i - 1] == ' ' || rl_line_buffer[i - 1] == '\t'))
+        i--;
+    return i == 0 || strchr(";|&(`", rl_line_buffer[i - 1]);
+}
+
+static char **complete_attempt(const char *text, int start, int end)
+{
+    UNUSED(end);
+    if (text[0] == '~') {
+        rl_variable_bind("mark-directories", mark_dirs);
+        return NULL;
+    }
+    if (command_position(start) && !strchr(text, '/')) {
+        // The answer is what the tree holds now, a change shows up next time
+        const char *path = getenv("PATH");
+        complete_refresh(&complete_sh->complete, path ? path : "");
+        return rl_completion_matches(text, command_match);
+    }
+    // Directories already end in a slash, readline marking them would stat each
+    rl_variable_bind("mark-directories", "off");
+    rl_filename_completion_desired = 1;
+    rl_attempted_completion_over = 1;
+    return rl_completion_matches(text, file_match);
+}
+
+void complete_install(struct shell *sh)
+{
+    complete_sh = sh;
+    mark_dirs = rl_variable_value("mark-directories");
+    rl_attempted_completion_function = complete_attempt;
+}
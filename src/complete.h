@@ -0,0 +1,143 @@
+#ifndef COMPLETE_H
+#define COMPLETE_H
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <time.h>
+#include "cmdtrie.h"
+#include "dirsnap.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+  struct shell;
+
+  /**
+   * A directory of PATH and the programs it held when it was last read,
+   * sorted so the next read can be compared with it.
+   */
+  struct complete_dir
+  {
+    char *name;
+    struct timespec mtime;
+    bool scanned;
+    char **names;
+    size_t count;
+  };
+
+  /**
+   * The names of every program in PATH for command completion. A worker
+   * thread reads the directories of PATH into a prefix tree. Each refresh
+   * rereads only the directories whose modification time changed and
+   * applies the difference to the tree in small batches, so completion,
+   * which takes the lock to walk the tree, never waits long even while
+   * the first read of a large PATH is still going on. Completion answers
+   * from what the tree holds at the time.
+   */
+  struct complete
+  {
+    struct cmdtrie trie;   /* under lock */
+    pthread_t worker;
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    pthread_cond_t idle;
+    bool running;          /* the worker thread was started */
+    bool stop;
+    bool busy;             /* the worker is doing a refresh */
+    char *want_path;       /* PATH for the next refresh, NULL if none is due */
+
+    /* Only used by the worker */
+    char *path;
+    struct complete_dir *dirs;
+    size_t ndirs;
+
+    /* Only used by the shell, the directory of the last file completed */
+    struct dirsnap files;
+  };
+
+  /**
+   * @brief Start the worker and have it read path.
+   *
+   * @param c The completion state
+   * @param path The value of PATH
+   */
+  void complete_init(struct complete *c, const char *path);
+
+  /**
+   * @brief Stop the worker and free all memory held.
+   *
+   * @param c The completion state
+   */
+  void complete_destroy(struct complete *c);
+
+  /**
+   * @brief Drop the worker in a forked child, where the thread does not
+   * exist. Nothing is freed, the worker may have been changing it.
+   *
+   * @param c The completion state
+   */
+  void complete_forget(struct complete *c);
+
+  /**
+   * @brief Have the worker check PATH for changes. Returns right away,
+   * without a worker the check is done before returning.
+   *
+   * @param c The completion state
+   * @param path The value of PATH
+   */
+  void complete_refresh(struct complete *c, const char *path);
+
+  /**
+   * @brief Wait until the worker has done every refresh asked for.
+   *
+   * @param c The completion state
+   */
+  void complete_wait(struct complete *c);
+
+  /**
+   * @brief Call fn for every program name in PATH that starts with prefix,
+   * in byte order.
+   *
+   * @param c The completion state
+   * @param prefix The start of the names
+   * @param fn Called with each name, which is only valid during the call
+   * @param ctx Passed to fn
+   * @return The number of names found
+   */
+  size_t complete_commands(struct complete *c, const char *prefix,
+                           void (*fn)(const char *name, void *ctx), void *ctx);
+
+  /**
+   * @brief Call fn for every file a word can be completed to, in byte
+   * order. The word is a path whose last part is the start of a name in
+   * the directory before it. A directory found ends in a slash, names
+   * starting with a dot are only found if the word's last part does too.
+   * The directory is read only if it is not the one of the last call or
+   * has changed since, so pressing TAB again in a large directory costs
+   * a stat of it and a pass over the names held in memory.
+   *
+   * @param c The completion state
+   * @param word The word being completed
+   * @param fn Called with each completion, only valid during the call
+   * @param ctx Passed to fn
+   * @return The number of completions found
+   */
+  size_t complete_files(struct complete *c, const char *word,
+                        void (*fn)(const char *match, void *ctx), void *ctx);
+
+  /**
+   * @brief Have readline complete the first word of a command from the
+   * builtins and the programs in PATH, and other words, or words with a
+   * /, with complete_files. Words starting with ~ are left to readline.
+   *
+   * @param sh The shell
+   */
+  void complete_install(struct shell *sh);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif
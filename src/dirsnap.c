@@ -0,0 +1,184 @@
+#define _GNU_SOURCE
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include "dirsnap.h"
+
+/* Bytes of entries asked of the kernel per getdents64 */
+#define DIRSNAP_BUF (64 * 1024)
+
+/* What getdents64 fills the buffer with */
+struct linux_dirent64
+{
+    uint64_t d_ino;
+    int64_t d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[];
+};
+
+static void *xrealloc(void *p, size_t size)
+{
+    void *rval = realloc(p, size);
+    if (!rval) {
+        fprintf(stderr, "realloc failed\n");
+        abort();
+    }
+    return rval;
+}
+
+static char *xstrdup(const char *s)
+{
+    char *rval = strdup(s);
+    if (!rval) {
+        fprintf(stderr, "strdup failed\n");
+        abort();
+    }
+    return rval;
+}
+
+void dirsnap_init(struct dirsnap *s)
+{
+    memset(s, 0, sizeof(*s));
+}
+
+void dirsnap_destroy(struct dirsnap *s)
+{
+    free(s->dir);
+    free(s->names);
+    free(s->entries);
+    free(s->found);
+    memset(s, 0, sizeof(*s));
+}
+
+static void add_entry(struct dirsnap *s, const char *name, unsigned char type)
+{
+    size_t len = strlen(name) + 1;
+    if (s->names_len + len > s->names_cap) {
+        while (s->names_len + len > s->names_cap)
+            s->names_cap = s->names_cap ? s->names_cap * 2 : 4096;
+        s->names = (char *)xrealloc(s->names, s->names_cap);
+    }
+    if (s->count == s->cap) {
+        s->cap = s->cap ? s->cap * 2 : 64;
+        s->entries = (struct dirsnap_entry *)xrealloc(s->entries, sizeof(struct dirsnap_entry) * s->cap);
+    }
+    memcpy(s->names + s->names_len, name, len);
+    s->entries[s->count].name = (uint32_t)s->names_len;
+    s->entries[s->count].type = type;
+    s->count++;
+    s->names_len += len;
+}
+
+static int cmp_found(const void *a, const void *b, void *arg)
+{
+    const struct dirsnap *s = (const struct dirsnap *)arg;
+    return strcmp(dirsnap_name(s, *(const uint32_t *)a), dirsnap_name(s, *(const uint32_t *)b));
+}
+
+/* Every entry of the directory open on fd but . and .. */
+static int read_entries(struct dirsnap *s, int fd)
+{
+    static char buf[DIRSNAP_BUF];
+    for (;;) {
+        long n = syscall(SYS_getdents64, fd, buf, sizeof(buf));
+        if (n < 0)
+            return -1;
+        if (n == 0)
+            break;
+        for (long off = 0; off < n;) {
+            struct linux_dirent64 *e = (struct linux_dirent64 *)(buf + off);
+            off += e->d_reclen;
+            if (e->d_name[0] == '.' && (!e->d_name[1] || (e->d_name[1] == '.' && !e->d_name[2])))
+                continue;
+            // Offsets into the names are 32 bits, a directory past that is cut short
+            if (s->count == UINT32_MAX || s->names_len + strlen(e->d_name) + 1 > UINT32_MAX)
+                return 0;
+            add_entry(s, e->d_name, e->d_type);
+        }
+    }
+    return 0;
+}
+
+int dirsnap_load(struct dirsnap *s, const char *dir)
+{
+    struct stat st;
+    struct timespec start;
+    int fd = open(dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0 || fstat(fd, &st) < 0) {
+        int err = errno;
+        if (fd >= 0)
+            close(fd);
+        s->valid = false;
+        s->count = 0;
+        s->names_len = 0;
+        errno = err;
+        return -1;
+    }
+    if (!s->dir || strcmp(s->dir, dir) != 0) {
+        free(s->dir);
+        s->dir = xstrdup(dir);
+    }
+    if (s->valid && st.st_dev == s->dev && st.st_ino == s->ino &&
+        st.st_mtim.tv_sec == s->mtime.tv_sec && st.st_mtim.tv_nsec == s->mtime.tv_nsec) {
+        close(fd);
+        return 1;
+    }
+
+    clock_gettime(CLOCK_REALTIME, &start);
+    s->count = 0;
+    s->names_len = 0;
+    int rval = read_entries(s, fd);
+    int err = errno;
+    close(fd);
+    if (rval < 0) {
+        s->valid = false;
+        s->count = 0;
+        s->names_len = 0;
+        errno = err;
+        return -1;
+    }
+    s->dev = st.st_dev;
+    s->ino = st.st_ino;
+    s->mtime = st.st_mtim;
+    // Times in seconds can hide a change made in the second of the read
+    s->valid = st.st_mtim.tv_sec < start.tv_sec;
+    return 0;
+}
+
+const uint32_t *dirsnap_find(struct dirsnap *s, const char *prefix, size_t *count)
+{
+    size_t len = strlen(prefix);
+    *count = 0;
+    for (size_t i = 0; i < s->count; i++) {
+        const char *name = dirsnap_name(s, i);
+        if (len && (name[0] != prefix[0] || strncmp(name, prefix, len) != 0))
+            continue;
+        if (*count == s->found_cap) {
+            s->found_cap = s->found_cap ? s->found_cap * 2 : 64;
+            s->found = (uint32_t *)xrealloc(s->found, sizeof(uint32_t) * s->found_cap);
+        }
+        s->found[(*count)++] = (uint32_t)i;
+    }
+    qsort_r(s->found, *count, sizeof(uint32_t), cmp_found, s);
+    return s->found;
+}
+
+bool dirsnap_is_dir(struct dirsnap *s, size_t i)
+{
+    struct dirsnap_entry *e = &s->entries[i];
+    if (e->type == DT_LNK || e->type == DT_UNKNOWN) {
+        char path[PATH_MAX];
+        struct stat st;
+        snprintf(path, sizeof(path), "%s/%s", s->dir, dirsnap_name(s, i));
+        e->type = stat(path, &st) == 0 && S_ISDIR(st.st_mode) ? DT_DIR : DT_REG;
+    }
+    return e->type == DT_DIR;
+}
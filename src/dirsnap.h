@@ -0,0 +1,108 @@
+#ifndef DIRSNAP_H
+#define DIRSNAP_H
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <sys/types.h>
+#include <time.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+  /**
+   * An entry of a directory, its name at offset name in the names of the
+   * snapshot and its type as getdents64 gave it, one of the DT_ values.
+   */
+  struct dirsnap_entry
+  {
+    uint32_t name;
+    unsigned char type;
+  };
+
+  /**
+   * The names in a directory, read with getdents64 and without a stat of
+   * any entry. They are kept in the order the directory gave them: a
+   * search goes through all of them and sorts only what it found, which
+   * for a large directory is far less than sorting it once. A snapshot is
+   * tied to the directory it was read from by device, inode and
+   * modification time, and loading the same directory while those are
+   * unchanged keeps it as it is. A directory changed in the second it was
+   * read may change again without its modification time showing it, so
+   * such a snapshot is read again.
+   */
+  struct dirsnap
+  {
+    dev_t dev;
+    ino_t ino;
+    struct timespec mtime;
+    bool valid;     /* may be kept while the directory is unchanged */
+    char *dir;      /* the path it was last loaded from */
+    char *names;
+    size_t names_len;
+    size_t names_cap;
+    struct dirsnap_entry *entries;
+    size_t count;
+    size_t cap;
+    uint32_t *found;  /* entries found by the last search */
+    size_t found_cap;
+  };
+
+  /**
+   * @brief Initialize an empty snapshot.
+   *
+   * @param s The snapshot
+   */
+  void dirsnap_init(struct dirsnap *s);
+
+  /**
+   * @brief Free all memory held by the snapshot.
+   *
+   * @param s The snapshot
+   */
+  void dirsnap_destroy(struct dirsnap *s);
+
+  /**
+   * @brief Make the snapshot hold the entries of dir, reading it only if
+   * it is not the directory held or has changed since.
+   *
+   * @param s The snapshot
+   * @param dir The directory
+   * @return 1 if the snapshot was kept, 0 if dir was read, -1 with errno
+   * set if dir could not be read, which leaves the snapshot empty
+   */
+  int dirsnap_load(struct dirsnap *s, const char *dir);
+
+  /**
+   * @brief Find the entries whose names start with prefix. The entries .
+   * and .. are never found.
+   *
+   * @param s The snapshot
+   * @param prefix The start of the names
+   * @param count Set to the number of entries found
+   * @return The indexes of the entries found, in byte order of their
+   * names, valid until the next search or load
+   */
+  const uint32_t *dirsnap_find(struct dirsnap *s, const char *prefix, size_t *count);
+
+  /**
+   * @brief Check if an entry is a directory. Only an entry whose type
+   * getdents64 did not know, or a symbolic link, costs a stat, done once.
+   *
+   * @param s The snapshot
+   * @param i The index of the entry
+   * @return True if the entry is a directory or a link to one
+   */
+  bool dirsnap_is_dir(struct dirsnap *s, size_t i);
+
+  static inline const char *dirsnap_name(const struct dirsnap *s, size_t i)
+  {
+    return s->names + s->entries[i].name;
+  }
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif
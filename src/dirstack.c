@@ -0,0 +1,237 @@
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "dirstack.h"
+
+static void *xrealloc(void *p, size_t size)
+{
+    void *rval = realloc(p, size);
+    if (!rval) {
+        fprintf(stderr, "realloc failed\n");
+        abort();
+    }
+    return rval;
+}
+
+static char *xstrdup(const char *s)
+{
+    char *rval = strdup(s);
+    if (!rval) {
+        fprintf(stderr, "strdup failed\n");
+        abort();
+    }
+    return rval;
+}
+
+void dirstack_init(struct dirstack *d)
+{
+    memset(d, 0, sizeof(*d));
+}
+
+void dirstack_destroy(struct dirstack *d)
+{
+    dirstack_clear(d);
+    dirstack_entry_free(&d->old);
+    dirstack_entry_free(&d->cur);
+    free(d->items);
+    memset(d, 0, sizeof(*d));
+}
+
+int dirstack_here(struct dirstack *d, struct dirstack_entry *e)
+{
+    if (d->cur.path) {
+        *e = d->cur;
+        d->cur.path = NULL;
+        return 0;
+    }
+    e->path = NULL;
+    e->fd = open(".", O_PATH | O_DIRECTORY | O_CLOEXEC);
+    if (e->fd < 0)
+        return -1;
+    e->path = getcwd(NULL, 0);
+    if (!e->path) {
+        int err = errno;
+        close(e->fd);
+        errno = err;
+        return -1;
+    }
+    return 0;
+}
+
+void dirstack_keep(struct dirstack *d, struct dirstack_entry *here)
+{
+    dirstack_entry_free(&d->cur);
+    d->cur = *here;
+    here->path = NULL;
+}
+
+void dirstack_hold(struct dirstack *d, const char *path)
+{
+    dirstack_entry_free(&d->cur);
+    d->cur.fd = open(".", O_PATH | O_DIRECTORY | O_CLOEXEC);
+    if (d->cur.fd >= 0)
+        d->cur.path = xstrdup(path);
+}
+
+void dirstack_entry_free(struct dirstack_entry *e)
+{
+    if (!e->path)
+        return;
+    close(e->fd);
+    free(e->path);
+    e->path = NULL;
+}
+
+void dirstack_left(struct dirstack *d, struct dirstack_entry *here)
+{
+    dirstack_entry_free(&d->old);
+    d->old = *here;
+    here->path = NULL;
+}
+
+/* Remember here for cd - while it also stays on the stack */
+static void left_copy(struct dirstack *d, const struct dirstack_entry *here)
+{
+    struct dirstack_entry copy;
+    copy.fd = fcntl(here->fd, F_DUPFD_CLOEXEC, 0);
+    if (copy.fd < 0)
+        return;
+    copy.path = xstrdup(here->path);
+    dirstack_left(d, &copy);
+}
+
+/*
+ * Change to a held directory, which becomes cur. Where the shell was is in
+ * here, if it could be held, and taken back as cur if the change failed.
+ */
+static int enter(struct dirstack *d, struct dirstack_entry *to, struct dirstack_entry *here)
+{
+    if (fchdir(to->fd) < 0) {
+        int err = errno;
+        if (here->path)
+            dirstack_keep(d, here);
+        errno = err;
+        return -1;
+    }
+    d->cur = *to;
+    to->path = NULL;
+    return 0;
+}
+
+const char *dirstack_back(struct dirstack *d)
+{
+    struct dirstack_entry here;
+    if (!d->old.path) {
+        errno = ENOENT;
+        return NULL;
+    }
+    // A current directory that was removed can still be left, not come back to
+    if (dirstack_here(d, &here) < 0)
+        here.path = NULL;
+    if (enter(d, &d->old, &here) < 0)
+        return NULL;
+    if (here.path)
+        dirstack_left(d, &here);
+    return d->cur.path;
+}
+
+int dirstack_push(struct dirstack *d, const char *dir)
+{
+    struct dirstack_entry here;
+    if (dirstack_here(d, &here) < 0)
+        return -1;
+    if (chdir(dir) < 0) {
+        int err = errno;
+        dirstack_keep(d, &here);
+        errno = err;
+        return -1;
+    }
+    if (d->count == d->cap) {
+        d->cap = d->cap ? d->cap * 2 : 8;
+        d->items = (struct dirstack_entry *)xrealloc(d->items, sizeof(struct dirstack_entry) * d->cap);
+    }
+    d->items[d->count++] = here;
+    left_copy(d, &here);
+    return 0;
+}
+
+int dirstack_swap(struct dirstack *d)
+{
+    struct dirstack_entry here;
+    if (!d->count) {
+        errno = ENOENT;
+        return -1;
+    }
+    if (dirstack_here(d, &here) < 0)
+        return -1;
+    struct dirstack_entry *top = &d->items[d->count - 1];
+    if (enter(d, top, &here) < 0)
+        return -1;
+    *top = here;
+    left_copy(d, &here);
+    return 0;
+}
+
+int dirstack_rotate(struct dirstack *d, size_t n)
+{
+    struct dirstack_entry here;
+    if (n < 1 || n > d->count) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (dirstack_here(d, &here) < 0)
+        return -1;
+    if (enter(d, &d->items[d->count - n], &here) < 0)
+        return -1;
+    left_copy(d, &here);
+
+    // The whole list top first, turned so entry n leads, which is now cur
+    size_t len = d->count + 1;
+    struct dirstack_entry *list = (struct dirstack_entry *)xrealloc(NULL, sizeof(struct dirstack_entry) * len);
+    list[0] = here;
+    for (size_t i = 1; i < len; i++)
+        list[i] = d->items[d->count - i];
+    for (size_t i = 1; i < len; i++)
+        d->items[d->count - i] = list[(n + i) % len];
+    free(list);
+    return 0;
+}
+
+int dirstack_pop(struct dirstack *d, size_t n)
+{
+    if (!d->count) {
+        errno = ENOENT;
+        return -1;
+    }
+    if (n > d->count) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (n == 0) {
+        struct dirstack_entry here;
+        if (dirstack_here(d, &here) < 0)
+            here.path = NULL;
+        if (enter(d, &d->items[d->count - 1], &here) < 0)
+            return -1;
+        if (here.path)
+            dirstack_left(d, &here);
+        d->count--;
+        return 0;
+    }
+    size_t i = d->count - n;
+    dirstack_entry_free(&d->items[i]);
+    memmove(&d->items[i], &d->items[i + 1], sizeof(struct dirstack_entry) * (d->count - i - 1));
+    d->count--;
+    return 0;
+}
+
+void dirstack_clear(struct dirstack *d)
+{
+    for (size_t i = 0; i < d->count; i++)
+        dirstack_entry_free(&d->items[i]);
+    d->count = 0;
+}
@@ -0,0 +1,155 @@
+#ifndef DIRSTACK_H
+#define DIRSTACK_H
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+  /**
+   * A directory held open with O_PATH, so going back to it is an fchdir
+   * with no walk of its path, and the path it had when it was left, to
+   * show it. An entry with no path holds nothing.
+   */
+  struct dirstack_entry
+  {
+    int fd;
+    char *path;
+  };
+
+  /**
+   * The directories of pushd and popd, the last one on top, and the one
+   * cd - goes back to. The current directory is not on the stack, it is
+   * entry 0 of what dirs shows and entry n is items[count - n]. When the
+   * stack put the shell in the current directory it keeps holding it in
+   * cur, so going back and forth between held directories is nothing but
+   * an fchdir each time.
+   */
+  struct dirstack
+  {
+    struct dirstack_entry *items;
+    size_t count;
+    size_t cap;
+    struct dirstack_entry old;
+    struct dirstack_entry cur;
+  };
+
+  /**
+   * @brief Initialize an empty stack.
+   *
+   * @param d The stack
+   */
+  void dirstack_init(struct dirstack *d);
+
+  /**
+   * @brief Close every directory held and free all memory.
+   *
+   * @param d The stack
+   */
+  void dirstack_destroy(struct dirstack *d);
+
+  /**
+   * @brief Hold the current directory, taking it from the stack if the
+   * stack put the shell there. Hand it to dirstack_left once the shell
+   * left it or back with dirstack_keep if it did not.
+   *
+   * @param d The stack
+   * @param e Set to the current directory
+   * @return 0 on success, -1 with errno set if it can not be opened
+   */
+  int dirstack_here(struct dirstack *d, struct dirstack_entry *e);
+
+  /**
+   * @brief Hand back what dirstack_here gave when the shell stayed in the
+   * directory after all.
+   *
+   * @param d The stack
+   * @param here The current directory, taken over by the stack
+   */
+  void dirstack_keep(struct dirstack *d, struct dirstack_entry *here);
+
+  /**
+   * @brief Hold the current directory as cur after the shell changed to
+   * it some other way, so nothing has to ask for its path later.
+   *
+   * @param d The stack
+   * @param path The path of the current directory
+   */
+  void dirstack_hold(struct dirstack *d, const char *path);
+
+  /**
+   * @brief Close the directory of an entry and free its path.
+   *
+   * @param e The entry
+   */
+  void dirstack_entry_free(struct dirstack_entry *e);
+
+  /**
+   * @brief Record that the shell left here for another directory, the
+   * one cd - goes back to.
+   *
+   * @param d The stack
+   * @param here The directory left, taken over by the stack
+   */
+  void dirstack_left(struct dirstack *d, struct dirstack_entry *here);
+
+  /**
+   * @brief Go back to the directory last left, cd -.
+   *
+   * @param d The stack
+   * @return The path of the directory now current, valid until the stack
+   * changes, NULL with errno set if there is none or it can not be entered
+   */
+  const char *dirstack_back(struct dirstack *d);
+
+  /**
+   * @brief Put the current directory on the stack and change to dir.
+   *
+   * @param d The stack
+   * @param dir The directory to change to
+   * @return 0 on success, -1 with errno set
+   */
+  int dirstack_push(struct dirstack *d, const char *dir);
+
+  /**
+   * @brief Change to the top of the stack and put the current directory
+   * there in its place.
+   *
+   * @param d The stack
+   * @return 0 on success, -1 with errno set
+   */
+  int dirstack_swap(struct dirstack *d);
+
+  /**
+   * @brief Turn the list of the current directory and the stack so entry
+   * n comes first and change to it.
+   *
+   * @param d The stack
+   * @param n The entry, 1 to count
+   * @return 0 on success, -1 with errno set
+   */
+  int dirstack_rotate(struct dirstack *d, size_t n);
+
+  /**
+   * @brief Take entry n off the stack. Entry 0 is the current directory,
+   * the shell changes to entry 1 in its place.
+   *
+   * @param d The stack
+   * @param n The entry, 0 to count
+   * @return 0 on success, -1 with errno set
+   */
+  int dirstack_pop(struct dirstack *d, size_t n);
+
+  /**
+   * @brief Close every directory on the stack.
+   *
+   * @param d The stack
+   */
+  void dirstack_clear(struct dirstack *d);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif
@@ -0,0 +1,662 @@
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include "exec.h"
+#include "spawn.h"
+#include "jobs.h"
+#include "builtins.h"
+
+/*
+ * Open the target of every redirection in the shell. The fds are opened
+ * close on exec and above the range a user can name so they never collide
+ * with the fds they are about to replace. On success map holds one entry per
+ * redirection in the order they were written and the caller must close the
+ * sources. Returns -1 if a file could not be opened.
+ */
+static int open_redirs(struct ast_redir *r, struct spawn_fd *map, size_t *n)
+{
+    *n = 0;
+    for (; r; r = r->next)
+    {
+        int flags = O_RDONLY | O_CLOEXEC;
+        if (r->type == REDIR_OUT)
+            flags = O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC;
+        else if (r->type == REDIR_APPEND)
+            flags = O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC;
+        int fd = open(r->target, flags, 0666);
+        if (fd >= 0 && fd < 10)
+        {
+            int high = fcntl(fd, F_DUPFD_CLOEXEC, 10);
+            close(fd);
+            fd = high;
+        }
+        if (fd < 0)
+        {
+            perror(r->target);
+            while (*n > 0)
+                close(map[--*n].source);
+            return -1;
+        }
+        map[*n].target = r->fd;
+        map[*n].source = fd;
+        (*n)++;
+    }
+    return 0;
+}
+
+static size_t count_redirs(struct ast_redir *r)
+{
+    size_t n = 0;
+    for (; r; r = r->next)
+        n++;
+    return n;
+}
+
+/*
+ * Builtins run inside the shell so any redirections have to be undone once
+ * they finish. The fds being replaced are saved and put back in reverse
+ * order.
+ */
+static void run_in_shell(struct shell *sh, struct ast_cmd *cmd)
+{
+    size_t count = count_redirs(cmd->redirs);
+    struct spawn_fd *map = (struct spawn_fd *)arena_alloc(&sh->arena, sizeof(struct spawn_fd) * (count + 1));
+    int *saved = (int *)arena_alloc(&sh->arena, sizeof(int) * (count + 1));
+    size_t n;
+
+    if (open_redirs(cmd->redirs, map, &n) < 0)
+    {
+        sh->status = EXIT_FAILURE;
+        return;
+    }
+    // Output still buffered from before must not follow the redirections
+    fflush(stdout);
+    fflush(stderr);
+    for (size_t i = 0; i < n; i++)
+    {
+        saved[i] = fcntl(map[i].target, F_DUPFD_CLOEXEC, 10);
+        dup2(map[i].source, map[i].target);
+        close(map[i].source);
+    }
+
+    if (cmd->argc)
+        do_builtin(sh, cmd->argv);
+    else
+        sh->status = 0;
+    fflush(stdout);
+    fflush(stderr);
+
+    while (n-- > 0)
+    {
+        if (saved[n] < 0)
+        {
+            close(map[n].target);
+        }
+        else
+        {
+            dup2(saved[n], map[n].target);
+            close(saved[n]);
+        }
+    }
+}
+
+int *pipestatus_reserve(struct shell *sh, size_t n)
+{
+    if (n > sh->pipestatus_cap)
+    {
+        size_t cap = sh->pipestatus_cap ? sh->pipestatus_cap : 8;
+        while (cap < n)
+            cap *= 2;
+        int *p = (int *)realloc(sh->pipestatus, sizeof(int) * cap);
+        if (!p)
+        {
+            fprintf(stderr, "realloc failed\n");
+            abort();
+        }
+        sh->pipestatus = p;
+        sh->pipestatus_cap = cap;
+    }
+    sh->pipestatus_len = n;
+    return sh->pipestatus;
+}
+
+struct stage
+{
+    struct shell *sh;
+    struct ast_cmd *cmd;
+};
+
+/*
+ * Drop what belongs to the shell in a forked copy of it: the jobs, the
+ * pending history entry, the directory visits, which only the shell
+ * saves, and the worker threads, which do not exist in the child. The copy
+ * does no job control.
+ */
+static void forget_parent(struct shell *sh)
+{
+    jobs_forget(sh);
+    histlog_forget(&sh->hist);
+    prompt_forget(&sh->prompt_fmt);
+    complete_forget(&sh->complete);
+    jump_forget(&sh->jump);
+    sh->shell_is_interactive = 0;
+}
+
+/*
+ * Builtins that are part of a pipeline run in a forked child like any other
+ * stage so they can read and write the pipe concurrently.
+ */
+static int stage_in_child(void *ctx)
+{
+    struct stage *st = (struct stage *)ctx;
+    forget_parent(st->sh);
+    if (!st->cmd->argc)
+        return 0;
+    do_builtin(st->sh, st->cmd->argv);
+    return st->sh->status;
+}
+
+/*
+ * Launch one stage of a pipeline with in and out as its stdin and stdout, -1
+ * to inherit them from the shell. Redirections written on the command are
+ * applied after the pipe so they take precedence. The first stage to launch
+ * leads the process group and gets the terminal, a pgid of -1 leaves the
+ * stage in the group of the shell. Returns the pid or -1 with
+ * the exit status of the stage in *status if nothing was launched.
+ * Background stages never get the terminal.
+ */
+static pid_t launch_stage(struct shell *sh, struct ast_cmd *cmd, int in, int out,
+                          pid_t pgid, bool bg, int *status)
+{
+    size_t count = count_redirs(cmd->redirs);
+    struct spawn_fd *map = (struct spawn_fd *)arena_alloc(&sh->arena, sizeof(struct spawn_fd) * (count + 2));
+    size_t n = 0;
+    size_t nredir;
+    if (in >= 0)
+    {
+        map[n].target = STDIN_FILENO;
+        map[n++].source = in;
+    }
+    if (out >= 0)
+    {
+        map[n].target = STDOUT_FILENO;
+        map[n++].source = out;
+    }
+    if (open_redirs(cmd->redirs, map + n, &nredir) < 0)
+    {
+        *status = EXIT_FAILURE;
+        return -1;
+    }
+
+    struct stage st = {sh, cmd};
+    struct spawn_req req;
+    req.argv = cmd->argv;
+    req.fds = map;
+    req.nfds = n + nredir;
+    req.pgid = pgid;
+    req.terminal = !pgid && !bg && sh->shell_is_interactive ? sh->shell_terminal : -1;
+    req.fn = NULL;
+    req.ctx = NULL;
+    if (!cmd->argc || is_builtin(cmd->argv[0]))
+    {
+        req.path = cmd->argc ? cmd->argv[0] : "";
+        req.fn = stage_in_child;
+        req.ctx = &st;
+    }
+    else
+    {
+        // Programs found through the command hash are launched without a PATH walk
+        req.path = cmd->argv[0];
+        if (!strchr(req.path, '/'))
+            req.path = cmdhash_lookup(&sh->cmdhash, req.path);
+        if (!req.path)
+        {
+            while (nredir > 0)
+                close(map[n + --nredir].source);
+            fprintf(stderr, "%s: command not found\n", cmd->argv[0]);
+            *status = 127;
+            return -1;
+        }
+    }
+
+    pid_t pid = spawn_cmd(sh->spawn_mode, &req);
+    int err = errno;
+    while (nredir > 0)
+        close(map[n + --nredir].source);
+    if (pid < 0)
+    {
+        fprintf(stderr, "%s: %s\n", cmd->argv[0], strerror(err));
+        *status = err == ENOENT ? 127 : 126;
+    }
+    return pid;
+}
+
+/*
+ * Start every stage of the pipeline before waiting on any of them. Each
+ * pipe is created close on exec so a stage only holds the two ends the
+ * spawn engine installs as its stdin and stdout, and the shell closes its
+ * copies as soon as the stages on both sides are running. All stages share
+ * one process group and become one job. Without job control they stay in
+ * the group of the shell, so a signal from the terminal reaches them along
+ * with the shell and nothing stops on a read. A foreground job is waited for
+ * until it finishes or stops, a background job goes straight to the job
+ * table.
+ */
+static void run_stages(struct shell *sh, struct ast_pipeline *pl)
+{
+    bool bg = pl->op == AST_BG;
+    struct job *j = job_new(pl);
+    bool launched = false;
+    int in = -1;
+    size_t i = 0;
+
+    for (struct ast_cmd *cmd = pl->cmds; cmd; cmd = cmd->next, i++)
+    {
+        struct job_proc *p = &j->procs[i];
+        int fds[2] = {-1, -1};
+        if (cmd->next && pipe2(fds, O_CLOEXEC) < 0)
+        {
+            perror("pipe");
+            break;
+        }
+        pid_t pgid = sh->shell_is_interactive ? j->pgid : -1;
+        p->pid = launch_stage(sh, cmd, in, fds[1], pgid, bg, &p->status);
+        if (p->pid > 0)
+        {
+            p->done = false;
+            launched = true;
+            if (!j->pgid && sh->shell_is_interactive)
+                j->pgid = p->pid;
+        }
+        if (in >= 0)
+            close(in);
+        if (fds[1] >= 0)
+            close(fds[1]);
+        in = fds[0];
+    }
+    if (in >= 0)
+        close(in);
+
+    if (bg && launched)
+        job_background(sh, j, false);
+    else
+        job_foreground(sh, j, false);
+}
+
+/*
+ * Builtins that only print and read the state of the shell. A command
+ * substitution made of these can run in the shell itself, it can not
+ * change anything a subshell would have kept to itself.
+ */
+static bool subst_builtin(const char *name)
+{
+    builtin_fn fn = builtin_lookup(name);
+    return fn == builtin_true || fn == builtin_false || fn == builtin_echo ||
+           fn == builtin_printf || fn == builtin_pwd || fn == builtin_test;
+}
+
+static bool subst_in_shell(struct ast_pipeline *list)
+{
+    for (; list; list = list->next)
+    {
+        struct ast_cmd *cmd = list->cmds;
+        if (list->count != 1 || list->op == AST_BG || cmd->redirs || !subst_builtin(cmd->argv[0]))
+            return false;
+    }
+    return true;
+}
+
+/* $(<file) is replaced by the contents of the file */
+static bool subst_is_file(struct ast_pipeline *list)
+{
+    struct ast_cmd *cmd = list->cmds;
+    return !list->next && list->count == 1 && !cmd->argc && !cmd->redirs->next &&
+           cmd->redirs->type == REDIR_IN && cmd->redirs->fd == STDIN_FILENO;
+}
+
+static void read_all(int fd, struct writer *w)
+{
+    char buf[4096];
+    for (;;)
+    {
+        ssize_t n = read(fd, buf, sizeof(buf));
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            break;
+        writer_put(w, buf, (size_t)n);
+    }
+}
+
+static char *expand_string(struct shell *sh, struct ast_part *parts);
+
+struct subshell
+{
+    struct shell *sh;
+    struct ast_pipeline *list;
+};
+
+static int subshell_in_child(void *ctx)
+{
+    struct subshell *ss = (struct subshell *)ctx;
+    struct shell *sh = ss->sh;
+    // A subshell does no job control and writes to the pipe even if the
+    // parent is capturing. Its children must be its own, the zygote would
+    // make them children of the parent shell.
+    forget_parent(sh);
+    writer_destroy(&sh->out);
+    writer_init(&sh->out, STDOUT_FILENO);
+    if (sh->spawn_mode == SPAWN_ZYGOTE)
+        sh->spawn_mode = spawn_default_mode();
+    exec_list(sh, ss->list);
+    return sh->status;
+}
+
+/*
+ * Run the commands of a substitution and append their output to w. When
+ * every command is a builtin from subst_builtin they run in the shell with
+ * sh->out capturing into w, and $(<file) reads the file, so neither forks.
+ * Anything else runs in a forked copy of the shell with its stdout on a
+ * pipe. sh->status is left at the status of the commands.
+ */
+static void command_subst(struct shell *sh, struct ast_pipeline *list, struct writer *w)
+{
+    if (!list)
+    {
+        sh->status = 0;
+        return;
+    }
+    if (subst_is_file(list))
+    {
+        struct ast_redir *r = list->cmds->redirs;
+        char *path = r->target_parts ? expand_string(sh, r->target_parts) : r->target;
+        int fd = open(path, O_RDONLY | O_CLOEXEC);
+        if (fd < 0)
+        {
+            fprintf(stderr, "%s: %s\n", path, strerror(errno));
+            sh->status = EXIT_FAILURE;
+            return;
+        }
+        read_all(fd, w);
+        close(fd);
+        sh->status = 0;
+        return;
+    }
+    if (subst_in_shell(list))
+    {
+        struct writer saved = sh->out;
+        sh->out = *w;
+        exec_list(sh, list);
+        *w = sh->out;
+        sh->out = saved;
+        return;
+    }
+
+    int fds[2];
+    if (pipe2(fds, O_CLOEXEC) < 0)
+    {
+        perror("pipe");
+        sh->status = EXIT_FAILURE;
+        return;
+    }
+    struct subshell ss = {sh, list};
+    struct spawn_fd map = {STDOUT_FILENO, fds[1]};
+    char *argv[] = {NULL};
+    struct spawn_req req = {"", argv, &map, 1, -1, -1, subshell_in_child, &ss};
+    pid_t pid = spawn_cmd(SPAWN_FORK, &req);
+    close(fds[1]);
+    if (pid > 0)
+        read_all(fds[0], w);
+    close(fds[0]);
+    if (pid < 0)
+    {
+        perror("fork");
+        sh->status = EXIT_FAILURE;
+        return;
+    }
+    int status;
+    while (waitpid(pid, &status, 0) < 0)
+    {
+        if (errno != EINTR)
+        {
+            perror("waitpid");
+            status = W_EXITCODE(EXIT_FAILURE, 0);
+            break;
+        }
+    }
+    sh->status = job_exit_status(status);
+}
+
+struct field
+{
+    char *text;
+    struct field *next;
+};
+
+/*
+ * The fields words expand to. The field being built is kept in cur, have is
+ * set once it exists, even if it is still empty.
+ */
+struct fields
+{
+    struct shell *sh;
+    struct field *head;
+    struct field **tail;
+    size_t count;
+    struct writer cur;
+    bool have;
+};
+
+static void fields_init(struct shell *sh, struct fields *f)
+{
+    f->sh = sh;
+    f->head = NULL;
+    f->tail = &f->head;
+    f->count = 0;
+    writer_init(&f->cur, -1);
+    f->have = false;
+}
+
+static void field_end(struct fields *f)
+{
+    if (f->have)
+    {
+        struct field *fl = (struct field *)arena_alloc(&f->sh->arena, sizeof(struct field));
+        fl->text = arena_strndup(&f->sh->arena, f->cur.buf ? f->cur.buf : "", f->cur.len);
+        fl->next = NULL;
+        *f->tail = fl;
+        f->tail = &fl->next;
+        f->count++;
+    }
+    f->cur.len = 0;
+    f->have = false;
+}
+
+/*
+ * Append the expansion of a word to the current field. Trailing newlines
+ * are removed from the output of a substitution and, unless it was quoted
+ * or split is false, the output is split into fields at blanks and
+ * newlines. The split is done in place, a field always ends before the
+ * output that is still to be read.
+ */
+static void expand_parts(struct fields *f, struct ast_part *part, bool split)
+{
+    for (; part; part = part->next)
+    {
+        if (part->text)
+        {
+            writer_puts(&f->cur, part->text);
+            f->have = true;
+            continue;
+        }
+        size_t start = f->cur.len;
+        command_subst(f->sh, part->subst, &f->cur);
+        size_t end = f->cur.len;
+        while (end > start && f->cur.buf[end - 1] == '\n')
+            end--;
+        f->cur.len = end;
+        if (part->quoted || !split)
+        {
+            f->have = f->have || part->quoted || end > start;
+            continue;
+        }
+        size_t len = start;
+        for (size_t i = start; i < end; i++)
+        {
+            char c = f->cur.buf[i];
+            if (c == ' ' || c == '\t' || c == '\n')
+            {
+                f->cur.len = len;
+                field_end(f);
+                len = 0;
+            }
+            else
+            {
+                f->cur.buf[len++] = c;
+                f->have = true;
+            }
+        }
+        f->cur.len = len;
+    }
+}
+
+static char *expand_string(struct shell *sh, struct ast_part *parts)
+{
+    struct fields f;
+    fields_init(sh, &f);
+    expand_parts(&f, parts, false);
+    f.have = true;
+    field_end(&f);
+    writer_destroy(&f.cur);
+    return f.head->text;
+}
+
+static bool has_subst(struct ast_cmd *cmd)
+{
+    if (cmd->parts)
+        return true;
+    for (struct ast_redir *r = cmd->redirs; r; r = r->next)
+    {
+        if (r->target_parts)
+            return true;
+    }
+    return false;
+}
+
+/*
+ * Copy a command with every substitution in its words and redirections
+ * replaced, left to right, by the output of its commands.
+ */
+static struct ast_cmd *expand_cmd(struct shell *sh, struct ast_cmd *cmd)
+{
+    struct ast_cmd *copy = (struct ast_cmd *)arena_alloc(&sh->arena, sizeof(struct ast_cmd));
+    struct fields f;
+
+    *copy = *cmd;
+    copy->parts = NULL;
+    fields_init(sh, &f);
+    for (size_t i = 0; i < cmd->argc; i++)
+    {
+        if (cmd->parts && cmd->parts[i])
+        {
+            expand_parts(&f, cmd->parts[i], true);
+        }
+        else
+        {
+            writer_puts(&f.cur, cmd->argv[i]);
+            f.have = true;
+        }
+        field_end(&f);
+    }
+    writer_destroy(&f.cur);
+    copy->argc = f.count;
+    copy->argv = (char **)arena_alloc(&sh->arena, sizeof(char *) * (f.count + 1));
+    size_t i = 0;
+    for (struct field *fl = f.head; fl; fl = fl->next)
+        copy->argv[i++] = fl->text;
+    copy->argv[i] = NULL;
+
+    struct ast_redir **tail = &copy->redirs;
+    for (struct ast_redir *r = cmd->redirs; r; r = r->next)
+    {
+        struct ast_redir *rc = (struct ast_redir *)arena_alloc(&sh->arena, sizeof(struct ast_redir));
+        *rc = *r;
+        if (r->target_parts)
+        {
+            rc->target = expand_string(sh, r->target_parts);
+            rc->target_parts = NULL;
+        }
+        *tail = rc;
+        tail = &rc->next;
+    }
+    return copy;
+}
+
+static struct ast_pipeline *expand_pipeline(struct shell *sh, struct ast_pipeline *pl)
+{
+    bool subst = false;
+    for (struct ast_cmd *cmd = pl->cmds; cmd && !subst; cmd = cmd->next)
+        subst = has_subst(cmd);
+    if (!subst)
+        return pl;
+
+    struct ast_pipeline *copy = (struct ast_pipeline *)arena_alloc(&sh->arena, sizeof(struct ast_pipeline));
+    *copy = *pl;
+    struct ast_cmd **tail = &copy->cmds;
+    for (struct ast_cmd *cmd = pl->cmds; cmd; cmd = cmd->next)
+    {
+        struct ast_cmd *c;
+        if (has_subst(cmd))
+        {
+            c = expand_cmd(sh, cmd);
+        }
+        else
+        {
+            c = (struct ast_cmd *)arena_alloc(&sh->arena, sizeof(struct ast_cmd));
+            *c = *cmd;
+        }
+        *tail = c;
+        tail = &c->next;
+    }
+    *tail = NULL;
+    return copy;
+}
+
+static void run_pipeline(struct shell *sh, struct ast_pipeline *pl)
+{
+    struct ast_pipeline *expanded = expand_pipeline(sh, pl);
+    struct ast_cmd *cmd = expanded->cmds;
+    if (expanded->count == 1 && pl->op != AST_BG && (!cmd->argc || is_builtin(cmd->argv[0])))
+    {
+        // With no words left the command has the status of its substitutions
+        int status = sh->status;
+        run_in_shell(sh, cmd);
+        if (!cmd->argc && pl->cmds->argc && sh->status == 0)
+            sh->status = status;
+        pipestatus_reserve(sh, 1)[0] = sh->status;
+    }
+    else
+    {
+        run_stages(sh, expanded);
+    }
+}
+
+void exec_list(struct shell *sh, struct ast_pipeline *pl)
+{
+    enum ast_op prev = AST_SEQ;
+    cmdhash_tick(&sh->cmdhash);
+    for (; pl; pl = pl->next)
+    {
+        if ((prev != AST_AND || sh->status == 0) &&
+            (prev != AST_OR || sh->status != 0))
+        {
+            run_pipeline(sh, pl);
+        }
+        prev = pl->op;
+    }
+}
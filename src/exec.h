@@ -0,0 +1,37 @@
+#ifndef EXEC_H
+#define EXEC_H
+#include "lab.h"
+#include "parse.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+  /**
+   * @brief Run every pipeline of a parsed line. && and || skip the next
+   * pipeline based on the status of the last one that ran. Builtins run
+   * inside the shell, everything else is launched with the spawn engine
+   * selected in sh->spawn_mode. The exit status of the last pipeline is left
+   * in sh->status. Scratch memory comes from sh->arena.
+   *
+   * @param sh The shell
+   * @param list The first pipeline of the line
+   */
+  void exec_list(struct shell *sh, struct ast_pipeline *list);
+
+  /**
+   * @brief Make room for the exit status of n pipeline stages in
+   * sh->pipestatus and set its length to n.
+   *
+   * @param sh The shell
+   * @param n The number of stages
+   * @return sh->pipestatus
+   */
+  int *pipestatus_reserve(struct shell *sh, size_t n);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif
@@ -0,0 +1,230 @@
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "histindex.h"
+
+#define HISTINDEX_MIN_CAP 1024
+/* Trigrams of a pattern intersected at most, the check of each candidate
+ * against the whole pattern covers the rest */
+#define HISTINDEX_MAX_LISTS 16
+
+static void *xrealloc(void *p, size_t size)
+{
+    void *rval = realloc(p, size);
+    if (!rval) {
+        fprintf(stderr, "realloc failed\n");
+        abort();
+    }
+    return rval;
+}
+
+static void *xcalloc(size_t n, size_t size)
+{
+    void *rval = calloc(n, size);
+    if (!rval) {
+        fprintf(stderr, "calloc failed\n");
+        abort();
+    }
+    return rval;
+}
+
+static uint32_t trigram(const char *s)
+{
+    return (uint32_t)tolower((unsigned char)s[0]) << 16 |
+           (uint32_t)tolower((unsigned char)s[1]) << 8 |
+           (uint32_t)tolower((unsigned char)s[2]);
+}
+
+static size_t slot_hash(uint32_t key)
+{
+    uint32_t h = key * 2654435761u;
+    return h ^ (h >> 15);
+}
+
+void histindex_init(struct histindex *ix)
+{
+    ix->slots = NULL;
+    ix->cap = 0;
+    ix->count = 0;
+    ix->indexed = 0;
+    ix->built = false;
+}
+
+void histindex_destroy(struct histindex *ix)
+{
+    for (size_t i = 0; i < ix->cap; i++)
+        free(ix->slots[i].ids);
+    free(ix->slots);
+    histindex_init(ix);
+}
+
+static struct histindex_list *find(const struct histindex *ix, uint32_t key)
+{
+    if (!ix->cap)
+        return NULL;
+    for (size_t i = slot_hash(key) & (ix->cap - 1);; i = (i + 1) & (ix->cap - 1)) {
+        if (ix->slots[i].key == key)
+            return &ix->slots[i];
+        if (!ix->slots[i].key)
+            return NULL;
+    }
+}
+
+static void grow(struct histindex *ix)
+{
+    struct histindex_list *old = ix->slots;
+    size_t old_cap = ix->cap;
+    ix->cap = ix->cap ? ix->cap * 2 : HISTINDEX_MIN_CAP;
+    ix->slots = (struct histindex_list *)xcalloc(ix->cap, sizeof(struct histindex_list));
+    for (size_t i = 0; i < old_cap; i++) {
+        if (!old[i].key)
+            continue;
+        size_t j = slot_hash(old[i].key) & (ix->cap - 1);
+        while (ix->slots[j].key)
+            j = (j + 1) & (ix->cap - 1);
+        ix->slots[j] = old[i];
+    }
+    free(old);
+}
+
+static struct histindex_list *insert(struct histindex *ix, uint32_t key)
+{
+    struct histindex_list *l = find(ix, key);
+    if (l)
+        return l;
+    if ((ix->count + 1) * 2 > ix->cap)
+        grow(ix);
+    size_t i = slot_hash(key) & (ix->cap - 1);
+    while (ix->slots[i].key)
+        i = (i + 1) & (ix->cap - 1);
+    ix->slots[i].key = key;
+    ix->count++;
+    return &ix->slots[i];
+}
+
+static void add_entry(struct histindex *ix, uint32_t id, const char *text, size_t len)
+{
+    for (size_t i = 0; i + 3 <= len; i++) {
+        struct histindex_list *l = insert(ix, trigram(text + i));
+        // A trigram seen earlier in the same entry is already listed
+        if (l->count && l->ids[l->count - 1] == id)
+            continue;
+        if (l->count == l->cap) {
+            l->cap = l->cap ? l->cap * 2 : 4;
+            l->ids = (uint32_t *)xrealloc(l->ids, sizeof(uint32_t) * l->cap);
+        }
+        l->ids[l->count++] = id;
+    }
+}
+
+void histindex_update(struct histindex *ix, const struct histlog *h)
+{
+    if (!ix->built)
+        return;
+    for (; ix->indexed < h->count; ix->indexed++) {
+        const struct histlog_rec *rec = histlog_get(h, ix->indexed);
+        add_entry(ix, (uint32_t)ix->indexed, histlog_text(rec), rec->len);
+    }
+}
+
+/* The first position in ids[0, n) holding an id not below id */
+static size_t lower_bound(const uint32_t *ids, size_t n, size_t id)
+{
+    size_t lo = 0;
+    while (lo < n) {
+        size_t mid = lo + (n - lo) / 2;
+        if (ids[mid] < id)
+            lo = mid + 1;
+        else
+            n = mid;
+    }
+    return lo;
+}
+
+/*
+ * lower_bound on ids[0, hi) for an id expected close to hi. The window
+ * doubles down from hi until it starts below id, so the cost grows with
+ * the log of the distance moved rather than of the list length.
+ */
+static size_t gallop(const uint32_t *ids, size_t hi, size_t id)
+{
+    size_t step = 1;
+    while (hi >= step && ids[hi - step] >= id) {
+        hi -= step;
+        step *= 2;
+    }
+    size_t lo = hi >= step ? hi - step : 0;
+    return lo + lower_bound(ids + lo, hi - lo, id);
+}
+
+static long scan(const struct histlog *h, const char *pattern, size_t before)
+{
+    while (before-- > 0) {
+        if (strstr(histlog_text(histlog_get(h, before)), pattern))
+            return (long)before;
+    }
+    return -1;
+}
+
+long histindex_search(struct histindex *ix, const struct histlog *h,
+                      const char *pattern, size_t before)
+{
+    size_t len = strlen(pattern);
+    if (before > h->count)
+        before = h->count;
+    if (len < 3)
+        return scan(h, pattern, before);
+    ix->built = true;
+    histindex_update(ix, h);
+
+    const struct histindex_list *lists[HISTINDEX_MAX_LISTS];
+    size_t hi[HISTINDEX_MAX_LISTS];
+    size_t n = 0;
+    for (size_t i = 0; i + 3 <= len && n < HISTINDEX_MAX_LISTS; i++) {
+        const struct histindex_list *l = find(ix, trigram(pattern + i));
+        if (!l)
+            return -1;
+        bool seen = false;
+        for (size_t k = 0; k < n && !seen; k++)
+            seen = lists[k] == l;
+        if (seen)
+            continue;
+        // Shortest first, the candidates come from the first list and the
+        // next shortest rule them out soonest
+        size_t k = n++;
+        for (; k > 0 && lists[k - 1]->count > l->count; k--)
+            lists[k] = lists[k - 1];
+        lists[k] = l;
+    }
+
+    /*
+     * Leapfrog from the newest entry down: the newest candidate of the
+     * first list is looked up in the others, and a list that lacks it
+     * names the next candidate, its newest entry below the old one.
+     * hi[k] bounds the part of list k that is still in play.
+     */
+    for (size_t k = 0; k < n; k++)
+        hi[k] = lists[k]->count;
+    size_t pos = lower_bound(lists[0]->ids, lists[0]->count, before);
+    while (pos > 0) {
+        uint32_t id = lists[0]->ids[pos - 1];
+        size_t k;
+        for (k = 1; k < n; k++) {
+            hi[k] = gallop(lists[k]->ids, hi[k], (size_t)id + 1);
+            if (!hi[k])
+                return -1;
+            uint32_t top = lists[k]->ids[hi[k] - 1];
+            if (top != id) {
+                pos = gallop(lists[0]->ids, pos, (size_t)top + 1);
+                break;
+            }
+        }
+        if (k < n)
+            continue;
+        if (strstr(histlog_text(histlog_get(h, id)), pattern))
+            return (long)id;
+        pos--;
+    }
+    return -1;
+}
@@ -0,0 +1,85 @@
+#ifndef HISTINDEX_H
+#define HISTINDEX_H
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+#include "histlog.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+  /**
+   * The entries whose text contains one trigram, oldest first.
+   */
+  struct histindex_list
+  {
+    uint32_t key;  /* the three bytes folded to lower case, 0 for an empty slot */
+    uint32_t count;
+    uint32_t cap;
+    uint32_t *ids;
+  };
+
+  /**
+   * A trigram index over the entries of a history log. Every trigram of
+   * an entry, folded to lower case, maps to the ascending list of entries
+   * that contain it. A search intersects the lists of the trigrams of the
+   * pattern from the newest entry backwards and checks each candidate
+   * against the pattern, so it only looks at entries that can match. The
+   * lists live in a hash table with linear probing kept at most half full.
+   *
+   * The index is built the first time it is searched and from then on
+   * kept up to date with the log.
+   */
+  struct histindex
+  {
+    struct histindex_list *slots;
+    size_t cap;     /* always a power of two */
+    size_t count;   /* distinct trigrams */
+    size_t indexed; /* entries of the log in the index */
+    bool built;
+  };
+
+  /**
+   * @brief Initialize an empty index.
+   *
+   * @param ix The index
+   */
+  void histindex_init(struct histindex *ix);
+
+  /**
+   * @brief Free all memory held by the index.
+   *
+   * @param ix The index
+   */
+  void histindex_destroy(struct histindex *ix);
+
+  /**
+   * @brief Add the entries of the log the index does not have yet. Does
+   * nothing until the index is built by its first search.
+   *
+   * @param ix The index
+   * @param h The log
+   */
+  void histindex_update(struct histindex *ix, const struct histlog *h);
+
+  /**
+   * @brief Find the newest entry before another that contains a pattern.
+   * The match is case sensitive. Patterns shorter than a trigram are
+   * looked for with a scan of the log.
+   *
+   * @param ix The index
+   * @param h The log
+   * @param pattern The text to look for
+   * @param before Only look at entries older than this one, h->count for all
+   * @return The index of the entry in the log, or -1 if none matches
+   */
+  long histindex_search(struct histindex *ix, const struct histlog *h,
+                        const char *pattern, size_t before);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif
@@ -0,0 +1,240 @@
+#define _GNU_SOURCE
+#include <errno.h>
+#include <stdbool.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "histlog.h"
+
+#define HISTLOG_MIN_CAP 1024
+
+static void *xrealloc(void *p, size_t size)
+{
+    void *rval = realloc(p, size);
+    if (!rval) {
+        fprintf(stderr, "realloc failed\n");
+        abort();
+    }
+    return rval;
+}
+
+static size_t rec_size(size_t len)
+{
+    return (sizeof(struct histlog_rec) + len + 1 + 7) & ~(size_t)7;
+}
+
+void histlog_init(struct histlog *h)
+{
+    h->fd = -1;
+    h->map = NULL;
+    h->mapped = 0;
+    h->mem_cap = 0;
+    h->end = 0;
+    h->offsets = NULL;
+    h->count = 0;
+    h->cap = 0;
+    h->pending = NULL;
+    h->pending_time = 0;
+    h->pending_start.tv_sec = 0;
+    h->pending_start.tv_nsec = 0;
+}
+
+static void histlog_unmap(struct histlog *h)
+{
+    if (h->fd < 0)
+        free(h->map);
+    else if (h->map)
+        munmap(h->map, h->mapped);
+    h->map = NULL;
+    h->mapped = 0;
+    h->mem_cap = 0;
+    h->end = 0;
+    h->count = 0;
+}
+
+int histlog_open(struct histlog *h, const char *path)
+{
+    int fd = open(path, O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0600);
+    if (fd < 0)
+        return -1;
+    histlog_unmap(h);
+    h->fd = fd;
+    histlog_sync(h);
+    return 0;
+}
+
+void histlog_close(struct histlog *h, int status)
+{
+    histlog_end(h, status);
+    histlog_unmap(h);
+    if (h->fd >= 0)
+        close(h->fd);
+    free(h->offsets);
+    histlog_init(h);
+}
+
+/*
+ * Grow the mapping to the current size of the file. A failed fstat or
+ * mremap leaves the old mapping, the new records are picked up by a later
+ * sync.
+ */
+static void histlog_remap(struct histlog *h)
+{
+    struct stat st;
+    if (fstat(h->fd, &st) < 0 || (size_t)st.st_size <= h->mapped)
+        return;
+    size_t size = (size_t)st.st_size;
+    void *map;
+    if (h->map)
+        map = mremap(h->map, h->mapped, size, MREMAP_MAYMOVE);
+    else // indexing reads every page anyway, map them in one go
+        map = mmap(NULL, size, PROT_READ, MAP_SHARED | MAP_POPULATE, h->fd, 0);
+    if (map == MAP_FAILED)
+        return;
+    h->map = (char *)map;
+    h->mapped = size;
+}
+
+/*
+ * Whether a whole record starts at off: the magic, all of it mapped and
+ * the text ending in the NUL right at its length, so the text can be
+ * handed to anything that reads up to a NUL.
+ */
+static bool rec_whole(const struct histlog *h, size_t off)
+{
+    const struct histlog_rec *rec = (const struct histlog_rec *)(h->map + off);
+    if (rec->magic != HISTLOG_MAGIC || rec_size(rec->len) > h->mapped - off)
+        return false;
+    const char *text = histlog_text(rec);
+    return memchr(text, '\0', (size_t)rec->len + 1) == text + rec->len;
+}
+
+size_t histlog_sync(struct histlog *h)
+{
+    if (h->fd >= 0)
+        histlog_remap(h);
+    size_t added = 0;
+    while (h->end + sizeof(struct histlog_rec) <= h->mapped) {
+        // A record torn by a crash is skipped up to the next whole one. If
+        // there is none, it may still be being written, so it is looked at
+        // again on the next sync.
+        if (!rec_whole(h, h->end)) {
+            size_t next = h->end + 8;
+            while (next + sizeof(struct histlog_rec) <= h->mapped && !rec_whole(h, next))
+                next += 8;
+            if (next + sizeof(struct histlog_rec) > h->mapped)
+                break;
+            h->end = next;
+        }
+        size_t size = rec_size(((const struct histlog_rec *)(h->map + h->end))->len);
+        if (h->count == h->cap) {
+            h->cap = h->cap ? h->cap * 2 : HISTLOG_MIN_CAP;
+            h->offsets = (uint64_t *)xrealloc(h->offsets, sizeof(uint64_t) * h->cap);
+        }
+        h->offsets[h->count++] = h->end;
+        h->end += size;
+        added++;
+    }
+    return added;
+}
+
+int histlog_append(struct histlog *h, const char *line, time_t time,
+                   uint32_t duration_ms, int status)
+{
+    char stack[512];
+    size_t len = strlen(line);
+    size_t size = rec_size(len);
+    size_t pad = 0;
+    char *buf = stack;
+
+    // A torn write can leave the file at any length, the record goes back
+    // to an 8 byte boundary so sync can find it
+    struct stat st;
+    if (h->fd >= 0 && fstat(h->fd, &st) == 0)
+        pad = (size_t)(-st.st_size & 7);
+    if (h->fd >= 0 && pad + size > sizeof(stack)) {
+        buf = (char *)xrealloc(NULL, pad + size);
+    } else if (h->fd < 0) {
+        if (h->mapped + size > h->mem_cap) {
+            h->mem_cap = h->mem_cap ? h->mem_cap * 2 : HISTLOG_MIN_CAP * 64;
+            while (h->mem_cap < h->mapped + size)
+                h->mem_cap *= 2;
+            h->map = (char *)xrealloc(h->map, h->mem_cap);
+        }
+        buf = h->map + h->mapped;
+    }
+    // Copied in, after the padding the header may not be aligned in buf
+    struct histlog_rec rec;
+    rec.magic = HISTLOG_MAGIC;
+    rec.len = (uint32_t)len;
+    rec.time = (int64_t)time;
+    rec.duration_ms = duration_ms;
+    rec.status = status;
+    memset(buf, 0, pad + size);
+    memcpy(buf + pad, &rec, sizeof(rec));
+    memcpy(buf + pad + sizeof(rec), line, len);
+    if (h->fd < 0) {
+        h->mapped += size;
+        histlog_sync(h);
+        return 0;
+    }
+
+    // One write so the record lands whole even with other shells appending
+    ssize_t n;
+    do {
+        n = write(h->fd, buf, pad + size);
+    } while (n < 0 && errno == EINTR);
+    int err = errno;
+    if (buf != stack)
+        free(buf);
+    if (n < 0) {
+        errno = err;
+        return -1;
+    }
+    if ((size_t)n != pad + size) {
+        errno = ENOSPC;
+        return -1;
+    }
+    return 0;
+}
+
+void histlog_begin(struct histlog *h, const char *line)
+{
+    free(h->pending);
+    h->pending = strdup(line);
+    h->pending_time = time(NULL);
+    clock_gettime(CLOCK_MONOTONIC, &h->pending_start);
+}
+
+void histlog_end(struct histlog *h, int status)
+{
+    if (!h->pending)
+        return;
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    long long ms = (now.tv_sec - h->pending_start.tv_sec) * 1000LL +
+                   (now.tv_nsec - h->pending_start.tv_nsec) / 1000000;
+    if (ms < 0)
+        ms = 0;
+    if (ms > UINT32_MAX)
+        ms = UINT32_MAX;
+    if (histlog_append(h, h->pending, h->pending_time, (uint32_t)ms, status) < 0)
+        perror("history");
+    free(h->pending);
+    h->pending = NULL;
+}
+
+void histlog_forget(struct histlog *h)
+{
+    free(h->pending);
+    h->pending = NULL;
+}
+
+const struct histlog_rec *histlog_get(const struct histlog *h, size_t i)
+{
+    return (const struct histlog_rec *)(h->map + h->offsets[i]);
+}
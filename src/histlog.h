@@ -0,0 +1,153 @@
+#ifndef HISTLOG_H
+#define HISTLOG_H
+#include <stdint.h>
+#include <stddef.h>
+#include <time.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#define HISTLOG_MAGIC 0x4c484931u /* "LHI1" */
+
+  /**
+   * One command in the history file. The text follows the record with a
+   * terminating NUL and the next record starts at the next multiple of 8
+   * bytes.
+   */
+  struct histlog_rec
+  {
+    uint32_t magic;       /* HISTLOG_MAGIC, anything else is not a record */
+    uint32_t len;         /* bytes of text, not counting the NUL */
+    int64_t time;         /* when the command started, seconds since the epoch */
+    uint32_t duration_ms; /* how long it ran */
+    int32_t status;       /* its exit status */
+  };
+
+  /**
+   * An append only history file. Opening it maps the file and builds an
+   * index of where each record starts, no entry is copied or parsed
+   * further. Every entry is added with a single write to a file opened
+   * with O_APPEND, so shells sharing the file never interleave records.
+   * A record a crash left half written is skipped, the log goes on at the
+   * next 8 byte boundary where a whole record starts. A log with no file
+   * keeps its records in memory the same way.
+   */
+  struct histlog
+  {
+    int fd;              /* -1 when there is no history file */
+    char *map;           /* the file, or the records in memory */
+    size_t mapped;       /* bytes of the file mapped or of records in memory */
+    size_t mem_cap;      /* bytes allocated for records in memory */
+    size_t end;          /* offset just past the last indexed record */
+    uint64_t *offsets;   /* where each indexed record starts */
+    size_t count;
+    size_t cap;
+    char *pending;       /* the command running now, logged once it is done */
+    time_t pending_time;
+    struct timespec pending_start;
+  };
+
+  /**
+   * @brief Initialize a log with no file behind it, records are kept in
+   * memory until histlog_open.
+   *
+   * @param h The log
+   */
+  void histlog_init(struct histlog *h);
+
+  /**
+   * @brief Open or create the history file and index every record in it.
+   * Records the log kept in memory before are dropped.
+   *
+   * @param h An initialized log
+   * @param path The file
+   * @return 0 on success, -1 with errno set
+   */
+  int histlog_open(struct histlog *h, const char *path);
+
+  /**
+   * @brief Log the pending command if there is one, then unmap and close
+   * the file and free the index.
+   *
+   * @param h The log
+   * @param status The exit status to log the pending command with
+   */
+  void histlog_close(struct histlog *h, int status);
+
+  /**
+   * @brief Index the records appended to the file since it was opened or
+   * last synced, by this shell or another. Records returned by
+   * histlog_get before the call may have moved.
+   *
+   * @param h The log
+   * @return The number of new records
+   */
+  size_t histlog_sync(struct histlog *h);
+
+  /**
+   * @brief Append one record with a single write, or in memory if there
+   * is no file. Records in memory are indexed right away.
+   *
+   * @param h The log
+   * @param line The command
+   * @param time When it started
+   * @param duration_ms How long it ran
+   * @param status Its exit status
+   * @return 0 on success, -1 with errno set
+   */
+  int histlog_append(struct histlog *h, const char *line, time_t time,
+                     uint32_t duration_ms, int status);
+
+  /**
+   * @brief Remember a command that is about to run. It is appended by
+   * histlog_end once its status and duration are known.
+   *
+   * @param h The log
+   * @param line The command
+   */
+  void histlog_begin(struct histlog *h, const char *line);
+
+  /**
+   * @brief Append the command given to histlog_begin.
+   *
+   * @param h The log
+   * @param status Its exit status
+   */
+  void histlog_end(struct histlog *h, int status);
+
+  /**
+   * @brief Drop the pending command in a forked copy of the shell, so
+   * only the shell that began it logs it.
+   *
+   * @param h The log
+   */
+  void histlog_forget(struct histlog *h);
+
+  /**
+   * @brief Get an indexed record. The pointer is into the mapping and is
+   * valid until the next histlog_sync.
+   *
+   * @param h The log
+   * @param i The index, 0 is the oldest record
+   * @return The record
+   */
+  const struct histlog_rec *histlog_get(const struct histlog *h, size_t i);
+
+  /**
+   * @brief The text of a record.
+   *
+   * @param rec The record
+   * @return The NUL terminated command
+   */
+  static inline const char *histlog_text(const struct histlog_rec *rec)
+  {
+    return (const char *)(rec + 1);
+  }
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif
@@ -0,0 +1,158 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "histring.h"
+
+static void *xcalloc(size_t n, size_t size)
+{
+    void *rval = calloc(n, size);
+    if (!rval) {
+        fprintf(stderr, "calloc failed\n");
+        abort();
+    }
+    return rval;
+}
+
+/* FNV-1a */
+static uint32_t line_hash(const char *s)
+{
+    uint32_t h = 2166136261u;
+    for (; *s; s++) {
+        h ^= (unsigned char)*s;
+        h *= 16777619u;
+    }
+    return h;
+}
+
+void histring_init(struct histring *r, size_t cap)
+{
+    memset(r, 0, sizeof(*r));
+    if (cap > HISTRING_MAX)
+        cap = HISTRING_MAX;
+    if (!cap)
+        return;
+    r->cap = cap;
+    r->newest = HISTRING_END;
+    r->oldest = HISTRING_END;
+    r->ring = (struct histring_entry *)xcalloc(cap, sizeof(struct histring_entry));
+    r->set_cap = 4;
+    while (r->set_cap < cap * 2)
+        r->set_cap *= 2;
+    r->set = (uint32_t *)xcalloc(r->set_cap, sizeof(uint32_t));
+}
+
+void histring_destroy(struct histring *r)
+{
+    for (size_t i = 0; i < r->count; i++)
+        free(r->ring[i].line);
+    free(r->ring);
+    free(r->set);
+    memset(r, 0, sizeof(*r));
+}
+
+/* The bucket holding the slot of line, or the empty bucket ending its run */
+static size_t set_find(const struct histring *r, const char *line, uint32_t hash)
+{
+    size_t mask = r->set_cap - 1;
+    size_t i = hash & mask;
+    for (; r->set[i]; i = (i + 1) & mask) {
+        const struct histring_entry *e = &r->ring[r->set[i] - 1];
+        if (e->hash == hash && strcmp(e->line, line) == 0)
+            break;
+    }
+    return i;
+}
+
+/*
+ * Take a slot out of the set. Later buckets of the same probe run move
+ * back into the hole, so lookups never need tombstones to get past it.
+ */
+static void set_remove(struct histring *r, size_t slot)
+{
+    size_t mask = r->set_cap - 1;
+    size_t i = r->ring[slot].hash & mask;
+    while (r->set[i] != slot + 1)
+        i = (i + 1) & mask;
+    for (size_t j = (i + 1) & mask; r->set[j]; j = (j + 1) & mask) {
+        size_t home = r->ring[r->set[j] - 1].hash & mask;
+        if (((j - home) & mask) >= ((j - i) & mask)) {
+            r->set[i] = r->set[j];
+            i = j;
+        }
+    }
+    r->set[i] = 0;
+}
+
+/* Take a slot out of the order */
+static void order_unlink(struct histring *r, uint32_t slot)
+{
+    struct histring_entry *e = &r->ring[slot];
+    if (e->older != HISTRING_END)
+        r->ring[e->older].newer = e->newer;
+    else
+        r->oldest = e->newer;
+    if (e->newer != HISTRING_END)
+        r->ring[e->newer].older = e->older;
+    else
+        r->newest = e->older;
+}
+
+/* Put a slot at the front of the order */
+static void order_push(struct histring *r, uint32_t slot)
+{
+    struct histring_entry *e = &r->ring[slot];
+    e->older = r->newest;
+    e->newer = HISTRING_END;
+    if (r->newest != HISTRING_END)
+        r->ring[r->newest].newer = slot;
+    else
+        r->oldest = slot;
+    r->newest = slot;
+}
+
+void histring_add(struct histring *r, const char *line)
+{
+    if (!r->cap)
+        return;
+    uint32_t hash = line_hash(line);
+    size_t b = set_find(r, line, hash);
+    uint32_t slot;
+    if (r->set[b]) {
+        slot = r->set[b] - 1;
+        if (slot == r->newest)
+            return;
+        // Run again, the slot moves to the front with its line
+        order_unlink(r, slot);
+        order_push(r, slot);
+        return;
+    }
+
+    char *copy = strdup(line);
+    if (!copy) {
+        fprintf(stderr, "strdup failed\n");
+        abort();
+    }
+    if (r->count < r->cap) {
+        slot = (uint32_t)r->count++;
+    } else {
+        slot = r->oldest;
+        order_unlink(r, slot);
+        set_remove(r, slot);
+        free(r->ring[slot].line);
+    }
+    struct histring_entry *e = &r->ring[slot];
+    e->line = copy;
+    e->hash = hash;
+    r->set[set_find(r, copy, hash)] = slot + 1;
+    order_push(r, slot);
+}
+
+const char *histring_get(const struct histring *r, size_t age)
+{
+    if (age >= r->count)
+        return NULL;
+    uint32_t slot = r->newest;
+    for (; age > 0; age--)
+        slot = r->ring[slot].older;
+    return r->ring[slot].line;
+}
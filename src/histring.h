@@ -0,0 +1,116 @@
+#ifndef HISTRING_H
+#define HISTRING_H
+#include <stddef.h>
+#include <stdint.h>
+
+/* Largest number of entries a ring can be made to hold */
+#define HISTRING_MAX (1u << 24)
+
+/* The end of the order, past the newest and the oldest entry */
+#define HISTRING_END UINT32_MAX
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+  /**
+   * One slot of the ring, linked into the order of the lines from the
+   * oldest to the newest.
+   */
+  struct histring_entry
+  {
+    char *line;
+    uint32_t hash;
+    uint32_t older; /* slot of the line run before, HISTRING_END if none */
+    uint32_t newer; /* slot of the line run after, HISTRING_END if none */
+  };
+
+  /**
+   * The lines the arrow keys walk through, newest first. At most cap
+   * lines are kept and the oldest is dropped to make room for a new one,
+   * so memory stays flat however long the shell runs. A hash set of the
+   * slots finds an earlier copy of a line in O(1): running the newest line
+   * again adds nothing and running an older one relinks its slot at the
+   * front, so every line is in the ring once and every slot holds a line.
+   *
+   * A zeroed ring is valid and holds nothing.
+   */
+  struct histring
+  {
+    struct histring_entry *ring;
+    size_t cap;      /* slots in the ring, HISTSIZE */
+    size_t count;    /* lines in the ring, in slots 0 to count - 1 */
+    uint32_t newest; /* slot of the newest line, HISTRING_END if none */
+    uint32_t oldest; /* slot of the oldest line, HISTRING_END if none */
+    uint32_t *set;   /* ring slot + 1 of every line, 0 for an empty bucket */
+    size_t set_cap;  /* a power of two at least twice cap */
+  };
+
+  /**
+   * @brief Initialize an empty ring.
+   *
+   * @param r The ring
+   * @param cap Lines kept at most, 0 keeps none, clamped to HISTRING_MAX
+   */
+  void histring_init(struct histring *r, size_t cap);
+
+  /**
+   * @brief Free all memory held by the ring.
+   *
+   * @param r The ring
+   */
+  void histring_destroy(struct histring *r);
+
+  /**
+   * @brief Add a line as the newest entry. A copy of the newest entry is
+   * dropped and a copy of an older one moves that entry to the front.
+   *
+   * @param r The ring
+   * @param line The line, copied
+   */
+  void histring_add(struct histring *r, const char *line);
+
+  /**
+   * @brief Get an entry by how far back it is, walking the order from the
+   * newest line.
+   *
+   * @param r The ring
+   * @param age 0 for the newest line, up to r->count - 1
+   * @return The line, or NULL if age is out of range
+   */
+  const char *histring_get(const struct histring *r, size_t age);
+
+  /**
+   * @brief Step back through the lines.
+   *
+   * @param r The ring
+   * @param slot A slot, or HISTRING_END to start from the newest line
+   * @return The slot of the line run before, HISTRING_END past the oldest
+   */
+  static inline uint32_t histring_older(const struct histring *r, uint32_t slot)
+  {
+    if (slot == HISTRING_END)
+      return r->count ? r->newest : HISTRING_END;
+    return r->ring[slot].older;
+  }
+
+  /**
+   * @brief Step forward through the lines.
+   *
+   * @param r The ring
+   * @param slot A slot, or HISTRING_END to start from the oldest line
+   * @return The slot of the line run after, HISTRING_END past the newest
+   */
+  static inline uint32_t histring_newer(const struct histring *r, uint32_t slot)
+  {
+    if (slot == HISTRING_END)
+      return r->count ? r->oldest : HISTRING_END;
+    return r->ring[slot].newer;
+  }
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif
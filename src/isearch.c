@@ -0,0 +1,144 @@
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <readline/readline.h>
+#include "isearch.h"
+#include "lab.h"
+
+/* State of the search in progress, readline only edits one line at a time */
+static struct shell *isearch_sh;
+static Keymap isearch_map;
+static Keymap saved_map;
+static char pattern[256];
+static size_t pattern_len;
+static long match;        /* entry on the line, -1 if none was found yet */
+static bool failed;       /* the last search found nothing */
+static char *saved_line;  /* the line as it was before the search */
+static int saved_point;
+
+static void isearch_show(void)
+{
+    struct histlog *h = &isearch_sh->hist;
+    rl_message("(%sreverse-i-search)`%s': ", failed ? "failed " : "", pattern);
+    if (match >= 0) {
+        const char *text = histlog_text(histlog_get(h, (size_t)match));
+        const char *at = strstr(text, pattern);
+        rl_replace_line(text, 0);
+        rl_point = at ? (int)(at - text) : 0;
+    }
+    rl_redisplay();
+}
+
+static void isearch_find(size_t before)
+{
+    long found = histindex_search(&isearch_sh->histindex, &isearch_sh->hist, pattern, before);
+    failed = found < 0;
+    if (!failed)
+        match = found;
+}
+
+static void isearch_end(void)
+{
+    rl_set_keymap(saved_map);
+    rl_restore_prompt();
+    rl_clear_message();
+    free(saved_line);
+    saved_line = NULL;
+}
+
+static int isearch_start(int count, int key)
+{
+    UNUSED(count);
+    UNUSED(key);
+    histlog_sync(&isearch_sh->hist);
+    saved_line = strdup(rl_line_buffer);
+    saved_point = rl_point;
+    pattern[0] = '\0';
+    pattern_len = 0;
+    match = -1;
+    failed = false;
+    saved_map = rl_get_keymap();
+    rl_set_keymap(isearch_map);
+    rl_save_prompt();
+    isearch_show();
+    return 0;
+}
+
+static int isearch_next(int count, int key)
+{
+    UNUSED(count);
+    UNUSED(key);
+    isearch_find(match >= 0 ? (size_t)match : isearch_sh->hist.count);
+    isearch_show();
+    return 0;
+}
+
+/* A longer pattern may still match the entry on the line */
+static int isearch_insert(int count, int key)
+{
+    UNUSED(count);
+    if (pattern_len + 1 >= sizeof(pattern)) {
+        rl_ding();
+        return 0;
+    }
+    pattern[pattern_len++] = (char)key;
+    pattern[pattern_len] = '\0';
+    isearch_find(match >= 0 ? (size_t)match + 1 : isearch_sh->hist.count);
+    isearch_show();
+    return 0;
+}
+
+static int isearch_erase(int count, int key)
+{
+    UNUSED(count);
+    UNUSED(key);
+    if (pattern_len)
+        pattern[--pattern_len] = '\0';
+    match = -1;
+    isearch_find(isearch_sh->hist.count);
+    isearch_show();
+    return 0;
+}
+
+static int isearch_abort(int count, int key)
+{
+    UNUSED(count);
+    UNUSED(key);
+    rl_replace_line(saved_line, 0);
+    rl_point = saved_point;
+    isearch_end();
+    rl_redisplay();
+    return 0;
+}
+
+/* Keep the line found and let the key do what it does outside the search */
+static int isearch_other(int count, int key)
+{
+    UNUSED(count);
+    isearch_end();
+    rl_execute_next(key);
+    return 0;
+}
+
+void isearch_install(struct shell *sh)
+{
+    isearch_sh = sh;
+    isearch_map = rl_make_bare_keymap();
+    for (int key = 0; key < KEYMAP_SIZE; key++) {
+        if (key >= ' ' && key != 127 && key < 256)
+            rl_bind_key_in_map(key, isearch_insert, isearch_map);
+        else
+            rl_bind_key_in_map(key, isearch_other, isearch_map);
+    }
+    rl_bind_key_in_map(CTRL('R'), isearch_next, isearch_map);
+    rl_bind_key_in_map(CTRL('G'), isearch_abort, isearch_map);
+    rl_bind_key_in_map(CTRL('H'), isearch_erase, isearch_map);
+    rl_bind_key_in_map(127, isearch_erase, isearch_map);
+    rl_bind_key_in_map(CTRL('R'), isearch_start, emacs_standard_keymap);
+}
+
+bool isearch_active(void)
+{
+    return isearch_map && rl_get_keymap() == isearch_map;
+}
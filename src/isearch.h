@@ -0,0 +1,35 @@
+#ifndef ISEARCH_H
+#define ISEARCH_H
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+  struct shell;
+
+  /**
+   * @brief Bind Ctrl-R to an incremental reverse search of the whole
+   * history log through the trigram index of the shell. It behaves like
+   * readline's own: typed characters extend the pattern, Ctrl-R finds the
+   * next older match, Ctrl-G gives up and any other key keeps the line
+   * found and then does what it normally does.
+   *
+   * @param sh The shell whose history is searched
+   */
+  void isearch_install(struct shell *sh);
+
+  /**
+   * @brief Check if a search is in progress. The search shows its own
+   * prompt, which must not be drawn over.
+   *
+   * @return True while a search is in progress
+   */
+  bool isearch_active(void);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif
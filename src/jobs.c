@@ -0,0 +1,755 @@
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/pidfd.h>
+#include <sys/wait.h>
+#include "jobs.h"
+#include "lab.h"
+#include "exec.h"
+
+/* Write end of the self pipe of the shell, used by the signal handler */
+static volatile int sigchld_wake = -1;
+
+static void on_sigchld(int sig)
+{
+    UNUSED(sig);
+    int saved = errno;
+    if (sigchld_wake >= 0)
+        (void)!write(sigchld_wake, "", 1);
+    errno = saved;
+}
+
+static void *xmalloc_jobs(size_t size)
+{
+    void *rval = malloc(size);
+    if (!rval)
+    {
+        fprintf(stderr, "malloc failed\n");
+        abort();
+    }
+    return rval;
+}
+
+void jobs_init(struct shell *sh)
+{
+    sh->jobs.head = NULL;
+    sh->jobs.epfd = -1;
+    if (pipe2(sh->jobs.wake, O_CLOEXEC | O_NONBLOCK) < 0)
+    {
+        perror("pipe");
+        exit(EXIT_FAILURE);
+    }
+    sigchld_wake = sh->jobs.wake[1];
+
+    // SA_RESTART keeps blocking waits and reads going when a child exits
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = on_sigchld;
+    sigemptyset(&sa.sa_mask);
+    sa.sa_flags = SA_RESTART;
+    sigaction(SIGCHLD, &sa, NULL);
+}
+
+/*
+ * Close the pidfd of a process. It is taken out of the epoll set first:
+ * a child forked meanwhile may still hold a copy of the pidfd, and then
+ * close alone would leave it registered and reporting a freed job.
+ */
+static void proc_unwatch(struct job_proc *p)
+{
+    if (p->pidfd < 0)
+        return;
+    if (p->epfd >= 0)
+        epoll_ctl(p->epfd, EPOLL_CTL_DEL, p->pidfd, NULL);
+    close(p->pidfd);
+    p->pidfd = -1;
+    p->epfd = -1;
+}
+
+static void proc_done(struct job_proc *p, int status)
+{
+    p->done = true;
+    p->stopped = false;
+    p->status = status;
+    // An exited process keeps its pidfd readable, it must leave the epoll set
+    proc_unwatch(p);
+}
+
+static void job_free(struct job *j)
+{
+    for (size_t i = 0; i < j->nprocs; i++)
+        proc_unwatch(&j->procs[i]);
+    free(j->procs);
+    free(j->cmd);
+    free(j);
+}
+
+void jobs_destroy(struct shell *sh)
+{
+    struct job *j = sh->jobs.head;
+    while (j)
+    {
+        struct job *next = j->next;
+        job_free(j);
+        j = next;
+    }
+    sh->jobs.head = NULL;
+    if (sigchld_wake == sh->jobs.wake[1])
+        sigchld_wake = -1;
+    close(sh->jobs.wake[0]);
+    close(sh->jobs.wake[1]);
+}
+
+void jobs_forget(struct shell *sh)
+{
+    // The epoll set is shared with the parent, removing from it would
+    // remove the parent's pidfds
+    for (struct job *j = sh->jobs.head; j; j = j->next)
+    {
+        for (size_t i = 0; i < j->nprocs; i++)
+            j->procs[i].epfd = -1;
+    }
+    jobs_destroy(sh);
+    jobs_init(sh);
+}
+
+int job_exit_status(int status)
+{
+    if (WIFEXITED(status))
+        return WEXITSTATUS(status);
+    if (WIFSIGNALED(status))
+        return 128 + WTERMSIG(status);
+    return EXIT_FAILURE;
+}
+
+/*
+ * Append word to p, in single quotes if the shell would otherwise split or
+ * interpret it. Needs at most 4 * strlen(word) + 2 bytes.
+ */
+static char *quote_word(char *p, const char *word)
+{
+    if (*word && !word[strcspn(word, " \t\n'\"\\|&;<>()$`#*?")])
+        return stpcpy(p, word);
+    *p++ = '\'';
+    for (; *word; word++)
+    {
+        if (*word == '\'')
+            p = stpcpy(p, "'\\''");
+        else
+            *p++ = *word;
+    }
+    *p++ = '\'';
+    return p;
+}
+
+/*
+ * Render the pipeline as text for job messages, words are separated by a
+ * single space and redirections are written without spaces.
+ */
+static char *pipeline_text(struct ast_pipeline *pl)
+{
+    static const char *const ops[] = {"<", ">", ">>"};
+    size_t len = 1;
+    for (struct ast_cmd *cmd = pl->cmds; cmd; cmd = cmd->next)
+    {
+        len += 3;
+        for (size_t i = 0; i < cmd->argc; i++)
+            len += strlen(cmd->argv[i]) * 4 + 3;
+        for (struct ast_redir *r = cmd->redirs; r; r = r->next)
+            len += strlen(r->target) * 4 + 16;
+    }
+
+    char *text = (char *)xmalloc_jobs(len);
+    char *p = text;
+    for (struct ast_cmd *cmd = pl->cmds; cmd; cmd = cmd->next)
+    {
+        if (cmd != pl->cmds)
+            p = stpcpy(p, " | ");
+        for (size_t i = 0; i < cmd->argc; i++)
+        {
+            if (i)
+                *p++ = ' ';
+            p = quote_word(p, cmd->argv[i]);
+        }
+        for (struct ast_redir *r = cmd->redirs; r; r = r->next)
+        {
+            int def = r->type == REDIR_IN ? STDIN_FILENO : STDOUT_FILENO;
+            if (p != text)
+                *p++ = ' ';
+            if (r->fd != def)
+                p += sprintf(p, "%d", r->fd);
+            p = quote_word(stpcpy(p, ops[r->type]), r->target);
+        }
+    }
+    *p = '\0';
+    return text;
+}
+
+struct job *job_new(struct ast_pipeline *pl)
+{
+    struct job *j = (struct job *)xmalloc_jobs(sizeof(struct job));
+    memset(j, 0, sizeof(*j));
+    j->procs = (struct job_proc *)xmalloc_jobs(sizeof(struct job_proc) * pl->count);
+    j->nprocs = pl->count;
+    for (size_t i = 0; i < pl->count; i++)
+    {
+        j->procs[i].pid = -1;
+        j->procs[i].status = EXIT_FAILURE;
+        j->procs[i].done = true;
+        j->procs[i].stopped = false;
+        j->procs[i].pidfd = -1;
+        j->procs[i].epfd = -1;
+    }
+    j->cmd = pipeline_text(pl);
+    return j;
+}
+
+static bool job_running(const struct job *j)
+{
+    for (size_t i = 0; i < j->nprocs; i++)
+    {
+        if (!j->procs[i].done && !j->procs[i].stopped)
+            return true;
+    }
+    return false;
+}
+
+static bool job_done(const struct job *j)
+{
+    for (size_t i = 0; i < j->nprocs; i++)
+    {
+        if (!j->procs[i].done)
+            return false;
+    }
+    return true;
+}
+
+/*
+ * Record a status from waitpid against the process it belongs to. Returns
+ * false if pid is not part of the job.
+ */
+static bool job_update(struct job *j, pid_t pid, int wstatus)
+{
+    for (size_t i = 0; i < j->nprocs; i++)
+    {
+        struct job_proc *p = &j->procs[i];
+        if (p->pid != pid || p->done)
+            continue;
+        if (WIFSTOPPED(wstatus))
+        {
+            p->stopped = true;
+        }
+        else if (WIFCONTINUED(wstatus))
+        {
+            p->stopped = false;
+        }
+        else
+        {
+            proc_done(p, job_exit_status(wstatus));
+        }
+        j->notified = false;
+        return true;
+    }
+    return false;
+}
+
+/*
+ * Open a pidfd for every live process of the job and add it to the epoll
+ * set of the shell. The processes are unreaped children of the shell so the
+ * pids cannot have been reused yet. Without pidfd support the processes are
+ * polled by pid instead.
+ */
+static void job_watch(struct shell *sh, struct job *j)
+{
+    for (size_t i = 0; i < j->nprocs; i++)
+    {
+        struct job_proc *p = &j->procs[i];
+        if (p->done)
+            continue;
+        if (p->pidfd < 0)
+        {
+            p->pidfd = pidfd_open(p->pid, 0);
+            if (p->pidfd < 0)
+                continue;
+        }
+        if (sh->jobs.epfd >= 0 && p->epfd < 0)
+        {
+            struct epoll_event ev;
+            ev.events = EPOLLIN;
+            ev.data.ptr = j;
+            if (epoll_ctl(sh->jobs.epfd, EPOLL_CTL_ADD, p->pidfd, &ev) == 0)
+                p->epfd = sh->jobs.epfd;
+            else if (errno != EEXIST)
+                perror("epoll_ctl");
+        }
+    }
+}
+
+/*
+ * Put a job in the table unless it is already there. Jobs are numbered one
+ * past the highest number in use, like other shells do.
+ */
+static void job_insert(struct shell *sh, struct job *j)
+{
+    int id = 0;
+    for (struct job *it = sh->jobs.head; it; it = it->next)
+    {
+        if (it == j)
+            return;
+        if (it->id > id)
+            id = it->id;
+    }
+    j->id = id + 1;
+    j->next = sh->jobs.head;
+    sh->jobs.head = j;
+    job_watch(sh, j);
+}
+
+static void job_remove(struct shell *sh, struct job *j)
+{
+    for (struct job **it = &sh->jobs.head; *it; it = &(*it)->next)
+    {
+        if (*it == j)
+        {
+            *it = j->next;
+            break;
+        }
+    }
+    job_free(j);
+}
+
+static void job_continue(struct job *j)
+{
+    for (size_t i = 0; i < j->nprocs; i++)
+        j->procs[i].stopped = false;
+    if (j->pgid > 0)
+    {
+        if (kill(-j->pgid, SIGCONT) < 0)
+            perror("kill (SIGCONT)");
+        return;
+    }
+    // Without job control the processes are in the group of the shell
+    for (size_t i = 0; i < j->nprocs; i++)
+    {
+        if (!j->procs[i].done)
+            kill(j->procs[i].pid, SIGCONT);
+    }
+}
+
+static const char *job_state(const struct job *j, char *buf, size_t n)
+{
+    if (!job_done(j))
+        return job_running(j) ? "Running" : "Stopped";
+    int status = j->procs[j->nprocs - 1].status;
+    if (status == 0)
+        return "Done";
+    snprintf(buf, n, "Exit %d", status);
+    return buf;
+}
+
+static void job_print(FILE *out, const struct job *j)
+{
+    char buf[32];
+    fprintf(out, "[%d]  %-22s %s\n", j->id, job_state(j, buf, sizeof(buf)), j->cmd);
+}
+
+/* The same line for the jobs builtin, which writes through sh->out */
+static void job_write(struct writer *w, const struct job *j)
+{
+    char buf[32];
+    writer_printf(w, "[%d]  %-22s %s\n", j->id, job_state(j, buf, sizeof(buf)), j->cmd);
+}
+
+/*
+ * Wait for the job until no process in it is running. Processes are waited
+ * for through the process group so a stage stopping while another is still
+ * running is seen right away. A process that left the group is waited for
+ * on its own.
+ */
+static void job_wait(struct job *j, int flags)
+{
+    while (job_running(j))
+    {
+        int wstatus;
+        pid_t pid = j->pgid > 0 ? waitpid(-j->pgid, &wstatus, flags) : -1;
+        if (pid > 0)
+        {
+            job_update(j, pid, wstatus);
+            continue;
+        }
+        for (size_t i = 0; i < j->nprocs; i++)
+        {
+            struct job_proc *p = &j->procs[i];
+            if (p->done || p->stopped)
+                continue;
+            if (waitpid(p->pid, &wstatus, flags) > 0)
+            {
+                job_update(j, p->pid, wstatus);
+            }
+            else
+            {
+                // Someone else reaped it, we will never learn the status
+                proc_done(p, EXIT_FAILURE);
+            }
+            break;
+        }
+    }
+}
+
+void job_foreground(struct shell *sh, struct job *j, bool cont)
+{
+    bool terminal = sh->shell_is_interactive && j->pgid > 0;
+    if (terminal)
+    {
+        tcsetpgrp(sh->shell_terminal, j->pgid);
+        if (cont && j->has_tmodes)
+            tcsetattr(sh->shell_terminal, TCSADRAIN, &j->tmodes);
+    }
+    if (cont)
+        job_continue(j);
+
+    job_wait(j, WUNTRACED);
+
+    // get control of the shell
+    if (terminal)
+    {
+        tcsetpgrp(sh->shell_terminal, sh->shell_pgid);
+        j->has_tmodes = tcgetattr(sh->shell_terminal, &j->tmodes) == 0;
+        tcsetattr(sh->shell_terminal, TCSADRAIN, &sh->shell_tmodes);
+    }
+
+    if (job_done(j))
+    {
+        int *status = pipestatus_reserve(sh, j->nprocs);
+        for (size_t i = 0; i < j->nprocs; i++)
+            status[i] = j->procs[i].status;
+        sh->status = status[j->nprocs - 1];
+        // A job brought back with fg has done its reporting
+        if (j->id)
+            job_remove(sh, j);
+        else
+            job_free(j);
+        return;
+    }
+
+    job_insert(sh, j);
+    j->notified = true;
+    sh->status = 128 + SIGTSTP;
+    fprintf(stderr, "\n");
+    job_print(stderr, j);
+}
+
+void job_background(struct shell *sh, struct job *j, bool cont)
+{
+    bool fresh = !j->id;
+    job_insert(sh, j);
+    j->notified = true;
+    if (cont)
+    {
+        job_continue(j);
+        fprintf(stderr, "[%d]  %s &\n", j->id, j->cmd);
+    }
+    else if (fresh && sh->shell_is_interactive)
+    {
+        fprintf(stderr, "[%d] %d\n", j->id, (int)j->pgid);
+    }
+    sh->status = 0;
+}
+
+/*
+ * Turn what waitid reported back into a waitpid status.
+ */
+static int siginfo_status(const siginfo_t *si)
+{
+    switch (si->si_code)
+    {
+    case CLD_EXITED:
+        return W_EXITCODE(si->si_status, 0);
+    case CLD_STOPPED:
+    case CLD_TRAPPED:
+        return W_STOPCODE(si->si_status);
+    case CLD_CONTINUED:
+        return 0xffff;
+    default:
+        return W_EXITCODE(0, si->si_status);
+    }
+}
+
+/*
+ * Collect an exit of one process without blocking. Processes with a pidfd
+ * are waited for through it so the wait can never hit a reused pid.
+ */
+static void proc_poll(struct job *j, struct job_proc *p)
+{
+    int wstatus;
+    if (p->pidfd >= 0)
+    {
+        siginfo_t si;
+        si.si_pid = 0;
+        if (waitid(P_PIDFD, p->pidfd, &si, WEXITED | WNOHANG) == 0 && si.si_pid)
+            job_update(j, p->pid, siginfo_status(&si));
+    }
+    else if (waitpid(p->pid, &wstatus, WNOHANG) > 0)
+    {
+        job_update(j, p->pid, wstatus);
+    }
+}
+
+/*
+ * Collect stops and continues of every child. Waiting for WSTOPPED and
+ * WCONTINUED without WEXITED never reaps, so this costs one call when
+ * nothing happened no matter how many jobs there are.
+ */
+static void jobs_reap_stops(struct shell *sh)
+{
+    for (;;)
+    {
+        siginfo_t si;
+        si.si_pid = 0;
+        if (waitid(P_ALL, 0, &si, WSTOPPED | WCONTINUED | WNOHANG) < 0 || !si.si_pid)
+            return;
+        for (struct job *j = sh->jobs.head; j; j = j->next)
+        {
+            if (job_update(j, si.si_pid, siginfo_status(&si)))
+                break;
+        }
+    }
+}
+
+/*
+ * Collect every state change of every job, used where the state must be
+ * current such as the job builtins.
+ */
+static void jobs_poll(struct shell *sh)
+{
+    jobs_reap_stops(sh);
+    for (struct job *j = sh->jobs.head; j; j = j->next)
+    {
+        for (size_t i = 0; i < j->nprocs; i++)
+        {
+            if (!j->procs[i].done)
+                proc_poll(j, &j->procs[i]);
+        }
+    }
+}
+
+void jobs_reap(struct shell *sh)
+{
+    jobs_reap_stops(sh);
+    for (struct job *j = sh->jobs.head; j; j = j->next)
+    {
+        for (size_t i = 0; i < j->nprocs; i++)
+        {
+            struct job_proc *p = &j->procs[i];
+            // Exits of watched processes arrive through jobs_event
+            if (!p->done && (p->pidfd < 0 || sh->jobs.epfd < 0))
+                proc_poll(j, p);
+        }
+    }
+}
+
+void jobs_watch(struct shell *sh, int epfd)
+{
+    sh->jobs.epfd = epfd;
+    for (struct job *j = sh->jobs.head; j; j = j->next)
+        job_watch(sh, j);
+}
+
+void jobs_event(struct shell *sh, void *tag)
+{
+    struct job *j = (struct job *)tag;
+    UNUSED(sh);
+    for (size_t i = 0; i < j->nprocs; i++)
+    {
+        if (j->procs[i].pidfd >= 0)
+            proc_poll(j, &j->procs[i]);
+    }
+}
+
+bool jobs_unreported(const struct shell *sh)
+{
+    if (!sh->shell_is_interactive)
+        return false;
+    for (const struct job *j = sh->jobs.head; j; j = j->next)
+    {
+        if (!j->notified && (job_done(j) || !job_running(j)))
+            return true;
+    }
+    return false;
+}
+
+bool jobs_pending(struct shell *sh)
+{
+    char buf[64];
+    bool pending = false;
+    while (read(sh->jobs.wake[0], buf, sizeof(buf)) > 0)
+        pending = true;
+    return pending;
+}
+
+void jobs_notify(struct shell *sh)
+{
+    struct job **it = &sh->jobs.head;
+    while (*it)
+    {
+        struct job *j = *it;
+        bool done = job_done(j);
+        if (!j->notified && (done || !job_running(j)))
+        {
+            if (sh->shell_is_interactive)
+                job_print(stderr, j);
+            j->notified = true;
+        }
+        if (done && j->notified)
+        {
+            *it = j->next;
+            job_free(j);
+            continue;
+        }
+        it = &j->next;
+    }
+}
+
+/*
+ * Find the job named by spec, %n or %% for the newest job. NULL names the
+ * newest job too. Reports an error for cmd and returns NULL if there is no
+ * such job.
+ */
+static struct job *job_find(struct shell *sh, const char *cmd, const char *spec)
+{
+    if (!spec || strcmp(spec, "%%") == 0 || strcmp(spec, "%+") == 0)
+    {
+        if (!sh->jobs.head)
+            fprintf(stderr, "%s: no current job\n", cmd);
+        return sh->jobs.head;
+    }
+    char *end;
+    long id = strtol(spec + (spec[0] == '%'), &end, 10);
+    for (struct job *j = sh->jobs.head; j && !*end; j = j->next)
+    {
+        if (j->id == id)
+            return j;
+    }
+    fprintf(stderr, "%s: %s: no such job\n", cmd, spec);
+    return NULL;
+}
+
+int builtin_jobs(struct shell *sh, char **argv)
+{
+    UNUSED(argv);
+    jobs_poll(sh);
+    // Print oldest first
+    size_t n = 0;
+    for (struct job *j = sh->jobs.head; j; j = j->next)
+        n++;
+    struct job **order = (struct job **)arena_alloc(&sh->arena, sizeof(struct job *) * (n + 1));
+    n = 0;
+    for (struct job *j = sh->jobs.head; j; j = j->next)
+        order[n++] = j;
+    while (n-- > 0)
+    {
+        job_write(&sh->out, order[n]);
+        order[n]->notified = true;
+    }
+    jobs_notify(sh);
+    return 0;
+}
+
+int builtin_fg(struct shell *sh, char **argv)
+{
+    jobs_poll(sh);
+    struct job *j = job_find(sh, "fg", argv[1]);
+    if (!j)
+        return EXIT_FAILURE;
+    // The job takes over the terminal, the line has to be out before it
+    writer_printf(&sh->out, "%s\n", j->cmd);
+    writer_flush(&sh->out);
+    job_foreground(sh, j, true);
+    return sh->status;
+}
+
+int builtin_bg(struct shell *sh, char **argv)
+{
+    jobs_poll(sh);
+    struct job *j = job_find(sh, "bg", argv[1]);
+    if (!j)
+        return EXIT_FAILURE;
+    if (job_done(j))
+    {
+        fprintf(stderr, "bg: job has terminated\n");
+        return EXIT_FAILURE;
+    }
+    job_background(sh, j, true);
+    return 0;
+}
+
+/*
+ * Wait for a job to finish and take it out of the table, its status has
+ * been reported to whoever asked for it. A job that stops is left in the
+ * table.
+ */
+static int job_wait_done(struct shell *sh, struct job *j)
+{
+    job_wait(j, WUNTRACED);
+    if (!job_done(j))
+        return 128 + SIGTSTP;
+    int status = j->procs[j->nprocs - 1].status;
+    job_remove(sh, j);
+    return status;
+}
+
+/*
+ * wait             wait for every job that is running
+ * wait %n|pid ...  wait for each job and return the status of the last one
+ */
+int builtin_wait(struct shell *sh, char **argv)
+{
+    int rval = 0;
+    jobs_poll(sh);
+    if (!argv[1])
+    {
+        struct job *j = sh->jobs.head;
+        while (j)
+        {
+            struct job *next = j->next;
+            if (job_running(j) || job_done(j))
+                job_wait_done(sh, j);
+            j = next;
+        }
+        return 0;
+    }
+    for (int i = 1; argv[i]; i++)
+    {
+        struct job *j = NULL;
+        if (argv[i][0] == '%')
+        {
+            j = job_find(sh, "wait", argv[i]);
+        }
+        else
+        {
+            char *end;
+            long pid = strtol(argv[i], &end, 10);
+            for (j = sh->jobs.head; j && !*end; j = j->next)
+            {
+                bool found = false;
+                for (size_t k = 0; k < j->nprocs && !found; k++)
+                    found = j->procs[k].pid == pid;
+                if (found)
+                    break;
+            }
+            if (!j || *end)
+            {
+                fprintf(stderr, "wait: pid %s is not a child of this shell\n", argv[i]);
+                j = NULL;
+            }
+        }
+        rval = j ? job_wait_done(sh, j) : 127;
+    }
+    return rval;
+}
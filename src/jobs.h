@@ -0,0 +1,182 @@
+#ifndef JOBS_H
+#define JOBS_H
+#include <stdbool.h>
+#include <sys/types.h>
+#include <termios.h>
+#include "parse.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+  struct shell;
+
+  /**
+   * One process of a job. Stages that could not be launched have a pid of
+   * -1 and are done from the start.
+   */
+  struct job_proc
+  {
+    pid_t pid;
+    int status;   /* exit status once done */
+    bool done;
+    bool stopped;
+    int pidfd;    /* open while the process is live and in the job table */
+    int epfd;     /* epoll set the pidfd was added to, -1 for none */
+  };
+
+  /**
+   * A pipeline the shell launched and has not finished reporting on.
+   */
+  struct job
+  {
+    int id;
+    pid_t pgid;
+    struct job_proc *procs;
+    size_t nprocs;
+    char *cmd;               /* the pipeline as text, for messages */
+    struct termios tmodes;   /* terminal modes saved when the job stopped */
+    bool has_tmodes;
+    bool notified;           /* the last state change has been reported */
+    struct job *next;
+  };
+
+  /**
+   * The jobs of a shell, newest first.
+   */
+  struct jobs
+  {
+    struct job *head;
+    int wake[2]; /* self pipe, the SIGCHLD handler writes a byte here */
+    int epfd;    /* epoll set the pidfds of jobs are added to, -1 for none */
+  };
+
+  /**
+   * @brief Set up an empty job table and install the SIGCHLD handler that
+   * signals the self pipe.
+   *
+   * @param sh The shell
+   */
+  void jobs_init(struct shell *sh);
+
+  /**
+   * @brief Free every job. Running jobs are left running.
+   *
+   * @param sh The shell
+   */
+  void jobs_destroy(struct shell *sh);
+
+  /**
+   * @brief Start over with an empty job table in a forked copy of the
+   * shell. The jobs belong to the parent, so their processes are not
+   * touched and their pidfds stay in the parent's epoll set.
+   *
+   * @param sh The shell
+   */
+  void jobs_forget(struct shell *sh);
+
+  /**
+   * @brief Create a job for a pipeline that is about to be launched. The
+   * caller fills in the pid of every stage and then hands the job to
+   * job_foreground or job_background.
+   *
+   * @param pl The pipeline
+   * @return The job, with every stage marked as not launched
+   */
+  struct job *job_new(struct ast_pipeline *pl);
+
+  /**
+   * @brief Give a job the terminal and wait until every process in it has
+   * finished or stopped. A finished job sets sh->status and sh->pipestatus
+   * and is freed. A stopped job is kept in the job table.
+   *
+   * @param sh The shell
+   * @param j The job
+   * @param cont Send SIGCONT to the job first
+   */
+  void job_foreground(struct shell *sh, struct job *j, bool cont);
+
+  /**
+   * @brief Let a job run without the terminal and keep it in the job table.
+   *
+   * @param sh The shell
+   * @param j The job
+   * @param cont Send SIGCONT to the job first
+   */
+  void job_background(struct shell *sh, struct job *j, bool cont);
+
+  /**
+   * @brief Collect the status of every background process that changed
+   * state without blocking, so finished jobs never linger as zombies. Exits
+   * of processes watched through jobs_watch are left to jobs_event.
+   *
+   * @param sh The shell
+   */
+  void jobs_reap(struct shell *sh);
+
+  /**
+   * @brief Add the pidfd of every process in the job table to an epoll set,
+   * now and whenever a job enters the table. The epoll data of each pidfd is
+   * a tag to pass to jobs_event when it becomes readable. A pidfd is closed,
+   * and so leaves the set, once its process has been reaped.
+   *
+   * @param sh The shell
+   * @param epfd The epoll set
+   */
+  void jobs_watch(struct shell *sh, int epfd);
+
+  /**
+   * @brief Reap the processes of the job a readable pidfd belongs to.
+   * Jobs are only freed by jobs_notify and the job builtins, so every tag
+   * returned by one epoll_wait call can be handled before either runs.
+   *
+   * @param sh The shell
+   * @param tag The epoll data of the pidfd
+   */
+  void jobs_event(struct shell *sh, void *tag);
+
+  /**
+   * @brief Check if jobs_notify has anything to print.
+   *
+   * @param sh The shell
+   * @return True if an interactive shell has job notices pending
+   */
+  bool jobs_unreported(const struct shell *sh);
+
+  /**
+   * @brief Check the self pipe for SIGCHLD. The pipe is drained.
+   *
+   * @param sh The shell
+   * @return True if a child changed state since the last call
+   */
+  bool jobs_pending(struct shell *sh);
+
+  /**
+   * @brief Report jobs that finished or stopped since they were last
+   * reported and drop finished jobs from the table.
+   *
+   * @param sh The shell
+   */
+  void jobs_notify(struct shell *sh);
+
+  /**
+   * @brief Convert a status from waitpid into the value we report as the
+   * exit status of a command. Commands killed by a signal report 128 plus
+   * the signal.
+   *
+   * @param status The status from waitpid
+   * @return The exit status
+   */
+  int job_exit_status(int status);
+
+  int builtin_jobs(struct shell *sh, char **argv);
+  int builtin_fg(struct shell *sh, char **argv);
+  int builtin_bg(struct shell *sh, char **argv);
+  int builtin_wait(struct shell *sh, char **argv);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif
@@ -0,0 +1,528 @@
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "jump.h"
+#include "writer.h"
+
+/*
+ * Once the ranks add up to more than this every rank is scaled down a
+ * little at each save and directories left below one visit are dropped.
+ */
+#define JUMP_RANK_MAX 1000000.0
+
+static void *xrealloc(void *p, size_t size)
+{
+    void *rval = realloc(p, size);
+    if (!rval) {
+        fprintf(stderr, "realloc failed\n");
+        abort();
+    }
+    return rval;
+}
+
+static char *xstrdup(const char *s)
+{
+    char *rval = strdup(s);
+    if (!rval) {
+        fprintf(stderr, "strdup failed\n");
+        abort();
+    }
+    return rval;
+}
+
+/* The records of an image, none if it is not a jump file */
+struct view
+{
+    const struct jump_rec *recs;
+    size_t count;
+    const char *paths;
+    size_t strings;
+};
+
+/*
+ * Whether a record points inside the paths. The paths end with a NUL, so
+ * any of them read from there stops before their end.
+ */
+static bool rec_ok(const struct jump_rec *r, size_t strings)
+{
+    return (size_t)r->path + r->len < strings && r->base <= r->len;
+}
+
+static void view_of(const char *image, size_t size, struct view *v)
+{
+    v->recs = NULL;
+    v->count = 0;
+    v->paths = NULL;
+    v->strings = 0;
+    const struct jump_header *h = (const struct jump_header *)image;
+    if (!image || size < sizeof(*h) || h->magic != JUMP_MAGIC)
+        return;
+    size_t start = sizeof(*h) + (size_t)h->count * sizeof(struct jump_rec);
+    if (start > size || h->strings > size - start)
+        return;
+    const char *paths = image + start;
+    if (h->count && (!h->strings || paths[h->strings - 1] != '\0'))
+        return;
+    v->recs = (const struct jump_rec *)(image + sizeof(*h));
+    v->count = h->count;
+    v->paths = paths;
+    v->strings = (size_t)h->strings;
+}
+
+static void drop_image(struct jump *j)
+{
+    if (j->mapped)
+        munmap(j->image, j->size);
+    else
+        free(j->image);
+    j->image = NULL;
+    j->size = 0;
+    j->mapped = false;
+    j->recs = NULL;
+    j->count = 0;
+    j->paths = NULL;
+    j->strings = 0;
+}
+
+static void set_image(struct jump *j, char *image, size_t size, bool mapped)
+{
+    struct view v;
+    drop_image(j);
+    j->image = image;
+    j->size = size;
+    j->mapped = mapped;
+    view_of(image, size, &v);
+    j->recs = v.recs;
+    j->count = v.count;
+    j->paths = v.paths;
+    j->strings = v.strings;
+}
+
+/* The whole file open on fd, NULL if it is empty */
+static int map_fd(int fd, char **image, size_t *size)
+{
+    struct stat st;
+    *image = NULL;
+    *size = 0;
+    if (fstat(fd, &st) < 0)
+        return -1;
+    if (st.st_size == 0)
+        return 0;
+    void *map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (map == MAP_FAILED)
+        return -1;
+    *image = (char *)map;
+    *size = (size_t)st.st_size;
+    return 0;
+}
+
+void jump_init(struct jump *j)
+{
+    memset(j, 0, sizeof(*j));
+}
+
+int jump_open(struct jump *j, const char *file)
+{
+    char *image;
+    size_t size;
+    int fd = open(file, O_RDONLY | O_CLOEXEC);
+    if (fd < 0 && errno != ENOENT)
+        return -1;
+    if (fd >= 0) {
+        int rval = map_fd(fd, &image, &size);
+        int err = errno;
+        close(fd);
+        if (rval < 0) {
+            errno = err;
+            return -1;
+        }
+        set_image(j, image, size, image != NULL);
+    }
+    free(j->file);
+    j->file = xstrdup(file);
+    return 0;
+}
+
+static void visits_free(struct jump *j)
+{
+    for (size_t i = 0; i < j->nvisits; i++)
+        free(j->visits[i].path);
+    j->nvisits = 0;
+}
+
+void jump_close(struct jump *j)
+{
+    jump_save(j);
+    visits_free(j);
+    drop_image(j);
+    free(j->visits);
+    free(j->file);
+    memset(j, 0, sizeof(*j));
+}
+
+void jump_forget(struct jump *j)
+{
+    memset(j, 0, sizeof(*j));
+}
+
+static size_t base_of(const char *path)
+{
+    const char *slash = strrchr(path, '/');
+    return slash ? (size_t)(slash - path) + 1 : 0;
+}
+
+void jump_visit(struct jump *j, const char *path, time_t now)
+{
+    if (path[0] != '/' || strlen(path) > UINT16_MAX)
+        return;
+    if (j->nvisits == j->visits_cap) {
+        j->visits_cap = j->visits_cap ? j->visits_cap * 2 : JUMP_PENDING;
+        j->visits = (struct jump_visit *)xrealloc(j->visits, sizeof(struct jump_visit) * j->visits_cap);
+    }
+    j->visits[j->nvisits].path = xstrdup(path);
+    j->visits[j->nvisits].time = now;
+    j->nvisits++;
+}
+
+/* A directory being merged, from the file or from a visit */
+struct entry
+{
+    const char *path;
+    size_t len;
+    size_t base;
+    double rank;
+    int64_t time;
+};
+
+static int cmp_entry(const void *a, const void *b)
+{
+    const struct entry *x = (const struct entry *)a;
+    const struct entry *y = (const struct entry *)b;
+    int c = strcmp(x->path + x->base, y->path + y->base);
+    return c ? c : strcmp(x->path, y->path);
+}
+
+/*
+ * The records of v and the visits held, sorted with the visits to a
+ * directory added to its record, written as a jump file.
+ */
+static void build(struct jump *j, const struct view *v, struct writer *w)
+{
+    size_t n = v->count + j->nvisits;
+    struct entry *e = (struct entry *)xrealloc(NULL, sizeof(struct entry) * (n ? n : 1));
+    size_t m = 0;
+    for (size_t i = 0; i < v->count; i++) {
+        const struct jump_rec *r = &v->recs[i];
+        if (!rec_ok(r, v->strings) || v->paths[r->path + r->len] != '\0')
+            continue;
+        e[m].path = v->paths + r->path;
+        e[m].len = r->len;
+        e[m].base = r->base;
+        e[m].rank = v->recs[i].rank;
+        e[m].time = v->recs[i].time;
+        m++;
+    }
+    n = m + j->nvisits;
+    for (size_t i = 0; i < j->nvisits; i++) {
+        struct entry *x = &e[m + i];
+        x->path = j->visits[i].path;
+        x->len = strlen(x->path);
+        x->base = base_of(x->path);
+        x->rank = 1;
+        x->time = j->visits[i].time;
+    }
+    qsort(e, n, sizeof(struct entry), cmp_entry);
+
+    size_t count = 0;
+    double total = 0;
+    for (size_t i = 0; i < n; i++) {
+        if (count && strcmp(e[count - 1].path, e[i].path) == 0) {
+            e[count - 1].rank += e[i].rank;
+            if (e[i].time > e[count - 1].time)
+                e[count - 1].time = e[i].time;
+        } else {
+            e[count++] = e[i];
+        }
+        total += e[i].rank;
+    }
+    if (total > JUMP_RANK_MAX) {
+        size_t kept = 0;
+        for (size_t i = 0; i < count; i++) {
+            e[i].rank *= 0.99;
+            if (e[i].rank >= 1)
+                e[kept++] = e[i];
+        }
+        count = kept;
+    }
+
+    struct jump_header h = {JUMP_MAGIC, (uint32_t)count, 0};
+    for (size_t i = 0; i < count; i++)
+        h.strings += e[i].len + 1;
+    writer_put(w, (const char *)&h, sizeof(h));
+    uint32_t off = 0;
+    for (size_t i = 0; i < count; i++) {
+        struct jump_rec r = {e[i].time, e[i].rank, off, (uint16_t)e[i].len, (uint16_t)e[i].base};
+        writer_put(w, (const char *)&r, sizeof(r));
+        off += (uint32_t)e[i].len + 1;
+    }
+    for (size_t i = 0; i < count; i++)
+        writer_put(w, e[i].path, e[i].len + 1);
+    free(e);
+}
+
+/*
+ * Lock the file as it is now. Another shell may replace it while this one
+ * waits for the lock, then it is the new file that has to be locked.
+ */
+static int lock_file(const char *file)
+{
+    for (;;) {
+        struct stat a, b;
+        int fd = open(file, O_RDONLY | O_CREAT | O_CLOEXEC, 0600);
+        if (fd < 0)
+            return -1;
+        if (flock(fd, LOCK_EX) < 0 || fstat(fd, &a) < 0) {
+            int err = errno;
+            close(fd);
+            errno = err;
+            return -1;
+        }
+        if (stat(file, &b) == 0 && a.st_dev == b.st_dev && a.st_ino == b.st_ino)
+            return fd;
+        close(fd);
+    }
+}
+
+/* Write a new file next to the old one and move it in its place */
+static int replace_file(struct jump *j, struct writer *w)
+{
+    char tmp[4096];
+    snprintf(tmp, sizeof(tmp), "%s.%d.tmp", j->file, (int)getpid());
+    int fd = open(tmp, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    if (fd < 0)
+        return -1;
+    w->fd = fd;
+    char *image = NULL;
+    size_t size = 0;
+    if (writer_flush(w) < 0 || map_fd(fd, &image, &size) < 0 || rename(tmp, j->file) < 0) {
+        int err = w->err ? w->err : errno;
+        if (image)
+            munmap(image, size);
+        close(fd);
+        unlink(tmp);
+        errno = err;
+        return -1;
+    }
+    close(fd);
+    set_image(j, image, size, image != NULL);
+    return 0;
+}
+
+int jump_save(struct jump *j)
+{
+    struct view v;
+    struct writer w;
+    if (!j->nvisits)
+        return 0;
+    writer_init(&w, -1);
+    if (!j->file) {
+        view_of(j->image, j->size, &v);
+        build(j, &v, &w);
+        set_image(j, w.buf, w.len, false);
+        visits_free(j);
+        return 0;
+    }
+
+    // The file as the last shell to save left it, not as it was mapped
+    char *image;
+    size_t size;
+    int lock = lock_file(j->file);
+    if (lock < 0 || map_fd(lock, &image, &size) < 0) {
+        int err = errno;
+        if (lock >= 0)
+            close(lock);
+        writer_destroy(&w);
+        errno = err;
+        return -1;
+    }
+    view_of(image, size, &v);
+    build(j, &v, &w);
+    if (image)
+        munmap(image, size);
+    int rval = replace_file(j, &w);
+    int err = errno;
+    close(lock);
+    writer_destroy(&w);
+    if (rval < 0) {
+        errno = err;
+        return -1;
+    }
+    visits_free(j);
+    return 0;
+}
+
+static const char *rec_path(const struct jump *j, size_t i)
+{
+    return rec_ok(&j->recs[i], j->strings) ? j->paths + j->recs[i].path : "";
+}
+
+static const char *rec_name(const struct jump *j, size_t i)
+{
+    return rec_ok(&j->recs[i], j->strings) ? j->paths + j->recs[i].path + j->recs[i].base : "";
+}
+
+/* The record of a path, -1 if it has none */
+static long find_rec(const struct jump *j, const char *path)
+{
+    const char *name = path + base_of(path);
+    size_t lo = 0, hi = j->count;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        int c = strcmp(rec_name(j, mid), name);
+        if (!c)
+            c = strcmp(rec_path(j, mid), path);
+        if (!c)
+            return (long)mid;
+        if (c < 0)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return -1;
+}
+
+/* Like z: a visit within the hour counts four times, after a week a quarter */
+static double frecency(double rank, int64_t time, time_t now)
+{
+    int64_t age = (int64_t)now - time;
+    if (age < 3600)
+        return rank * 4;
+    if (age < 86400)
+        return rank * 2;
+    if (age < 604800)
+        return rank / 2;
+    return rank / 4;
+}
+
+/* The words but the last in the path before its last component, in order */
+static bool words_before(const char *path, size_t base, char **words, size_t last)
+{
+    const char *p = path;
+    for (size_t i = 0; i < last; i++) {
+        const char *q = strstr(p, words[i]);
+        size_t len = strlen(words[i]);
+        if (!q || q + len > path + base)
+            return false;
+        p = q + len;
+    }
+    return true;
+}
+
+static bool name_matches(const char *name, const char *word, size_t len, bool prefix)
+{
+    return prefix ? strncmp(name, word, len) == 0 : strstr(name, word) != NULL;
+}
+
+/* Keep the best directories in order, most lookups find a few */
+static void add_match(struct jump *j, const char *path, double score)
+{
+    size_t i = j->nmatches;
+    if (i == JUMP_MATCHES) {
+        if (score <= j->matches[i - 1].score)
+            return;
+        i--;
+    } else {
+        j->nmatches++;
+    }
+    for (; i > 0 && j->matches[i - 1].score < score; i--)
+        j->matches[i] = j->matches[i - 1];
+    j->matches[i].path = path;
+    j->matches[i].score = score;
+}
+
+/* What the visits held add to a directory's rank, and the last of them */
+static double held_rank(const struct jump *j, const char *path, int64_t *time)
+{
+    double rank = 0;
+    for (size_t i = 0; i < j->nvisits; i++) {
+        if (strcmp(j->visits[i].path, path) == 0) {
+            rank += 1;
+            if (j->visits[i].time > *time)
+                *time = j->visits[i].time;
+        }
+    }
+    return rank;
+}
+
+static void consider_rec(struct jump *j, size_t i, char **words, size_t last, time_t now)
+{
+    if (!rec_ok(&j->recs[i], j->strings))
+        return;
+    const char *path = rec_path(j, i);
+    if (!words_before(path, j->recs[i].base, words, last))
+        return;
+    int64_t time = j->recs[i].time;
+    double rank = j->recs[i].rank + held_rank(j, path, &time);
+    add_match(j, path, frecency(rank, time, now));
+}
+
+/* Visited directories the file does not have yet, each once */
+static void consider_visits(struct jump *j, char **words, size_t last, bool prefix, time_t now)
+{
+    size_t len = strlen(words[last]);
+    for (size_t i = 0; i < j->nvisits; i++) {
+        const char *path = j->visits[i].path;
+        size_t base = base_of(path);
+        bool seen = false;
+        for (size_t k = 0; k < i && !seen; k++)
+            seen = strcmp(j->visits[k].path, path) == 0;
+        if (seen || !name_matches(path + base, words[last], len, prefix) ||
+            !words_before(path, base, words, last) || find_rec(j, path) >= 0)
+            continue;
+        int64_t time = 0;
+        double rank = held_rank(j, path, &time);
+        add_match(j, path, frecency(rank, time, now));
+    }
+}
+
+size_t jump_find(struct jump *j, char **words, time_t now, const struct jump_match **matches)
+{
+    size_t last = 0;
+    while (words[last + 1])
+        last++;
+    const char *word = words[last];
+    size_t len = strlen(word);
+    j->nmatches = 0;
+
+    // The names starting with the word are next to each other
+    size_t lo = 0, hi = j->count;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (strcmp(rec_name(j, mid), word) < 0)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    for (size_t i = lo; i < j->count && strncmp(rec_name(j, i), word, len) == 0; i++)
+        consider_rec(j, i, words, last, now);
+    consider_visits(j, words, last, true, now);
+
+    // Only when no name starts with it is every name looked through
+    if (!j->nmatches) {
+        for (size_t i = 0; i < j->count; i++) {
+            const char *name = strchr(rec_name(j, i), word[0]);
+            if (name && strstr(name, word))
+                consider_rec(j, i, words, last, now);
+        }
+        consider_visits(j, words, last, false, now);
+    }
+    *matches = j->matches;
+    return j->nmatches;
+}
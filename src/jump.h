@@ -0,0 +1,156 @@
+#ifndef JUMP_H
+#define JUMP_H
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <time.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#define JUMP_MAGIC 0x4c4a4d31u /* "LJM1" */
+
+/* Visits the shell holds before it writes them to the file */
+#define JUMP_PENDING 16
+
+/* Directories a lookup keeps, the best ones */
+#define JUMP_MATCHES 16
+
+  /**
+   * The start of the jump file. The records follow, then the paths they
+   * point into, each with a terminating NUL.
+   */
+  struct jump_header
+  {
+    uint32_t magic;   /* JUMP_MAGIC, anything else is an empty file */
+    uint32_t count;   /* records */
+    uint64_t strings; /* bytes of paths after the records */
+  };
+
+  /**
+   * A directory and how often and how lately it was visited. The records
+   * are sorted by the last component of the path, then by the path, so
+   * the directories whose name starts with a word follow one another.
+   */
+  struct jump_rec
+  {
+    int64_t time;  /* last visit, seconds since the epoch */
+    double rank;   /* visits, scaled down as the file ages */
+    uint32_t path; /* offset of the path in the paths */
+    uint16_t len;  /* bytes of path */
+    uint16_t base; /* offset of the last component in the path */
+  };
+
+  /** A visit not written to the file yet. */
+  struct jump_visit
+  {
+    char *path;
+    int64_t time;
+  };
+
+  /** A directory a lookup found, best first. */
+  struct jump_match
+  {
+    const char *path;
+    double score;
+  };
+
+  /**
+   * The directories cd went to, ranked by frecency: how often and how
+   * lately each was visited. The file is mapped as it is and a record is
+   * only checked when it is read, a lookup binary searches the records for
+   * a name and only scores what it finds. Visits
+   * are held in memory and merged into the file in batches: the file is
+   * locked, read again in case another shell wrote it, and replaced by a
+   * new one. An index with no file keeps the merged records in memory the
+   * same way.
+   */
+  struct jump
+  {
+    char *file;          /* NULL keeps the index in memory only */
+    char *image;         /* the file mapped, or the records in memory */
+    size_t size;
+    bool mapped;         /* image is a mapping of the file */
+    const struct jump_rec *recs;
+    size_t count;
+    const char *paths;
+    size_t strings;      /* bytes of paths */
+    struct jump_visit *visits;
+    size_t nvisits;
+    size_t visits_cap;
+    struct jump_match matches[JUMP_MATCHES]; /* the result of the last lookup */
+    size_t nmatches;
+  };
+
+  /**
+   * @brief Initialize an empty index with no file behind it.
+   *
+   * @param j The index
+   */
+  void jump_init(struct jump *j);
+
+  /**
+   * @brief Map the jump file, which does not have to exist yet. Visits
+   * held so far go into it on the next save.
+   *
+   * @param j The index
+   * @param file The path of the file
+   * @return 0 on success, -1 with errno set
+   */
+  int jump_open(struct jump *j, const char *file);
+
+  /**
+   * @brief Save the visits held and free all memory.
+   *
+   * @param j The index
+   */
+  void jump_close(struct jump *j);
+
+  /**
+   * @brief Drop the index in a forked child without saving, the parent
+   * saves the visits it holds.
+   *
+   * @param j The index
+   */
+  void jump_forget(struct jump *j);
+
+  /**
+   * @brief Count a visit to a directory.
+   *
+   * @param j The index
+   * @param path The absolute path of the directory
+   * @param now The time of the visit
+   */
+  void jump_visit(struct jump *j, const char *path, time_t now);
+
+  /**
+   * @brief Merge the visits held into the file, or into the records in
+   * memory when there is no file.
+   *
+   * @param j The index
+   * @return 0 on success, -1 with errno set, the visits are kept then
+   */
+  int jump_save(struct jump *j);
+
+  /**
+   * @brief Find the directories for the words of cd. The last word has to
+   * start the last component of the path, or if no directory's does, be
+   * part of it. The other words have to be in the path before it, in
+   * order.
+   *
+   * @param j The index
+   * @param words The words, NULL terminated, at least one
+   * @param now The time to score the visits against
+   * @param matches Set to the best JUMP_MATCHES directories found, best
+   * first, valid until the next call
+   * @return The number of directories in matches
+   */
+  size_t jump_find(struct jump *j, char **words, time_t now, const struct jump_match **matches);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif
@@ -1,23 +1,30 @@
+#include <errno.h>
 #include <stdio.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include <unistd.h>
 #include <signal.h>
-#include <ctype.h>
 #include "lab.h"
+#include "scan.h"
+#include "builtins.h"
 #include <pwd.h>
 #include <readline/readline.h>
-#include <readline/history.h>
 
 #include <sys/types.h>
 #include <sys/wait.h>
 
+#define DEFAULT_PROMPT "shell>"
+
+/* How many lines the arrow keys can reach when HISTSIZE is not set */
+#define HISTORY_RECALL 1000
 
 char *get_prompt(const char *env) {
     char *rval = NULL;
     const char *tmp = getenv(env);
     if (!tmp) {
-        tmp = "shell>";
+        tmp = DEFAULT_PROMPT;
     }
     int n = strlen(tmp) + 1;
     rval = (char*)malloc(sizeof(char)*n);
@@ -25,28 +32,136 @@ char *get_prompt(const char *env) {
     return rval;
 }
 
-char **cmd_parse(char const *line) {
-    const long arg_max = sysconf(_SC_ARG_MAX);
-    char *tmp = strdup(line);
-    char *save = NULL;
-    if (!tmp) {
-        fprintf(stderr, "strdup failed\n");
-        abort();
+/*
+ * Find the next argument in [*p, end). On success the argument starts at the
+ * returned pointer, is len bytes long and *p is moved past it. Returns NULL
+ * when there are no arguments left.
+ */
+static const char *cmd_next(const char **p, const char *end, size_t *len)
+{
+    const char *start = *p + scan_nonspace(*p, (size_t)(end - *p));
+    if (start == end)
+        return NULL;
+    *len = scan_space(start, (size_t)(end - start));
+    *p = start + *len;
+    return start;
+}
+
+/*
+ * Count the arguments in line and the bytes needed to hold a NUL terminated
+ * copy of each of them.
+ */
+static size_t cmd_count(char const *line, const char *end, size_t *bytes)
+{
+    size_t argc = 0;
+    size_t len;
+    *bytes = 0;
+    for (const char *p = line; cmd_next(&p, end, &len);) {
+        argc++;
+        *bytes += len + 1;
+    }
+    return argc;
+}
+
+/*
+ * Lay out argv followed by the packed argument strings. The caller has
+ * already sized the arena (or does not care about it growing).
+ */
+static char **cmd_fill(struct arena *a, char const *line, const char *end, size_t argc)
+{
+    char **rval = (char **)arena_alloc(a, sizeof(char *) * (argc + 1));
+    size_t i = 0;
+    size_t len;
+    const char *tok;
+    for (const char *p = line; (tok = cmd_next(&p, end, &len));) {
+        rval[i++] = arena_strndup(a, tok, len);
+    }
+    rval[i] = NULL;
+    return rval;
+}
+
+void cmd_tokenize(struct arena *a, char const *line, struct cmd_tokens *out)
+{
+    const char *end = line + strlen(line);
+    size_t bytes;
+    size_t len;
+    size_t i = 0;
+    const char *tok;
+
+    out->line = line;
+    out->count = cmd_count(line, end, &bytes);
+    out->tok = (struct cmd_token *)arena_alloc(a, sizeof(struct cmd_token) * (out->count + 1));
+    for (const char *p = line; (tok = cmd_next(&p, end, &len));) {
+        out->tok[i].off = (size_t)(tok - line);
+        out->tok[i].len = len;
+        i++;
+    }
+}
+
+bool cmd_token_is(const struct cmd_tokens *t, size_t i, const char *s)
+{
+    if (i >= t->count)
+        return false;
+    size_t n = strlen(s);
+    return t->tok[i].len == n && memcmp(t->line + t->tok[i].off, s, n) == 0;
+}
+
+char **cmd_materialize(struct arena *a, const struct cmd_tokens *t)
+{
+    size_t bytes = 0;
+    for (size_t i = 0; i < t->count; i++)
+        bytes += t->tok[i].len + 1;
+
+    char **rval = (char **)arena_alloc(a, sizeof(char *) * (t->count + 1));
+    char *buf = (char *)arena_alloc(a, bytes);
+    for (size_t i = 0; i < t->count; i++) {
+        memcpy(buf, t->line + t->tok[i].off, t->tok[i].len);
+        buf[t->tok[i].len] = '\0';
+        rval[i] = buf;
+        buf += t->tok[i].len + 1;
     }
-    char **rval = (char**)calloc(arg_max, sizeof(char*));
-    char *tok = strtok_r(tmp, " ", &save);
+    rval[t->count] = NULL;
+    return rval;
+}
+
+char **cmd_terminate(struct arena *a, char *line, const struct cmd_tokens *t)
+{
+    char **rval = (char **)arena_alloc(a, sizeof(char *) * (t->count + 1));
+    for (size_t i = 0; i < t->count; i++) {
+        rval[i] = line + t->tok[i].off;
+        rval[i][t->tok[i].len] = '\0';
+    }
+    rval[t->count] = NULL;
+    return rval;
+}
 
+char **cmd_parse_arena(struct arena *a, char const *line) {
+    const char *end = line + strlen(line);
+    size_t bytes;
+    size_t argc = cmd_count(line, end, &bytes);
+    return cmd_fill(a, line, end, argc);
+}
+
+char **cmd_parse(char const *line) {
+    const char *end = line + strlen(line);
+    size_t bytes;
+    size_t argc = cmd_count(line, end, &bytes);
+    struct arena a;
 
-    for (int i = 0; tok && i < arg_max; i++) {
-        rval[i] = tok;
-        tok = strtok_r(NULL, " ", &save);
+    /*
+     * Size a one shot arena exactly so argv lands at the start of its only
+     * block, that way cmd_free can release everything with a single free.
+     */
+    arena_init(&a, sizeof(char *) * (argc + 1) + bytes);
+    char **rval = cmd_fill(&a, line, end, argc);
+    if (a.chunks || (char *)rval != a.base) {
+        fprintf(stderr, "cmd_parse: arena was not sized correctly\n");
+        abort();
     }
     return rval;
 }
 
 void cmd_free(char **line) {
-    char *tmp = *line;
-    free(tmp);
     free((void *)line);
 }
 
@@ -57,64 +172,669 @@ char *trim_white(char *line)
         return line;
     }
 
-    char *curr = line;
-    while (curr && isspace(*curr)) 
-        curr++;
-    if (*curr == '\0') {
+    size_t len = strlen(line);
+    size_t start = scan_nonspace(line, len);
+    if (start == len) {
         *line = '\0';
         return line;
     }
 
-    if (curr != line) 
-    {
-        int len = strlen(curr);
-        memmove(line, curr, len + 1);
-    }
+    // trailing whitespace is short in practice, walk it back a byte at a time
+    while (len > start && scan_is_space(line[len - 1]))
+        len--;
 
-    curr = line + strlen(line) - 1;
-    while (curr > line && isspace(*curr)) {
-        curr--;
+    if (start)
+    {
+        memmove(line, line + start, len - start);
     }
-    *(curr + 1) = '\0';
+    line[len - start] = '\0';
 
     return line;
     
 }
 
-bool do_builtin(struct shell *sh, char **argv) {
-   bool rval = false;
-   if (strcmp(argv[0], "cd") == 0) 
-   {
-       if (change_dir(argv)) 
-       {
-           fprintf(stderr, "Failed to change directory\n");
-       }
-       rval = true;
-   } 
-   else if (strcmp(argv[0], "exit") == 0) 
-   {
-         sh_destroy(sh);
-   }
-    else if (strcmp(argv[0], "history") == 0) 
+/*
+ * Count a visit to the directory cd, pushd or popd went to. HOME is not
+ * worth jumping to, cd goes there with no word at all.
+ */
+static void jump_record(struct shell *sh)
+{
+    const char *path = sh->pwd.path;
+    const char *home = getenv("HOME");
+    if (path && !(home && strcmp(path, home) == 0)) {
+        jump_visit(&sh->jump, path, time(NULL));
+        if (sh->jump.nvisits >= JUMP_PENDING)
+            jump_save(&sh->jump);
+    }
+}
+
+/*
+ * The shell went to a directory cd or pushd named. The stack holds it so
+ * the next change needs no path for where the shell was.
+ */
+static void entered(struct shell *sh)
+{
+    if (sh->pwd.path)
+        dirstack_hold(&sh->dirs, sh->pwd.path);
+    jump_record(sh);
+}
+
+/* The best directory visited before for the words that can be entered */
+static const char *jump_to(struct shell *sh, char **words)
+{
+    const struct jump_match *m;
+    size_t n = jump_find(&sh->jump, words, time(NULL), &m);
+    for (size_t i = 0; i < n; i++) {
+        if (chdir(m[i].path) == 0)
+            return m[i].path;
+    }
+    return NULL;
+}
+
+/*
+ * cd [dir]        change to dir, or to HOME without one
+ * cd -            go back to the directory cd last left and print it
+ * cd word ...     jump to the directory visited most often and lately
+ *                 whose name starts with the last word, see jump_find,
+ *                 and print it. One word is only looked up when it has
+ *                 no slash and there is no such directory here.
+ */
+static int builtin_cd(struct shell *sh, char **argv)
+{
+    struct dirstack_entry here;
+    if (argv[1] && strcmp(argv[1], "-") == 0)
+    {
+        if (!sh->dirs.old.path)
+        {
+            fprintf(stderr, "cd: OLDPWD not set\n");
+            return 1;
+        }
+        const char *path = dirstack_back(&sh->dirs);
+        if (!path)
+        {
+            fprintf(stderr, "cd: %s\n", strerror(errno));
+            return 1;
+        }
+        pwd_set(&sh->pwd, path);
+        writer_printf(&sh->out, "%s\n", path);
+        jump_record(sh);
+        return 0;
+    }
+    bool have = dirstack_here(&sh->dirs, &here) == 0;
+    const char *jumped = NULL;
+    int rval = argv[1] && argv[2] ? -1 : change_dir(sh, argv);
+    if (rval && argv[1] && (argv[2] || (errno == ENOENT && !strchr(argv[1], '/'))))
+        jumped = jump_to(sh, argv + 1);
+    if (rval && !jumped)
     {
-        for (int i = history_base; i < history_length; i++){
-            HIST_ENTRY *curr = history_get(i);
-            printf("%d: %s\n", i, curr->line);
+        if (have)
+            dirstack_keep(&sh->dirs, &here);
+        fprintf(stderr, "Failed to change directory\n");
+        return 1;
+    }
+    if (have)
+        dirstack_left(&sh->dirs, &here);
+    if (jumped) {
+        pwd_set(&sh->pwd, jumped);
+        writer_printf(&sh->out, "%s\n", jumped);
+    }
+    entered(sh);
+    return 0;
+}
+
+/*
+ * The entry of the directory stack an argument of dirs, pushd or popd
+ * names, +n counting from the top where the current directory is 0 and -n
+ * from the bottom. Returns 0 if arg is not of that form, -1 if it names no
+ * entry.
+ */
+static int stack_arg(struct shell *sh, const char *arg, size_t *n)
+{
+    char *end;
+    if ((arg[0] != '+' && arg[0] != '-') || arg[1] < '0' || arg[1] > '9')
+        return 0;
+    unsigned long v = strtoul(arg + 1, &end, 10);
+    if (*end || v > sh->dirs.count)
+        return -1;
+    *n = arg[0] == '+' ? v : sh->dirs.count - v;
+    return 1;
+}
+
+static void print_dir(struct shell *sh, size_t i, const char *path, bool verbose, bool full)
+{
+    const char *home = getenv("HOME");
+    size_t len = home ? strlen(home) : 0;
+    if (verbose)
+        writer_printf(&sh->out, "%2zu  ", i);
+    else if (i)
+        writer_putc(&sh->out, ' ');
+    if (!full && len > 1 && strncmp(path, home, len) == 0 && (!path[len] || path[len] == '/')) {
+        writer_putc(&sh->out, '~');
+        path += len;
+    }
+    writer_puts(&sh->out, path);
+    if (verbose)
+        writer_putc(&sh->out, '\n');
+}
+
+static void print_dirs(struct shell *sh, bool verbose, bool full)
+{
+    struct dirstack *d = &sh->dirs;
+    const char *cwd = pwd_get(&sh->pwd);
+    print_dir(sh, 0, cwd ? cwd : ".", verbose, full);
+    for (size_t i = 1; i <= d->count; i++)
+        print_dir(sh, i, d->items[d->count - i].path, verbose, full);
+    if (!verbose)
+        writer_putc(&sh->out, '\n');
+}
+
+/*
+ * dirs [-c] [-l] [-v]
+ * List the current directory and the directory stack, top first. -c
+ * empties the stack, -l prints HOME in full, -v prints one entry a line
+ * with its number.
+ */
+static int builtin_dirs(struct shell *sh, char **argv)
+{
+    bool verbose = false, full = false;
+    for (int i = 1; argv[i]; i++) {
+        if (strcmp(argv[i], "-c") == 0) {
+            dirstack_clear(&sh->dirs);
+            return 0;
+        } else if (strcmp(argv[i], "-l") == 0) {
+            full = true;
+        } else if (strcmp(argv[i], "-v") == 0) {
+            verbose = true;
+        } else {
+            fprintf(stderr, "dirs: %s: invalid option\n", argv[i]);
+            return 2;
         }
-        rval = true;
-   }
-   return rval;
+    }
+    print_dirs(sh, verbose, full);
+    return 0;
+}
+
+/*
+ * pushd dir   put the current directory on the stack and change to dir
+ * pushd       swap the current directory with the top of the stack
+ * pushd +n    turn the stack until entry n is the current directory
+ * Going to a directory on the stack is an fchdir of the fd it holds.
+ */
+static int builtin_pushd(struct shell *sh, char **argv)
+{
+    size_t n = 0;
+    int arg = argv[1] ? stack_arg(sh, argv[1], &n) : 1;
+    if (arg < 0) {
+        fprintf(stderr, "pushd: %s: directory stack index out of range\n", argv[1]);
+        return 1;
+    }
+    if (!sh->dirs.count && arg) {
+        fprintf(stderr, "pushd: no other directory\n");
+        return 1;
+    }
+    int rval = 0;
+    char *to = NULL;
+    if (!argv[1]) {
+        rval = dirstack_swap(&sh->dirs);
+    } else if (!arg) {
+        // The logical path, pushd goes up through .. as cd does
+        to = pwd_lexical(&sh->pwd, argv[1]);
+        rval = dirstack_push(&sh->dirs, to ? to : argv[1]);
+    } else if (n) {
+        rval = dirstack_rotate(&sh->dirs, n);
+    }
+    if (rval < 0) {
+        fprintf(stderr, "pushd: %s: %s\n", argv[1] ? argv[1] : "", strerror(errno));
+        free(to);
+        return 1;
+    }
+    if (!arg)
+        pwd_set(&sh->pwd, to);
+    else if (!argv[1] || n)
+        pwd_set(&sh->pwd, sh->dirs.cur.path);
+    free(to);
+    print_dirs(sh, false, false);
+    if (!arg)
+        entered(sh);
+    else if (!argv[1] || n)
+        jump_record(sh);
+    return 0;
+}
+
+/*
+ * popd      take the top of the stack off and change to it
+ * popd +n   take entry n off the stack
+ */
+static int builtin_popd(struct shell *sh, char **argv)
+{
+    size_t n = 0;
+    int arg = argv[1] ? stack_arg(sh, argv[1], &n) : 1;
+    if (!sh->dirs.count) {
+        fprintf(stderr, "popd: directory stack empty\n");
+        return 1;
+    }
+    if (arg == 0) {
+        fprintf(stderr, "popd: %s: invalid argument\n", argv[1]);
+        return 2;
+    }
+    if (arg < 0) {
+        fprintf(stderr, "popd: %s: directory stack index out of range\n", argv[1]);
+        return 1;
+    }
+    if (dirstack_pop(&sh->dirs, n) < 0) {
+        fprintf(stderr, "popd: %s\n", strerror(errno));
+        return 1;
+    }
+    if (!n)
+        pwd_set(&sh->pwd, sh->dirs.cur.path);
+    print_dirs(sh, false, false);
+    if (!n)
+        jump_record(sh);
+    return 0;
+}
+
+/*
+ * exit [n]   exit with status n, or with the status of the last command
+ */
+static int builtin_exit(struct shell *sh, char **argv)
+{
+    if (argv[1]) {
+        char *end;
+        long n = strtol(argv[1], &end, 10);
+        if (end == argv[1] || *end) {
+            fprintf(stderr, "exit: %s: numeric argument required\n", argv[1]);
+            n = 2;
+        } else if (argv[2]) {
+            fprintf(stderr, "exit: too many arguments\n");
+            return 1;
+        }
+        sh->status = (int)(n & 0xff);
+    }
+    sh_destroy(sh);
+    return 0;
+}
+
+/*
+ * history              list the history, the command running now last
+ * history -s pattern   list the entries containing pattern, newest first
+ * history -n           let the arrow keys reach what other shells logged
+ */
+static int builtin_history(struct shell *sh, char **argv)
+{
+    struct histlog *h = &sh->hist;
+    histlog_sync(h);
+    if (argv[1] && strcmp(argv[1], "-n") == 0) {
+        sh_history_sync(sh);
+        return 0;
+    }
+    if (argv[1] && strcmp(argv[1], "-s") == 0) {
+        if (!argv[2]) {
+            fprintf(stderr, "history: -s: pattern required\n");
+            return 2;
+        }
+        // More than one word is searched for as the words joined by spaces
+        size_t len = 0;
+        for (int i = 2; argv[i]; i++)
+            len += strlen(argv[i]) + 1;
+        char *pattern = (char *)arena_alloc(&sh->arena, len);
+        pattern[0] = '\0';
+        for (int i = 2; argv[i]; i++) {
+            if (i > 2)
+                strcat(pattern, " ");
+            strcat(pattern, argv[i]);
+        }
+        long i = (long)h->count;
+        while ((i = histindex_search(&sh->histindex, h, pattern, (size_t)i)) >= 0)
+            writer_printf(&sh->out, "%ld: %s\n", i + 1, histlog_text(histlog_get(h, (size_t)i)));
+        return 0;
+    }
+    for (size_t i = 0; i < h->count; i++)
+        writer_printf(&sh->out, "%zu: %s\n", i + 1, histlog_text(histlog_get(h, i)));
+    if (h->pending)
+        writer_printf(&sh->out, "%zu: %s\n", h->count + 1, h->pending);
+    return 0;
+}
+
+/*
+ * hash           list the remembered commands and how often they were used
+ * hash -r        forget every remembered command
+ * hash -s        show how many lookups hit and missed the table
+ * hash name ...  look up and remember each name
+ */
+static int builtin_hash_cmd(struct shell *sh, char **argv)
+{
+    struct cmdhash *h = &sh->cmdhash;
+    int rval = 0;
+
+    if (!argv[1]) {
+        if (!h->count) {
+            writer_printf(&sh->out, "hash: hash table empty\n");
+            return 0;
+        }
+        writer_printf(&sh->out, "hits\tcommand\n");
+        for (size_t i = 0; i < h->cap; i++) {
+            if (h->slots[i].name)
+                writer_printf(&sh->out, "%4lu\t%s\n", h->slots[i].hits, h->slots[i].path);
+        }
+        return 0;
+    }
+    if (strcmp(argv[1], "-r") == 0) {
+        cmdhash_clear(h);
+        return 0;
+    }
+    if (strcmp(argv[1], "-s") == 0) {
+        writer_printf(&sh->out, "hits %lu misses %lu\n", h->hits, h->misses);
+        return 0;
+    }
+    for (int i = 1; argv[i]; i++) {
+        if (strchr(argv[i], '/'))
+            continue;
+        if (!cmdhash_lookup(h, argv[i])) {
+            fprintf(stderr, "hash: %s: not found\n", argv[i]);
+            rval = 1;
+        }
+    }
+    return rval;
+}
+
+struct builtin
+{
+    const char *name;
+    builtin_fn fn;
+};
+
+/*
+ * The registry. slots maps (hash(name, seed) & mask) to an index into
+ * builtins, the seed is picked so that every registered name gets a slot of
+ * its own.
+ */
+static struct
+{
+    struct builtin *builtins;
+    size_t count;
+    size_t cap;
+    int *slots;
+    size_t mask;
+    uint32_t seed;
+} registry;
+
+static uint32_t builtin_hash(const char *name, uint32_t seed)
+{
+    uint32_t h = 2166136261u ^ seed;
+    for (; *name; name++) {
+        h ^= (unsigned char)*name;
+        h *= 16777619u;
+    }
+    h ^= h >> 15;
+    h *= 0x2c1b3c6dU;
+    h ^= h >> 12;
+    return h;
+}
+
+/*
+ * Search for a seed that places every builtin in its own slot. A table of
+ * at least twice as many slots as names almost always works within a few
+ * seeds, if not the table is doubled and the search starts again.
+ */
+static void registry_rebuild(void)
+{
+    size_t size = 8;
+    while (size < registry.count * 2)
+        size *= 2;
+
+    for (;;) {
+        int *slots = (int *)realloc(registry.slots, sizeof(int) * size);
+        if (!slots) {
+            fprintf(stderr, "realloc failed\n");
+            abort();
+        }
+        registry.slots = slots;
+        registry.mask = size - 1;
+        for (uint32_t seed = 0; seed < 256; seed++) {
+            bool ok = true;
+            for (size_t i = 0; i < size; i++)
+                slots[i] = -1;
+            for (size_t i = 0; i < registry.count && ok; i++) {
+                size_t slot = builtin_hash(registry.builtins[i].name, seed) & registry.mask;
+                ok = slots[slot] < 0;
+                slots[slot] = (int)i;
+            }
+            if (ok) {
+                registry.seed = seed;
+                return;
+            }
+        }
+        size *= 2;
+    }
+}
+
+static void builtin_add(const char *name, builtin_fn fn)
+{
+    for (size_t i = 0; i < registry.count; i++) {
+        if (strcmp(registry.builtins[i].name, name) == 0) {
+            registry.builtins[i].fn = fn;
+            return;
+        }
+    }
+    if (registry.count == registry.cap) {
+        size_t cap = registry.cap ? registry.cap * 2 : 16;
+        struct builtin *b = (struct builtin *)realloc(registry.builtins, sizeof(struct builtin) * cap);
+        if (!b) {
+            fprintf(stderr, "realloc failed\n");
+            abort();
+        }
+        registry.builtins = b;
+        registry.cap = cap;
+    }
+    registry.builtins[registry.count].name = name;
+    registry.builtins[registry.count].fn = fn;
+    registry.count++;
+}
+
+/* The builtins every shell starts with */
+static const struct builtin default_builtins[] = {
+    {"cd", builtin_cd},
+    {"pushd", builtin_pushd},
+    {"popd", builtin_popd},
+    {"dirs", builtin_dirs},
+    {"exit", builtin_exit},
+    {"history", builtin_history},
+    {"hash", builtin_hash_cmd},
+    {"jobs", builtin_jobs},
+    {"fg", builtin_fg},
+    {"bg", builtin_bg},
+    {"wait", builtin_wait},
+    {"true", builtin_true},
+    {"false", builtin_false},
+    {"echo", builtin_echo},
+    {"printf", builtin_printf},
+    {"pwd", builtin_pwd},
+    {"test", builtin_test},
+    {"[", builtin_test},
+};
+
+static void registry_init(void)
+{
+    if (registry.slots)
+        return;
+    for (size_t i = 0; i < sizeof(default_builtins) / sizeof(default_builtins[0]); i++)
+        builtin_add(default_builtins[i].name, default_builtins[i].fn);
+    registry_rebuild();
+}
+
+void builtin_register(const char *name, builtin_fn fn) {
+    registry_init();
+    size_t count = registry.count;
+    builtin_add(name, fn);
+    if (registry.count != count)
+        registry_rebuild();
+}
+
+builtin_fn builtin_lookup(const char *name) {
+    registry_init();
+    int i = registry.slots[builtin_hash(name, registry.seed) & registry.mask];
+    if (i < 0 || strcmp(registry.builtins[i].name, name) != 0)
+        return NULL;
+    return registry.builtins[i].fn;
+}
+
+const char *builtin_name(size_t i) {
+    registry_init();
+    return i < registry.count ? registry.builtins[i].name : NULL;
+}
+
+bool is_builtin(const char *name) {
+    return builtin_lookup(name) != NULL;
+}
+
+bool do_builtin(struct shell *sh, char **argv) {
+    builtin_fn fn = builtin_lookup(argv[0]);
+    if (!fn)
+        return false;
+    sh->status = fn(sh, argv);
+    if (writer_flush(&sh->out) < 0) {
+        fprintf(stderr, "%s: write error: %s\n", argv[0], strerror(sh->out.err));
+        sh->out.err = 0;
+        if (!sh->status)
+            sh->status = EXIT_FAILURE;
+    }
+    return true;
+}
+
+/*
+ * HISTSIZE lines at most are kept for the arrow keys, HISTORY_RECALL if it
+ * is not set or not a number.
+ */
+static size_t history_size(void)
+{
+    const char *env = getenv("HISTSIZE");
+    char *end;
+    if (!env || !*env)
+        return HISTORY_RECALL;
+    long n = strtol(env, &end, 10);
+    if (*end || n < 0)
+        return HISTORY_RECALL;
+    return (size_t)n;
+}
+
+/*
+ * Open HISTFILE, or ~/.lab_history if it is not set. An empty HISTFILE
+ * keeps history in memory only. The newest entries go in the ring the
+ * arrow keys walk, the rest stay in the file until asked for.
+ */
+static void history_open(struct shell *sh)
+{
+    char buf[4096];
+    const char *path = getenv("HISTFILE");
+    histlog_init(&sh->hist);
+    histindex_init(&sh->histindex);
+    histring_init(&sh->recall, history_size());
+    sh->recalled = 0;
+    sh->share_history = false;
+    // Lines nobody typed are not history
+    if (!sh->shell_is_interactive)
+        return;
+    if (!path) {
+        const char *home = getenv("HOME");
+        struct passwd *pw = home ? NULL : getpwuid(getuid());
+        if (pw)
+            home = pw->pw_dir;
+        if (!home)
+            return;
+        snprintf(buf, sizeof(buf), "%s/.lab_history", home);
+        path = buf;
+    }
+    if (!*path)
+        return;
+    if (histlog_open(&sh->hist, path) < 0) {
+        fprintf(stderr, "history: %s: %s\n", path, strerror(errno));
+        return;
+    }
+    size_t i = sh->hist.count > sh->recall.cap ? sh->hist.count - sh->recall.cap : 0;
+    for (; i < sh->hist.count; i++)
+        histring_add(&sh->recall, histlog_text(histlog_get(&sh->hist, i)));
+    sh->recalled = sh->hist.count;
+    // MY_SHARE_HISTORY=1 shows the commands of every shell on the same
+    // file as they run
+    const char *share = getenv("MY_SHARE_HISTORY");
+    sh->share_history = share && *share && strcmp(share, "0") != 0;
+}
+
+/*
+ * Open MY_JUMPFILE, or ~/.lab_jump if it is not set, for cd to jump by
+ * name. An empty MY_JUMPFILE keeps the directories in memory only.
+ */
+static void jump_open_default(struct shell *sh)
+{
+    char buf[4096];
+    const char *path = getenv("MY_JUMPFILE");
+    jump_init(&sh->jump);
+    // A script going through directories says nothing of where a user goes
+    if (!sh->shell_is_interactive)
+        return;
+    if (!path) {
+        const char *home = getenv("HOME");
+        struct passwd *pw = home ? NULL : getpwuid(getuid());
+        if (pw)
+            home = pw->pw_dir;
+        if (!home)
+            return;
+        snprintf(buf, sizeof(buf), "%s/.lab_jump", home);
+        path = buf;
+    }
+    if (*path && jump_open(&sh->jump, path) < 0)
+        fprintf(stderr, "cd: %s: %s\n", path, strerror(errno));
+}
+
+/*
+ * The template is looked up again for every prompt but only parsed again
+ * when it is not the one the prompt was parsed from.
+ */
+const char *sh_prompt(struct shell *sh)
+{
+    const char *tmpl = getenv("MY_PROMPT");
+    if (prompt_set(&sh->prompt_fmt, tmpl ? tmpl : DEFAULT_PROMPT)) {
+        free(sh->prompt);
+        sh->prompt = get_prompt("MY_PROMPT");
+    }
+    const char *cwd = sh->prompt_fmt.needs_cwd ? sh->pwd.path : NULL;
+    return prompt_render(&sh->prompt_fmt, sh->status, cwd);
+}
+
+/*
+ * Other shells append whole records with O_APPEND, so the size of the file
+ * is the tail of the log and everything before it is there to read. The
+ * log may already have mapped new records for a listing or a search, the
+ * arrow keys get everything past what they were last offered.
+ */
+size_t sh_history_sync(struct shell *sh)
+{
+    histlog_sync(&sh->hist);
+    size_t added = sh->hist.count - sh->recalled;
+    for (; sh->recalled < sh->hist.count; sh->recalled++)
+        histring_add(&sh->recall, histlog_text(histlog_get(&sh->hist, sh->recalled)));
+    histindex_update(&sh->histindex, &sh->hist);
+    return added;
 }
 
 void sh_init(struct shell *sh) {
     sh->shell_terminal = STDIN_FILENO;
-    sh->shell_is_interactive = isatty(sh->shell_terminal);
+    sh->shell_is_interactive = !sh->command && !sh->script && isatty(sh->shell_terminal);
 
     if (sh->shell_is_interactive) {
         while (tcgetpgrp(sh->shell_terminal) != (sh->shell_pgid = getpgrp())) {
             kill(-sh->shell_pgid, SIGTTIN);
         }
 
+        // Ignore signals in the shell, SIGTTOU must be ignored before we take
+        // the terminal or tcsetpgrp stops us when started from a non job control
+        // parent. A script is stopped by ^C like the commands it runs.
+        signal(SIGINT, SIG_IGN);
+        signal(SIGQUIT, SIG_IGN);
+        signal(SIGTSTP, SIG_IGN);
+        signal(SIGTTIN, SIG_IGN);
+        signal(SIGTTOU, SIG_IGN);
+
         sh->shell_pgid = getpid();
         if (setpgid(sh->shell_pgid, sh->shell_pgid) < 0) {
             perror("Couldn't put the shell in its own process group");
@@ -125,57 +845,98 @@ void sh_init(struct shell *sh) {
         tcgetattr(sh->shell_terminal, &sh->shell_tmodes);
     }
 
-    // Ignore signals in the shell
-    signal(SIGINT, SIG_IGN);
-    signal(SIGQUIT, SIG_IGN);
-    signal(SIGTSTP, SIG_IGN);
-    signal(SIGTTIN, SIG_IGN);
-    signal(SIGTTOU, SIG_IGN);
-
     sh->prompt = get_prompt("MY_PROMPT");
+    prompt_init(&sh->prompt_fmt, sh->prompt);
+    sh->status = 0;
+    sh->pipestatus = NULL;
+    sh->pipestatus_len = 0;
+    sh->pipestatus_cap = 0;
+    // MY_SPAWN=fork falls back to the fork and exec launch path, MY_SPAWN=zygote
+    // launches through a helper forked now while the shell is still small
+    const char *spawn = getenv("MY_SPAWN");
+    sh->spawn_mode = spawn_default_mode();
+    if (spawn && strcmp(spawn, "fork") == 0)
+        sh->spawn_mode = SPAWN_FORK;
+    else if (spawn && strcmp(spawn, "zygote") == 0 && spawn_zygote_start() == 0)
+        sh->spawn_mode = SPAWN_ZYGOTE;
+    arena_init(&sh->arena, 4096);
+    cmdhash_init(&sh->cmdhash);
+    writer_init(&sh->out, STDOUT_FILENO);
+    jobs_init(sh);
+    history_open(sh);
+    pwd_init(&sh->pwd);
+    dirstack_init(&sh->dirs);
+    if (sh->pwd.path)
+        dirstack_hold(&sh->dirs, sh->pwd.path);
+    jump_open_default(sh);
+    // Only a shell someone types into completes, PATH is read in the
+    // background from now on so the first TAB finds it read
+    memset(&sh->complete, 0, sizeof(sh->complete));
+    if (sh->shell_is_interactive) {
+        const char *path = getenv("PATH");
+        complete_init(&sh->complete, path ? path : "");
+    }
 }
 
 void sh_destroy(struct shell *sh) {
     if (sh->prompt) {
         free(sh->prompt);
     }
-    clear_history();
-    exit(EXIT_SUCCESS);
-    
+    prompt_destroy(&sh->prompt_fmt);
+    complete_destroy(&sh->complete);
+    dirstack_destroy(&sh->dirs);
+    jump_close(&sh->jump);
+    pwd_destroy(&sh->pwd);
+    arena_destroy(&sh->arena);
+    cmdhash_destroy(&sh->cmdhash);
+    jobs_destroy(sh);
+    writer_destroy(&sh->out);
+    spawn_zygote_stop();
+    free(sh->pipestatus);
+    histlog_close(&sh->hist, sh->status);
+    histindex_destroy(&sh->histindex);
+    histring_destroy(&sh->recall);
+    exit(sh->status);
 }
 
-int change_dir(char **cmd) {
+int change_dir(struct shell *sh, char **cmd) {
     int rval = -1;
     if (cmd[1]) {
-        rval = chdir(cmd[1]);
+        rval = pwd_chdir(&sh->pwd, cmd[1]);
     } else {
         uid_t user = getuid();
         struct passwd *pw = getpwuid(user);
         if (pw != NULL) {
-            rval = chdir(pw->pw_dir);
+            rval = pwd_chdir(&sh->pwd, pw->pw_dir);
         }
     }
     return rval;
 }
 
-void parse_args(int argc, char **argv) 
+void parse_args(struct shell *sh, int argc, char **argv) 
 {
     int c;
-    while ((c = getopt(argc, argv, "vh")) != -1) 
+    // Options stop at the script, what follows it is for the script
+    while ((c = getopt(argc, argv, "+c:vh")) != -1) 
     {
         switch (c) {
+            case 'c':
+                sh->command = optarg;
+                break;
             case 'v':
                 printf("Version: %d.%d\n", lab_VERSION_MAJOR, lab_VERSION_MINOR);
                 exit(0);
                 break;
             case 'h':
-                printf("Usage: %s [-h]\n", argv[0]);
+                printf("Usage: %s [-h] [-c commands | script]\n", argv[0]);
                 exit(0);
                 break;
             default:
-                fprintf(stderr, "Usage: %s [-h]\n", argv[0]);
+                fprintf(stderr, "Usage: %s [-h] [-c commands | script]\n", argv[0]);
                 exit(EXIT_FAILURE);
         }
     }
+    if (!sh->command && optind < argc)
+        sh->script = argv[optind];
     
 }
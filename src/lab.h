@@ -5,6 +5,18 @@
 #include <sys/types.h>
 #include <termios.h>
 #include <unistd.h>
+#include "arena.h"
+#include "spawn.h"
+#include "cmdhash.h"
+#include "jobs.h"
+#include "writer.h"
+#include "histindex.h"
+#include "histring.h"
+#include "prompt.h"
+#include "complete.h"
+#include "dirstack.h"
+#include "jump.h"
+#include "pwd.h"
 
 #define lab_VERSION_MAJOR 1
 #define lab_VERSION_MINOR 0
@@ -22,6 +34,53 @@ extern "C"
     struct termios shell_tmodes;
     int shell_terminal;
     char *prompt;
+    struct prompt prompt_fmt; /* prompt parsed, rendered before each line */
+    int status;
+    int *pipestatus;       /* exit status of every stage of the last pipeline */
+    size_t pipestatus_len;
+    size_t pipestatus_cap;
+    enum spawn_mode spawn_mode;
+    struct arena arena;
+    struct cmdhash cmdhash;
+    struct jobs jobs;
+    struct writer out;     /* stdout of builtins, flushed once per command */
+    struct histlog hist;   /* the history file */
+    struct histindex histindex; /* trigram index of hist for searches */
+    struct histring recall; /* the newest distinct lines, for the arrow keys */
+    size_t recalled;       /* entries of hist offered to recall so far */
+    bool share_history;    /* take in what other shells log before each prompt */
+    struct complete complete; /* program names in PATH for completion */
+    struct dirstack dirs;  /* pushd and popd, and where cd - goes */
+    struct jump jump;      /* directories cd went to, for cd by name */
+    struct pwd pwd;        /* the logical working directory, $PWD */
+    const char *command;   /* -c, the commands to run instead of reading any */
+    const char *script;    /* the file to read commands from instead of stdin */
+  };
+
+  /**
+   * A built in command. The handler runs inside the shell and returns the
+   * exit status of the command.
+   */
+  typedef int (*builtin_fn)(struct shell *sh, char **argv);
+
+  /**
+   * A single argument expressed as a view into the line it was read from.
+   */
+  struct cmd_token
+  {
+    size_t off;
+    size_t len;
+  };
+
+  /**
+   * The arguments of a line as views into that line. Nothing is copied
+   * until the tokens are materialized.
+   */
+  struct cmd_tokens
+  {
+    const char *line;
+    struct cmd_token *tok;
+    size_t count;
   };
 
 
@@ -37,22 +96,34 @@ extern "C"
    */
   char *get_prompt(const char *env);
 
+  /**
+   * @brief Render the prompt of the shell from MY_PROMPT, see struct
+   * prompt for what the template may contain. The template is parsed
+   * again only after MY_PROMPT changed.
+   *
+   * @param sh The shell
+   * @return The prompt, valid until the next call
+   */
+  const char *sh_prompt(struct shell *sh);
+
   /**
    * Changes the current working directory of the shell. Uses the linux system
    * call chdir. With no arguments the users home directory is used as the
-   * directory to change to.
+   * directory to change to. The logical working directory follows, see
+   * pwd_chdir.
    *
+   * @param sh The shell
    * @param dir The directory to change to
    * @return  On success, zero is returned.  On error, -1 is returned, and
    * errno is set to indicate the error.
    */
-  int change_dir(char **dir);
+  int change_dir(struct shell *sh, char **dir);
 
   /**
    * @brief Convert line read from the user into to format that will work with
-   * execvp. We limit the number of arguments to ARG_MAX loaded from sysconf.
-   * This function allocates memory that must be reclaimed with the cmd_free
-   * function.
+   * execvp. The argument vector and the copy of the arguments are sized
+   * exactly for the line and live in a single allocation. This function
+   * allocates memory that must be reclaimed with the cmd_free function.
    *
    * @param line The line to process
    *
@@ -60,6 +131,61 @@ extern "C"
    */
   char **cmd_parse(char const *line);
 
+  /**
+   * @brief Same as cmd_parse but the argument vector and strings are
+   * allocated from the arena. The result is released by resetting the arena
+   * and must NOT be passed to cmd_free.
+   *
+   * @param a The arena to allocate from
+   * @param line The line to process
+   *
+   * @return The line read in a format suitable for exec
+   */
+  char **cmd_parse_arena(struct arena *a, char const *line);
+
+  /**
+   * @brief Split line into arguments without copying any of the argument
+   * text. The token array is allocated from the arena and refers back into
+   * line, so line must outlive the tokens.
+   *
+   * @param a The arena to allocate the token array from
+   * @param line The line to process
+   * @param out The tokens found in line
+   */
+  void cmd_tokenize(struct arena *a, char const *line, struct cmd_tokens *out);
+
+  /**
+   * @brief Check if token i is exactly the string s.
+   *
+   * @param t The tokens
+   * @param i The token to compare
+   * @param s The string to compare against
+   * @return True if the token and the string are equal
+   */
+  bool cmd_token_is(const struct cmd_tokens *t, size_t i, const char *s);
+
+  /**
+   * @brief Copy the tokens into a NULL terminated argument vector of NUL
+   * terminated strings suitable for execvp. All memory comes from the arena.
+   *
+   * @param a The arena to allocate from
+   * @param t The tokens to copy
+   * @return The argument vector
+   */
+  char **cmd_materialize(struct arena *a, const struct cmd_tokens *t);
+
+  /**
+   * @brief Build an argument vector for tokens that were read from line by
+   * terminating each token in place. No argument text is copied, only the
+   * pointer array is allocated from the arena. This modifies line.
+   *
+   * @param a The arena to allocate from
+   * @param line The line the tokens were read from
+   * @param t The tokens
+   * @return The argument vector, pointing into line
+   */
+  char **cmd_terminate(struct arena *a, char *line, const struct cmd_tokens *t);
+
   /**
    * @brief Free the line that was constructed with parse_cmd
    *
@@ -84,7 +210,7 @@ extern "C"
    * built in command such as exit, cd, jobs, etc. If the command is a
    * built in command this function will handle the command and then return
    * true. If the first argument is NOT a built in command this function will
-   * return false.
+   * return false. The exit status of the built in is stored in sh->status.
    *
    * @param sh The shell
    * @param argv The command to check
@@ -92,6 +218,42 @@ extern "C"
    */
   bool do_builtin(struct shell *sh, char **argv);
 
+  /**
+   * @brief Check if name is a built in command that do_builtin handles.
+   *
+   * @param name The command name
+   * @return True if name is a built in command
+   */
+  bool is_builtin(const char *name);
+
+  /**
+   * @brief Add a built in command, or replace the handler of an existing one.
+   * Builtins are dispatched through a hash table that is rebuilt with a new
+   * seed on every registration until no two names share a slot, so a lookup
+   * is one hash and one string compare no matter how many builtins exist.
+   * The name is not copied and must outlive the shell.
+   *
+   * @param name The command name
+   * @param fn The handler
+   */
+  void builtin_register(const char *name, builtin_fn fn);
+
+  /**
+   * @brief List the built in commands.
+   *
+   * @param i Which one, from 0
+   * @return The name of builtin i, or NULL past the last one
+   */
+  const char *builtin_name(size_t i);
+
+  /**
+   * @brief Find the handler of a built in command.
+   *
+   * @param name The command name
+   * @return The handler or NULL if name is not a built in command
+   */
+  builtin_fn builtin_lookup(const char *name);
+
   /**
    * @brief Initialize the shell for use. Allocate all data structures
    * Grab control of the terminal and put the shell in its own
@@ -104,21 +266,35 @@ extern "C"
    */
   void sh_init(struct shell *sh);
 
+  /**
+   * @brief Take in the entries other shells appended to the history file
+   * since the last call. The log maps only the new records and the arrow
+   * keys and the search index get the new entries, nothing already read
+   * is read again.
+   *
+   * @param sh The shell
+   * @return The number of entries taken in
+   */
+  size_t sh_history_sync(struct shell *sh);
+
   /**
    * @brief Destroy shell. Free any allocated memory and resources and exit
-   * normally.
+   * with the status of the last command.
    *
    * @param sh
    */
   void sh_destroy(struct shell *sh);
 
   /**
-   * @brief Parse command line args from the user when the shell was launched
+   * @brief Parse command line args from the user when the shell was launched.
+   * -c commands runs the commands and a first argument that is no option
+   * names a script to run, either way the shell is not interactive.
    *
+   * @param sh The shell, command and script are set
    * @param argc Number of args
    * @param argv The arg array
    */
-  void parse_args(int argc, char **argv);
+  void parse_args(struct shell *sh, int argc, char **argv);
 
 
 
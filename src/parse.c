@@ -0,0 +1,476 @@
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include "parse.h"
+#include "scan.h"
+
+enum tok_type
+{
+    TOK_END,
+    TOK_WORD,
+    TOK_PIPE,
+    TOK_AND,
+    TOK_OR,
+    TOK_SEMI,
+    TOK_AMP,
+    TOK_LESS,
+    TOK_GREAT,
+    TOK_DGREAT,
+    TOK_CLOSE,
+};
+
+/* Command substitutions nest no deeper than this */
+#define SUBST_MAX_DEPTH 64
+
+static const char *const tok_errors[] = {
+    [TOK_END] = "syntax error near unexpected end of line",
+    [TOK_WORD] = "syntax error near unexpected word",
+    [TOK_PIPE] = "syntax error near unexpected token `|'",
+    [TOK_AND] = "syntax error near unexpected token `&&'",
+    [TOK_OR] = "syntax error near unexpected token `||'",
+    [TOK_SEMI] = "syntax error near unexpected token `;'",
+    [TOK_AMP] = "syntax error near unexpected token `&'",
+    [TOK_LESS] = "syntax error near unexpected token `<'",
+    [TOK_GREAT] = "syntax error near unexpected token `>'",
+    [TOK_DGREAT] = "syntax error near unexpected token `>>'",
+    [TOK_CLOSE] = "syntax error near unexpected token `)'",
+};
+
+struct lexer
+{
+    struct arena *a;
+    const char *p;  /* next unread input byte */
+    char *out;      /* next free byte of the word buffer */
+    const char *err;
+    enum tok_type type;
+    char *word;     /* text of a TOK_WORD */
+    struct ast_part *parts;  /* parts of a TOK_WORD with a substitution */
+    struct ast_part **parts_tail;
+    char *seg;      /* start of the literal text not yet in parts */
+    bool seg_quoted; /* the literal text had quotes, even if now empty */
+    int io_number;  /* fd of a redirection operator, -1 if not given */
+    int depth;      /* substitutions the input is inside of */
+    int open;       /* $( read by this lexer and not closed yet */
+};
+
+struct word_list
+{
+    char *word;
+    struct ast_part *parts;
+    struct word_list *next;
+};
+
+static bool is_blank(char c)
+{
+    return c != '\n' && scan_is_space(c);
+}
+
+static bool is_meta(char c)
+{
+    return c == '|' || c == '&' || c == ';' || c == '<' || c == '>' || c == '\n';
+}
+
+static const char *skip_backquoted(const char *p)
+{
+    while (*p && *p != '`') {
+        if (*p == '\\' && p[1])
+            p++;
+        p++;
+    }
+    return *p ? p : NULL;
+}
+
+static void add_part(struct lexer *l, char *text, struct ast_pipeline *subst, bool quoted)
+{
+    struct ast_part *part = (struct ast_part *)arena_alloc(l->a, sizeof(struct ast_part));
+    part->text = text;
+    part->subst = subst;
+    part->quoted = quoted;
+    part->next = NULL;
+    *l->parts_tail = part;
+    l->parts_tail = &part->next;
+}
+
+static void lex_next(struct lexer *l);
+static struct ast_pipeline *parse_list(struct lexer *l);
+static struct ast_pipeline *parse_text(struct arena *a, const char *line, int depth,
+                                       const char **err);
+
+/*
+ * Parse the $(...) or `...` at p into a part of the current word. The
+ * literal text before it becomes a part of its own. The body of $( is
+ * parsed right where it is by this lexer, its words go into the word
+ * buffer after the text of the current word. Inside backquotes a
+ * backslash only escapes $, ` and itself, so that body is copied without
+ * them and parsed as a line of its own. Returns the input after the
+ * substitution or NULL on error.
+ */
+static const char *lex_subst(struct lexer *l, const char *p, char **out, bool quoted)
+{
+    if (l->depth == SUBST_MAX_DEPTH) {
+        l->err = "command substitution nested too deeply";
+        return NULL;
+    }
+
+    // The substitution takes at least two bytes of input, room for this NUL.
+    // Empty quotes before it only matter if the substitution is unquoted.
+    if (*out > l->seg || (l->seg_quoted && !quoted)) {
+        *(*out)++ = '\0';
+        add_part(l, l->seg, NULL, false);
+    }
+
+    struct ast_pipeline *subst;
+    const char *end;
+    if (*p == '`') {
+        const char *body = p + 1;
+        end = skip_backquoted(body);
+        if (!end) {
+            l->err = "unterminated backquote";
+            return NULL;
+        }
+        char *q = *out;
+        for (const char *s = body; s < end; s++) {
+            if (*s == '\\' && s[1] && strchr("$`\\", s[1]))
+                s++;
+            *q++ = *s;
+        }
+        *q = '\0';
+        // The copy is only needed until the body is parsed
+        subst = parse_text(l->a, *out, l->depth + 1, &l->err);
+    } else {
+        // The body overwrites what lex_word keeps of the current word
+        char *word = l->word;
+        struct ast_part *parts = l->parts;
+        struct ast_part **parts_tail = l->parts_tail;
+
+        l->p = p + 2;
+        l->out = *out;
+        l->depth++;
+        l->open++;
+        lex_next(l);
+        subst = parse_list(l);
+        l->depth--;
+        l->open--;
+        if (!l->err && l->type != TOK_CLOSE)
+            l->err = "unterminated command substitution";
+        end = l->p;
+        *out = l->out;
+        l->word = word;
+        l->parts = parts;
+        l->parts_tail = parts_tail;
+    }
+    if (l->err)
+        return NULL;
+
+    l->seg = *out;
+    l->seg_quoted = false;
+    add_part(l, NULL, subst, quoted);
+    return end + 1;
+}
+
+static bool is_subst(const char *p)
+{
+    return *p == '`' || (*p == '$' && p[1] == '(');
+}
+
+/*
+ * Copy one word from the input into the word buffer removing quotes and
+ * escapes as we go. The quote removed text is never longer than the input
+ * so the buffer sized in parse_text can not overflow. A word with command
+ * substitutions is split into parts. Outside of any substitution it keeps
+ * its source text as the word, inside one the word is left empty so that
+ * nesting does not copy the same text again at each level.
+ */
+static void lex_word(struct lexer *l)
+{
+    static char no_text[] = "";
+    const char *start = l->p;
+    const char *p = l->p;
+    char *out = l->out;
+
+    l->word = out;
+    l->parts = NULL;
+    l->parts_tail = &l->parts;
+    l->seg = out;
+    l->seg_quoted = false;
+    while (*p && !is_blank(*p) && !is_meta(*p) && !(*p == ')' && l->open)) {
+        if (*p == '\'') {
+            l->seg_quoted = true;
+            p++;
+            while (*p && *p != '\'')
+                *out++ = *p++;
+            if (!*p) {
+                l->err = "unterminated single quote";
+                return;
+            }
+            p++;
+        } else if (*p == '"') {
+            l->seg_quoted = true;
+            p++;
+            while (*p && *p != '"') {
+                if (is_subst(p)) {
+                    if (!(p = lex_subst(l, p, &out, true)))
+                        return;
+                    continue;
+                }
+                if (*p == '\\' && p[1] && strchr("$`\"\\\n", p[1]))
+                    p++;
+                *out++ = *p++;
+            }
+            if (!*p) {
+                l->err = "unterminated double quote";
+                return;
+            }
+            p++;
+        } else if (*p == '\\') {
+            p++;
+            if (*p == '\n')
+                p++;
+            else if (*p)
+                *out++ = *p++;
+            else
+                *out++ = '\\';
+        } else if (is_subst(p)) {
+            if (!(p = lex_subst(l, p, &out, false)))
+                return;
+        } else {
+            *out++ = *p++;
+        }
+    }
+    *out++ = '\0';
+    if (l->parts) {
+        if (out - 1 > l->seg || l->seg_quoted)
+            add_part(l, l->seg, NULL, false);
+        l->word = l->depth ? no_text : arena_strndup(l->a, start, (size_t)(p - start));
+    }
+    l->p = p;
+    l->out = out;
+}
+
+/*
+ * Advance to the next token. Errors are sticky, once err is set every
+ * following token is TOK_END.
+ */
+static void lex_next(struct lexer *l)
+{
+    const char *p = l->p;
+
+    l->io_number = -1;
+    if (l->err) {
+        l->type = TOK_END;
+        return;
+    }
+    while (is_blank(*p))
+        p++;
+    if (*p == '#') {
+        while (*p && *p != '\n')
+            p++;
+    }
+
+    // A short run of digits directly in front of < or > names the fd
+    size_t digits = 0;
+    while (digits < 4 && p[digits] >= '0' && p[digits] <= '9')
+        digits++;
+    if (digits && (p[digits] == '<' || p[digits] == '>')) {
+        l->io_number = atoi(p);
+        p += digits;
+    }
+
+    if (*p == ')' && l->open) {
+        // Left for lex_subst to step over
+        l->type = TOK_CLOSE;
+        l->p = p;
+        return;
+    }
+    switch (*p) {
+    case '\0':
+        l->type = TOK_END;
+        break;
+    case '\n':
+    case ';':
+        l->type = TOK_SEMI;
+        p++;
+        break;
+    case '|':
+        l->type = p[1] == '|' ? TOK_OR : TOK_PIPE;
+        p += l->type == TOK_OR ? 2 : 1;
+        break;
+    case '&':
+        l->type = p[1] == '&' ? TOK_AND : TOK_AMP;
+        p += l->type == TOK_AND ? 2 : 1;
+        break;
+    case '<':
+        l->type = TOK_LESS;
+        p++;
+        break;
+    case '>':
+        l->type = p[1] == '>' ? TOK_DGREAT : TOK_GREAT;
+        p += l->type == TOK_DGREAT ? 2 : 1;
+        break;
+    default:
+        l->type = TOK_WORD;
+        l->p = p;
+        lex_word(l);
+        // A substitution in the word leaves the type of its last token
+        l->type = l->err ? TOK_END : TOK_WORD;
+        return;
+    }
+    l->p = p;
+}
+
+static void syntax_error(struct lexer *l)
+{
+    if (!l->err)
+        l->err = tok_errors[l->type];
+}
+
+static struct ast_cmd *parse_cmd(struct arena *a, struct lexer *l)
+{
+    struct ast_cmd *cmd = (struct ast_cmd *)arena_alloc(a, sizeof(struct ast_cmd));
+    struct ast_redir **redir_tail = &cmd->redirs;
+    struct word_list *words = NULL;
+    struct word_list **word_tail = &words;
+    bool parts = false;
+
+    cmd->argc = 0;
+    cmd->parts = NULL;
+    cmd->redirs = NULL;
+    cmd->next = NULL;
+    for (;;) {
+        if (l->type == TOK_WORD) {
+            struct word_list *w = (struct word_list *)arena_alloc(a, sizeof(struct word_list));
+            w->word = l->word;
+            w->parts = l->parts;
+            w->next = NULL;
+            parts = parts || l->parts;
+            *word_tail = w;
+            word_tail = &w->next;
+            cmd->argc++;
+        } else if (l->type == TOK_LESS || l->type == TOK_GREAT || l->type == TOK_DGREAT) {
+            struct ast_redir *r = (struct ast_redir *)arena_alloc(a, sizeof(struct ast_redir));
+            r->type = l->type == TOK_LESS ? REDIR_IN : l->type == TOK_GREAT ? REDIR_OUT : REDIR_APPEND;
+            r->fd = l->io_number >= 0 ? l->io_number : r->type == REDIR_IN ? 0 : 1;
+            r->next = NULL;
+            lex_next(l);
+            if (l->type != TOK_WORD) {
+                syntax_error(l);
+                return NULL;
+            }
+            r->target = l->word;
+            r->target_parts = l->parts;
+            *redir_tail = r;
+            redir_tail = &r->next;
+        } else {
+            break;
+        }
+        lex_next(l);
+    }
+
+    if (!cmd->argc && !cmd->redirs) {
+        syntax_error(l);
+        return NULL;
+    }
+    cmd->argv = (char **)arena_alloc(a, sizeof(char *) * (cmd->argc + 1));
+    if (parts)
+        cmd->parts = (struct ast_part **)arena_alloc(a, sizeof(struct ast_part *) * cmd->argc);
+    size_t i = 0;
+    for (struct word_list *w = words; w; w = w->next) {
+        if (parts)
+            cmd->parts[i] = w->parts;
+        cmd->argv[i++] = w->word;
+    }
+    cmd->argv[i] = NULL;
+    return cmd;
+}
+
+static struct ast_pipeline *parse_pipeline(struct arena *a, struct lexer *l)
+{
+    struct ast_pipeline *pl = (struct ast_pipeline *)arena_alloc(a, sizeof(struct ast_pipeline));
+    struct ast_cmd **tail = &pl->cmds;
+
+    pl->count = 0;
+    pl->op = AST_SEQ;
+    pl->next = NULL;
+    for (;;) {
+        struct ast_cmd *cmd = parse_cmd(a, l);
+        if (!cmd)
+            return NULL;
+        *tail = cmd;
+        tail = &cmd->next;
+        pl->count++;
+        if (l->type != TOK_PIPE)
+            break;
+        lex_next(l);
+    }
+    return pl;
+}
+
+/*
+ * Parse pipelines up to the end of the input or, inside $(, up to the )
+ * closing it.
+ */
+static struct ast_pipeline *parse_list(struct lexer *l)
+{
+    struct ast_pipeline *head = NULL;
+    struct ast_pipeline **tail = &head;
+
+    while (l->type != TOK_END && l->type != TOK_CLOSE) {
+        struct ast_pipeline *pl = parse_pipeline(l->a, l);
+        if (!pl)
+            break;
+        *tail = pl;
+        tail = &pl->next;
+
+        enum tok_type sep = l->type;
+        switch (sep) {
+        case TOK_END:
+        case TOK_CLOSE:
+            break;
+        case TOK_SEMI:
+            pl->op = AST_SEQ;
+            break;
+        case TOK_AMP:
+            pl->op = AST_BG;
+            break;
+        case TOK_AND:
+            pl->op = AST_AND;
+            break;
+        case TOK_OR:
+            pl->op = AST_OR;
+            break;
+        default:
+            syntax_error(l);
+            break;
+        }
+        if (l->err || sep == TOK_END || sep == TOK_CLOSE)
+            break;
+        lex_next(l);
+        // && and || must be followed by another command, ; and & may end the line
+        if ((sep == TOK_AND || sep == TOK_OR) && (l->type == TOK_END || l->type == TOK_CLOSE))
+            syntax_error(l);
+    }
+    return l->err ? NULL : head;
+}
+
+static struct ast_pipeline *parse_text(struct arena *a, const char *line, int depth,
+                                       const char **err)
+{
+    struct lexer l;
+
+    l.a = a;
+    l.p = line;
+    l.out = (char *)arena_alloc(a, strlen(line) + 1);
+    l.err = NULL;
+    l.depth = depth;
+    l.open = 0;
+
+    lex_next(&l);
+    struct ast_pipeline *head = parse_list(&l);
+    *err = l.err;
+    return head;
+}
+
+struct ast_pipeline *parse_line(struct arena *a, const char *line, const char **err)
+{
+    return parse_text(a, line, 0, err);
+}
@@ -0,0 +1,105 @@
+#ifndef PARSE_H
+#define PARSE_H
+#include <stdbool.h>
+#include <stddef.h>
+#include "arena.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+  enum redir_type
+  {
+    REDIR_IN,     /* [n]<file  */
+    REDIR_OUT,    /* [n]>file  */
+    REDIR_APPEND, /* [n]>>file */
+  };
+
+  struct ast_pipeline;
+
+  /**
+   * A piece of a word with a command substitution in it. The word is the
+   * concatenation of its parts once every substitution has been replaced
+   * by the output of its commands.
+   */
+  struct ast_part
+  {
+    char *text;                 /* literal text, NULL for a substitution */
+    struct ast_pipeline *subst; /* commands of $(...) or `...`, NULL if empty */
+    bool quoted;                /* the substitution was inside double quotes */
+    struct ast_part *next;
+  };
+
+  /**
+   * A redirection attached to a simple command.
+   */
+  struct ast_redir
+  {
+    int fd;
+    enum redir_type type;
+    char *target;
+    struct ast_part *target_parts; /* NULL unless the target has a substitution */
+    struct ast_redir *next;
+  };
+
+  /**
+   * A simple command: the arguments with quotes removed and the
+   * redirections in the order they were written. A word with a command
+   * substitution has its parts in parts, argv keeps its source text if the
+   * command is not itself in a substitution and is empty if it is.
+   */
+  struct ast_cmd
+  {
+    char **argv;
+    size_t argc;
+    struct ast_part **parts;  /* parts of each word, NULL for plain words or if no word has any */
+    struct ast_redir *redirs;
+    struct ast_cmd *next; /* next stage of the pipeline */
+  };
+
+  /**
+   * How a pipeline is joined to the one that follows it.
+   */
+  enum ast_op
+  {
+    AST_SEQ, /* ; or end of line */
+    AST_AND, /* && */
+    AST_OR,  /* || */
+    AST_BG,  /* &  */
+  };
+
+  /**
+   * One or more commands joined with |. A parsed line is a list of
+   * pipelines chained through next.
+   */
+  struct ast_pipeline
+  {
+    struct ast_cmd *cmds;
+    size_t count;
+    enum ast_op op;
+    struct ast_pipeline *next;
+  };
+
+  /**
+   * @brief Parse a line into a list of pipelines. The lexer understands
+   * single and double quotes, backslash escapes, comments, the operators
+   * | ; & && || < > >> and command substitution with $(...) and `...`,
+   * whose commands are parsed along with the line. Parsing is a single
+   * left to right pass with no backtracking so it runs in time linear in
+   * the length of the line. Every node and string is allocated from the
+   * arena.
+   *
+   * @param a The arena to allocate from
+   * @param line The line to parse
+   * @param err Set to a description of the problem if the line is invalid
+   * @return The first pipeline, or NULL if the line was empty or invalid.
+   * Check err to tell the two apart.
+   */
+  struct ast_pipeline *parse_line(struct arena *a, const char *line, const char **err);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif
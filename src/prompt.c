@@ -0,0 +1,440 @@
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pwd.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <sys/stat.h>
+#include "prompt.h"
+
+static void *xrealloc(void *p, size_t size)
+{
+    void *rval = realloc(p, size);
+    if (!rval) {
+        fprintf(stderr, "realloc failed\n");
+        abort();
+    }
+    return rval;
+}
+
+static void add_seg(struct prompt *p, enum prompt_seg_kind kind)
+{
+    if (p->nsegs == p->segs_cap) {
+        p->segs_cap = p->segs_cap ? p->segs_cap * 2 : 8;
+        p->segs = (struct prompt_seg *)xrealloc(p->segs, sizeof(struct prompt_seg) * p->segs_cap);
+    }
+    p->segs[p->nsegs].kind = kind;
+    p->segs[p->nsegs].off = p->text.len;
+    p->segs[p->nsegs].len = 0;
+    p->nsegs++;
+}
+
+/* Text next to text is one segment */
+static void add_text(struct prompt *p, const char *s, size_t n)
+{
+    if (!p->nsegs || p->segs[p->nsegs - 1].kind != PROMPT_TEXT)
+        add_seg(p, PROMPT_TEXT);
+    writer_put(&p->text, s, n);
+    p->segs[p->nsegs - 1].len += n;
+}
+
+static void add_user(struct prompt *p)
+{
+    struct passwd *pw = getpwuid(geteuid());
+    const char *name = pw ? pw->pw_name : getenv("USER");
+    if (name)
+        add_text(p, name, strlen(name));
+}
+
+static void add_host(struct prompt *p)
+{
+    char host[256];
+    if (gethostname(host, sizeof(host)) < 0)
+        return;
+    host[sizeof(host) - 1] = '\0';
+    add_text(p, host, strcspn(host, "."));
+}
+
+/* Returns true if some segment needs the worker */
+static bool parse(struct prompt *p)
+{
+    bool worker = false;
+    for (const char *s = p->tmpl; *s;) {
+        if (s[0] == '$' && s[1] == '?') {
+            add_seg(p, PROMPT_STATUS);
+            s += 2;
+            continue;
+        }
+        if (s[0] != '\\') {
+            add_text(p, s++, 1);
+            continue;
+        }
+        switch (s[1]) {
+        case 'u':
+            add_user(p);
+            break;
+        case 'h':
+            add_host(p);
+            break;
+        case 'w':
+            add_seg(p, PROMPT_CWD);
+            p->needs_cwd = true;
+            break;
+        case 'W':
+            add_seg(p, PROMPT_CWD_BASE);
+            p->needs_cwd = true;
+            break;
+        case 't':
+            add_seg(p, PROMPT_TIME);
+            break;
+        case '$':
+            add_text(p, geteuid() == 0 ? "#" : "$", 1);
+            break;
+        case 'g':
+            add_seg(p, PROMPT_GIT);
+            p->needs_cwd = true;
+            worker = true;
+            break;
+        case '\\':
+            add_text(p, "\\", 1);
+            break;
+        default:
+            add_text(p, s, s[1] ? 2 : 1);
+            s += s[1] ? 2 : 1;
+            continue;
+        }
+        s += 2;
+    }
+    return worker;
+}
+
+/*
+ * Find the HEAD file of the repository holding dir. A .git file instead of
+ * a directory, as in a worktree or a submodule, names the real one. A path
+ * too long for the buffers is not looked at, a truncated one could name
+ * the HEAD of another repository.
+ */
+static bool find_head(const char *cwd, char *head, size_t n)
+{
+    char dir[PATH_MAX];
+    char link[PATH_MAX];
+    int len = snprintf(dir, sizeof(dir), "%s", cwd);
+    if (len < 0 || (size_t)len >= sizeof(dir))
+        return false;
+    for (;;) {
+        struct stat st;
+        len = snprintf(head, n, "%s/.git", dir);
+        if (len >= 0 && (size_t)len < n && stat(head, &st) == 0) {
+            if (S_ISDIR(st.st_mode)) {
+                len = snprintf(head, n, "%s/.git/HEAD", dir);
+                return len >= 0 && (size_t)len < n;
+            }
+            if (S_ISREG(st.st_mode)) {
+                FILE *f = fopen(head, "r");
+                bool ok = f && fgets(link, sizeof(link), f) && strncmp(link, "gitdir: ", 8) == 0;
+                if (f)
+                    fclose(f);
+                if (!ok)
+                    return false;
+                link[strcspn(link, "\n")] = '\0';
+                if (link[8] == '/')
+                    len = snprintf(head, n, "%s/HEAD", link + 8);
+                else
+                    len = snprintf(head, n, "%s/%s/HEAD", dir, link + 8);
+                return len >= 0 && (size_t)len < n;
+            }
+        }
+        if (!*dir)
+            return false;
+        *strrchr(dir, '/') = '\0';
+    }
+}
+
+/*
+ * The branch HEAD is on, or the start of the commit it is detached at. A
+ * name too long for branch is not shown.
+ */
+static bool read_branch(const char *head, char *branch, size_t n)
+{
+    char buf[256];
+    int fd = open(head, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return false;
+    ssize_t len = read(fd, buf, sizeof(buf) - 1);
+    close(fd);
+    if (len <= 0)
+        return false;
+    buf[len] = '\0';
+    buf[strcspn(buf, "\n")] = '\0';
+    if (strncmp(buf, "ref: refs/heads/", 16) == 0)
+        len = snprintf(branch, n, "%s", buf + 16);
+    else if (strncmp(buf, "ref: ", 5) == 0)
+        len = snprintf(branch, n, "%s", buf + 5);
+    else
+        len = snprintf(branch, n, "%.7s", buf);
+    return len >= 0 && (size_t)len < n;
+}
+
+static struct prompt_git *cache_find(struct prompt *p, const char *cwd)
+{
+    for (size_t i = 0; i < PROMPT_CACHE; i++) {
+        if (p->cache[i].cwd && strcmp(p->cache[i].cwd, cwd) == 0)
+            return &p->cache[i];
+    }
+    return NULL;
+}
+
+static struct prompt_git *cache_take(struct prompt *p, const char *cwd)
+{
+    struct prompt_git *e = &p->cache[p->cache_next];
+    p->cache_next = (p->cache_next + 1) % PROMPT_CACHE;
+    free(e->cwd);
+    free(e->head);
+    memset(e, 0, sizeof(*e));
+    e->cwd = strdup(cwd);
+    return e;
+}
+
+static bool same_time(struct timespec a, struct timespec b)
+{
+    return a.tv_sec == b.tv_sec && a.tv_nsec == b.tv_nsec;
+}
+
+/*
+ * Check the directory the last render asked about. A HEAD file that has
+ * not changed since it was read ends the check, anything else walks up
+ * from the directory again. Only the worker writes the cache, the lock
+ * is dropped while it touches the file system.
+ */
+static void *prompt_worker(void *arg)
+{
+    struct prompt *p = (struct prompt *)arg;
+    char cwd[PATH_MAX];
+    char head[PATH_MAX];
+    pthread_mutex_lock(&p->lock);
+    for (;;) {
+        while (!p->want[0] && !p->stop)
+            pthread_cond_wait(&p->wake, &p->lock);
+        if (p->stop)
+            break;
+        memcpy(cwd, p->want, sizeof(cwd));
+        p->want[0] = '\0';
+        struct prompt_git *e = cache_find(p, cwd);
+        struct timespec mtime = {0, 0};
+        bool had_head = e && e->head;
+        if (had_head) {
+            snprintf(head, sizeof(head), "%s", e->head);
+            mtime = e->mtime;
+        }
+        pthread_mutex_unlock(&p->lock);
+
+        struct stat st;
+        char branch[PROMPT_BRANCH_MAX] = "";
+        if (had_head && stat(head, &st) == 0 && same_time(st.st_mtim, mtime)) {
+            pthread_mutex_lock(&p->lock);
+            continue;
+        }
+        bool repo = find_head(cwd, head, sizeof(head)) && stat(head, &st) == 0 &&
+                    read_branch(head, branch, sizeof(branch));
+
+        pthread_mutex_lock(&p->lock);
+        if (!e)
+            e = cache_take(p, cwd);
+        bool changed = strcmp(e->branch, branch) != 0;
+        free(e->head);
+        e->head = repo ? strdup(head) : NULL;
+        e->mtime = repo ? st.st_mtim : mtime;
+        memcpy(e->branch, branch, sizeof(branch));
+        if (changed) {
+            uint64_t one = 1;
+            (void)!write(p->event_fd, &one, sizeof(one));
+        }
+    }
+    pthread_mutex_unlock(&p->lock);
+    return NULL;
+}
+
+static void start_worker(struct prompt *p)
+{
+    sigset_t all, old;
+    p->event_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (p->event_fd < 0)
+        return;
+    pthread_mutex_init(&p->lock, NULL);
+    pthread_cond_init(&p->wake, NULL);
+    // Signals are for the shell, the worker starts with all of them blocked
+    sigfillset(&all);
+    pthread_sigmask(SIG_SETMASK, &all, &old);
+    int err = pthread_create(&p->worker, NULL, prompt_worker, p);
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+    if (err) {
+        pthread_mutex_destroy(&p->lock);
+        pthread_cond_destroy(&p->wake);
+        close(p->event_fd);
+        p->event_fd = -1;
+    }
+}
+
+void prompt_init(struct prompt *p, const char *tmpl)
+{
+    memset(p, 0, sizeof(*p));
+    p->event_fd = -1;
+    writer_init(&p->text, -1);
+    writer_init(&p->out, -1);
+    prompt_set(p, tmpl);
+}
+
+bool prompt_set(struct prompt *p, const char *tmpl)
+{
+    if (p->tmpl && strcmp(p->tmpl, tmpl) == 0)
+        return false;
+    free(p->tmpl);
+    p->tmpl = strdup(tmpl);
+    p->text.len = 0;
+    p->nsegs = 0;
+    p->needs_cwd = false;
+    if (parse(p) && p->event_fd < 0)
+        start_worker(p);
+    return true;
+}
+
+void prompt_destroy(struct prompt *p)
+{
+    if (p->event_fd >= 0) {
+        pthread_mutex_lock(&p->lock);
+        p->stop = true;
+        pthread_cond_signal(&p->wake);
+        pthread_mutex_unlock(&p->lock);
+        pthread_join(p->worker, NULL);
+        pthread_mutex_destroy(&p->lock);
+        pthread_cond_destroy(&p->wake);
+        close(p->event_fd);
+    }
+    for (size_t i = 0; i < PROMPT_CACHE; i++) {
+        free(p->cache[i].cwd);
+        free(p->cache[i].head);
+    }
+    writer_destroy(&p->out);
+    writer_destroy(&p->text);
+    free(p->segs);
+    free(p->tmpl);
+    memset(p, 0, sizeof(*p));
+    p->event_fd = -1;
+}
+
+void prompt_forget(struct prompt *p)
+{
+    // The lock may have been held by the worker when the child forked
+    if (p->event_fd >= 0)
+        close(p->event_fd);
+    p->event_fd = -1;
+}
+
+/* The directory with the home directory shown as ~ */
+static void put_cwd(struct writer *w, const char *cwd)
+{
+    const char *home = getenv("HOME");
+    size_t n = home ? strlen(home) : 0;
+    if (n > 1 && strncmp(cwd, home, n) == 0 && (cwd[n] == '/' || !cwd[n])) {
+        writer_putc(w, '~');
+        cwd += n;
+    }
+    writer_puts(w, cwd);
+}
+
+/* The last part of the directory, ~ for the home directory itself */
+static void put_cwd_base(struct writer *w, const char *cwd)
+{
+    const char *home = getenv("HOME");
+    if (home && strlen(home) > 1 && strcmp(cwd, home) == 0) {
+        writer_putc(w, '~');
+        return;
+    }
+    const char *base = strrchr(cwd, '/');
+    writer_puts(w, base && base[1] ? base + 1 : cwd);
+}
+
+static void put_int(struct writer *w, int n)
+{
+    char buf[16];
+    size_t i = sizeof(buf);
+    unsigned int u = n < 0 ? 0u - (unsigned int)n : (unsigned int)n;
+    do {
+        buf[--i] = (char)('0' + u % 10);
+    } while (u /= 10);
+    if (n < 0)
+        buf[--i] = '-';
+    writer_put(w, buf + i, sizeof(buf) - i);
+}
+
+static void put_time(struct writer *w)
+{
+    struct tm tm;
+    time_t now = time(NULL);
+    localtime_r(&now, &tm);
+    char buf[8] = {(char)('0' + tm.tm_hour / 10), (char)('0' + tm.tm_hour % 10), ':',
+                   (char)('0' + tm.tm_min / 10),  (char)('0' + tm.tm_min % 10),  ':',
+                   (char)('0' + tm.tm_sec / 10),  (char)('0' + tm.tm_sec % 10)};
+    writer_put(w, buf, sizeof(buf));
+}
+
+const char *prompt_render(struct prompt *p, int status, const char *cwd)
+{
+    char buf[PATH_MAX];
+    if (p->needs_cwd && !cwd)
+        cwd = getcwd(buf, sizeof(buf));
+    bool have_cwd = p->needs_cwd && cwd && strlen(cwd) < sizeof(p->want);
+    p->out.len = 0;
+    for (size_t i = 0; i < p->nsegs; i++) {
+        const struct prompt_seg *seg = &p->segs[i];
+        switch (seg->kind) {
+        case PROMPT_TEXT:
+            writer_put(&p->out, p->text.buf + seg->off, seg->len);
+            break;
+        case PROMPT_CWD:
+            if (have_cwd)
+                put_cwd(&p->out, cwd);
+            break;
+        case PROMPT_CWD_BASE:
+            if (have_cwd)
+                put_cwd_base(&p->out, cwd);
+            break;
+        case PROMPT_TIME:
+            put_time(&p->out);
+            break;
+        case PROMPT_STATUS:
+            put_int(&p->out, status);
+            break;
+        case PROMPT_GIT:
+            if (have_cwd && p->event_fd >= 0) {
+                pthread_mutex_lock(&p->lock);
+                const struct prompt_git *e = cache_find(p, cwd);
+                if (e)
+                    writer_puts(&p->out, e->branch);
+                pthread_mutex_unlock(&p->lock);
+            }
+            break;
+        }
+    }
+    if (have_cwd && p->event_fd >= 0) {
+        pthread_mutex_lock(&p->lock);
+        memcpy(p->want, cwd, strlen(cwd) + 1);
+        pthread_cond_signal(&p->wake);
+        pthread_mutex_unlock(&p->lock);
+    }
+    writer_putc(&p->out, '\0');
+    return p->out.buf;
+}
+
+bool prompt_refresh(struct prompt *p)
+{
+    uint64_t n;
+    if (p->event_fd < 0)
+        return false;
+    return read(p->event_fd, &n, sizeof(n)) == (ssize_t)sizeof(n);
+}
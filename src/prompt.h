@@ -0,0 +1,148 @@
+#ifndef PROMPT_H
+#define PROMPT_H
+#include <limits.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <time.h>
+#include "writer.h"
+
+/* Directories whose git branch is remembered */
+#define PROMPT_CACHE 16
+#define PROMPT_BRANCH_MAX 64
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+  enum prompt_seg_kind
+  {
+    PROMPT_TEXT,     /* text copied as is, \u, \h and \$ are resolved to text */
+    PROMPT_CWD,      /* \w, the working directory with $HOME as ~ */
+    PROMPT_CWD_BASE, /* \W, the last part of the working directory */
+    PROMPT_TIME,     /* \t, the time as HH:MM:SS */
+    PROMPT_STATUS,   /* $?, the exit status of the last command */
+    PROMPT_GIT,      /* \g, the git branch, computed by the worker */
+  };
+
+  struct prompt_seg
+  {
+    enum prompt_seg_kind kind;
+    size_t off; /* PROMPT_TEXT, the bytes in the text of the prompt */
+    size_t len;
+  };
+
+  /**
+   * The git branch of one directory as the worker last found it. head is
+   * the HEAD file it was read from, NULL outside a repository.
+   */
+  struct prompt_git
+  {
+    char *cwd;
+    char *head;
+    struct timespec mtime;
+    char branch[PROMPT_BRANCH_MAX];
+  };
+
+  /**
+   * A prompt template parsed into segments. The template may contain
+   *
+   *   \u  the user name        \h  the host name up to the first dot
+   *   \w  the directory, ~ for $HOME   \W  its last part
+   *   \t  the time, HH:MM:SS   \$  # for root, $ for anyone else
+   *   $?  the last exit status \g  the git branch
+   *   \\  a backslash
+   *
+   * Anything else is shown as written. What cannot change while the shell
+   * runs is resolved when the template is parsed, the rest is computed in
+   * one pass over the segments into a buffer kept from one render to the
+   * next, so a render allocates nothing once the buffer is big enough.
+   *
+   * Cheap segments are computed as the prompt is drawn. Segments that
+   * touch the file system are computed by a worker thread and cached by
+   * directory, checked against the modification time of the file they
+   * came from. A render uses whatever the cache holds right away and asks
+   * the worker to check it; when the answer changes the worker makes
+   * event_fd readable so the caller can draw the prompt again.
+   */
+  struct prompt
+  {
+    char *tmpl;          /* the template the segments were parsed from */
+    struct writer text;  /* the text of every PROMPT_TEXT segment */
+    struct prompt_seg *segs;
+    size_t nsegs;
+    size_t segs_cap;
+    bool needs_cwd;      /* some segment shows the working directory */
+    struct writer out;   /* the last render, reused by the next one */
+
+    /* Only used by templates with a worker segment */
+    int event_fd;        /* eventfd, -1 when there is no worker */
+    pthread_t worker;
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    char want[PATH_MAX]; /* the directory to check next, empty if none */
+    bool stop;
+    struct prompt_git cache[PROMPT_CACHE];
+    size_t cache_next;   /* the entry replaced next */
+  };
+
+  /**
+   * @brief Parse a template and start the worker if it needs one.
+   *
+   * @param p The prompt
+   * @param tmpl The template, copied
+   */
+  void prompt_init(struct prompt *p, const char *tmpl);
+
+  /**
+   * @brief Parse a new template. Nothing is done if it is the one the
+   * prompt already has.
+   *
+   * @param p The prompt
+   * @param tmpl The template, copied
+   * @return True if the template changed and was parsed
+   */
+  bool prompt_set(struct prompt *p, const char *tmpl);
+
+  /**
+   * @brief Stop the worker and free all memory held by the prompt.
+   *
+   * @param p The prompt
+   */
+  void prompt_destroy(struct prompt *p);
+
+  /**
+   * @brief Drop the worker in a forked child, where the thread does not
+   * exist. The child renders no worker segments after this.
+   *
+   * @param p The prompt
+   */
+  void prompt_forget(struct prompt *p);
+
+  /**
+   * @brief Render the prompt with what is known now and have the worker
+   * check its segments for the current directory.
+   *
+   * @param p The prompt
+   * @param status The exit status of the last command
+   * @param cwd The working directory, NULL to ask getcwd when a segment
+   * shows it
+   * @return The prompt, valid until the next render
+   */
+  const char *prompt_render(struct prompt *p, int status, const char *cwd);
+
+  /**
+   * @brief Clear event_fd after it became readable.
+   *
+   * @param p The prompt
+   * @return True if the worker had new data, the prompt should be
+   * rendered again
+   */
+  bool prompt_refresh(struct prompt *p);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif
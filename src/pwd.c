@@ -0,0 +1,170 @@
+#define _GNU_SOURCE
+#include <errno.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "pwd.h"
+
+static void *xmalloc(size_t size)
+{
+    void *rval = malloc(size);
+    if (!rval) {
+        fprintf(stderr, "malloc failed\n");
+        abort();
+    }
+    return rval;
+}
+
+static char *xstrdup(const char *s)
+{
+    char *rval = strdup(s);
+    if (!rval) {
+        fprintf(stderr, "strdup failed\n");
+        abort();
+    }
+    return rval;
+}
+
+/* Whether a component of path is . or .., or with dots false only .. */
+static bool has_dots(const char *path, bool dots)
+{
+    for (const char *s = path; *s;) {
+        const char *e = strchrnul(s, '/');
+        if (e - s == 2 && s[0] == '.' && s[1] == '.')
+            return true;
+        if (dots && e - s == 1 && s[0] == '.')
+            return true;
+        s = *e ? e + 1 : e;
+    }
+    return false;
+}
+
+/*
+ * $PWD names the working directory if it is an absolute path without . or
+ * .. components that leads to the same directory as ".".
+ */
+static bool is_current(const char *pwd)
+{
+    struct stat a, b;
+    if (!pwd || pwd[0] != '/' || has_dots(pwd, true))
+        return false;
+    return stat(pwd, &a) == 0 && stat(".", &b) == 0 && a.st_dev == b.st_dev && a.st_ino == b.st_ino;
+}
+
+/* Remember which directory path is and export it */
+static void note(struct pwd *p)
+{
+    struct stat st;
+    p->dev = 0;
+    p->ino = 0;
+    if (stat(".", &st) == 0) {
+        p->dev = st.st_dev;
+        p->ino = st.st_ino;
+    }
+    if (p->path)
+        setenv("PWD", p->path, 1);
+    else
+        unsetenv("PWD");
+    if (p->old)
+        setenv("OLDPWD", p->old, 1);
+}
+
+/* The shell is in path now, taken over, and left where it was */
+static void enter(struct pwd *p, char *path)
+{
+    free(p->old);
+    p->old = p->path;
+    p->path = path ? path : getcwd(NULL, 0);
+    note(p);
+}
+
+void pwd_init(struct pwd *p)
+{
+    const char *env = getenv("PWD");
+    memset(p, 0, sizeof(*p));
+    p->path = is_current(env) ? xstrdup(env) : getcwd(NULL, 0);
+    note(p);
+}
+
+void pwd_destroy(struct pwd *p)
+{
+    free(p->path);
+    free(p->old);
+    memset(p, 0, sizeof(*p));
+}
+
+char *pwd_lexical(struct pwd *p, const char *dir)
+{
+    size_t len = 0;
+    if (dir[0] != '/' && !pwd_get(p))
+        return NULL;
+    size_t base = dir[0] == '/' ? 0 : strlen(p->path);
+    char *out = (char *)xmalloc(base + strlen(dir) + 2);
+    // The root is kept as no components at all
+    if (base > 1) {
+        memcpy(out, p->path, base);
+        len = base;
+    }
+    for (const char *s = dir; *s;) {
+        const char *e = strchrnul(s, '/');
+        size_t n = (size_t)(e - s);
+        if (n == 2 && s[0] == '.' && s[1] == '.') {
+            while (len && out[len - 1] != '/')
+                len--;
+            if (len)
+                len--;
+        } else if (n && !(n == 1 && s[0] == '.')) {
+            out[len++] = '/';
+            memcpy(out + len, s, n);
+            len += n;
+        }
+        s = *e ? e + 1 : e;
+    }
+    if (!len)
+        out[len++] = '/';
+    out[len] = '\0';
+    return out;
+}
+
+int pwd_chdir(struct pwd *p, const char *dir)
+{
+    char *to = pwd_lexical(p, dir);
+    // Without .. dir itself leads to the same directory and walks less
+    bool up = to && has_dots(dir, false);
+    int rval = chdir(up ? to : dir);
+    if (rval < 0 && up) {
+        free(to);
+        to = NULL;
+        rval = chdir(dir);
+    }
+    if (rval < 0) {
+        int err = errno;
+        free(to);
+        errno = err;
+        return -1;
+    }
+    enter(p, to);
+    return 0;
+}
+
+void pwd_set(struct pwd *p, const char *path)
+{
+    enter(p, path ? xstrdup(path) : NULL);
+}
+
+const char *pwd_get(struct pwd *p)
+{
+    struct stat st;
+    if (p->path && stat(".", &st) == 0 && st.st_dev == p->dev && st.st_ino == p->ino)
+        return p->path;
+    char *cwd = getcwd(NULL, 0);
+    if (cwd) {
+        free(p->path);
+        p->path = cwd;
+        note(p);
+    }
+    return p->path;
+}
@@ -0,0 +1,87 @@
+#ifndef PWD_H
+#define PWD_H
+#include <sys/types.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+  /**
+   * The logical working directory, the path the user took to it through
+   * symbolic links. A change works it out from the path it had, with .
+   * and .. taken out without looking at the file system, so nothing asks
+   * the kernel for the path with getcwd. Only the shell changes its
+   * directory, so path is read as it is where that costs, the prompt. The
+   * device and inode of the directory are kept with it for pwd_get, which
+   * stats "." and only looks the path up again when the shell is
+   * somewhere else than it thinks. PWD and OLDPWD are exported at each
+   * change.
+   */
+  struct pwd
+  {
+    char *path; /* absolute, NULL when not known */
+    char *old;  /* the one before, NULL if none */
+    dev_t dev;
+    ino_t ino;
+  };
+
+  /**
+   * @brief Start from $PWD when it names the current directory, otherwise
+   * from the physical path.
+   *
+   * @param p The working directory
+   */
+  void pwd_init(struct pwd *p);
+
+  /**
+   * @brief Free all memory.
+   *
+   * @param p The working directory
+   */
+  void pwd_destroy(struct pwd *p);
+
+  /**
+   * @brief The absolute path dir leads to from the working directory,
+   * with . and .. components taken out as text. The working directory is
+   * checked first, see pwd_get.
+   *
+   * @param p The working directory
+   * @param dir The path, relative or absolute
+   * @return The path, which the caller must free, NULL if dir is relative
+   * and the working directory is not known
+   */
+  char *pwd_lexical(struct pwd *p, const char *dir);
+
+  /**
+   * @brief Change to dir the way cd does. A .. in dir goes up the logical
+   * path, if that leads nowhere it goes up from the directory dir names.
+   *
+   * @param p The working directory
+   * @param dir The directory to change to
+   * @return 0 on success, -1 with errno set
+   */
+  int pwd_chdir(struct pwd *p, const char *dir);
+
+  /**
+   * @brief Record that the shell changed to path some other way.
+   *
+   * @param p The working directory
+   * @param path The absolute path changed to, NULL to look it up
+   */
+  void pwd_set(struct pwd *p, const char *path);
+
+  /**
+   * @brief The working directory, looked up again if the shell is not in
+   * the directory it was in at the last change.
+   *
+   * @param p The working directory
+   * @return The path, NULL if it can not be found
+   */
+  const char *pwd_get(struct pwd *p);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif
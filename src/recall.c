@@ -0,0 +1,70 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <readline/readline.h>
+#include "recall.h"
+#include "lab.h"
+
+static struct shell *recall_sh;
+static uint32_t shown = HISTRING_END; /* slot of the line shown, HISTRING_END for typed */
+static char *typed;   /* the line being typed while another one is shown */
+
+/* Every new line starts from the bottom of the history */
+static int recall_reset(void)
+{
+    shown = HISTRING_END;
+    free(typed);
+    typed = NULL;
+    return 0;
+}
+
+static int recall_move(int count)
+{
+    const struct histring *r = &recall_sh->recall;
+    uint32_t to = shown;
+    for (; count > 0; count--) {
+        uint32_t next = histring_older(r, to);
+        if (next == HISTRING_END)
+            break;
+        to = next;
+    }
+    for (; count < 0 && to != HISTRING_END; count++)
+        to = histring_newer(r, to);
+    if (to == shown) {
+        rl_ding();
+        return 0;
+    }
+    if (shown == HISTRING_END) {
+        free(typed);
+        typed = strdup(rl_line_buffer);
+    }
+    shown = to;
+    rl_replace_line(shown != HISTRING_END ? r->ring[shown].line : typed ? typed : "", 0);
+    rl_point = rl_end;
+    return 0;
+}
+
+static int recall_prev(int count, int key)
+{
+    UNUSED(key);
+    return recall_move(count);
+}
+
+static int recall_next(int count, int key)
+{
+    UNUSED(key);
+    return recall_move(-count);
+}
+
+void recall_install(struct shell *sh)
+{
+    recall_sh = sh;
+    rl_startup_hook = recall_reset;
+    rl_bind_key_in_map(CTRL('P'), recall_prev, emacs_standard_keymap);
+    rl_bind_key_in_map(CTRL('N'), recall_next, emacs_standard_keymap);
+    // Bound before readline starts, which then leaves the arrows alone
+    rl_bind_keyseq_in_map("\033[A", recall_prev, emacs_standard_keymap);
+    rl_bind_keyseq_in_map("\033[B", recall_next, emacs_standard_keymap);
+    rl_bind_keyseq_in_map("\033OA", recall_prev, emacs_standard_keymap);
+    rl_bind_keyseq_in_map("\033OB", recall_next, emacs_standard_keymap);
+}
@@ -0,0 +1,25 @@
+#ifndef RECALL_H
+#define RECALL_H
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+  struct shell;
+
+  /**
+   * @brief Bind the up and down arrows, Ctrl-P and Ctrl-N to walk the
+   * bounded history ring of the shell instead of readline's own list.
+   * Walking back past the line being typed keeps it, walking forward to
+   * the end brings it back.
+   *
+   * @param sh The shell whose ring is walked
+   */
+  void recall_install(struct shell *sh);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif
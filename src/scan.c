@@ -0,0 +1,134 @@
+#include <stdint.h>
+#include <string.h>
+#include "scan.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define SCAN_X86 1
+#include <immintrin.h>
+#endif
+
+static size_t scalar_find_space(const char *s, size_t n)
+{
+    size_t i = 0;
+    while (i < n && !scan_is_space(s[i]))
+        i++;
+    return i;
+}
+
+static size_t scalar_find_nonspace(const char *s, size_t n)
+{
+    size_t i = 0;
+    while (i < n && scan_is_space(s[i]))
+        i++;
+    return i;
+}
+
+#ifdef SCAN_X86
+/*
+ * A byte is a separator if it is ' ' or falls in ['\t', '\r']. The range
+ * check is done as an unsigned (c - '\t') <= 4 using min_epu8 since SSE2 and
+ * AVX2 only have signed byte compares.
+ */
+static inline __m128i sse2_space_mask(__m128i v)
+{
+    __m128i sp = _mm_cmpeq_epi8(v, _mm_set1_epi8(' '));
+    __m128i d = _mm_sub_epi8(v, _mm_set1_epi8('\t'));
+    __m128i ctl = _mm_cmpeq_epi8(_mm_min_epu8(d, _mm_set1_epi8(4)), d);
+    return _mm_or_si128(sp, ctl);
+}
+
+static size_t sse2_find(const char *s, size_t n, unsigned flip)
+{
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(s + i));
+        unsigned m = (unsigned)_mm_movemask_epi8(sse2_space_mask(v)) ^ flip;
+        if (m)
+            return i + (size_t)__builtin_ctz(m);
+    }
+    if (flip)
+        return i + scalar_find_nonspace(s + i, n - i);
+    return i + scalar_find_space(s + i, n - i);
+}
+
+static size_t sse2_find_space(const char *s, size_t n)
+{
+    return sse2_find(s, n, 0);
+}
+
+static size_t sse2_find_nonspace(const char *s, size_t n)
+{
+    return sse2_find(s, n, 0xffffu);
+}
+
+__attribute__((target("avx2")))
+static inline __m256i avx2_space_mask(__m256i v)
+{
+    __m256i sp = _mm256_cmpeq_epi8(v, _mm256_set1_epi8(' '));
+    __m256i d = _mm256_sub_epi8(v, _mm256_set1_epi8('\t'));
+    __m256i ctl = _mm256_cmpeq_epi8(_mm256_min_epu8(d, _mm256_set1_epi8(4)), d);
+    return _mm256_or_si256(sp, ctl);
+}
+
+__attribute__((target("avx2")))
+static size_t avx2_find(const char *s, size_t n, uint32_t flip)
+{
+    size_t i = 0;
+    for (; i + 32 <= n; i += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i *)(s + i));
+        uint32_t m = (uint32_t)_mm256_movemask_epi8(avx2_space_mask(v)) ^ flip;
+        if (m)
+            return i + (size_t)__builtin_ctz(m);
+    }
+    if (flip)
+        return i + sse2_find_nonspace(s + i, n - i);
+    return i + sse2_find_space(s + i, n - i);
+}
+
+static size_t avx2_find_space(const char *s, size_t n)
+{
+    return avx2_find(s, n, 0);
+}
+
+static size_t avx2_find_nonspace(const char *s, size_t n)
+{
+    return avx2_find(s, n, 0xffffffffu);
+}
+#endif
+
+static const struct scan_kernel kernels[] = {
+    {"scalar", scalar_find_space, scalar_find_nonspace},
+#ifdef SCAN_X86
+    {"sse2", sse2_find_space, sse2_find_nonspace},
+    {"avx2", avx2_find_space, avx2_find_nonspace},
+#endif
+};
+
+static size_t kernels_supported(void)
+{
+    size_t n = 1;
+#ifdef SCAN_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("sse2"))
+        n = 2;
+    if (n == 2 && __builtin_cpu_supports("avx2"))
+        n = 3;
+#endif
+    return n;
+}
+
+/* Selected on first use, racing threads all pick the same kernel */
+static const struct scan_kernel *active;
+
+const struct scan_kernel *scan_kernel(void)
+{
+    if (!active)
+        active = &kernels[kernels_supported() - 1];
+    return active;
+}
+
+const struct scan_kernel *scan_kernels(size_t *count)
+{
+    *count = kernels_supported();
+    return kernels;
+}
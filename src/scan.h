@@ -0,0 +1,74 @@
+#ifndef SCAN_H
+#define SCAN_H
+#include <stdbool.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+  /**
+   * A set of routines that search a buffer for argument separators. The
+   * separators are the whitespace characters of the C locale: space, \t,
+   * \n, \v, \f and \r.
+   */
+  struct scan_kernel
+  {
+    const char *name;
+    /* Index of the first separator in s[0, n) or n if there is none */
+    size_t (*find_space)(const char *s, size_t n);
+    /* Index of the first non separator in s[0, n) or n if there is none */
+    size_t (*find_nonspace)(const char *s, size_t n);
+  };
+
+  /**
+   * @brief Check if c is a separator. Unlike isspace this does not depend on
+   * the current locale.
+   *
+   * @param c The character to check
+   * @return True if c is a separator
+   */
+  static inline bool scan_is_space(char c)
+  {
+    return c == ' ' || (unsigned char)(c - '\t') < 5;
+  }
+
+  /**
+   * @brief Get the fastest kernel supported by this CPU. The choice is made
+   * with CPUID the first time this function is called.
+   *
+   * @return The kernel
+   */
+  const struct scan_kernel *scan_kernel(void);
+
+  /**
+   * @brief Get every kernel supported by this CPU, slowest first. The
+   * scalar kernel is always available.
+   *
+   * @param count Set to the number of kernels returned
+   * @return The kernels
+   */
+  const struct scan_kernel *scan_kernels(size_t *count);
+
+  /**
+   * @brief Index of the first separator in s[0, n) or n if there is none.
+   */
+  static inline size_t scan_space(const char *s, size_t n)
+  {
+    return scan_kernel()->find_space(s, n);
+  }
+
+  /**
+   * @brief Index of the first non separator in s[0, n) or n if there is none.
+   */
+  static inline size_t scan_nonspace(const char *s, size_t n)
+  {
+    return scan_kernel()->find_nonspace(s, n);
+  }
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif
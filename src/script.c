@@ -0,0 +1,156 @@
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "script.h"
+#include "exec.h"
+#include "jobs.h"
+#include "parse.h"
+
+static void *xrealloc(void *p, size_t size)
+{
+    void *rval = realloc(p, size);
+    if (!rval) {
+        fprintf(stderr, "realloc failed\n");
+        abort();
+    }
+    return rval;
+}
+
+void script_init_string(struct script *s, const char *text)
+{
+    memset(s, 0, sizeof(*s));
+    s->fd = -1;
+    s->eof = true;
+    s->data = text;
+    s->len = strlen(text);
+}
+
+int script_open(struct script *s, int fd, bool shared)
+{
+    struct stat st;
+    memset(s, 0, sizeof(*s));
+    s->fd = fd;
+    s->shared = shared;
+    if (fstat(fd, &st) < 0)
+        return -1;
+    if (S_ISREG(st.st_mode)) {
+        // A stdin handed over part way through the file starts from there
+        off_t start = shared ? lseek(fd, 0, SEEK_CUR) : 0;
+        s->eof = true;
+        if (st.st_size == 0)
+            return 0;
+        void *map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (map != MAP_FAILED) {
+            madvise(map, (size_t)st.st_size, MADV_SEQUENTIAL);
+            s->mapped = true;
+            s->data = (const char *)map;
+            s->len = (size_t)st.st_size;
+            s->pos = start > 0 && (size_t)start < s->len ? (size_t)start : 0;
+            return 0;
+        }
+        s->eof = false;
+    }
+    s->cap = SCRIPT_CHUNK;
+    s->buf = (char *)xrealloc(NULL, s->cap);
+    s->data = s->buf;
+    return 0;
+}
+
+void script_close(struct script *s)
+{
+    if (s->mapped)
+        munmap((void *)s->data, s->len);
+    if (s->fd > STDIN_FILENO)
+        close(s->fd);
+    free(s->buf);
+    free(s->line);
+    memset(s, 0, sizeof(*s));
+    s->fd = -1;
+}
+
+/* Read more after what is left of buf, false at the end of the file */
+static bool fill(struct script *s)
+{
+    if (s->eof)
+        return false;
+    memmove(s->buf, s->buf + s->pos, s->len - s->pos);
+    s->len -= s->pos;
+    s->pos = 0;
+    if (s->len == s->cap) {
+        s->cap *= 2;
+        s->buf = (char *)xrealloc(s->buf, s->cap);
+        s->data = s->buf;
+    }
+    ssize_t n;
+    do {
+        n = read(s->fd, s->buf + s->len, s->cap - s->len);
+    } while (n < 0 && errno == EINTR);
+    if (n <= 0) {
+        s->eof = true;
+        return false;
+    }
+    s->len += (size_t)n;
+    return true;
+}
+
+char *script_next(struct script *s)
+{
+    const char *nl = NULL;
+    // A command that read from the file leaves the next line where it stopped
+    if (s->shared && s->mapped) {
+        off_t at = lseek(s->fd, 0, SEEK_CUR);
+        if (at >= 0 && (size_t)at <= s->len)
+            s->pos = (size_t)at;
+    }
+    size_t from = s->pos;
+    for (;;) {
+        if (s->len > from)
+            nl = (const char *)memchr(s->data + from, '\n', s->len - from);
+        // What was looked through moves to the front of buf with the line
+        from = s->len - s->pos;
+        if (nl || !fill(s))
+            break;
+    }
+    if (!nl && s->pos == s->len)
+        return NULL;
+    size_t end = nl ? (size_t)(nl - s->data) : s->len;
+    size_t n = end - s->pos;
+    if (n + 1 > s->line_cap) {
+        s->line_cap = n + 1 > 256 ? n + 1 : 256;
+        s->line = (char *)xrealloc(s->line, s->line_cap);
+    }
+    memcpy(s->line, s->data + s->pos, n);
+    s->line[n] = '\0';
+    s->pos = nl ? end + 1 : end;
+    if (s->shared && s->mapped)
+        lseek(s->fd, (off_t)s->pos, SEEK_SET);
+    return s->line;
+}
+
+void script_run(struct shell *sh, struct script *s)
+{
+    char *line;
+    while ((line = script_next(s))) {
+        // Nothing to wait for costs no system call a line
+        if (sh->jobs.head) {
+            jobs_reap(sh);
+            jobs_notify(sh);
+        }
+        line = trim_white(line);
+        if (!*line)
+            continue;
+        arena_reset(&sh->arena);
+        const char *err;
+        struct ast_pipeline *list = parse_line(&sh->arena, line, &err);
+        if (err) {
+            fprintf(stderr, "%s\n", err);
+            sh->status = 2;
+        } else {
+            exec_list(sh, list);
+        }
+    }
+}
@@ -0,0 +1,86 @@
+#ifndef SCRIPT_H
+#define SCRIPT_H
+#include <stdbool.h>
+#include <stddef.h>
+#include "lab.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/* Bytes read at a time from what can not be mapped */
+#define SCRIPT_CHUNK 65536
+
+  /**
+   * The commands of a shell nobody types into: a script, the string of -c
+   * or a stdin that is not a terminal. A regular file is mapped whole and
+   * anything else read SCRIPT_CHUNK bytes at a time, lines are cut out of
+   * that with memchr and copied into line for the parser. There is no
+   * readline, no prompt and no history.
+   */
+  struct script
+  {
+    int fd;           /* the file, -1 for a string */
+    bool shared;      /* the commands run read from fd too */
+    bool mapped;      /* data is a mapping of the file */
+    bool eof;         /* nothing more to read into buf */
+    const char *data; /* the mapping, the string or buf */
+    size_t len;
+    size_t pos;       /* the next line starts here */
+    char *buf;        /* what was read and not run yet */
+    size_t cap;
+    char *line;
+    size_t line_cap;
+  };
+
+  /**
+   * @brief Read the commands of a string, for -c.
+   *
+   * @param s The script
+   * @param text The commands, one or more lines, not copied
+   */
+  void script_init_string(struct script *s, const char *text);
+
+  /**
+   * @brief Read the commands of an open file.
+   *
+   * @param s The script
+   * @param fd The file, closed by script_close unless it is stdin
+   * @param shared Whether commands run read from fd too. A regular file is
+   * then kept at the offset right after the line being run, so they read
+   * on from there and the script goes on from where they stopped, like in
+   * other shells.
+   * @return 0 on success, -1 with errno set
+   */
+  int script_open(struct script *s, int fd, bool shared);
+
+  /**
+   * @brief Free all memory.
+   *
+   * @param s The script
+   */
+  void script_close(struct script *s);
+
+  /**
+   * @brief The next line, without its newline.
+   *
+   * @param s The script
+   * @return The line, valid until the next call, NULL at the end
+   */
+  char *script_next(struct script *s);
+
+  /**
+   * @brief Run every line, the exit status of the last command is left in
+   * sh->status.
+   *
+   * @param sh The shell
+   * @param s The script
+   */
+  void script_run(struct shell *sh, struct script *s);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif
@@ -0,0 +1,136 @@
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <spawn.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "spawn.h"
+#include "zygote.h"
+
+#if defined(__GLIBC__) && __GLIBC_PREREQ(2, 35)
+#define SPAWN_HAVE_TCSETPGRP 1
+#endif
+
+/* Signals the shell ignores or catches that a job must see with default
+ * handling */
+static const int job_signals[] = {SIGINT, SIGQUIT, SIGTSTP, SIGTTIN, SIGTTOU, SIGCHLD};
+
+enum spawn_mode spawn_default_mode(void)
+{
+#ifdef SPAWN_HAVE_TCSETPGRP
+    return SPAWN_POSIX;
+#else
+    return SPAWN_FORK;
+#endif
+}
+
+static pid_t spawn_posix(const struct spawn_req *req)
+{
+    posix_spawnattr_t attr;
+    posix_spawn_file_actions_t fa;
+    sigset_t def;
+    sigset_t mask;
+    short flags = POSIX_SPAWN_SETSIGDEF | POSIX_SPAWN_SETSIGMASK;
+    pid_t pid = -1;
+
+    posix_spawnattr_init(&attr);
+    posix_spawn_file_actions_init(&fa);
+
+    sigemptyset(&def);
+    for (size_t i = 0; i < sizeof(job_signals) / sizeof(job_signals[0]); i++)
+        sigaddset(&def, job_signals[i]);
+    sigemptyset(&mask);
+    posix_spawnattr_setsigdefault(&attr, &def);
+    posix_spawnattr_setsigmask(&attr, &mask);
+    if (req->pgid >= 0) {
+        flags |= POSIX_SPAWN_SETPGROUP;
+        posix_spawnattr_setpgroup(&attr, req->pgid);
+    }
+    posix_spawnattr_setflags(&attr, flags);
+
+    for (size_t i = 0; i < req->nfds; i++)
+        posix_spawn_file_actions_adddup2(&fa, req->fds[i].source, req->fds[i].target);
+#ifdef SPAWN_HAVE_TCSETPGRP
+    // Runs in the child after setpgid with every signal blocked, so no SIGTTOU
+    if (req->terminal >= 0)
+        posix_spawn_file_actions_addtcsetpgrp_np(&fa, req->terminal);
+#endif
+
+    int rc;
+    if (strchr(req->path, '/'))
+        rc = posix_spawn(&pid, req->path, &fa, &attr, req->argv, environ);
+    else
+        rc = posix_spawnp(&pid, req->path, &fa, &attr, req->argv, environ);
+
+    posix_spawn_file_actions_destroy(&fa);
+    posix_spawnattr_destroy(&attr);
+    if (rc) {
+        errno = rc;
+        return -1;
+    }
+    return pid;
+}
+
+static pid_t spawn_fork(const struct spawn_req *req)
+{
+    // Anything still buffered would otherwise be written twice
+    fflush(NULL);
+    pid_t pid = fork();
+    if (pid == 0) {
+        /*This is the child process*/
+        if (req->pgid >= 0)
+            setpgid(0, req->pgid);
+        if (req->terminal >= 0)
+            tcsetpgrp(req->terminal, getpgrp());
+        for (size_t i = 0; i < sizeof(job_signals) / sizeof(job_signals[0]); i++)
+            signal(job_signals[i], SIG_DFL);
+        sigset_t mask;
+        sigemptyset(&mask);
+        sigprocmask(SIG_SETMASK, &mask, NULL);
+        for (size_t i = 0; i < req->nfds; i++) {
+            if (req->fds[i].source == req->fds[i].target)
+                fcntl(req->fds[i].target, F_SETFD, 0);
+            else
+                dup2(req->fds[i].source, req->fds[i].target);
+        }
+        if (req->fn) {
+            int status = req->fn(req->ctx);
+            fflush(NULL);
+            _exit(status);
+        }
+        if (strchr(req->path, '/'))
+            execv(req->path, req->argv);
+        else
+            execvp(req->path, req->argv);
+        fprintf(stderr, "%s: %s\n", req->path, strerror(errno));
+        _exit(127);
+    }
+    return pid;
+}
+
+pid_t spawn_cmd(enum spawn_mode mode, const struct spawn_req *req)
+{
+    pid_t pid;
+    if (req->fn || mode == SPAWN_FORK)
+        pid = spawn_fork(req);
+    else if (mode != SPAWN_ZYGOTE || !spawn_zygote(req, &pid))
+        pid = spawn_posix(req);
+    if (pid <= 0)
+        return -1;
+
+    /*
+    This is in the parent put the child process into its own
+    process group and give it control of the terminal
+    to avoid a race condition
+    */
+    if (req->pgid >= 0) {
+        pid_t pgid = req->pgid ? req->pgid : pid;
+        setpgid(pid, pgid);
+        if (req->terminal >= 0)
+            tcsetpgrp(req->terminal, pgid);
+    }
+    return pid;
+}
@@ -0,0 +1,94 @@
+#ifndef SPAWN_H
+#define SPAWN_H
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/types.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+  /**
+   * How child processes are created.
+   */
+  enum spawn_mode
+  {
+    SPAWN_POSIX, /* posix_spawn, glibc uses clone(CLONE_VM|CLONE_VFORK) */
+    SPAWN_FORK,  /* fork and exec, copies the page tables of the shell */
+    SPAWN_ZYGOTE, /* fork and exec in a small helper forked at startup */
+  };
+
+  /**
+   * Install fd source in the child as fd target.
+   */
+  struct spawn_fd
+  {
+    int target;
+    int source;
+  };
+
+  /**
+   * Everything needed to launch one child.
+   */
+  struct spawn_req
+  {
+    const char *path;         /* program to run, searched for in PATH if it has no / */
+    char *const *argv;        /* NULL terminated arguments */
+    const struct spawn_fd *fds; /* fds to install in the child, in order */
+    size_t nfds;
+    pid_t pgid;               /* group to join, 0 to lead a new group, -1 to stay */
+    int terminal;             /* terminal to hand the group, -1 for none */
+    int (*fn)(void *ctx);     /* if set run this in a forked child instead of path */
+    void *ctx;
+  };
+
+  /**
+   * @brief The fastest mode that supports everything the shell needs. This
+   * is SPAWN_POSIX when the C library can hand the terminal to the child
+   * before it execs and SPAWN_FORK otherwise.
+   *
+   * @return The default mode
+   */
+  enum spawn_mode spawn_default_mode(void);
+
+  /**
+   * @brief Launch a child. The child is put in its process group, given the
+   * terminal if requested and has the job control signals the shell ignores
+   * reset to their defaults before the program runs. The parent repeats the
+   * setpgid and tcsetpgrp calls so there is no window where the child is
+   * running but not yet in its group.
+   *
+   * If req->fn is set the child is always created with fork, runs fn with
+   * req->ctx and exits with the value it returns.
+   *
+   * @param mode How to create the child
+   * @param req What to launch
+   * @return The pid of the child or -1 with errno set if the program could not
+   * be started. In SPAWN_FORK mode exec errors are only seen as exit status 127.
+   */
+  pid_t spawn_cmd(enum spawn_mode mode, const struct spawn_req *req);
+
+  /**
+   * @brief Fork the zygote helper used by SPAWN_ZYGOTE. The helper is forked
+   * while the process is still small so the fork it does for every launch
+   * copies only a few pages no matter how large the shell grows. Requests
+   * carry the argv, environment, working directory and fds of the child over
+   * a socketpair. Children are created with CLONE_PARENT so they are
+   * children of this process, not of the helper. Until the helper is
+   * started, or if it dies, SPAWN_ZYGOTE launches with posix_spawn.
+   *
+   * @return 0 on success or -1 with errno set
+   */
+  int spawn_zygote_start(void);
+
+  /**
+   * @brief Stop the zygote helper and wait for it to exit.
+   */
+  void spawn_zygote_stop(void);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif
@@ -0,0 +1,104 @@
+#include <errno.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "writer.h"
+
+#define WRITER_MIN_CAP 256
+/* Output beyond this is written out early so huge output is not held */
+#define WRITER_HIGH_WATER (64 * 1024)
+
+void writer_init(struct writer *w, int fd)
+{
+    w->buf = NULL;
+    w->len = 0;
+    w->cap = 0;
+    w->fd = fd;
+    w->err = 0;
+}
+
+void writer_destroy(struct writer *w)
+{
+    free(w->buf);
+    w->buf = NULL;
+    w->len = 0;
+    w->cap = 0;
+}
+
+static void reserve(struct writer *w, size_t n)
+{
+    if (w->len + n <= w->cap)
+        return;
+    size_t cap = w->cap ? w->cap : WRITER_MIN_CAP;
+    while (cap < w->len + n)
+        cap *= 2;
+    char *buf = (char *)realloc(w->buf, cap);
+    if (!buf)
+    {
+        fprintf(stderr, "realloc failed\n");
+        abort();
+    }
+    w->buf = buf;
+    w->cap = cap;
+}
+
+void writer_put(struct writer *w, const char *s, size_t n)
+{
+    if (w->fd >= 0 && w->len + n > WRITER_HIGH_WATER)
+        writer_flush(w);
+    reserve(w, n);
+    memcpy(w->buf + w->len, s, n);
+    w->len += n;
+}
+
+void writer_puts(struct writer *w, const char *s)
+{
+    writer_put(w, s, strlen(s));
+}
+
+void writer_putc(struct writer *w, char c)
+{
+    if (w->len < w->cap)
+        w->buf[w->len++] = c;
+    else
+        writer_put(w, &c, 1);
+}
+
+void writer_printf(struct writer *w, const char *fmt, ...)
+{
+    va_list ap;
+    va_start(ap, fmt);
+    int n = vsnprintf(w->buf ? w->buf + w->len : NULL, w->cap - w->len, fmt, ap);
+    va_end(ap);
+    if (n < 0)
+        return;
+    if ((size_t)n >= w->cap - w->len)
+    {
+        reserve(w, (size_t)n + 1);
+        va_start(ap, fmt);
+        vsnprintf(w->buf + w->len, w->cap - w->len, fmt, ap);
+        va_end(ap);
+    }
+    w->len += (size_t)n;
+}
+
+int writer_flush(struct writer *w)
+{
+    if (w->fd < 0)
+        return 0;
+    size_t off = 0;
+    while (off < w->len && !w->err)
+    {
+        ssize_t n = write(w->fd, w->buf + off, w->len - off);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0)
+            w->err = errno;
+        else
+            off += (size_t)n;
+    }
+    w->len = 0;
+    return w->err ? -1 : 0;
+}
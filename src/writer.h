@@ -0,0 +1,87 @@
+#ifndef WRITER_H
+#define WRITER_H
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+  /**
+   * Buffered output for builtins. Everything a builtin prints is collected
+   * and written with as few write calls as possible when the command is
+   * done. A writer with no fd keeps the output in memory for the caller.
+   */
+  struct writer
+  {
+    char *buf;
+    size_t len;
+    size_t cap;
+    int fd;  /* where writer_flush writes, -1 to keep the output in memory */
+    int err; /* errno of the first failed write, 0 if none failed */
+  };
+
+  /**
+   * @brief Initialize an empty writer.
+   *
+   * @param w The writer
+   * @param fd Where output goes, -1 to capture it in w->buf
+   */
+  void writer_init(struct writer *w, int fd);
+
+  /**
+   * @brief Free the buffer. Nothing is flushed.
+   *
+   * @param w The writer
+   */
+  void writer_destroy(struct writer *w);
+
+  /**
+   * @brief Append n bytes.
+   *
+   * @param w The writer
+   * @param s The bytes
+   * @param n How many
+   */
+  void writer_put(struct writer *w, const char *s, size_t n);
+
+  /**
+   * @brief Append a NUL terminated string.
+   *
+   * @param w The writer
+   * @param s The string
+   */
+  void writer_puts(struct writer *w, const char *s);
+
+  /**
+   * @brief Append one byte.
+   *
+   * @param w The writer
+   * @param c The byte
+   */
+  void writer_putc(struct writer *w, char c);
+
+  /**
+   * @brief Append formatted output like printf.
+   *
+   * @param w The writer
+   * @param fmt The format
+   */
+  void writer_printf(struct writer *w, const char *fmt, ...)
+      __attribute__((format(printf, 2, 3)));
+
+  /**
+   * @brief Write out everything buffered. A capturing writer keeps its
+   * output. After a failed write the rest of the output is dropped until
+   * the caller clears w->err.
+   *
+   * @param w The writer
+   * @return 0 on success, -1 if a write failed with the error in w->err
+   */
+  int writer_flush(struct writer *w);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif
@@ -0,0 +1,416 @@
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/prctl.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include "zygote.h"
+
+/* Most fds one request can carry: cwd, terminal, stdio and redirections */
+#define ZYGOTE_MAX_FDS 64
+/* Stack the child runs on until it execs */
+#define ZYGOTE_STACK_SIZE (64 * 1024)
+
+/* Signals the shell ignores or catches, the helper runs with the defaults */
+static const int job_signals[] = {SIGINT, SIGQUIT, SIGTSTP, SIGTTIN, SIGTTOU, SIGCHLD};
+
+/*
+ * A launch request. The fds travel as SCM_RIGHTS in the order cwd, the
+ * terminal if there is one and then the source for every entry of the
+ * targets that follow the header. After the targets come the strings, path
+ * first and then argv and the environment, each NUL terminated.
+ */
+struct zygote_msg
+{
+    int32_t pgid;         /* group to join, 0 to lead a new group */
+    int32_t has_terminal;
+    uint32_t nfds;
+    uint32_t argc;
+    uint32_t envc;
+};
+
+struct zygote_reply
+{
+    int32_t pid;
+    int32_t err; /* errno if the program could not be started */
+};
+
+static pid_t zygote_pid = -1;
+static int zygote_sock = -1;
+static char *msg_buf;
+static size_t msg_cap;
+
+static void *grow(void *p, size_t size)
+{
+    void *rval = realloc(p, size);
+    if (!rval) {
+        fprintf(stderr, "realloc failed\n");
+        abort();
+    }
+    return rval;
+}
+
+struct launch
+{
+    const struct zygote_msg *m;
+    const int32_t *targets;
+    const char *path;
+    char **argv;
+    char **envp;
+    int cwd;
+    int term;
+    const int *src;
+    int err; /* written by the child if exec fails */
+};
+
+/*
+ * Runs in the child on its own stack while the helper is suspended, the two
+ * share memory until exec so an exec error is simply stored in l->err.
+ */
+static int launch_child(void *arg)
+{
+    struct launch *l = (struct launch *)arg;
+    setpgid(0, l->m->pgid);
+    if (l->term >= 0)
+        tcsetpgrp(l->term, getpgrp());
+    for (uint32_t i = 0; i < l->m->nfds; i++) {
+        if (l->src[i] == l->targets[i])
+            fcntl(l->targets[i], F_SETFD, 0);
+        else
+            dup2(l->src[i], l->targets[i]);
+    }
+    if (fchdir(l->cwd) < 0)
+        perror("fchdir");
+    sigset_t none;
+    sigemptyset(&none);
+    sigprocmask(SIG_SETMASK, &none, NULL);
+    if (strchr(l->path, '/'))
+        execve(l->path, l->argv, l->envp);
+    else
+        execvpe(l->path, l->argv, l->envp);
+    l->err = errno;
+    _exit(127);
+}
+
+/*
+ * Runs in the helper. The child is created like posix_spawn creates it,
+ * sharing the memory of the helper and with the helper suspended until the
+ * child has called exec, so nothing is copied. CLONE_PARENT makes the child
+ * a sibling of the helper and so a child of the shell. Returns the pid with
+ * the exec error of the child in *err.
+ */
+static pid_t helper_launch(const struct zygote_msg *m, const int32_t *targets, const char *path,
+                           char **argv, char **envp, const int *fds, int *err)
+{
+    static char *stack;
+    if (!stack) {
+        stack = (char *)malloc(ZYGOTE_STACK_SIZE);
+        if (!stack) {
+            *err = ENOMEM;
+            return -1;
+        }
+    }
+    struct launch l;
+    l.m = m;
+    l.targets = targets;
+    l.path = path;
+    l.argv = argv;
+    l.envp = envp;
+    l.cwd = fds[0];
+    l.term = m->has_terminal ? fds[1] : -1;
+    l.src = fds + 1 + (m->has_terminal != 0);
+    l.err = 0;
+
+    // With every signal blocked the child can take the terminal without SIGTTOU
+    sigset_t all, old;
+    sigfillset(&all);
+    sigprocmask(SIG_SETMASK, &all, &old);
+    pid_t pid = clone(launch_child, stack + ZYGOTE_STACK_SIZE,
+                      CLONE_VM | CLONE_VFORK | CLONE_PARENT | SIGCHLD, &l);
+    *err = pid < 0 ? errno : l.err;
+    sigprocmask(SIG_SETMASK, &old, NULL);
+    return pid;
+}
+
+/*
+ * Check a request and split it into its parts. Returns 0 on success.
+ */
+static int helper_decode(char *buf, size_t len, size_t nfds, struct zygote_msg *m,
+                         int32_t **targets, char **path, char ***vec, size_t *veccap)
+{
+    if (len < sizeof(*m))
+        return -1;
+    memcpy(m, buf, sizeof(*m));
+    size_t off = sizeof(*m) + sizeof(int32_t) * (size_t)m->nfds;
+    if (m->nfds > ZYGOTE_MAX_FDS || off > len || nfds != 1 + (m->has_terminal != 0) + m->nfds)
+        return -1;
+    *targets = (int32_t *)(buf + sizeof(*m));
+
+    size_t nstr = 1 + (size_t)m->argc + m->envc;
+    if (nstr + 2 > *veccap) {
+        *veccap = nstr + 2;
+        *vec = (char **)grow(*vec, sizeof(char *) * *veccap);
+    }
+    // argv and the environment share one vector, each NULL terminated
+    size_t k = 0;
+    for (size_t i = 0; i < nstr; i++) {
+        char *s = buf + off;
+        char *end = (char *)memchr(s, '\0', len - off);
+        if (!end)
+            return -1;
+        off += (size_t)(end - s) + 1;
+        if (i == 0) {
+            *path = s;
+            continue;
+        }
+        (*vec)[k++] = s;
+        if (i == m->argc)
+            (*vec)[k++] = NULL;
+    }
+    (*vec)[k] = NULL;
+    return m->argc ? 0 : -1;
+}
+
+static void helper_main(int sock)
+{
+    char *buf = NULL;
+    size_t cap = 0;
+    char **vec = NULL;
+    size_t veccap = 0;
+
+    for (;;) {
+        ssize_t len = recv(sock, NULL, 0, MSG_PEEK | MSG_TRUNC);
+        if (len < 0 && errno == EINTR)
+            continue;
+        if (len <= 0)
+            _exit(0);
+        if ((size_t)len > cap) {
+            cap = (size_t)len;
+            buf = (char *)grow(buf, cap);
+        }
+
+        union {
+            struct cmsghdr h;
+            char buf[CMSG_SPACE(sizeof(int) * ZYGOTE_MAX_FDS)];
+        } ctl;
+        struct iovec iov = {buf, cap};
+        struct msghdr mh;
+        memset(&mh, 0, sizeof(mh));
+        mh.msg_iov = &iov;
+        mh.msg_iovlen = 1;
+        mh.msg_control = ctl.buf;
+        mh.msg_controllen = sizeof(ctl.buf);
+        len = recvmsg(sock, &mh, MSG_CMSG_CLOEXEC);
+        if (len <= 0)
+            _exit(0);
+
+        int fds[ZYGOTE_MAX_FDS];
+        size_t nfds = 0;
+        for (struct cmsghdr *c = CMSG_FIRSTHDR(&mh); c; c = CMSG_NXTHDR(&mh, c)) {
+            if (c->cmsg_level != SOL_SOCKET || c->cmsg_type != SCM_RIGHTS)
+                continue;
+            size_t n = (c->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+            for (size_t i = 0; i < n && nfds < ZYGOTE_MAX_FDS; i++)
+                memcpy(&fds[nfds++], CMSG_DATA(c) + i * sizeof(int), sizeof(int));
+        }
+        // Sources live above the fds a child can name, as they do in the shell
+        for (size_t i = 0; i < nfds; i++) {
+            if (fds[i] < 10) {
+                int high = fcntl(fds[i], F_DUPFD_CLOEXEC, 10);
+                close(fds[i]);
+                fds[i] = high;
+            }
+        }
+
+        struct zygote_msg m;
+        int32_t *targets;
+        char *path;
+        struct zygote_reply r = {-1, EINVAL};
+        if (helper_decode(buf, (size_t)len, nfds, &m, &targets, &path, &vec, &veccap) == 0) {
+            int err;
+            r.pid = helper_launch(&m, targets, path, vec, vec + m.argc + 1, fds, &err);
+            r.err = err;
+        }
+        for (size_t i = 0; i < nfds; i++)
+            close(fds[i]);
+        if (send(sock, &r, sizeof(r), MSG_NOSIGNAL) < 0)
+            _exit(0);
+    }
+}
+
+/*
+ * Runs in the freshly forked helper. It leaves the process group of the
+ * shell so terminal signals meant for the shell never reach it, and keeps
+ * nothing open but the socket.
+ */
+static void helper_setup(int sock, pid_t shell)
+{
+    prctl(PR_SET_PDEATHSIG, SIGKILL);
+    if (getppid() != shell)
+        _exit(0);
+    setpgid(0, 0);
+    for (size_t i = 0; i < sizeof(job_signals) / sizeof(job_signals[0]); i++)
+        signal(job_signals[i], SIG_DFL);
+    sigset_t none;
+    sigemptyset(&none);
+    sigprocmask(SIG_SETMASK, &none, NULL);
+
+    int null = open("/dev/null", O_RDWR);
+    for (int fd = 0; fd < 3; fd++)
+        dup2(null, fd);
+    dup2(sock, 3);
+    fcntl(3, F_SETFD, FD_CLOEXEC);
+    close_range(4, ~0U, 0);
+    helper_main(3);
+}
+
+int spawn_zygote_start(void)
+{
+    int sv[2];
+    if (zygote_sock >= 0)
+        return 0;
+    if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, sv) < 0)
+        return -1;
+
+    pid_t shell = getpid();
+    fflush(NULL);
+    pid_t pid = fork();
+    if (pid < 0) {
+        close(sv[0]);
+        close(sv[1]);
+        return -1;
+    }
+    if (pid == 0) {
+        close(sv[0]);
+        helper_setup(sv[1], shell);
+    }
+    close(sv[1]);
+    zygote_pid = pid;
+    zygote_sock = sv[0];
+    return 0;
+}
+
+void spawn_zygote_stop(void)
+{
+    if (zygote_sock < 0)
+        return;
+    close(zygote_sock);
+    waitpid(zygote_pid, NULL, 0);
+    zygote_sock = -1;
+    zygote_pid = -1;
+    free(msg_buf);
+    msg_buf = NULL;
+    msg_cap = 0;
+}
+
+static char *put_str(char *p, const char *s)
+{
+    size_t n = strlen(s) + 1;
+    memcpy(p, s, n);
+    return p + n;
+}
+
+bool spawn_zygote(const struct spawn_req *req, pid_t *pid)
+{
+    static const struct spawn_fd stdio[] = {{0, 0}, {1, 1}, {2, 2}};
+    size_t nstdio = sizeof(stdio) / sizeof(stdio[0]);
+    size_t nfds = nstdio + req->nfds;
+    if (zygote_sock < 0 || nfds + 2 > ZYGOTE_MAX_FDS)
+        return false;
+
+    size_t argc = 0;
+    size_t envc = 0;
+    size_t len = sizeof(struct zygote_msg) + sizeof(int32_t) * nfds + strlen(req->path) + 1;
+    for (; req->argv[argc]; argc++)
+        len += strlen(req->argv[argc]) + 1;
+    for (; environ[envc]; envc++)
+        len += strlen(environ[envc]) + 1;
+    if (len > msg_cap) {
+        msg_cap = len;
+        msg_buf = (char *)grow(msg_buf, msg_cap);
+    }
+
+    struct zygote_msg m;
+    m.pgid = req->pgid >= 0 ? req->pgid : getpgrp();
+    m.has_terminal = req->terminal >= 0;
+    m.nfds = (uint32_t)nfds;
+    m.argc = (uint32_t)argc;
+    m.envc = (uint32_t)envc;
+    memcpy(msg_buf, &m, sizeof(m));
+    int32_t *targets = (int32_t *)(msg_buf + sizeof(m));
+    char *p = (char *)(targets + nfds);
+    p = put_str(p, req->path);
+    for (size_t i = 0; i < argc; i++)
+        p = put_str(p, req->argv[i]);
+    for (size_t i = 0; i < envc; i++)
+        p = put_str(p, environ[i]);
+
+    int fds[ZYGOTE_MAX_FDS];
+    size_t n = 0;
+    int cwd = open(".", O_PATH | O_DIRECTORY | O_CLOEXEC);
+    if (cwd < 0)
+        return false;
+    fds[n++] = cwd;
+    if (req->terminal >= 0)
+        fds[n++] = req->terminal;
+    for (size_t i = 0; i < nfds; i++) {
+        const struct spawn_fd *f = i < nstdio ? &stdio[i] : &req->fds[i - nstdio];
+        targets[i] = f->target;
+        fds[n++] = f->source;
+    }
+
+    union {
+        struct cmsghdr h;
+        char buf[CMSG_SPACE(sizeof(int) * ZYGOTE_MAX_FDS)];
+    } ctl;
+    memset(&ctl, 0, sizeof(ctl));
+    struct iovec iov = {msg_buf, len};
+    struct msghdr mh;
+    memset(&mh, 0, sizeof(mh));
+    mh.msg_iov = &iov;
+    mh.msg_iovlen = 1;
+    mh.msg_control = ctl.buf;
+    mh.msg_controllen = CMSG_SPACE(sizeof(int) * n);
+    struct cmsghdr *c = CMSG_FIRSTHDR(&mh);
+    c->cmsg_level = SOL_SOCKET;
+    c->cmsg_type = SCM_RIGHTS;
+    c->cmsg_len = CMSG_LEN(sizeof(int) * n);
+    memcpy(CMSG_DATA(c), fds, sizeof(int) * n);
+
+    ssize_t sent;
+    do {
+        sent = sendmsg(zygote_sock, &mh, MSG_NOSIGNAL);
+    } while (sent < 0 && errno == EINTR);
+    close(cwd);
+    struct zygote_reply r;
+    ssize_t got = -1;
+    if (sent == (ssize_t)len) {
+        do {
+            got = recv(zygote_sock, &r, sizeof(r), 0);
+        } while (got < 0 && errno == EINTR);
+    }
+    if (got != (ssize_t)sizeof(r)) {
+        // A bad fd fails just this request, anything else means the helper is gone
+        if (sent < 0 && errno == EBADF)
+            return false;
+        fprintf(stderr, "zygote: helper lost, launching directly\n");
+        spawn_zygote_stop();
+        return false;
+    }
+
+    *pid = r.pid;
+    if (r.pid > 0 && r.err) {
+        // The child is ours to reap even though it never ran
+        waitpid(r.pid, NULL, 0);
+        *pid = -1;
+    }
+    errno = r.err;
+    return true;
+}
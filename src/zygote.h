@@ -0,0 +1,28 @@
+#ifndef ZYGOTE_H
+#define ZYGOTE_H
+#include <stdbool.h>
+#include "spawn.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+  /**
+   * @brief Hand a launch request to the zygote helper. The child is created
+   * by the helper but is a child of the calling process, it is in its
+   * process group and has the terminal when this returns.
+   *
+   * @param req What to launch, req->fn must not be set
+   * @param pid The pid of the child, or -1 with errno set if the program
+   * could not be started
+   * @return False if the helper is not running or could not take the
+   * request, the caller should launch the child itself
+   */
+  bool spawn_zygote(const struct spawn_req *req, pid_t *pid);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif
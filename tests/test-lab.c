@@ -1,6 +1,23 @@
 #include <string.h>
 #include "harness/unity.h"
 #include "../src/lab.h"
+#include "../src/scan.h"
+#include "../src/parse.h"
+#include "../src/spawn.h"
+#include <sys/wait.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/epoll.h>
+#include <malloc.h>
+#include <poll.h>
+#include <limits.h>
+#include <pwd.h>
+#include <ctype.h>
+#include "../src/cmdhash.h"
+#include "../src/exec.h"
+#include "../src/jobs.h"
+#include "../src/script.h"
 
 
 void setUp(void) {
@@ -49,6 +66,1119 @@ void test_cmd_parse(void)
      cmd_free(rval);
 }
 
+void test_cmd_parse_arena_scales_with_line(void)
+{
+     const long arg_max = sysconf(_SC_ARG_MAX);
+     size_t lens[] = {10, 1000, 100000};
+     struct arena a;
+     arena_init(&a, 0);
+     for (size_t i = 0; i < sizeof(lens) / sizeof(lens[0]); i++)
+     {
+          //worst case line "a a a a ..." has the most arguments per byte
+          size_t n = lens[i];
+          char *line = (char*) malloc(n + 1);
+          for (size_t j = 0; j < n; j++)
+               line[j] = (j % 2) ? ' ' : 'a';
+          line[n] = '\0';
+
+          arena_reset(&a);
+          char **rval = cmd_parse_arena(&a, line);
+          size_t argc = (n + 1) / 2;
+          TEST_ASSERT_EQUAL_STRING("a", rval[argc - 1]);
+          TEST_ASSERT_NULL(rval[argc]);
+          //argv pointers plus the packed strings, nothing to do with ARG_MAX
+          size_t bound = (argc + 1) * sizeof(char*) + 2 * argc + 16;
+          TEST_ASSERT_TRUE(a.allocated <= bound);
+          TEST_ASSERT_TRUE(a.allocated < arg_max * sizeof(char*));
+          free(line);
+     }
+     //the arena coalesces so the largest command fits in one block
+     arena_reset(&a);
+     TEST_ASSERT_NULL(a.chunks);
+     TEST_ASSERT_TRUE(a.reserved < 4 * (lens[2] / 2 + 1) * sizeof(char*) + 8 * lens[2]);
+     arena_destroy(&a);
+}
+
+void test_cmd_parse_empty(void)
+{
+     char **rval = cmd_parse("   ");
+     TEST_ASSERT_NULL(rval[0]);
+     cmd_free(rval);
+}
+
+void test_cmd_tokenize_views(void)
+{
+     const char *line = "  ls  -a -l ";
+     struct arena a;
+     struct cmd_tokens t;
+     arena_init(&a, 0);
+     cmd_tokenize(&a, line, &t);
+     TEST_ASSERT_EQUAL_PTR(line, t.line);
+     TEST_ASSERT_EQUAL_size_t(3, t.count);
+     TEST_ASSERT_EQUAL_size_t(2, t.tok[0].off);
+     TEST_ASSERT_EQUAL_size_t(2, t.tok[0].len);
+     TEST_ASSERT_TRUE(cmd_token_is(&t, 0, "ls"));
+     TEST_ASSERT_TRUE(cmd_token_is(&t, 2, "-l"));
+     TEST_ASSERT_FALSE(cmd_token_is(&t, 1, "-al"));
+     TEST_ASSERT_FALSE(cmd_token_is(&t, 3, "-l"));
+
+     char **argv = cmd_materialize(&a, &t);
+     TEST_ASSERT_EQUAL_STRING("ls", argv[0]);
+     TEST_ASSERT_EQUAL_STRING("-a", argv[1]);
+     TEST_ASSERT_EQUAL_STRING("-l", argv[2]);
+     TEST_ASSERT_NULL(argv[3]);
+     //the original line is untouched
+     TEST_ASSERT_EQUAL_STRING("  ls  -a -l ", line);
+     arena_destroy(&a);
+}
+
+void test_cmd_terminate_in_place(void)
+{
+     char line[] = "cd /tmp";
+     struct arena a;
+     struct cmd_tokens t;
+     arena_init(&a, 0);
+     cmd_tokenize(&a, line, &t);
+     char **argv = cmd_terminate(&a, line, &t);
+     TEST_ASSERT_EQUAL_PTR(line, argv[0]);
+     TEST_ASSERT_EQUAL_PTR(line + 3, argv[1]);
+     TEST_ASSERT_EQUAL_STRING("cd", argv[0]);
+     TEST_ASSERT_EQUAL_STRING("/tmp", argv[1]);
+     TEST_ASSERT_NULL(argv[2]);
+     arena_destroy(&a);
+}
+
+void test_scan_kernels_agree(void)
+{
+     size_t count;
+     const struct scan_kernel *k = scan_kernels(&count);
+     const char seps[] = " \t\n\v\f\r";
+     char buf[100];
+     TEST_ASSERT_TRUE(count >= 1);
+     TEST_ASSERT_EQUAL_STRING("scalar", k[0].name);
+     //a single separator or non separator at every offset and length
+     for (size_t i = 0; i < count; i++)
+     {
+          for (size_t pos = 0; pos < sizeof(buf); pos++)
+          {
+               char sep = seps[pos % (sizeof(seps) - 1)];
+               memset(buf, 'x', sizeof(buf));
+               buf[pos] = sep;
+               TEST_ASSERT_EQUAL_size_t(pos, k[i].find_space(buf, sizeof(buf)));
+               TEST_ASSERT_EQUAL_size_t(pos < 7 ? pos : 7, k[i].find_space(buf, 7));
+               memset(buf, sep, sizeof(buf));
+               buf[pos] = (char)(0x80 + pos);
+               TEST_ASSERT_EQUAL_size_t(pos, k[i].find_nonspace(buf, sizeof(buf)));
+          }
+          memset(buf, 'x', sizeof(buf));
+          TEST_ASSERT_EQUAL_size_t(sizeof(buf), k[i].find_space(buf, sizeof(buf)));
+          TEST_ASSERT_EQUAL_size_t(0, k[i].find_space(buf, 0));
+     }
+}
+
+void test_cmd_parse_tabs(void)
+{
+     char **rval = cmd_parse("ls\t-a \t -l\n");
+     TEST_ASSERT_EQUAL_STRING("ls", rval[0]);
+     TEST_ASSERT_EQUAL_STRING("-a", rval[1]);
+     TEST_ASSERT_EQUAL_STRING("-l", rval[2]);
+     TEST_ASSERT_NULL(rval[3]);
+     cmd_free(rval);
+}
+
+void test_trim_white_tabs(void)
+{
+     char *line = (char*) calloc(10, sizeof(char));
+     strncpy(line, "\t ls\t\n", 10);
+     char *rval = trim_white(line);
+     TEST_ASSERT_EQUAL_STRING("ls", rval);
+     free(line);
+}
+
+void test_parse_quotes(void)
+{
+     struct arena a;
+     const char *err;
+     arena_init(&a, 0);
+     struct ast_pipeline *pl = parse_line(&a, "echo \"a  b\" 'c\\d' e\\ f \"\\\"\" '' x\"y\"z", &err);
+     TEST_ASSERT_NULL(err);
+     TEST_ASSERT_NOT_NULL(pl);
+     TEST_ASSERT_EQUAL_size_t(1, pl->count);
+     char **argv = pl->cmds->argv;
+     TEST_ASSERT_EQUAL_size_t(7, pl->cmds->argc);
+     TEST_ASSERT_EQUAL_STRING("echo", argv[0]);
+     TEST_ASSERT_EQUAL_STRING("a  b", argv[1]);
+     TEST_ASSERT_EQUAL_STRING("c\\d", argv[2]);
+     TEST_ASSERT_EQUAL_STRING("e f", argv[3]);
+     TEST_ASSERT_EQUAL_STRING("\"", argv[4]);
+     TEST_ASSERT_EQUAL_STRING("", argv[5]);
+     TEST_ASSERT_EQUAL_STRING("xyz", argv[6]);
+     TEST_ASSERT_NULL(argv[7]);
+     arena_destroy(&a);
+}
+
+void test_parse_lists_and_pipelines(void)
+{
+     struct arena a;
+     const char *err;
+     arena_init(&a, 0);
+     struct ast_pipeline *pl = parse_line(&a, "a|b | c&&d||e;f&g", &err);
+     TEST_ASSERT_NULL(err);
+     TEST_ASSERT_EQUAL_size_t(3, pl->count);
+     TEST_ASSERT_EQUAL_STRING("a", pl->cmds->argv[0]);
+     TEST_ASSERT_EQUAL_STRING("b", pl->cmds->next->argv[0]);
+     TEST_ASSERT_EQUAL_STRING("c", pl->cmds->next->next->argv[0]);
+     TEST_ASSERT_EQUAL_INT(AST_AND, pl->op);
+     pl = pl->next;
+     TEST_ASSERT_EQUAL_STRING("d", pl->cmds->argv[0]);
+     TEST_ASSERT_EQUAL_INT(AST_OR, pl->op);
+     pl = pl->next;
+     TEST_ASSERT_EQUAL_STRING("e", pl->cmds->argv[0]);
+     TEST_ASSERT_EQUAL_INT(AST_SEQ, pl->op);
+     pl = pl->next;
+     TEST_ASSERT_EQUAL_STRING("f", pl->cmds->argv[0]);
+     TEST_ASSERT_EQUAL_INT(AST_BG, pl->op);
+     pl = pl->next;
+     TEST_ASSERT_EQUAL_STRING("g", pl->cmds->argv[0]);
+     TEST_ASSERT_EQUAL_INT(AST_SEQ, pl->op);
+     TEST_ASSERT_NULL(pl->next);
+     arena_destroy(&a);
+}
+
+void test_parse_redirections(void)
+{
+     struct arena a;
+     const char *err;
+     arena_init(&a, 0);
+     struct ast_pipeline *pl = parse_line(&a, "sort <in >out 2>>log x2>y", &err);
+     TEST_ASSERT_NULL(err);
+     struct ast_cmd *cmd = pl->cmds;
+     TEST_ASSERT_EQUAL_size_t(2, cmd->argc);
+     TEST_ASSERT_EQUAL_STRING("sort", cmd->argv[0]);
+     TEST_ASSERT_EQUAL_STRING("x2", cmd->argv[1]);
+     struct ast_redir *r = cmd->redirs;
+     TEST_ASSERT_EQUAL_INT(REDIR_IN, r->type);
+     TEST_ASSERT_EQUAL_INT(0, r->fd);
+     TEST_ASSERT_EQUAL_STRING("in", r->target);
+     r = r->next;
+     TEST_ASSERT_EQUAL_INT(REDIR_OUT, r->type);
+     TEST_ASSERT_EQUAL_INT(1, r->fd);
+     TEST_ASSERT_EQUAL_STRING("out", r->target);
+     r = r->next;
+     TEST_ASSERT_EQUAL_INT(REDIR_APPEND, r->type);
+     TEST_ASSERT_EQUAL_INT(2, r->fd);
+     TEST_ASSERT_EQUAL_STRING("log", r->target);
+     r = r->next;
+     TEST_ASSERT_EQUAL_INT(REDIR_OUT, r->type);
+     TEST_ASSERT_EQUAL_STRING("y", r->target);
+     TEST_ASSERT_NULL(r->next);
+     arena_destroy(&a);
+}
+
+void test_parse_substitution(void)
+{
+     struct arena a;
+     const char *err;
+     arena_init(&a, 0);
+     struct ast_pipeline *pl = parse_line(&a, "echo a$(ls | wc -l)b \"`pwd`\" plain", &err);
+     TEST_ASSERT_NULL(err);
+     struct ast_cmd *cmd = pl->cmds;
+     TEST_ASSERT_EQUAL_size_t(4, cmd->argc);
+     TEST_ASSERT_NOT_NULL(cmd->parts);
+     TEST_ASSERT_NULL(cmd->parts[0]);
+     TEST_ASSERT_NULL(cmd->parts[3]);
+     //the source text stays in argv
+     TEST_ASSERT_EQUAL_STRING("a$(ls | wc -l)b", cmd->argv[1]);
+     struct ast_part *part = cmd->parts[1];
+     TEST_ASSERT_EQUAL_STRING("a", part->text);
+     part = part->next;
+     TEST_ASSERT_NULL(part->text);
+     TEST_ASSERT_FALSE(part->quoted);
+     TEST_ASSERT_EQUAL_size_t(2, part->subst->count);
+     TEST_ASSERT_EQUAL_STRING("wc", part->subst->cmds->next->argv[0]);
+     TEST_ASSERT_EQUAL_STRING("b", part->next->text);
+     TEST_ASSERT_NULL(part->next->next);
+     part = cmd->parts[2];
+     TEST_ASSERT_TRUE(part->quoted);
+     TEST_ASSERT_EQUAL_STRING("pwd", part->subst->cmds->argv[0]);
+     TEST_ASSERT_NULL(part->next);
+
+     TEST_ASSERT_NULL(parse_line(&a, "echo $(echo x", &err));
+     TEST_ASSERT_NOT_NULL(err);
+     TEST_ASSERT_NULL(parse_line(&a, "echo `x", &err));
+     TEST_ASSERT_NOT_NULL(err);
+     TEST_ASSERT_NULL(parse_line(&a, "echo $(|)", &err));
+     TEST_ASSERT_NOT_NULL(err);
+     TEST_ASSERT_NULL(parse_line(&a, "echo $(echo a &&)", &err));
+     TEST_ASSERT_NOT_NULL(err);
+     pl = parse_line(&a, "echo $(echo a;)", &err);
+     TEST_ASSERT_NULL(err);
+     TEST_ASSERT_EQUAL_STRING("a", pl->cmds->parts[1]->subst->cmds->argv[1]);
+     arena_destroy(&a);
+}
+
+void test_parse_substitution_depth(void)
+{
+     struct arena a;
+     const char *err;
+     char line[1024];
+     arena_init(&a, 0);
+     for (int depth = 64; depth <= 65; depth++)
+     {
+          char *p = stpcpy(line, "echo");
+          for (int i = 0; i < depth; i++)
+               p = stpcpy(p, " x$(echo");
+          p = stpcpy(p, " deep");
+          for (int i = 0; i < depth; i++)
+               *p++ = ')';
+          *p = '\0';
+          struct ast_pipeline *pl = parse_line(&a, line, &err);
+          if (depth == 65)
+          {
+               TEST_ASSERT_NULL(pl);
+               TEST_ASSERT_EQUAL_STRING("command substitution nested too deeply", err);
+               break;
+          }
+          TEST_ASSERT_NULL(err);
+          //only the outermost word keeps its source text
+          TEST_ASSERT_EQUAL_size_t(strlen(line) - 5, strlen(pl->cmds->argv[1]));
+          for (int i = 0; i < depth; i++)
+          {
+               struct ast_cmd *cmd = pl->cmds;
+               TEST_ASSERT_NOT_NULL(cmd->parts);
+               if (i)
+                    TEST_ASSERT_EQUAL_STRING("", cmd->argv[1]);
+               pl = cmd->parts[1]->next->subst;
+          }
+          TEST_ASSERT_EQUAL_STRING("deep", pl->cmds->argv[1]);
+     }
+     arena_destroy(&a);
+}
+
+void test_parse_errors(void)
+{
+     const char *bad[] = {"| a", "a |", "a &&", "a ;; b", "a >", "echo 'x", "echo \"x", "&"};
+     struct arena a;
+     const char *err;
+     arena_init(&a, 0);
+     for (size_t i = 0; i < sizeof(bad) / sizeof(bad[0]); i++)
+     {
+          TEST_ASSERT_NULL(parse_line(&a, bad[i], &err));
+          TEST_ASSERT_NOT_NULL_MESSAGE(err, bad[i]);
+     }
+     //blank lines and comments are empty, not errors
+     TEST_ASSERT_NULL(parse_line(&a, "  # just a comment", &err));
+     TEST_ASSERT_NULL(err);
+     TEST_ASSERT_NOT_NULL(parse_line(&a, "a; b &", &err));
+     TEST_ASSERT_NULL(err);
+     arena_destroy(&a);
+}
+
+static void check_spawn(enum spawn_mode mode)
+{
+     int fds[2];
+     char buf[32] = {0};
+     char *argv[] = {"sh", "-c", "echo $$ && exit 3", NULL};
+     TEST_ASSERT_EQUAL_INT(0, pipe(fds));
+     struct spawn_fd map[] = {{1, fds[1]}};
+     struct spawn_req req = {"sh", argv, map, 1, 0, -1, NULL, NULL};
+     pid_t pid = spawn_cmd(mode, &req);
+     TEST_ASSERT_TRUE(pid > 0);
+     close(fds[1]);
+     int status;
+     TEST_ASSERT_EQUAL_INT(pid, waitpid(pid, &status, 0));
+     TEST_ASSERT_TRUE(WIFEXITED(status));
+     TEST_ASSERT_EQUAL_INT(3, WEXITSTATUS(status));
+     //the child wrote its own pid through the pipe
+     TEST_ASSERT_TRUE(read(fds[0], buf, sizeof(buf) - 1) > 0);
+     TEST_ASSERT_EQUAL_INT(pid, atoi(buf));
+     close(fds[0]);
+}
+
+void test_spawn_posix(void)
+{
+     check_spawn(SPAWN_POSIX);
+     char *argv[] = {"no-such-command-anywhere", NULL};
+     struct spawn_req req = {argv[0], argv, NULL, 0, -1, -1, NULL, NULL};
+     TEST_ASSERT_EQUAL_INT(-1, spawn_cmd(SPAWN_POSIX, &req));
+}
+
+void test_spawn_fork(void)
+{
+     check_spawn(SPAWN_FORK);
+}
+
+void test_spawn_zygote(void)
+{
+     int fds[2];
+     char buf[64] = {0};
+     char *cwd = getcwd(NULL, 0);
+     TEST_ASSERT_EQUAL_INT(0, spawn_zygote_start());
+     check_spawn(SPAWN_ZYGOTE);
+
+     //the child runs in the cwd and environment the shell has now
+     TEST_ASSERT_EQUAL_INT(0, chdir("/tmp"));
+     setenv("TEST_ZYGOTE", "yes", true);
+     char *argv[] = {"sh", "-c", "echo $(pwd) $TEST_ZYGOTE", NULL};
+     TEST_ASSERT_EQUAL_INT(0, pipe(fds));
+     struct spawn_fd map[] = {{1, fds[1]}};
+     struct spawn_req req = {"sh", argv, map, 1, 0, -1, NULL, NULL};
+     pid_t pid = spawn_cmd(SPAWN_ZYGOTE, &req);
+     TEST_ASSERT_TRUE(pid > 0);
+     close(fds[1]);
+     TEST_ASSERT_EQUAL_INT(pid, waitpid(pid, NULL, 0));
+     TEST_ASSERT_TRUE(read(fds[0], buf, sizeof(buf) - 1) > 0);
+     TEST_ASSERT_EQUAL_STRING("/tmp yes\n", buf);
+     close(fds[0]);
+     unsetenv("TEST_ZYGOTE");
+     TEST_ASSERT_EQUAL_INT(0, chdir(cwd));
+     free(cwd);
+
+     char *missing[] = {"no-such-command-anywhere", NULL};
+     struct spawn_req bad = {missing[0], missing, NULL, 0, -1, -1, NULL, NULL};
+     TEST_ASSERT_EQUAL_INT(-1, spawn_cmd(SPAWN_ZYGOTE, &bad));
+     TEST_ASSERT_EQUAL_INT(ENOENT, errno);
+
+     //without the helper the mode falls back to posix_spawn
+     spawn_zygote_stop();
+     check_spawn(SPAWN_ZYGOTE);
+     TEST_ASSERT_EQUAL_INT(-1, waitpid(-1, NULL, WNOHANG));
+}
+
+static void make_exec(const char *path)
+{
+     int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0755);
+     TEST_ASSERT_TRUE(fd >= 0);
+     TEST_ASSERT_EQUAL_INT(10, write(fd, "#!/bin/sh\n", 10));
+     close(fd);
+}
+
+void test_cmdhash_lookup_and_invalidate(void)
+{
+     char root[] = "/tmp/test-cmdhash-XXXXXX";
+     char a[64], b[64], path[160], file[96];
+     TEST_ASSERT_NOT_NULL(mkdtemp(root));
+     snprintf(a, sizeof(a), "%s/a", root);
+     snprintf(b, sizeof(b), "%s/b", root);
+     TEST_ASSERT_EQUAL_INT(0, mkdir(a, 0755));
+     TEST_ASSERT_EQUAL_INT(0, mkdir(b, 0755));
+     snprintf(file, sizeof(file), "%s/foo", b);
+     make_exec(file);
+
+     char *old = getenv("PATH") ? strdup(getenv("PATH")) : NULL;
+     snprintf(path, sizeof(path), "%s:%s", a, b);
+     setenv("PATH", path, true);
+
+     struct cmdhash h;
+     cmdhash_init(&h);
+     TEST_ASSERT_EQUAL_STRING(file, cmdhash_lookup(&h, "foo"));
+     TEST_ASSERT_EQUAL_STRING(file, cmdhash_lookup(&h, "foo"));
+     TEST_ASSERT_NULL(cmdhash_lookup(&h, "bar"));
+     TEST_ASSERT_EQUAL_UINT(1, h.hits);
+     TEST_ASSERT_EQUAL_UINT(2, h.misses);
+
+     //a new foo in an earlier directory shadows the remembered one
+     snprintf(file, sizeof(file), "%s/foo", a);
+     make_exec(file);
+     cmdhash_tick(&h);
+     TEST_ASSERT_EQUAL_STRING(file, cmdhash_lookup(&h, "foo"));
+     TEST_ASSERT_EQUAL_UINT(3, h.misses);
+     TEST_ASSERT_EQUAL_STRING(file, cmdhash_lookup(&h, "foo"));
+     TEST_ASSERT_EQUAL_UINT(2, h.hits);
+
+     //changing PATH forgets everything
+     setenv("PATH", b, true);
+     snprintf(file, sizeof(file), "%s/foo", b);
+     TEST_ASSERT_EQUAL_STRING(file, cmdhash_lookup(&h, "foo"));
+     TEST_ASSERT_EQUAL_UINT(4, h.misses);
+     TEST_ASSERT_EQUAL_size_t(1, h.count);
+
+     cmdhash_destroy(&h);
+     if (old)
+     {
+          setenv("PATH", old, true);
+          free(old);
+     }
+     snprintf(file, sizeof(file), "rm -rf %s", root);
+     TEST_ASSERT_EQUAL_INT(0, system(file));
+}
+
+static int builtin_test_status(struct shell *sh, char **argv)
+{
+     UNUSED(sh);
+     return atoi(argv[1]);
+}
+
+void test_builtin_registry(void)
+{
+     static char names[300][16];
+     struct shell sh;
+     memset(&sh, 0, sizeof(sh));
+     TEST_ASSERT_TRUE(is_builtin("cd"));
+     TEST_ASSERT_TRUE(is_builtin("history"));
+     TEST_ASSERT_FALSE(is_builtin("ls"));
+     TEST_ASSERT_FALSE(is_builtin(""));
+
+     //dispatch stays exact as the registry grows
+     for (int i = 0; i < 300; i++)
+     {
+          snprintf(names[i], sizeof(names[i]), "test-bi-%d", i);
+          builtin_register(names[i], builtin_test_status);
+     }
+     for (int i = 0; i < 300; i++)
+          TEST_ASSERT_EQUAL_PTR(builtin_test_status, builtin_lookup(names[i]));
+     TEST_ASSERT_NULL(builtin_lookup("test-bi-300"));
+     TEST_ASSERT_NULL(builtin_lookup("test-bi-"));
+     TEST_ASSERT_TRUE(is_builtin("cd"));
+
+     char *argv[] = {"test-bi-7", "42", NULL};
+     TEST_ASSERT_TRUE(do_builtin(&sh, argv));
+     TEST_ASSERT_EQUAL_INT(42, sh.status);
+     char *notbuiltin[] = {"ls", NULL};
+     TEST_ASSERT_FALSE(do_builtin(&sh, notbuiltin));
+}
+
+static void collect_name(const char *name, void *ctx)
+{
+     char *out = (char *)ctx;
+     strcat(out, name);
+     strcat(out, " ");
+}
+
+void test_cmdtrie_complete(void)
+{
+     char out[256] = "";
+     struct cmdtrie t;
+     cmdtrie_init(&t);
+     TEST_ASSERT_TRUE(cmdtrie_add(&t, "git"));
+     TEST_ASSERT_TRUE(cmdtrie_add(&t, "gitk"));
+     TEST_ASSERT_TRUE(cmdtrie_add(&t, "gcc"));
+     TEST_ASSERT_TRUE(cmdtrie_add(&t, "ls"));
+     //a name in two PATH directories stays until both are gone
+     TEST_ASSERT_FALSE(cmdtrie_add(&t, "git"));
+     TEST_ASSERT_EQUAL_size_t(4, cmdtrie_count(&t));
+
+     TEST_ASSERT_EQUAL_size_t(3, cmdtrie_complete(&t, "g", collect_name, out));
+     TEST_ASSERT_EQUAL_STRING("gcc git gitk ", out);
+     out[0] = '\0';
+     TEST_ASSERT_EQUAL_size_t(4, cmdtrie_complete(&t, "", collect_name, out));
+     TEST_ASSERT_EQUAL_STRING("gcc git gitk ls ", out);
+     TEST_ASSERT_EQUAL_size_t(0, cmdtrie_complete(&t, "x", collect_name, out));
+
+     TEST_ASSERT_FALSE(cmdtrie_remove(&t, "git"));
+     TEST_ASSERT_TRUE(cmdtrie_remove(&t, "git"));
+     TEST_ASSERT_FALSE(cmdtrie_remove(&t, "git"));
+     TEST_ASSERT_TRUE(cmdtrie_remove(&t, "ls"));
+     out[0] = '\0';
+     TEST_ASSERT_EQUAL_size_t(1, cmdtrie_complete(&t, "gi", collect_name, out));
+     TEST_ASSERT_EQUAL_STRING("gitk ", out);
+     TEST_ASSERT_EQUAL_size_t(0, cmdtrie_complete(&t, "l", collect_name, out));
+     TEST_ASSERT_EQUAL_size_t(2, cmdtrie_count(&t));
+     cmdtrie_destroy(&t);
+}
+
+static void make_program(const char *path, mode_t mode)
+{
+     int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, mode);
+     TEST_ASSERT_TRUE(fd >= 0);
+     close(fd);
+}
+
+void test_complete_path_refresh(void)
+{
+     char out[256] = "";
+     struct complete c;
+     mkdir("/tmp/test-lab-bin1", 0700);
+     mkdir("/tmp/test-lab-bin2", 0700);
+     mkdir("/tmp/test-lab-bin1/labdir", 0700);
+     make_program("/tmp/test-lab-bin1/labtool", 0700);
+     make_program("/tmp/test-lab-bin1/labdata", 0600);
+     make_program("/tmp/test-lab-bin2/labtool", 0700);
+     make_program("/tmp/test-lab-bin2/labrun", 0700);
+     complete_init(&c, "/tmp/test-lab-bin1:relative:/tmp/test-lab-bin2");
+     complete_wait(&c);
+     //directories and files nobody may run are not commands
+     TEST_ASSERT_EQUAL_size_t(2, complete_commands(&c, "lab", collect_name, out));
+     TEST_ASSERT_EQUAL_STRING("labrun labtool ", out);
+
+     //only a directory whose mtime changed is read again
+     make_program("/tmp/test-lab-bin1/labnew", 0700);
+     struct timespec times[2] = {{0, UTIME_OMIT}, {12345, 0}};
+     TEST_ASSERT_EQUAL_INT(0, utimensat(AT_FDCWD, "/tmp/test-lab-bin1", times, 0));
+     complete_refresh(&c, "/tmp/test-lab-bin1:relative:/tmp/test-lab-bin2");
+     complete_wait(&c);
+     out[0] = '\0';
+     TEST_ASSERT_EQUAL_size_t(3, complete_commands(&c, "lab", collect_name, out));
+     TEST_ASSERT_EQUAL_STRING("labnew labrun labtool ", out);
+
+     //a directory leaving PATH takes its programs along
+     complete_refresh(&c, "/tmp/test-lab-bin1");
+     complete_wait(&c);
+     out[0] = '\0';
+     TEST_ASSERT_EQUAL_size_t(2, complete_commands(&c, "lab", collect_name, out));
+     TEST_ASSERT_EQUAL_STRING("labnew labtool ", out);
+     complete_destroy(&c);
+
+     unlink("/tmp/test-lab-bin1/labtool");
+     unlink("/tmp/test-lab-bin1/labdata");
+     unlink("/tmp/test-lab-bin1/labnew");
+     unlink("/tmp/test-lab-bin2/labtool");
+     unlink("/tmp/test-lab-bin2/labrun");
+     rmdir("/tmp/test-lab-bin1/labdir");
+     rmdir("/tmp/test-lab-bin1");
+     rmdir("/tmp/test-lab-bin2");
+}
+
+void test_complete_files_snapshot(void)
+{
+     char out[256] = "";
+     struct complete c;
+     struct dirsnap *snap = &c.files;
+     mkdir("/tmp/test-lab-files", 0700);
+     mkdir("/tmp/test-lab-files/sub", 0700);
+     make_program("/tmp/test-lab-files/alpha", 0600);
+     make_program("/tmp/test-lab-files/also", 0600);
+     make_program("/tmp/test-lab-files/.hidden", 0600);
+     TEST_ASSERT_EQUAL_INT(0, symlink("sub", "/tmp/test-lab-files/link"));
+     struct timespec times[2] = {{0, UTIME_OMIT}, {12345, 0}};
+     TEST_ASSERT_EQUAL_INT(0, utimensat(AT_FDCWD, "/tmp/test-lab-files", times, 0));
+     complete_init(&c, "");
+
+     TEST_ASSERT_EQUAL_size_t(2, complete_files(&c, "/tmp/test-lab-files/al", collect_name, out));
+     TEST_ASSERT_EQUAL_STRING("/tmp/test-lab-files/alpha /tmp/test-lab-files/also ", out);
+     //directories, and links to them, end in a slash, dot files need a dot
+     out[0] = '\0';
+     TEST_ASSERT_EQUAL_size_t(4, complete_files(&c, "/tmp/test-lab-files/", collect_name, out));
+     TEST_ASSERT_EQUAL_STRING("/tmp/test-lab-files/alpha /tmp/test-lab-files/also "
+                              "/tmp/test-lab-files/link/ /tmp/test-lab-files/sub/ ", out);
+     out[0] = '\0';
+     TEST_ASSERT_EQUAL_size_t(1, complete_files(&c, "/tmp/test-lab-files/.", collect_name, out));
+     TEST_ASSERT_EQUAL_STRING("/tmp/test-lab-files/.hidden ", out);
+
+     //the same unchanged directory is not read again, a changed one is
+     TEST_ASSERT_EQUAL_INT(1, dirsnap_load(snap, "/tmp/test-lab-files"));
+     make_program("/tmp/test-lab-files/alpine", 0600);
+     TEST_ASSERT_EQUAL_INT(0, utimensat(AT_FDCWD, "/tmp/test-lab-files", times, 0));
+     TEST_ASSERT_EQUAL_INT(1, dirsnap_load(snap, "/tmp/test-lab-files"));
+     times[1].tv_sec++;
+     TEST_ASSERT_EQUAL_INT(0, utimensat(AT_FDCWD, "/tmp/test-lab-files", times, 0));
+     out[0] = '\0';
+     TEST_ASSERT_EQUAL_size_t(3, complete_files(&c, "/tmp/test-lab-files/al", collect_name, out));
+     TEST_ASSERT_EQUAL_STRING("/tmp/test-lab-files/alpha /tmp/test-lab-files/alpine "
+                              "/tmp/test-lab-files/also ", out);
+     TEST_ASSERT_EQUAL_INT(-1, dirsnap_load(snap, "/tmp/test-lab-files/none"));
+     //a directory changed in the second it was read is read again next time
+     TEST_ASSERT_EQUAL_INT(0, dirsnap_load(snap, "/tmp/test-lab-files/sub"));
+     TEST_ASSERT_EQUAL_INT(0, dirsnap_load(snap, "/tmp/test-lab-files/sub"));
+     complete_destroy(&c);
+
+     unlink("/tmp/test-lab-files/alpha");
+     unlink("/tmp/test-lab-files/also");
+     unlink("/tmp/test-lab-files/alpine");
+     unlink("/tmp/test-lab-files/.hidden");
+     unlink("/tmp/test-lab-files/link");
+     rmdir("/tmp/test-lab-files/sub");
+     rmdir("/tmp/test-lab-files");
+}
+
+void test_histlog_append_and_reload(void)
+{
+     const char *path = "/tmp/test-lab-histlog";
+     struct histlog a, b;
+     unlink(path);
+     histlog_init(&a);
+     TEST_ASSERT_EQUAL_INT(0, histlog_open(&a, path));
+     TEST_ASSERT_EQUAL_size_t(0, a.count);
+     TEST_ASSERT_EQUAL_INT(0, histlog_append(&a, "ls -l", 1700000000, 12, 0));
+     TEST_ASSERT_EQUAL_INT(0, histlog_append(&a, "false", 1700000001, 0, 1));
+     histlog_begin(&a, "sleep 1");
+     histlog_end(&a, 130);
+
+     //a second shell sees every record, a torn one at the end is ignored
+     int fd = open(path, O_WRONLY | O_APPEND);
+     uint32_t torn[] = {HISTLOG_MAGIC, 100};
+     TEST_ASSERT_EQUAL_INT(sizeof(torn), write(fd, torn, sizeof(torn)));
+     close(fd);
+     histlog_init(&b);
+     TEST_ASSERT_EQUAL_INT(0, histlog_open(&b, path));
+     TEST_ASSERT_EQUAL_size_t(3, b.count);
+     const struct histlog_rec *rec = histlog_get(&b, 0);
+     TEST_ASSERT_EQUAL_STRING("ls -l", histlog_text(rec));
+     TEST_ASSERT_EQUAL_INT64(1700000000, rec->time);
+     TEST_ASSERT_EQUAL_UINT32(12, rec->duration_ms);
+     TEST_ASSERT_EQUAL_INT(1, histlog_get(&b, 1)->status);
+     TEST_ASSERT_EQUAL_STRING("sleep 1", histlog_text(histlog_get(&b, 2)));
+     TEST_ASSERT_EQUAL_INT(130, histlog_get(&b, 2)->status);
+     TEST_ASSERT_EQUAL_size_t(0, histlog_sync(&b));
+
+     //only whole records are picked up once the torn one is gone
+     TEST_ASSERT_EQUAL_INT(0, truncate(path, (off_t)b.end));
+     TEST_ASSERT_EQUAL_INT(0, histlog_append(&a, "echo done", 1700000002, 3, 0));
+     TEST_ASSERT_EQUAL_size_t(1, histlog_sync(&b));
+     TEST_ASSERT_EQUAL_STRING("echo done", histlog_text(histlog_get(&b, 3)));
+
+     //records after a torn one are found again
+     fd = open(path, O_WRONLY | O_APPEND);
+     TEST_ASSERT_EQUAL_INT(sizeof(torn), write(fd, torn, sizeof(torn)));
+     TEST_ASSERT_EQUAL_INT(0, histlog_append(&a, "pwd", 1700000003, 0, 0));
+     //and after one whose text does not end at its length
+     struct histlog_rec bad = {HISTLOG_MAGIC, 3, 0, 0, 0};
+     char text[8] = "abcdefg";
+     TEST_ASSERT_EQUAL_INT(sizeof(bad), write(fd, &bad, sizeof(bad)));
+     TEST_ASSERT_EQUAL_INT(sizeof(text), write(fd, text, sizeof(text)));
+     close(fd);
+     TEST_ASSERT_EQUAL_INT(0, histlog_append(&a, "true", 1700000004, 0, 0));
+     TEST_ASSERT_EQUAL_size_t(2, histlog_sync(&b));
+     TEST_ASSERT_EQUAL_STRING("pwd", histlog_text(histlog_get(&b, 4)));
+     TEST_ASSERT_EQUAL_STRING("true", histlog_text(histlog_get(&b, 5)));
+
+     //a torn tail of any length leaves the records after it on a boundary
+     fd = open(path, O_WRONLY | O_APPEND);
+     TEST_ASSERT_EQUAL_INT(5, write(fd, "stray", 5));
+     close(fd);
+     TEST_ASSERT_EQUAL_INT(0, histlog_append(&a, "two", 1700000005, 0, 0));
+     TEST_ASSERT_EQUAL_INT(0, histlog_append(&a, "three", 1700000006, 0, 0));
+     histlog_close(&b, 0);
+     histlog_init(&b);
+     TEST_ASSERT_EQUAL_INT(0, histlog_open(&b, path));
+     TEST_ASSERT_EQUAL_size_t(8, b.count);
+     TEST_ASSERT_EQUAL_STRING("two", histlog_text(histlog_get(&b, 6)));
+     TEST_ASSERT_EQUAL_STRING("three", histlog_text(histlog_get(&b, 7)));
+     histlog_close(&a, 0);
+     histlog_close(&b, 0);
+     unlink(path);
+}
+
+void test_histindex_search(void)
+{
+     const char *lines[] = {"git status", "make check", "git commit -m 'Fix Make'",
+                            "ls", "make -j4 check", "echo gitk"};
+     struct histlog h;
+     struct histindex ix;
+     histlog_init(&h);
+     histindex_init(&ix);
+     for (size_t i = 0; i < sizeof(lines) / sizeof(lines[0]); i++)
+          TEST_ASSERT_EQUAL_INT(0, histlog_append(&h, lines[i], 0, 0, 0));
+     //newest first, then each older match
+     TEST_ASSERT_EQUAL_INT(4, histindex_search(&ix, &h, "make", h.count));
+     TEST_ASSERT_EQUAL_INT(1, histindex_search(&ix, &h, "make", 4));
+     TEST_ASSERT_EQUAL_INT(-1, histindex_search(&ix, &h, "make", 1));
+     //the index folds case, the match does not
+     TEST_ASSERT_EQUAL_INT(2, histindex_search(&ix, &h, "Make", h.count));
+     TEST_ASSERT_EQUAL_INT(-1, histindex_search(&ix, &h, "GIT", h.count));
+     //every trigram present but not next to each other
+     TEST_ASSERT_EQUAL_INT(-1, histindex_search(&ix, &h, "git check", h.count));
+     //short patterns scan
+     TEST_ASSERT_EQUAL_INT(5, histindex_search(&ix, &h, "gi", h.count));
+     TEST_ASSERT_EQUAL_INT(3, histindex_search(&ix, &h, "ls", h.count));
+     //entries added later are found once the index catches up
+     TEST_ASSERT_EQUAL_INT(0, histlog_append(&h, "gitk --all", 0, 0, 0));
+     histindex_update(&ix, &h);
+     TEST_ASSERT_EQUAL_size_t(h.count, ix.indexed);
+     TEST_ASSERT_EQUAL_INT(6, histindex_search(&ix, &h, "gitk", h.count));
+     TEST_ASSERT_EQUAL_INT(5, histindex_search(&ix, &h, "gitk", 6));
+     histindex_destroy(&ix);
+     histlog_close(&h, 0);
+}
+
+void test_histring_dedup_and_evict(void)
+{
+     struct histring r;
+     histring_init(&r, 3);
+     histring_add(&r, "ls");
+     histring_add(&r, "make");
+     //running the newest line again adds nothing
+     histring_add(&r, "make");
+     TEST_ASSERT_EQUAL_size_t(2, r.count);
+     TEST_ASSERT_EQUAL_STRING("make", histring_get(&r, 0));
+     TEST_ASSERT_EQUAL_STRING("ls", histring_get(&r, 1));
+     //an older one moves to the front
+     histring_add(&r, "ls");
+     TEST_ASSERT_EQUAL_size_t(2, r.count);
+     TEST_ASSERT_EQUAL_STRING("ls", histring_get(&r, 0));
+     TEST_ASSERT_EQUAL_STRING("make", histring_get(&r, 1));
+     TEST_ASSERT_NULL(histring_get(&r, 2));
+     //and takes no room from the lines that follow
+     histring_add(&r, "vi");
+     TEST_ASSERT_EQUAL_size_t(3, r.count);
+     TEST_ASSERT_EQUAL_STRING("vi", histring_get(&r, 0));
+     TEST_ASSERT_EQUAL_STRING("ls", histring_get(&r, 1));
+     TEST_ASSERT_EQUAL_STRING("make", histring_get(&r, 2));
+     //a full ring drops its oldest line
+     histring_add(&r, "cd");
+     TEST_ASSERT_EQUAL_size_t(3, r.count);
+     TEST_ASSERT_EQUAL_STRING("cd", histring_get(&r, 0));
+     TEST_ASSERT_EQUAL_STRING("vi", histring_get(&r, 1));
+     TEST_ASSERT_EQUAL_STRING("ls", histring_get(&r, 2));
+     TEST_ASSERT_NULL(histring_get(&r, 3));
+     histring_add(&r, "make");
+     TEST_ASSERT_EQUAL_STRING("make", histring_get(&r, 0));
+     TEST_ASSERT_EQUAL_STRING("vi", histring_get(&r, 2));
+     //the arrow keys step through the same order
+     uint32_t slot = histring_older(&r, HISTRING_END);
+     TEST_ASSERT_EQUAL_STRING("make", r.ring[slot].line);
+     slot = histring_older(&r, histring_older(&r, slot));
+     TEST_ASSERT_EQUAL_STRING("vi", r.ring[slot].line);
+     TEST_ASSERT_EQUAL_UINT32(HISTRING_END, histring_older(&r, slot));
+     TEST_ASSERT_EQUAL_STRING("cd", r.ring[histring_newer(&r, slot)].line);
+     histring_destroy(&r);
+
+     //rerunning an older line drops nothing while there is room
+     histring_init(&r, 3);
+     histring_add(&r, "x");
+     histring_add(&r, "a");
+     histring_add(&r, "b");
+     histring_add(&r, "a");
+     TEST_ASSERT_EQUAL_size_t(3, r.count);
+     TEST_ASSERT_EQUAL_STRING("a", histring_get(&r, 0));
+     TEST_ASSERT_EQUAL_STRING("b", histring_get(&r, 1));
+     TEST_ASSERT_EQUAL_STRING("x", histring_get(&r, 2));
+     histring_destroy(&r);
+
+     //HISTSIZE=0 keeps nothing
+     histring_init(&r, 0);
+     histring_add(&r, "ls");
+     TEST_ASSERT_NULL(histring_get(&r, 0));
+     histring_destroy(&r);
+}
+
+void test_histring_memory_flat(void)
+{
+     char line[64];
+     struct histring r;
+     histring_init(&r, 1000);
+     size_t ceiling = 0;
+     for (unsigned i = 0; i < 10000000; i++)
+     {
+          //mostly new lines, some run again right away or a while later
+          if (i % 7 == 0)
+               snprintf(line, sizeof(line), "make -j8 target-%u", i % 1500);
+          else if (i % 5 != 0)
+               snprintf(line, sizeof(line), "git commit -m 'change %u'", i);
+          histring_add(&r, line);
+          if (i == 1000000)
+               ceiling = mallinfo2().uordblks + 64 * 1024;
+     }
+     TEST_ASSERT_TRUE(r.count <= 1000);
+     TEST_ASSERT_TRUE(mallinfo2().uordblks <= ceiling);
+     histring_destroy(&r);
+}
+
+static void test_shell_init(struct shell *sh)
+{
+     memset(sh, 0, sizeof(*sh));
+     sh->shell_terminal = -1;
+     sh->spawn_mode = spawn_default_mode();
+     arena_init(&sh->arena, 0);
+     cmdhash_init(&sh->cmdhash);
+     writer_init(&sh->out, STDOUT_FILENO);
+     histlog_init(&sh->hist);
+     histindex_init(&sh->histindex);
+     prompt_init(&sh->prompt_fmt, "");
+     jobs_init(sh);
+}
+
+static void test_shell_destroy(struct shell *sh)
+{
+     arena_destroy(&sh->arena);
+     cmdhash_destroy(&sh->cmdhash);
+     jobs_destroy(sh);
+     writer_destroy(&sh->out);
+     histlog_close(&sh->hist, 0);
+     histindex_destroy(&sh->histindex);
+     prompt_destroy(&sh->prompt_fmt);
+     dirstack_destroy(&sh->dirs);
+     jump_close(&sh->jump);
+     pwd_destroy(&sh->pwd);
+     free(sh->pipestatus);
+}
+
+static void test_shell_run(struct shell *sh, const char *line)
+{
+     const char *err;
+     arena_reset(&sh->arena);
+     struct ast_pipeline *pl = parse_line(&sh->arena, line, &err);
+     TEST_ASSERT_NULL_MESSAGE(err, line);
+     exec_list(sh, pl);
+}
+
+static void read_file(const char *path, char *buf, size_t n)
+{
+     FILE *f = fopen(path, "r");
+     TEST_ASSERT_NOT_NULL(f);
+     size_t len = fread(buf, 1, n - 1, f);
+     buf[len] = '\0';
+     fclose(f);
+}
+
+void test_exec_pipeline_status(void)
+{
+     struct shell sh;
+     test_shell_init(&sh);
+     test_shell_run(&sh, "sh -c 'exit 3' | true | sh -c 'exit 5'");
+     TEST_ASSERT_EQUAL_INT(5, sh.status);
+     TEST_ASSERT_EQUAL_size_t(3, sh.pipestatus_len);
+     TEST_ASSERT_EQUAL_INT(3, sh.pipestatus[0]);
+     TEST_ASSERT_EQUAL_INT(0, sh.pipestatus[1]);
+     TEST_ASSERT_EQUAL_INT(5, sh.pipestatus[2]);
+
+     test_shell_run(&sh, "no-such-command-anywhere | true");
+     TEST_ASSERT_EQUAL_INT(0, sh.status);
+     TEST_ASSERT_EQUAL_INT(127, sh.pipestatus[0]);
+
+     test_shell_run(&sh, "false");
+     TEST_ASSERT_EQUAL_size_t(1, sh.pipestatus_len);
+     TEST_ASSERT_EQUAL_INT(1, sh.pipestatus[0]);
+     test_shell_destroy(&sh);
+}
+
+void test_exec_pipeline_data(void)
+{
+     char buf[64];
+     struct shell sh;
+     test_shell_init(&sh);
+     //the builtin stage runs in a child and writes into the pipe
+     test_shell_run(&sh, "hash -s | tr a-z A-Z | sed 's/ .*//' > /tmp/test-lab-pipe.txt");
+     TEST_ASSERT_EQUAL_INT(0, sh.status);
+     read_file("/tmp/test-lab-pipe.txt", buf, sizeof(buf));
+     TEST_ASSERT_EQUAL_STRING("HITS\n", buf);
+     test_shell_run(&sh, "echo one >/tmp/test-lab-pipe.txt && echo two >>/tmp/test-lab-pipe.txt || echo three");
+     read_file("/tmp/test-lab-pipe.txt", buf, sizeof(buf));
+     TEST_ASSERT_EQUAL_STRING("one\ntwo\n", buf);
+     unlink("/tmp/test-lab-pipe.txt");
+     test_shell_destroy(&sh);
+}
+
+/*
+ * Run a builtin with its output kept in memory and return that output.
+ */
+static const char *run_captured(struct shell *sh, char **argv)
+{
+     writer_destroy(&sh->out);
+     writer_init(&sh->out, -1);
+     TEST_ASSERT_TRUE(do_builtin(sh, argv));
+     writer_putc(&sh->out, '\0');
+     return sh->out.buf;
+}
+
+void test_builtin_hash_jobs_output(void)
+{
+     struct shell sh;
+     test_shell_init(&sh);
+     //hash and jobs write through sh.out like every other builtin
+     char *hash[] = {"hash", NULL};
+     char *stats[] = {"hash", "-s", NULL};
+     char *sh_name[] = {"hash", "sh", NULL};
+     char *jobs[] = {"jobs", NULL};
+     TEST_ASSERT_EQUAL_STRING("hash: hash table empty\n", run_captured(&sh, hash));
+     TEST_ASSERT_EQUAL_STRING("", run_captured(&sh, sh_name));
+     TEST_ASSERT_EQUAL_STRING("hits 0 misses 1\n", run_captured(&sh, stats));
+     const char *list = run_captured(&sh, hash);
+     TEST_ASSERT_EQUAL_INT(0, strncmp(list, "hits\tcommand\n", 13));
+     TEST_ASSERT_NOT_NULL(strstr(list, "/sh\n"));
+     TEST_ASSERT_EQUAL_STRING("", run_captured(&sh, jobs));
+     test_shell_destroy(&sh);
+}
+
+void test_builtin_echo_printf(void)
+{
+     struct shell sh;
+     test_shell_init(&sh);
+     char *echo1[] = {"echo", "a", "", "b", NULL};
+     TEST_ASSERT_EQUAL_STRING("a  b\n", run_captured(&sh, echo1));
+     char *echo2[] = {"echo", "-n", "-e", "x\\ty\\0101\\c", "z", NULL};
+     TEST_ASSERT_EQUAL_STRING("x\tyA", run_captured(&sh, echo2));
+     char *echo3[] = {"echo", "-nx", "\\t", NULL};
+     TEST_ASSERT_EQUAL_STRING("-nx \\t\n", run_captured(&sh, echo3));
+
+     char *printf1[] = {"printf", "[%5s|%-3d|%x|%.2f|%c]\\n", "hi", "7", "255", "2.5", "word", NULL};
+     TEST_ASSERT_EQUAL_STRING("[   hi|7  |ff|2.50|w]\n", run_captured(&sh, printf1));
+     TEST_ASSERT_EQUAL_INT(0, sh.status);
+     //the format is reused until the arguments run out
+     char *printf2[] = {"printf", "%s=%d;", "a", "1", "b", NULL};
+     TEST_ASSERT_EQUAL_STRING("a=1;b=0;", run_captured(&sh, printf2));
+     char *printf3[] = {"printf", "%b|%*d|%%|\\101", "1\\t2", "4", "'A", NULL};
+     TEST_ASSERT_EQUAL_STRING("1\t2|  65|%|A", run_captured(&sh, printf3));
+     char *printf4[] = {"printf", "%d\\n", "12abc", NULL};
+     TEST_ASSERT_EQUAL_STRING("12\n", run_captured(&sh, printf4));
+     TEST_ASSERT_EQUAL_INT(1, sh.status);
+     test_shell_destroy(&sh);
+}
+
+static int run_test_builtin(struct shell *sh, char **argv)
+{
+     TEST_ASSERT_TRUE(do_builtin(sh, argv));
+     return sh->status;
+}
+
+void test_builtin_test(void)
+{
+     struct shell sh;
+     test_shell_init(&sh);
+     char *t1[] = {"test", "1", "-lt", "2", NULL};
+     TEST_ASSERT_EQUAL_INT(0, run_test_builtin(&sh, t1));
+     char *t2[] = {"[", "-d", "/tmp", "-a", "!", "-f", "/tmp", "]", NULL};
+     TEST_ASSERT_EQUAL_INT(0, run_test_builtin(&sh, t2));
+     char *t3[] = {"test", "(", "a", "=", "b", ")", "-o", "-z", "x", NULL};
+     TEST_ASSERT_EQUAL_INT(1, run_test_builtin(&sh, t3));
+     //with three arguments a binary operator wins over !
+     char *t4[] = {"test", "!", "=", "!", NULL};
+     TEST_ASSERT_EQUAL_INT(0, run_test_builtin(&sh, t4));
+     char *t5[] = {"test", "-n", NULL};
+     TEST_ASSERT_EQUAL_INT(0, run_test_builtin(&sh, t5));
+     char *t6[] = {"test", NULL};
+     TEST_ASSERT_EQUAL_INT(1, run_test_builtin(&sh, t6));
+     char *t7[] = {"test", "1", "-eq", "one", NULL};
+     TEST_ASSERT_EQUAL_INT(2, run_test_builtin(&sh, t7));
+     char *t8[] = {"[", "x", NULL};
+     TEST_ASSERT_EQUAL_INT(2, run_test_builtin(&sh, t8));
+     char *t9[] = {"test", "/", "-ef", "/.", NULL};
+     TEST_ASSERT_EQUAL_INT(0, run_test_builtin(&sh, t9));
+
+     char *f[] = {"false", NULL};
+     TEST_ASSERT_EQUAL_INT(1, run_test_builtin(&sh, f));
+     char *pwd[] = {"pwd", "-P", NULL};
+     char *cwd = getcwd(NULL, 0);
+     const char *out = run_captured(&sh, pwd);
+     TEST_ASSERT_EQUAL_INT(strlen(cwd) + 1, strlen(out));
+     TEST_ASSERT_EQUAL_INT(0, strncmp(cwd, out, strlen(cwd)));
+     free(cwd);
+     test_shell_destroy(&sh);
+}
+
+static const char *run_line_captured(struct shell *sh, const char *line)
+{
+     writer_destroy(&sh->out);
+     writer_init(&sh->out, -1);
+     test_shell_run(sh, line);
+     writer_putc(&sh->out, '\0');
+     return sh->out.buf;
+}
+
+void test_exec_substitution(void)
+{
+     char cwd[4096];
+     char expected[4200];
+     struct shell sh;
+     test_shell_init(&sh);
+     TEST_ASSERT_NOT_NULL(getcwd(cwd, sizeof(cwd)));
+     snprintf(expected, sizeof(expected), "[%s]\n", cwd);
+     TEST_ASSERT_EQUAL_STRING(expected, run_line_captured(&sh, "echo [$(pwd)]"));
+     //unquoted output is split into fields, quoted output is not
+     TEST_ASSERT_EQUAL_STRING("<ab><cd>",
+                              run_line_captured(&sh, "printf '<%s>' a$(printf 'b\\n c\\n\\n')d"));
+     TEST_ASSERT_EQUAL_STRING("<ab\n cd>",
+                              run_line_captured(&sh, "printf '<%s>' \"a$(printf 'b\\n c\\n\\n')d\""));
+     TEST_ASSERT_EQUAL_STRING("deep\n", run_line_captured(&sh, "echo `echo $(echo deep)`"));
+     //commands that are not builtins run in a subshell
+     TEST_ASSERT_EQUAL_STRING("Y Z\n", run_line_captured(&sh, "echo $(echo y z | tr a-z A-Z)"));
+     test_shell_run(&sh, "cd $(echo /)");
+     TEST_ASSERT_EQUAL_INT(0, sh.status);
+     TEST_ASSERT_EQUAL_STRING("/\n", run_line_captured(&sh, "echo $(cd /tmp; true) $(pwd)"));
+     TEST_ASSERT_EQUAL_INT(0, chdir(cwd));
+     //a command with no words left has the status of the substitution
+     test_shell_run(&sh, "$(false)");
+     TEST_ASSERT_EQUAL_INT(1, sh.status);
+     test_shell_run(&sh, "$(sh -c 'exit 4')");
+     TEST_ASSERT_EQUAL_INT(4, sh.status);
+     test_shell_destroy(&sh);
+}
+
+void test_history_shared_between_shells(void)
+{
+     const char *path = "/tmp/test-lab-histshare";
+     struct shell sh;
+     struct histlog other;
+     unlink(path);
+     test_shell_init(&sh);
+     histring_init(&sh.recall, 10);
+     TEST_ASSERT_EQUAL_INT(0, histlog_open(&sh.hist, path));
+     histlog_init(&other);
+     TEST_ASSERT_EQUAL_INT(0, histlog_open(&other, path));
+
+     histlog_begin(&sh.hist, "make");
+     histlog_end(&sh.hist, 0);
+     TEST_ASSERT_EQUAL_INT(0, histlog_append(&other, "git pull", 0, 0, 0));
+     TEST_ASSERT_EQUAL_size_t(2, sh_history_sync(&sh));
+     TEST_ASSERT_EQUAL_STRING("git pull", histring_get(&sh.recall, 0));
+     TEST_ASSERT_EQUAL_STRING("make", histring_get(&sh.recall, 1));
+     TEST_ASSERT_EQUAL_size_t(0, sh_history_sync(&sh));
+
+     //entries a listing already mapped still reach the arrow keys once
+     TEST_ASSERT_EQUAL_INT(0, histlog_append(&other, "ls", 0, 0, 0));
+     test_shell_run(&sh, "history > /dev/null");
+     TEST_ASSERT_EQUAL_size_t(1, sh_history_sync(&sh));
+     TEST_ASSERT_EQUAL_STRING("ls", histring_get(&sh.recall, 0));
+     TEST_ASSERT_EQUAL_size_t(3, sh.recall.count);
+
+     histlog_close(&other, 0);
+     histring_destroy(&sh.recall);
+     test_shell_destroy(&sh);
+     unlink(path);
+}
+
+void test_jobs_background(void)
+{
+     struct shell sh;
+     test_shell_init(&sh);
+     //the prompt comes back while the job runs
+     test_shell_run(&sh, "sleep 0.2 | sh -c 'exit 4' &");
+     TEST_ASSERT_EQUAL_INT(0, sh.status);
+     TEST_ASSERT_NOT_NULL(sh.jobs.head);
+     TEST_ASSERT_EQUAL_INT(1, sh.jobs.head->id);
+     TEST_ASSERT_EQUAL_STRING("sleep 0.2 | sh -c 'exit 4'", sh.jobs.head->cmd);
+     test_shell_run(&sh, "true &");
+     TEST_ASSERT_EQUAL_INT(2, sh.jobs.head->id);
+
+     test_shell_run(&sh, "wait %1");
+     TEST_ASSERT_EQUAL_INT(4, sh.status);
+     TEST_ASSERT_EQUAL_INT(2, sh.jobs.head->id);
+     TEST_ASSERT_NULL(sh.jobs.head->next);
+
+     //a finished job is reaped without blocking and dropped once reported
+     for (int i = 0; i < 200 && sh.jobs.head; i++)
+     {
+          usleep(10000);
+          if (jobs_pending(&sh))
+               jobs_reap(&sh);
+          jobs_notify(&sh);
+     }
+     TEST_ASSERT_NULL(sh.jobs.head);
+     TEST_ASSERT_EQUAL_INT(-1, waitpid(-1, NULL, WNOHANG));
+     TEST_ASSERT_EQUAL_INT(ECHILD, errno);
+
+     test_shell_run(&sh, "wait %7");
+     TEST_ASSERT_EQUAL_INT(127, sh.status);
+     test_shell_destroy(&sh);
+}
+
+void test_jobs_pidfd_events(void)
+{
+     struct shell sh;
+     struct epoll_event ev[16];
+     test_shell_init(&sh);
+     int ep = epoll_create1(EPOLL_CLOEXEC);
+     jobs_watch(&sh, ep);
+     for (int i = 0; i < 50; i++)
+     {
+          test_shell_run(&sh, "sleep 0.05 &");
+          TEST_ASSERT_TRUE(sh.jobs.head->procs[0].pidfd >= 0);
+     }
+     //exits arrive through the pidfds, the sigchld pipe is never consulted
+     for (int i = 0; i < 500 && sh.jobs.head; i++)
+     {
+          int n = epoll_wait(ep, ev, 16, 100);
+          for (int k = 0; k < n; k++)
+               jobs_event(&sh, ev[k].data.ptr);
+          jobs_notify(&sh);
+     }
+     TEST_ASSERT_NULL(sh.jobs.head);
+     TEST_ASSERT_EQUAL_INT(0, epoll_wait(ep, ev, 16, 0));
+     TEST_ASSERT_EQUAL_INT(-1, waitpid(-1, NULL, WNOHANG));
+     close(ep);
+     test_shell_destroy(&sh);
+}
+
 void test_trim_white_no_whitespace(void)
 {
      char *line = (char*) calloc(10, sizeof(char));
@@ -132,47 +1262,547 @@ void test_get_prompt_custom(void)
      unsetenv(prmpt);
 }
 
+static void write_file(const char *path, const char *text, time_t mtime)
+{
+     FILE *f = fopen(path, "w");
+     TEST_ASSERT_NOT_NULL(f);
+     fputs(text, f);
+     fclose(f);
+     struct timespec times[2] = {{mtime, 0}, {mtime, 0}};
+     TEST_ASSERT_EQUAL_INT(0, utimensat(AT_FDCWD, path, times, 0));
+}
+
+static void wait_prompt(struct prompt *p)
+{
+     struct pollfd pfd = {p->event_fd, POLLIN, 0};
+     TEST_ASSERT_EQUAL_INT(1, poll(&pfd, 1, 2000));
+     TEST_ASSERT_TRUE(prompt_refresh(p));
+}
+
+void test_prompt_git_segment(void)
+{
+     char cwd[PATH_MAX];
+     struct prompt p;
+     mkdir("/tmp/test-lab-prompt", 0700);
+     mkdir("/tmp/test-lab-prompt/.git", 0700);
+     mkdir("/tmp/test-lab-prompt/sub", 0700);
+     write_file("/tmp/test-lab-prompt/.git/HEAD", "ref: refs/heads/feature\n", 1000);
+     TEST_ASSERT_NOT_NULL(getcwd(cwd, sizeof(cwd)));
+     TEST_ASSERT_EQUAL_INT(0, chdir("/tmp/test-lab-prompt/sub"));
+
+     prompt_init(&p, "[\\g] $? >");
+     TEST_ASSERT_TRUE(p.event_fd >= 0);
+     //nothing is known yet, the worker finds the branch in the background
+     TEST_ASSERT_EQUAL_STRING("[] 3 >", prompt_render(&p, 3, NULL));
+     wait_prompt(&p);
+     //the cached branch is shown until the worker sees HEAD change, each
+     //render asks for a check so HEAD changes before the next one
+     write_file("/tmp/test-lab-prompt/.git/HEAD", "0123456789abcdef\n", 2000);
+     TEST_ASSERT_EQUAL_STRING("[feature] 0 >", prompt_render(&p, 0, NULL));
+     wait_prompt(&p);
+     TEST_ASSERT_EQUAL_STRING("[0123456] 0 >", prompt_render(&p, 0, NULL));
+     prompt_destroy(&p);
+
+     TEST_ASSERT_EQUAL_INT(0, chdir(cwd));
+     unlink("/tmp/test-lab-prompt/.git/HEAD");
+     rmdir("/tmp/test-lab-prompt/.git");
+     rmdir("/tmp/test-lab-prompt/sub");
+     rmdir("/tmp/test-lab-prompt");
+}
+
+void test_prompt_escapes(void)
+{
+     char cwd[PATH_MAX];
+     char host[256];
+     char expect[1024];
+     struct prompt p;
+     char *home = getenv("HOME") ? strdup(getenv("HOME")) : NULL;
+     mkdir("/tmp/test-lab-home", 0700);
+     mkdir("/tmp/test-lab-home/work", 0700);
+     TEST_ASSERT_NOT_NULL(getcwd(cwd, sizeof(cwd)));
+     setenv("HOME", "/tmp/test-lab-home", 1);
+     TEST_ASSERT_EQUAL_INT(0, chdir("/tmp/test-lab-home/work"));
+
+     struct passwd *pw = getpwuid(geteuid());
+     TEST_ASSERT_NOT_NULL(pw);
+     TEST_ASSERT_EQUAL_INT(0, gethostname(host, sizeof(host)));
+     host[strcspn(host, ".")] = '\0';
+     prompt_init(&p, "\\u@\\h:\\w \\W \\$ $? \\\\ \\x $");
+     snprintf(expect, sizeof(expect), "%s@%s:~/work work %s 130 \\ \\x $", pw->pw_name, host,
+              geteuid() == 0 ? "#" : "$");
+     TEST_ASSERT_EQUAL_STRING(expect, prompt_render(&p, 130, NULL));
+
+     //the home directory itself and the root
+     TEST_ASSERT_TRUE(prompt_set(&p, "\\w|\\W"));
+     TEST_ASSERT_EQUAL_INT(0, chdir("/tmp/test-lab-home"));
+     TEST_ASSERT_EQUAL_STRING("~|~", prompt_render(&p, 0, NULL));
+     TEST_ASSERT_EQUAL_INT(0, chdir("/"));
+     TEST_ASSERT_EQUAL_STRING("/|/", prompt_render(&p, 0, NULL));
+     TEST_ASSERT_EQUAL_INT(0, chdir("/tmp"));
+     TEST_ASSERT_EQUAL_STRING("/tmp|tmp", prompt_render(&p, 0, NULL));
+
+     TEST_ASSERT_TRUE(prompt_set(&p, "\\t"));
+     const char *t = prompt_render(&p, 0, NULL);
+     TEST_ASSERT_EQUAL_size_t(8, strlen(t));
+     TEST_ASSERT_TRUE(isdigit(t[0]) && isdigit(t[1]) && t[2] == ':' && isdigit(t[3]) &&
+                      isdigit(t[4]) && t[5] == ':' && isdigit(t[6]) && isdigit(t[7]));
+
+     //the same template is not parsed again and renders reuse one buffer
+     TEST_ASSERT_FALSE(prompt_set(&p, "\\t"));
+     for (int i = 0; i < 1000; i++)
+          TEST_ASSERT_EQUAL_PTR(t, prompt_render(&p, i, NULL));
+     prompt_destroy(&p);
+
+     //the shell picks up a new MY_PROMPT
+     struct shell sh;
+     test_shell_init(&sh);
+     sh.status = 2;
+     setenv("MY_PROMPT", "a $? ", 1);
+     TEST_ASSERT_EQUAL_STRING("a 2 ", sh_prompt(&sh));
+     setenv("MY_PROMPT", "b> ", 1);
+     TEST_ASSERT_EQUAL_STRING("b> ", sh_prompt(&sh));
+     unsetenv("MY_PROMPT");
+     TEST_ASSERT_EQUAL_STRING("shell>", sh_prompt(&sh));
+     free(sh.prompt);
+     test_shell_destroy(&sh);
+
+     TEST_ASSERT_EQUAL_INT(0, chdir(cwd));
+     if (home)
+          setenv("HOME", home, 1);
+     else
+          unsetenv("HOME");
+     free(home);
+     rmdir("/tmp/test-lab-home/work");
+     rmdir("/tmp/test-lab-home");
+}
+
 void test_ch_dir_home(void)
 {
+     struct shell sh;
+     test_shell_init(&sh);
      char *line = (char*) calloc(10, sizeof(char));
      strncpy(line, "cd", 10);
      char **cmd = cmd_parse(line);
      char *expected = getenv("HOME");
-     change_dir(cmd);
+     change_dir(&sh, cmd);
      char *actual = getcwd(NULL,0);
      TEST_ASSERT_EQUAL_STRING(expected, actual);
      free(line);
      free(actual);
      cmd_free(cmd);
+     test_shell_destroy(&sh);
 }
 
 void test_ch_dir_root(void)
 {
+     struct shell sh;
+     test_shell_init(&sh);
      char *line = (char*) calloc(10, sizeof(char));
      strncpy(line, "cd /", 10);
      char **cmd = cmd_parse(line);
-     change_dir(cmd);
+     change_dir(&sh, cmd);
      char *actual = getcwd(NULL,0);
      TEST_ASSERT_EQUAL_STRING("/", actual);
      free(line);
      free(actual);
      cmd_free(cmd);
+     test_shell_destroy(&sh);
+}
+
+void test_dirstack_pushd_popd(void)
+{
+     struct shell sh;
+     char *cwd = getcwd(NULL, 0);
+     char *home = getenv("HOME") ? strdup(getenv("HOME")) : NULL;
+     mkdir("/tmp/test-lab-dirs", 0700);
+     mkdir("/tmp/test-lab-dirs/a", 0700);
+     mkdir("/tmp/test-lab-dirs/a/b", 0700);
+     mkdir("/tmp/test-lab-dirs/a/b/c", 0700);
+     mkdir("/tmp/test-lab-dirs/x", 0700);
+     setenv("HOME", "/tmp/test-lab-dirs", 1);
+     TEST_ASSERT_EQUAL_INT(0, chdir("/tmp/test-lab-dirs"));
+     test_shell_init(&sh);
+
+     char *push_c[] = {"pushd", "a/b/c", NULL};
+     TEST_ASSERT_EQUAL_STRING("~/a/b/c ~\n", run_captured(&sh, push_c));
+     char *push_x[] = {"pushd", "/tmp/test-lab-dirs/x", NULL};
+     TEST_ASSERT_EQUAL_STRING("~/x ~/a/b/c ~\n", run_captured(&sh, push_x));
+     char *swap[] = {"pushd", NULL};
+     TEST_ASSERT_EQUAL_STRING("~/a/b/c ~/x ~\n", run_captured(&sh, swap));
+     char *rotate[] = {"pushd", "+2", NULL};
+     TEST_ASSERT_EQUAL_STRING("~ ~/a/b/c ~/x\n", run_captured(&sh, rotate));
+     char *dirs[] = {"dirs", "-v", "-l", NULL};
+     TEST_ASSERT_EQUAL_STRING(" 0  /tmp/test-lab-dirs\n 1  /tmp/test-lab-dirs/a/b/c\n"
+                              " 2  /tmp/test-lab-dirs/x\n", run_captured(&sh, dirs));
+     char *range[] = {"pushd", "+3", NULL};
+     run_captured(&sh, range);
+     TEST_ASSERT_EQUAL_INT(1, sh.status);
+
+     //a stacked directory is held, not looked up again by its path
+     TEST_ASSERT_EQUAL_INT(0, rename("/tmp/test-lab-dirs/a/b", "/tmp/test-lab-dirs/a/moved"));
+     char *pop[] = {"popd", NULL};
+     TEST_ASSERT_EQUAL_STRING("~/a/b/c ~/x\n", run_captured(&sh, pop));
+     char *here = getcwd(NULL, 0);
+     TEST_ASSERT_EQUAL_STRING("/tmp/test-lab-dirs/a/moved/c", here);
+     free(here);
+     char *back[] = {"cd", "-", NULL};
+     TEST_ASSERT_EQUAL_STRING("/tmp/test-lab-dirs\n", run_captured(&sh, back));
+     TEST_ASSERT_EQUAL_STRING("/tmp/test-lab-dirs/a/b/c\n", run_captured(&sh, back));
+     TEST_ASSERT_EQUAL_STRING("~/x\n", run_captured(&sh, pop));
+     run_captured(&sh, pop);
+     TEST_ASSERT_EQUAL_INT(1, sh.status);
+
+     char *cd_root[] = {"cd", "/", NULL};
+     TEST_ASSERT_EQUAL_STRING("", run_captured(&sh, cd_root));
+     TEST_ASSERT_EQUAL_STRING("/tmp/test-lab-dirs/x\n", run_captured(&sh, back));
+     test_shell_destroy(&sh);
+
+     TEST_ASSERT_EQUAL_INT(0, chdir(cwd));
+     if (home)
+          setenv("HOME", home, 1);
+     else
+          unsetenv("HOME");
+     free(home);
+     free(cwd);
+     rmdir("/tmp/test-lab-dirs/a/moved/c");
+     rmdir("/tmp/test-lab-dirs/a/moved");
+     rmdir("/tmp/test-lab-dirs/a");
+     rmdir("/tmp/test-lab-dirs/x");
+     rmdir("/tmp/test-lab-dirs");
+}
+
+/* The status a shell exits with after running line in a child */
+static int exit_status(const char *line)
+{
+     //the child leaves through exit, which flushes what it inherited
+     fflush(stdout);
+     fflush(stderr);
+     pid_t pid = fork();
+     if (pid == 0)
+     {
+          struct shell sh;
+          test_shell_init(&sh);
+          test_shell_run(&sh, line);
+          _exit(99);
+     }
+     int status;
+     waitpid(pid, &status, 0);
+     return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+}
+
+void test_builtin_exit_status(void)
+{
+     TEST_ASSERT_EQUAL_INT(7, exit_status("exit 7"));
+     TEST_ASSERT_EQUAL_INT(1, exit_status("false; exit"));
+     TEST_ASSERT_EQUAL_INT(44, exit_status("exit 300"));
+     TEST_ASSERT_EQUAL_INT(2, exit_status("exit x 2>/dev/null"));
+     //too many arguments fail without leaving
+     TEST_ASSERT_EQUAL_INT(1, exit_status("exit 1 2 2>/dev/null; exit"));
+}
+
+void test_builtin_exit_in_pipeline(void)
+{
+     struct shell sh;
+     test_shell_init(&sh);
+     complete_init(&sh.complete, "");
+     //the stage exits without waiting for a worker it does not have
+     fflush(stdout);
+     fflush(stderr);
+     alarm(10);
+     test_shell_run(&sh, "true | exit 3");
+     alarm(0);
+     TEST_ASSERT_EQUAL_INT(3, sh.status);
+     complete_destroy(&sh.complete);
+     test_shell_destroy(&sh);
+}
+
+void test_jump_find_and_save(void)
+{
+     const char *file = "/tmp/test-lab-jump";
+     const struct jump_match *m;
+     struct jump j, other;
+     char *api[] = {"api", NULL};
+     time_t now = 1000000000;
+     unlink(file);
+     jump_init(&j);
+     TEST_ASSERT_EQUAL_INT(0, jump_open(&j, file));
+     for (int i = 0; i < 3; i++)
+          jump_visit(&j, "/srv/payments/api", now - 30 * 86400);
+     jump_visit(&j, "/srv/search/api-gateway", now - 60);
+     jump_visit(&j, "/srv/search/docs", now);
+     //one visit a minute ago beats three a month ago
+     TEST_ASSERT_EQUAL_size_t(2, jump_find(&j, api, now, &m));
+     TEST_ASSERT_EQUAL_STRING("/srv/search/api-gateway", m[0].path);
+     TEST_ASSERT_EQUAL_STRING("/srv/payments/api", m[1].path);
+     TEST_ASSERT_EQUAL_INT(0, jump_save(&j));
+     TEST_ASSERT_EQUAL_size_t(0, j.nvisits);
+     TEST_ASSERT_EQUAL_size_t(3, j.count);
+     //the words before the last narrow the path down
+     char *pay_api[] = {"pay", "api", NULL};
+     TEST_ASSERT_EQUAL_size_t(1, jump_find(&j, pay_api, now, &m));
+     TEST_ASSERT_EQUAL_STRING("/srv/payments/api", m[0].path);
+     //when no name starts with the word one with it inside will do
+     char *gate[] = {"gate", NULL};
+     TEST_ASSERT_EQUAL_size_t(1, jump_find(&j, gate, now, &m));
+     TEST_ASSERT_EQUAL_STRING("/srv/search/api-gateway", m[0].path);
+     jump_close(&j);
+
+     //two shells on the same file both get their visits in
+     jump_init(&j);
+     jump_init(&other);
+     TEST_ASSERT_EQUAL_INT(0, jump_open(&j, file));
+     TEST_ASSERT_EQUAL_INT(0, jump_open(&other, file));
+     TEST_ASSERT_EQUAL_size_t(3, j.count);
+     for (int i = 0; i < 8; i++)
+          jump_visit(&j, "/srv/payments/api", now);
+     jump_visit(&other, "/srv/billing/api", now);
+     jump_visit(&other, "/srv/billing/api", now);
+     TEST_ASSERT_EQUAL_INT(0, jump_save(&j));
+     TEST_ASSERT_EQUAL_INT(0, jump_save(&other));
+     TEST_ASSERT_EQUAL_size_t(4, other.count);
+     TEST_ASSERT_EQUAL_size_t(3, jump_find(&other, api, now, &m));
+     TEST_ASSERT_EQUAL_STRING("/srv/payments/api", m[0].path);
+     TEST_ASSERT_EQUAL_STRING("/srv/billing/api", m[1].path);
+     jump_close(&j);
+     jump_close(&other);
+     unlink(file);
+}
+
+void test_jump_close_saves(void)
+{
+     const char *file = "/tmp/test-lab-jump";
+     const struct jump_match *m;
+     struct jump j;
+     char *two[] = {"two", NULL};
+     time_t now = 1000000000;
+     unlink(file);
+     jump_init(&j);
+     TEST_ASSERT_EQUAL_INT(0, jump_open(&j, file));
+     jump_visit(&j, "/srv/a/one", now);
+     jump_visit(&j, "/srv/b/two", now);
+     //too few visits to have been saved on their own
+     TEST_ASSERT_TRUE(j.nvisits < JUMP_PENDING);
+     TEST_ASSERT_EQUAL_size_t(0, j.count);
+     jump_close(&j);
+
+     jump_init(&j);
+     TEST_ASSERT_EQUAL_INT(0, jump_open(&j, file));
+     TEST_ASSERT_EQUAL_size_t(2, j.count);
+     TEST_ASSERT_EQUAL_size_t(1, jump_find(&j, two, now, &m));
+     TEST_ASSERT_EQUAL_STRING("/srv/b/two", m[0].path);
+     jump_close(&j);
+     unlink(file);
+}
+
+void test_cd_jump(void)
+{
+     struct shell sh;
+     char *cwd = getcwd(NULL, 0);
+     mkdir("/tmp/test-lab-jumps", 0700);
+     mkdir("/tmp/test-lab-jumps/deep", 0700);
+     mkdir("/tmp/test-lab-jumps/deep/service-alpha", 0700);
+     test_shell_init(&sh);
+
+     char *visit[] = {"cd", "/tmp/test-lab-jumps/deep/service-alpha", NULL};
+     TEST_ASSERT_EQUAL_STRING("", run_captured(&sh, visit));
+     char *root[] = {"cd", "/", NULL};
+     run_captured(&sh, root);
+     //a word that is no directory here is a directory visited before
+     char *word[] = {"cd", "serv", NULL};
+     TEST_ASSERT_EQUAL_STRING("/tmp/test-lab-jumps/deep/service-alpha\n", run_captured(&sh, word));
+     TEST_ASSERT_EQUAL_INT(0, sh.status);
+     run_captured(&sh, root);
+     char *words[] = {"cd", "deep", "alpha", NULL};
+     TEST_ASSERT_EQUAL_STRING("/tmp/test-lab-jumps/deep/service-alpha\n", run_captured(&sh, words));
+     char *here = getcwd(NULL, 0);
+     TEST_ASSERT_EQUAL_STRING("/tmp/test-lab-jumps/deep/service-alpha", here);
+     free(here);
+     char *none[] = {"cd", "no-such-place", NULL};
+     run_captured(&sh, none);
+     TEST_ASSERT_EQUAL_INT(1, sh.status);
+     test_shell_destroy(&sh);
+
+     TEST_ASSERT_EQUAL_INT(0, chdir(cwd));
+     free(cwd);
+     rmdir("/tmp/test-lab-jumps/deep/service-alpha");
+     rmdir("/tmp/test-lab-jumps/deep");
+     rmdir("/tmp/test-lab-jumps");
+}
+
+void test_cd_jump_in_pipeline(void)
+{
+     const char *file = "/tmp/test-lab-jump";
+     struct shell sh;
+     struct jump other;
+     unlink(file);
+     test_shell_init(&sh);
+     TEST_ASSERT_EQUAL_INT(0, jump_open(&sh.jump, file));
+     for (int i = 0; i < JUMP_PENDING - 1; i++)
+          jump_visit(&sh.jump, "/srv/payments/api", 1000000000);
+     //the visit of a cd in a pipeline would be the one that saves
+     fflush(stdout);
+     fflush(stderr);
+     test_shell_run(&sh, "cd /tmp | true");
+     jump_init(&other);
+     TEST_ASSERT_EQUAL_INT(0, jump_open(&other, file));
+     TEST_ASSERT_EQUAL_size_t(0, other.count);
+     jump_close(&other);
+     test_shell_destroy(&sh);
+     unlink(file);
+}
+
+void test_pwd_logical(void)
+{
+     struct shell sh;
+     char *cwd = getcwd(NULL, 0);
+     mkdir("/tmp/test-lab-pwd", 0700);
+     mkdir("/tmp/test-lab-pwd/real", 0700);
+     mkdir("/tmp/test-lab-pwd/real/sub", 0700);
+     symlink("real", "/tmp/test-lab-pwd/link");
+
+     //. and .. are taken out as text
+     struct pwd p = {0};
+     pwd_set(&p, "/tmp");
+     char *lex = pwd_lexical(&p, "a/./b/../c//");
+     TEST_ASSERT_EQUAL_STRING("/tmp/a/c", lex);
+     free(lex);
+     lex = pwd_lexical(&p, "../../..");
+     TEST_ASSERT_EQUAL_STRING("/", lex);
+     free(lex);
+     pwd_destroy(&p);
+
+     //cd keeps the path through the link, .. goes back up it
+     test_shell_init(&sh);
+     char *cd_sub[] = {"cd", "/tmp/test-lab-pwd/link/sub", NULL};
+     char *up[] = {"cd", "..", NULL};
+     char *pwd[] = {"pwd", NULL};
+     char *physical[] = {"pwd", "-P", NULL};
+     run_captured(&sh, cd_sub);
+     TEST_ASSERT_EQUAL_STRING("/tmp/test-lab-pwd/link/sub\n", run_captured(&sh, pwd));
+     TEST_ASSERT_EQUAL_STRING("/tmp/test-lab-pwd/link/sub", getenv("PWD"));
+     run_captured(&sh, up);
+     TEST_ASSERT_EQUAL_STRING("/tmp/test-lab-pwd/link\n", run_captured(&sh, pwd));
+     TEST_ASSERT_EQUAL_STRING("/tmp/test-lab-pwd/real\n", run_captured(&sh, physical));
+     TEST_ASSERT_EQUAL_STRING("/tmp/test-lab-pwd/link/sub", getenv("OLDPWD"));
+
+     //a change the shell did not make is found at the next read
+     TEST_ASSERT_EQUAL_INT(0, chdir("/tmp/test-lab-pwd/real/sub"));
+     TEST_ASSERT_EQUAL_STRING("/tmp/test-lab-pwd/real/sub\n", run_captured(&sh, pwd));
+     test_shell_destroy(&sh);
+
+     TEST_ASSERT_EQUAL_INT(0, chdir(cwd));
+     free(cwd);
+     unlink("/tmp/test-lab-pwd/link");
+     rmdir("/tmp/test-lab-pwd/real/sub");
+     rmdir("/tmp/test-lab-pwd/real");
+     rmdir("/tmp/test-lab-pwd");
+}
+
+void test_script_lines(void)
+{
+     struct script s;
+     script_init_string(&s, "echo a\n\n  true  \nlast");
+     TEST_ASSERT_EQUAL_STRING("echo a", script_next(&s));
+     TEST_ASSERT_EQUAL_STRING("", script_next(&s));
+     TEST_ASSERT_EQUAL_STRING("  true  ", script_next(&s));
+     TEST_ASSERT_EQUAL_STRING("last", script_next(&s));
+     TEST_ASSERT_NULL(script_next(&s));
+     script_close(&s);
+
+     //a file is mapped, a pipe is read in chunks with lines across them
+     char *lng = (char *)malloc(SCRIPT_CHUNK * 2 + 1);
+     memset(lng, 'x', SCRIPT_CHUNK * 2);
+     lng[SCRIPT_CHUNK * 2] = '\0';
+     int fds[2];
+     TEST_ASSERT_EQUAL_INT(0, pipe(fds));
+     if (fork() == 0)
+     {
+          close(fds[0]);
+          dprintf(fds[1], "one\n%s\nthree\n", lng);
+          _exit(0);
+     }
+     close(fds[1]);
+     TEST_ASSERT_EQUAL_INT(0, script_open(&s, fds[0], false));
+     TEST_ASSERT_FALSE(s.mapped);
+     TEST_ASSERT_EQUAL_STRING("one", script_next(&s));
+     TEST_ASSERT_EQUAL_STRING(lng, script_next(&s));
+     TEST_ASSERT_EQUAL_STRING("three", script_next(&s));
+     TEST_ASSERT_NULL(script_next(&s));
+     script_close(&s);
+     wait(NULL);
+     free(lng);
+
+     write_file("/tmp/test-lab-script", "false\necho x > /dev/null\nfalse\n", 1000);
+     TEST_ASSERT_EQUAL_INT(0, script_open(&s, open("/tmp/test-lab-script", O_RDONLY), false));
+     TEST_ASSERT_TRUE(s.mapped);
+     struct shell sh;
+     test_shell_init(&sh);
+     script_run(&sh, &s);
+     TEST_ASSERT_EQUAL_INT(1, sh.status);
+     script_close(&s);
+     test_shell_destroy(&sh);
+     unlink("/tmp/test-lab-script");
 }
 
 int main(void) {
   UNITY_BEGIN();
   RUN_TEST(test_cmd_parse);
   RUN_TEST(test_cmd_parse2);
+  RUN_TEST(test_cmd_parse_arena_scales_with_line);
+  RUN_TEST(test_cmd_parse_empty);
+  RUN_TEST(test_cmd_tokenize_views);
+  RUN_TEST(test_cmd_terminate_in_place);
+  RUN_TEST(test_scan_kernels_agree);
+  RUN_TEST(test_cmd_parse_tabs);
+  RUN_TEST(test_parse_quotes);
+  RUN_TEST(test_parse_lists_and_pipelines);
+  RUN_TEST(test_parse_redirections);
+  RUN_TEST(test_parse_substitution);
+  RUN_TEST(test_parse_substitution_depth);
+  RUN_TEST(test_parse_errors);
+  RUN_TEST(test_spawn_posix);
+  RUN_TEST(test_spawn_fork);
+  RUN_TEST(test_spawn_zygote);
+  RUN_TEST(test_cmdhash_lookup_and_invalidate);
+  RUN_TEST(test_cmdtrie_complete);
+  RUN_TEST(test_complete_path_refresh);
+  RUN_TEST(test_complete_files_snapshot);
+  RUN_TEST(test_histlog_append_and_reload);
+  RUN_TEST(test_histindex_search);
+  RUN_TEST(test_histring_dedup_and_evict);
+  RUN_TEST(test_histring_memory_flat);
+  RUN_TEST(test_builtin_registry);
+  RUN_TEST(test_exec_pipeline_status);
+  RUN_TEST(test_exec_pipeline_data);
+  RUN_TEST(test_builtin_echo_printf);
+  RUN_TEST(test_builtin_hash_jobs_output);
+  RUN_TEST(test_builtin_test);
+  RUN_TEST(test_exec_substitution);
+  RUN_TEST(test_history_shared_between_shells);
+  RUN_TEST(test_jobs_background);
+  RUN_TEST(test_jobs_pidfd_events);
   RUN_TEST(test_trim_white_no_whitespace);
   RUN_TEST(test_trim_white_start_whitespace);
   RUN_TEST(test_trim_white_end_whitespace);
   RUN_TEST(test_trim_white_both_whitespace_single);
   RUN_TEST(test_trim_white_both_whitespace_double);
   RUN_TEST(test_trim_white_all_whitespace);
+  RUN_TEST(test_trim_white_tabs);
   RUN_TEST(test_get_prompt_default);
   RUN_TEST(test_get_prompt_custom);
+  RUN_TEST(test_prompt_git_segment);
+  RUN_TEST(test_prompt_escapes);
   RUN_TEST(test_ch_dir_home);
   RUN_TEST(test_ch_dir_root);
+  RUN_TEST(test_dirstack_pushd_popd);
+  RUN_TEST(test_builtin_exit_status);
+  RUN_TEST(test_builtin_exit_in_pipeline);
+  RUN_TEST(test_jump_find_and_save);
+  RUN_TEST(test_jump_close_saves);
+  RUN_TEST(test_cd_jump);
+  RUN_TEST(test_cd_jump_in_pipeline);
+  RUN_TEST(test_pwd_logical);
+  RUN_TEST(test_script_lines);
 
   return UNITY_END();
 }